@@ -70,6 +70,10 @@ if(mpi)
   check_symbol_exists(MPI_Win_allocate_shared mpi.h P4EST_ENABLE_MPIWINSHARED)
 endif()
 
+if(openmp)
+  set(P4EST_ENABLE_OPENMP 1)
+endif()
+
 check_symbol_exists(sqrt math.h P4EST_NONEED_M)
 if(NOT P4EST_NONEED_M)
   set(CMAKE_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES} m)
@@ -0,0 +1,233 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+/*
+ * Compare the batched Morton index conversions with the per-quadrant ones.
+ * A uniform grid of quadrants in random order is converted to linear
+ * indices and back repeatedly, once by looping over the scalar functions
+ * and once by calling the array versions.
+ */
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+#include <sc_flops.h>
+#include <sc_options.h>
+#include <sc_statistics.h>
+
+enum
+{
+  MORTON_LINEAR_ID,
+  MORTON_LINEAR_ID_BATCH,
+  MORTON_SET,
+  MORTON_SET_BATCH,
+  MORTON_LINEAR_ID_EXT128,
+  MORTON_LINEAR_ID_EXT128_BATCH,
+  MORTON_SET_EXT128,
+  MORTON_SET_EXT128_BATCH,
+  MORTON_NUM_STATS
+};
+
+static void
+check_equal (sc_array_t * quadrants, sc_array_t * target)
+{
+  size_t              zz;
+
+  for (zz = 0; zz < quadrants->elem_count; ++zz) {
+    SC_CHECK_ABORT (p4est_quadrant_is_equal
+                    (p4est_quadrant_array_index (quadrants, zz),
+                     p4est_quadrant_array_index (target, zz)),
+                    "Morton round trip");
+  }
+}
+
+static void
+run_morton (sc_array_t * quadrants, int level, int repetitions,
+            sc_statinfo_t * stats)
+{
+  const size_t        count = quadrants->elem_count;
+  int                 rep;
+  size_t              zz;
+  uint64_t           *ids;
+  p4est_lid_t        *lids;
+  p4est_quadrant_t   *q;
+  sc_array_t         *target;
+  sc_flopinfo_t       fi, snapshot;
+
+  ids = P4EST_ALLOC (uint64_t, count);
+  lids = P4EST_ALLOC (p4est_lid_t, count);
+  target = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  sc_flops_start (&fi);
+
+  /* 64 bit indices */
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (quadrants, zz);
+      ids[zz] = p4est_quadrant_linear_id (q, level);
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_LINEAR_ID], snapshot.iwtime, "Linear id");
+
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    p4est_quadrant_array_linear_id (quadrants, level, ids);
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_LINEAR_ID_BATCH], snapshot.iwtime,
+                 "Linear id batch");
+
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (target, zz);
+      p4est_quadrant_set_morton (q, level, ids[zz]);
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_SET], snapshot.iwtime, "Set morton");
+
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    p4est_quadrant_array_set_morton (target, level, ids);
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_SET_BATCH], snapshot.iwtime,
+                 "Set morton batch");
+  check_equal (quadrants, target);
+
+  /* 128 bit indices */
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (quadrants, zz);
+      p4est_quadrant_linear_id_ext128 (q, level, &lids[zz]);
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_LINEAR_ID_EXT128], snapshot.iwtime,
+                 "Linear id ext128");
+
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    p4est_quadrant_array_linear_id_ext128 (quadrants, level, lids);
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_LINEAR_ID_EXT128_BATCH], snapshot.iwtime,
+                 "Linear id ext128 batch");
+
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (target, zz);
+      p4est_quadrant_set_morton_ext128 (q, level, &lids[zz]);
+    }
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_SET_EXT128], snapshot.iwtime,
+                 "Set morton ext128");
+
+  sc_flops_snap (&fi, &snapshot);
+  for (rep = 0; rep < repetitions; ++rep) {
+    p4est_quadrant_array_set_morton_ext128 (target, level, lids);
+  }
+  sc_flops_shot (&fi, &snapshot);
+  sc_stats_set1 (&stats[MORTON_SET_EXT128_BATCH], snapshot.iwtime,
+                 "Set morton ext128 batch");
+  check_equal (quadrants, target);
+
+  sc_array_destroy (target);
+  P4EST_FREE (lids);
+  P4EST_FREE (ids);
+}
+
+int
+main (int argc, char **argv)
+{
+  sc_MPI_Comm         mpicomm;
+  int                 mpiret, retval;
+  int                 level, repetitions;
+  size_t              zz, count;
+  p4est_quadrant_t   *q, r;
+  sc_array_t         *quadrants;
+  sc_statinfo_t       stats[MORTON_NUM_STATS];
+  sc_options_t       *opt;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  opt = sc_options_new (argv[0]);
+  sc_options_add_int (opt, 'l', "level", &level, P4EST_DIM == 2 ? 9 : 6,
+                      "Level of the uniform grid");
+  sc_options_add_int (opt, 'r', "repetitions", &repetitions, 10,
+                      "Number of conversions to time");
+  retval = sc_options_parse (p4est_package_id, SC_LP_ERROR, opt, argc, argv);
+  if (retval == -1 || retval < argc || level < 0 ||
+      P4EST_DIM * level > 24 || repetitions < 1) {
+    sc_options_print_usage (p4est_package_id, SC_LP_PRODUCTION, opt, NULL);
+    sc_abort_collective ("Usage error");
+  }
+
+  /* the quadrants of a uniform grid in random order */
+  count = (size_t) 1 << (P4EST_DIM * level);
+  quadrants = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  for (zz = 0; zz < count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    P4EST_QUADRANT_INIT (q);
+    p4est_quadrant_set_morton (q, level, (uint64_t) zz);
+  }
+  for (zz = count - 1; zz > 0; --zz) {
+    q = p4est_quadrant_array_index (quadrants, (size_t) rand () % (zz + 1));
+    r = *q;
+    *q = *p4est_quadrant_array_index (quadrants, zz);
+    *p4est_quadrant_array_index (quadrants, zz) = r;
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Converting %llu quadrants %d times\n",
+                            (unsigned long long) count, repetitions);
+
+  run_morton (quadrants, level, repetitions, stats);
+
+  sc_stats_compute (mpicomm, MORTON_NUM_STATS, stats);
+  sc_stats_print (p4est_package_id, SC_LP_ESSENTIAL,
+                  MORTON_NUM_STATS, stats, 1, 1);
+
+  sc_array_destroy (quadrants);
+  sc_options_destroy (opt);
+
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
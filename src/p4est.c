@@ -67,6 +67,25 @@ p4est_balance_peer_t;
 
 #define p4est_num_ranges (25)
 
+#ifdef P4_TO_P8
+#define p4est_balance_context           p8est_balance_context
+#define p4est_balance_log               p8est_balance_log
+#endif
+
+/** Mesh changes since the last 2:1 balance. */
+struct p4est_balance_log
+{
+  int                 balanced;         /**< The forest was balanced */
+  p4est_connect_type_t btype;           /**< Connect type of that balance */
+  long                revision;         /**< Revision the log is valid for */
+  sc_array_t          regions;          /**< Refined and coarsened quadrants
+                                             with p.which_tree set */
+  long                num_incremental;  /**< Balances run incrementally */
+};
+
+/* number of quadrants whose Morton indices are set in one batch */
+#define p4est_morton_batch (256)
+
 #ifndef P4_TO_P8
 
 static int          p4est_uninitialized_key;
@@ -77,6 +96,11 @@ void               *P4EST_DATA_UNINITIALIZED = &p4est_uninitialized_key;
 static const size_t number_toread_quadrants = 32;
 static const int8_t fully_owned_flag = 0x01;
 static const int8_t any_face_flag = 0x02;
+static const int8_t interior_flag = 0x04;
+
+/* an incremental balance is run if at most this fraction of quadrants
+   has changed on every process */
+static const size_t balance_log_fraction = 8;
 
 void
 p4est_qcoord_to_vertex (p4est_connectivity_t * connectivity,
@@ -177,6 +201,11 @@ p4est_memory_used (p4est_t * p4est)
   P4EST_ASSERT (p4est->quadrant_pool != NULL);
   size += sc_mempool_memory_used (p4est->quadrant_pool);
 
+  if (p4est->balance_log != NULL) {
+    size += sizeof (p4est_balance_log_t) +
+      sc_array_memory_used (&p4est->balance_log->regions, 0);
+  }
+
   return size;
 }
 
@@ -190,6 +219,29 @@ p4est_revision (p4est_t * p4est)
   return p4est->revision;
 }
 
+/** Return the balance log if it is consistent with the forest. */
+static p4est_balance_log_t *
+p4est_balance_log_current (p4est_t * p4est)
+{
+  p4est_balance_log_t *log = p4est->balance_log;
+
+  if (log != NULL && log->revision == p4est->revision) {
+    return log;
+  }
+  return NULL;
+}
+
+/** Record a changed region of the mesh. */
+static void
+p4est_balance_log_push (p4est_balance_log_t * log, p4est_topidx_t which_tree,
+                        const p4est_quadrant_t * q)
+{
+  p4est_quadrant_t   *r;
+
+  r = p4est_quadrant_array_push_copy (&log->regions, q);
+  r->p.which_tree = which_tree;
+}
+
 p4est_t            *
 p4est_new (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
            size_t data_size, p4est_init_t init_fn, void *user_pointer)
@@ -207,6 +259,8 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   int                 i, must_remove_last_quadrant;
   int                 level;
   uint64_t            first_morton, last_morton, miu, count;
+  uint64_t            mids[p4est_morton_batch];
+  size_t              zz, nbatch;
   p4est_topidx_t      jt, num_trees;
   p4est_gloidx_t      tree_num_quadrants, global_num_quadrants;
   p4est_gloidx_t      first_tree, first_quadrant, first_tree_quadrant;
@@ -218,6 +272,7 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   p4est_quadrant_t    a, b, c;
   p4est_quadrant_t   *global_first_position;
   sc_array_t         *tquadrants;
+  sc_array_t          view;
 
   P4EST_GLOBAL_PRODUCTIONF
     ("Into " P4EST_STRING
@@ -413,16 +468,20 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
       count = last_morton - first_morton + 1;
       P4EST_ASSERT (count > 0);
 
-      /* populate quadrant array in Morton order */
+      /* populate quadrant array in Morton order, one batch at a time */
       sc_array_resize (tquadrants, (size_t) count);
-      quad = p4est_quadrant_array_index (tquadrants, 0);
-      P4EST_QUADRANT_INIT (quad);
-      p4est_quadrant_set_morton (quad, level, first_morton);
-      p4est_quadrant_init_data (p4est, jt, quad, init_fn);
-      for (miu = 1; miu < count; ++miu) {
-        quad = p4est_quadrant_array_index (tquadrants, (size_t) miu);
-        P4EST_QUADRANT_INIT (quad);
-        p4est_quadrant_successor (quad - 1, quad);
+      for (miu = 0; miu < count; miu += nbatch) {
+        nbatch = (size_t) SC_MIN (count - miu, p4est_morton_batch);
+        for (zz = 0; zz < nbatch; ++zz) {
+          mids[zz] = first_morton + miu + zz;
+          P4EST_QUADRANT_INIT (p4est_quadrant_array_index
+                               (tquadrants, (size_t) miu + zz));
+        }
+        sc_array_init_view (&view, tquadrants, (size_t) miu, nbatch);
+        p4est_quadrant_array_set_morton (&view, level, mids);
+      }
+      for (zz = 0; zz < (size_t) count; ++zz) {
+        quad = p4est_quadrant_array_index (tquadrants, zz);
         p4est_quadrant_init_data (p4est, jt, quad, init_fn);
       }
 
@@ -529,6 +588,7 @@ p4est_destroy (p4est_t * p4est)
   }
   sc_mempool_destroy (p4est->quadrant_pool);
 
+  p4est_balance_track (p4est, 0);
   p4est_comm_parallel_env_release (p4est);
   P4EST_FREE (p4est->global_first_quadrant);
   P4EST_FREE (p4est->global_first_position);
@@ -563,6 +623,7 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   p4est->trees = NULL;
   p4est->user_data_pool = NULL;
   p4est->quadrant_pool = NULL;
+  p4est->balance_log = NULL;
 
   /* set parallel environment */
   p4est_comm_parallel_env_assign (p4est, input->mpicomm);
@@ -707,6 +768,7 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
   sc_array_t         *tquadrants;
   p4est_quadrant_t   *family[8];
   p4est_quadrant_t    parent, *pp = &parent;
+  p4est_balance_log_t *log;
 
   if (allowed_level < 0) {
     allowed_level = P4EST_QMAXLEVEL;
@@ -723,6 +785,7 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
 
   /* remember input quadrant count; it will not decrease */
   old_gnq = p4est->global_num_quadrants;
+  log = p4est_balance_log_current (p4est);
 
   /*
      q points to a quadrant that is an array member
@@ -802,6 +865,10 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
         firsttime = 0;
         sc_array_resize (tquadrants,
                          tquadrants->elem_count + P4EST_CHILDREN - 1);
+        if (log != NULL && !qpop->pad8) {
+          /* the children of a new quadrant are within a logged region */
+          p4est_balance_log_push (log, nt, qpop);
+        }
 
         if (replace_fn != NULL) {
           /* do not free qpop's data yet: we will do this when the parent
@@ -923,6 +990,9 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
   if (old_gnq != p4est->global_num_quadrants) {
     ++p4est->revision;
   }
+  if (log != NULL) {
+    log->revision = p4est->revision;
+  }
 
   P4EST_ASSERT (p4est_is_valid (p4est));
   p4est_log_indent_pop ();
@@ -931,6 +1001,333 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
                             (long long) p4est->global_num_quadrants);
 }
 
+/** Allocate and initialize user data from within a threaded algorithm. */
+static void
+p4est_threads_init_data (p4est_t * p4est, p4est_topidx_t which_tree,
+                         p4est_quadrant_t * quad, p4est_init_t init_fn,
+                         int concurrent_callbacks)
+{
+  /* the user data pool is shared by all threads */
+  if (p4est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+    quad->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
+  }
+  else {
+    quad->p.user_data = NULL;
+  }
+  if (init_fn != NULL && p4est_quadrant_is_inside_root (quad)) {
+    if (concurrent_callbacks) {
+      init_fn (p4est, which_tree, quad);
+    }
+    else {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_threads_callback)
+#endif
+      init_fn (p4est, which_tree, quad);
+    }
+  }
+}
+
+/** Free user data from within a threaded algorithm. */
+static void
+p4est_threads_free_data (p4est_t * p4est, p4est_quadrant_t * quad)
+{
+  if (p4est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+    sc_mempool_free (p4est->user_data_pool, quad->p.user_data);
+  }
+  quad->p.user_data = NULL;
+}
+
+/** A contiguous range of one local tree that is refined by one thread. */
+typedef struct p4est_refine_unit
+{
+  p4est_topidx_t      which_tree;       /**< The local tree of this range */
+  size_t              begin, end;       /**< Input range in tree->quadrants */
+  size_t              first_refined;    /**< Input quadrants before this
+                                             position are kept unchanged */
+  size_t              offset;           /**< Output position of this range */
+  sc_array_t          out;              /**< Output from first_refined on */
+  p4est_locidx_t      quadrants_per_level[P4EST_MAXLEVEL + 1];
+  int                 maxlevel;
+}
+p4est_refine_unit_t;
+
+static int
+p4est_refine_unit_test (p4est_t * p4est, p4est_topidx_t which_tree,
+                        p4est_quadrant_t * q, p4est_refine_t refine_fn,
+                        int allowed_level, int concurrent_callbacks)
+{
+  int                 doit;
+
+  if (concurrent_callbacks) {
+    doit = refine_fn (p4est, which_tree, q);
+  }
+  else {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_threads_callback)
+#endif
+    doit = refine_fn (p4est, which_tree, q);
+  }
+  return doit && (int) q->level < allowed_level;
+}
+
+/** Refine one range of a tree into its private output array.
+ * The range is processed depth first with an explicit stack that only
+ * this thread touches, so no shared quadrant memory is needed.
+ */
+static void
+p4est_refine_unit (p4est_t * p4est, p4est_refine_unit_t * unit,
+                   int refine_recursive, int allowed_level,
+                   p4est_refine_t refine_fn, p4est_init_t init_fn,
+                   p4est_replace_t replace_fn, int concurrent_callbacks)
+{
+  int                 i, firsttime;
+  size_t              current;
+  p4est_topidx_t      nt = unit->which_tree;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *c;
+  p4est_quadrant_t    top, *family[P4EST_CHILDREN];
+  p4est_quadrant_t    parent, *pp = &parent;
+  sc_array_t          stack;
+
+  tree = p4est_tree_array_index (p4est->trees, nt);
+  sc_array_init (&unit->out, sizeof (p4est_quadrant_t));
+  for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+    unit->quadrants_per_level[i] = 0;
+  }
+  unit->maxlevel = 0;
+
+  /* run through the range to find first quadrant to be refined */
+  for (current = unit->begin; current < unit->end; ++current) {
+    q = p4est_quadrant_array_index (&tree->quadrants, current);
+    if (p4est_refine_unit_test (p4est, nt, q, refine_fn, allowed_level,
+                                concurrent_callbacks)) {
+      break;
+    }
+    unit->maxlevel = SC_MAX (unit->maxlevel, (int) q->level);
+    ++unit->quadrants_per_level[q->level];
+  }
+  unit->first_refined = current;
+  if (current == unit->end) {
+    /* no refinement occurs in this range */
+    return;
+  }
+
+  /* the stack holds copies of quadrants with the next one on top */
+  sc_array_init (&stack, sizeof (p4est_quadrant_t));
+  P4EST_QUADRANT_INIT (&parent);
+  for (; current < unit->end; ++current) {
+    q = p4est_quadrant_array_index (&tree->quadrants, current);
+    if (current > unit->first_refined &&
+        !p4est_refine_unit_test (p4est, nt, q, refine_fn, allowed_level,
+                                 concurrent_callbacks)) {
+      *(p4est_quadrant_t *) sc_array_push (&unit->out) = *q;
+      unit->maxlevel = SC_MAX (unit->maxlevel, (int) q->level);
+      ++unit->quadrants_per_level[q->level];
+      continue;
+    }
+
+    /* this input quadrant has been tested positive */
+    *(p4est_quadrant_t *) sc_array_push (&stack) = *q;
+    firsttime = 1;
+    while (stack.elem_count > 0) {
+      top = *(p4est_quadrant_t *) sc_array_pop (&stack);
+      if (!firsttime &&
+          !(refine_recursive &&
+            p4est_refine_unit_test (p4est, nt, &top, refine_fn,
+                                    allowed_level, concurrent_callbacks))) {
+        /* store new quadrant and update counters */
+        *(p4est_quadrant_t *) sc_array_push (&unit->out) = top;
+        unit->maxlevel = SC_MAX (unit->maxlevel, (int) top.level);
+        ++unit->quadrants_per_level[top.level];
+        continue;
+      }
+      firsttime = 0;
+
+      if (replace_fn != NULL) {
+        /* do not free the data yet: we will do this after replace */
+        parent = top;
+      }
+      else {
+        p4est_threads_free_data (p4est, &top);
+      }
+
+      /* push the children in reverse order to pop them in order */
+      c = (p4est_quadrant_t *) sc_array_push_count (&stack, P4EST_CHILDREN);
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        family[i] = c + (P4EST_CHILDREN - 1 - i);
+        p4est_quadrant_child (&top, family[i], i);
+      }
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        p4est_threads_init_data (p4est, nt, family[i], init_fn,
+                                 concurrent_callbacks);
+      }
+      if (replace_fn != NULL) {
+        if (concurrent_callbacks) {
+          replace_fn (p4est, nt, 1, &pp, P4EST_CHILDREN, family);
+        }
+        else {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_threads_callback)
+#endif
+          replace_fn (p4est, nt, 1, &pp, P4EST_CHILDREN, family);
+        }
+        p4est_threads_free_data (p4est, &parent);
+      }
+    }
+  }
+  sc_array_reset (&stack);
+}
+
+void
+p4est_refine_threads (p4est_t * p4est, int refine_recursive,
+                      int allowed_level, p4est_refine_t refine_fn,
+                      p4est_init_t init_fn, p4est_replace_t replace_fn,
+                      int num_threads, int concurrent_callbacks)
+{
+  int                 i, maxlevel;
+  long                lu, num_units;
+  size_t              zz, count, unit_size, next_cut;
+  size_t              first_unit, prefix, total;
+  p4est_topidx_t      nt;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
+  p4est_refine_unit_t *unit;
+  sc_array_t         *units;
+
+  num_threads = p4est_num_threads (num_threads);
+  if (num_threads == 1) {
+    /* the serial algorithm is the reference */
+    p4est_refine_ext (p4est, refine_recursive, allowed_level,
+                      refine_fn, init_fn, replace_fn);
+    return;
+  }
+
+  if (allowed_level < 0) {
+    allowed_level = P4EST_QMAXLEVEL;
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_refine_threads with %lld total quadrants,"
+                            " allowed level %d, %d threads\n",
+                            (long long) p4est->global_num_quadrants,
+                            allowed_level, num_threads);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (refine_fn != NULL);
+
+  /* remember input quadrant count; it will not decrease */
+  old_gnq = p4est->global_num_quadrants;
+
+  /* cut the local quadrants into ranges that do not cross tree boundaries */
+  units = sc_array_new (sizeof (p4est_refine_unit_t));
+  unit_size = (size_t) p4est->local_num_quadrants /
+    (size_t) (4 * num_threads) + 1;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    count = tree->quadrants.elem_count;
+    for (zz = 0; zz < count; zz = unit->end) {
+      next_cut = ((size_t) tree->quadrants_offset + zz) / unit_size + 1;
+      unit = (p4est_refine_unit_t *) sc_array_push (units);
+      unit->which_tree = nt;
+      unit->begin = zz;
+      unit->end = SC_MIN (count, next_cut * unit_size -
+                          (size_t) tree->quadrants_offset);
+    }
+  }
+  num_units = (long) units->elem_count;
+
+  /* refine all ranges independently */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (lu = 0; lu < num_units; ++lu) {
+    p4est_refine_unit (p4est, (p4est_refine_unit_t *)
+                       sc_array_index_long (units, lu),
+                       refine_recursive, allowed_level, refine_fn,
+                       init_fn, replace_fn, concurrent_callbacks);
+  }
+
+  /* splice the results of all ranges into the tree arrays */
+  p4est->local_num_quadrants = 0;
+  lu = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+
+    /* compute the output position and the counters of every range */
+    maxlevel = 0;
+    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+      tree->quadrants_per_level[i] = 0;
+    }
+    total = 0;
+    first_unit = (size_t) lu;
+    for (; lu < num_units; ++lu) {
+      unit = (p4est_refine_unit_t *) sc_array_index_long (units, lu);
+      if (unit->which_tree != nt) {
+        break;
+      }
+      unit->offset = total;
+      total += unit->first_refined - unit->begin + unit->out.elem_count;
+      maxlevel = SC_MAX (maxlevel, unit->maxlevel);
+      for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+        tree->quadrants_per_level[i] += unit->quadrants_per_level[i];
+      }
+    }
+    tree->maxlevel = (int8_t) maxlevel;
+    P4EST_ASSERT (total >= tree->quadrants.elem_count);
+
+    /* move back to front: no range overwrites input still to be moved */
+    sc_array_resize (&tree->quadrants, total);
+    for (zz = (size_t) lu; zz > first_unit; --zz) {
+      unit = (p4est_refine_unit_t *) sc_array_index (units, zz - 1);
+      if (unit->out.elem_count > 0) {
+        prefix = unit->first_refined - unit->begin;
+        memcpy (sc_array_index (&tree->quadrants, unit->offset + prefix),
+                unit->out.array, unit->out.elem_count * sizeof
+                (p4est_quadrant_t));
+      }
+      if (unit->offset != unit->begin && unit->first_refined > unit->begin) {
+        memmove (sc_array_index (&tree->quadrants, unit->offset),
+                 sc_array_index (&tree->quadrants, unit->begin),
+                 (unit->first_refined - unit->begin) *
+                 sizeof (p4est_quadrant_t));
+      }
+      sc_array_reset (&unit->out);
+    }
+    p4est->local_num_quadrants += tree->quadrants.elem_count;
+
+    P4EST_ASSERT (p4est_tree_is_sorted (tree));
+    P4EST_ASSERT (p4est_tree_is_complete (tree));
+  }
+  P4EST_ASSERT (lu == num_units);
+  if (p4est->last_local_tree >= 0) {
+    for (; nt < p4est->connectivity->num_trees; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+  sc_array_destroy (units);
+
+  /* compute global number of quadrants */
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
+  if (old_gnq != p4est->global_num_quadrants) {
+    ++p4est->revision;
+  }
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_refine_threads with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
+
 void
 p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
                p4est_coarsen_t coarsen_fn, p4est_init_t init_fn)
@@ -960,6 +1357,7 @@ p4est_coarsen_ext (p4est_t * p4est,
   p4est_quadrant_t   *cfirst, *clast;
   sc_array_t         *tquadrants;
   p4est_quadrant_t    qtemp;
+  p4est_balance_log_t *log;
 
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
                             "_coarsen with %lld total quadrants\n",
@@ -970,6 +1368,7 @@ p4est_coarsen_ext (p4est_t * p4est,
 
   /* remember input quadrant count; it will not increase */
   old_gnq = p4est->global_num_quadrants;
+  log = p4est_balance_log_current (p4est);
 
   P4EST_QUADRANT_INIT (&qtemp);
 
@@ -1035,6 +1434,9 @@ p4est_coarsen_ext (p4est_t * p4est,
           c[0] = &qtemp;
         }
         p4est_quadrant_parent (c[0], cfirst);
+        if (log != NULL) {
+          p4est_balance_log_push (log, jt, cfirst);
+        }
         p4est_quadrant_init_data (p4est, jt, cfirst, init_fn);
         tree->quadrants_per_level[cfirst->level] += 1;
         p4est->local_num_quadrants -= P4EST_CHILDREN - 1;
@@ -1128,6 +1530,9 @@ p4est_coarsen_ext (p4est_t * p4est,
   if (old_gnq != p4est->global_num_quadrants) {
     ++p4est->revision;
   }
+  if (log != NULL) {
+    log->revision = p4est->revision;
+  }
 
   P4EST_ASSERT (p4est_is_valid (p4est));
   p4est_log_indent_pop ();
@@ -1136,180 +1541,1445 @@ p4est_coarsen_ext (p4est_t * p4est,
                             (long long) p4est->global_num_quadrants);
 }
 
-/** Check if the insulation layer of a quadrant overlaps anybody.
- * If yes, the quadrant itself is scheduled for sending.
- * Both quadrants are in the receiving tree's coordinates.
- * \param [in]  qtree       Tree id of the receiving tree.
- * \param [in]  inter_tree  Boolean flag to specify inter-tree communication.
- * \param [in]  q           The quadrant to be sent if there is overlap.
- * \param [in]  insul       An insulation quadrant of \a q.
- * \param [in,out]  first_peer  Lowest peer, will be updated.
- * \param [in,out]  last_peer   Highest peer, will be updated.
+/** A range of one local tree that is coarsened by one thread.
+ * Every range but the first of a tree begins with a quadrant of child id
+ * zero, thus no family of the input quadrants crosses a range boundary.
  */
-static void
-p4est_balance_schedule (p4est_t * p4est, p4est_balance_peer_t * peers,
-                        p4est_topidx_t qtree, int inter_tree,
-                        const p4est_quadrant_t * q,
-                        const p4est_quadrant_t * insul,
-                        int *first_peer, int *last_peer)
+typedef struct p4est_coarsen_unit
 {
-  const int           rank = p4est->mpirank;
-  int                 found;
-  int                 back, pos;
-  int                 owner, first_owner, last_owner;
-  p4est_gloidx_t     *global_first_quadrant = p4est->global_first_quadrant;
-  p4est_quadrant_t    ld, *s;
-  p4est_balance_peer_t *peer;
-
-  P4EST_QUADRANT_INIT (&ld);
+  p4est_topidx_t      which_tree;       /**< The local tree of this range */
+  size_t              begin, end;       /**< Input range in tree->quadrants */
+  size_t              count;            /**< Quadrants kept from begin on */
+  size_t              offset;           /**< Output position of this range */
+  sc_array_t          families;         /**< Positions of families found */
+  p4est_locidx_t      level_delta[P4EST_MAXLEVEL + 1];
+}
+p4est_coarsen_unit_t;
 
-  /* querying insul is equivalent to querying first descendant */
-  first_owner = p4est_comm_find_owner (p4est, qtree, insul, rank);
-  /* querying last descendant */
-  p4est_quadrant_last_descendant (insul, &ld, P4EST_QMAXLEVEL);
-  last_owner = p4est_comm_find_owner (p4est, qtree, &ld, rank);
+/** Replace a family by its parent, which is stored in place of c[0].
+ * The callbacks are called directly; the caller decides on concurrency.
+ */
+static void
+p4est_coarsen_family (p4est_t * p4est, p4est_topidx_t which_tree,
+                      p4est_quadrant_t * c[], p4est_init_t init_fn,
+                      p4est_replace_t replace_fn,
+                      p4est_locidx_t * level_delta)
+{
+  int                 zz;
+  p4est_quadrant_t   *cfirst;
+  p4est_quadrant_t    qtemp;
 
-  /* send to all processors possibly intersecting insulation */
-  for (owner = first_owner; owner <= last_owner; ++owner) {
-    if (owner == rank && !inter_tree) {
-      /* do not send to self for the same tree */
-      continue;
+  if (replace_fn == NULL) {
+    for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+      p4est_threads_free_data (p4est, c[zz]);
     }
-    if (global_first_quadrant[owner] == global_first_quadrant[owner + 1]) {
-      /* do not send to empty processors */
-      continue;
+  }
+  level_delta[c[0]->level] -= P4EST_CHILDREN;
+  cfirst = c[0];
+  if (replace_fn != NULL) {
+    qtemp = *(c[0]);
+    c[0] = &qtemp;
+  }
+  p4est_quadrant_parent (c[0], cfirst);
+  p4est_threads_init_data (p4est, which_tree, cfirst, init_fn, 1);
+  level_delta[cfirst->level] += 1;
+
+  if (replace_fn != NULL) {
+    replace_fn (p4est, which_tree, P4EST_CHILDREN, c, 1, &cfirst);
+    for (zz = 0; zz < P4EST_CHILDREN; zz++) {
+      p4est_threads_free_data (p4est, c[zz]);
     }
-    peer = peers + owner;
-    /* avoid duplicates in the send array */
-    found = 0;
-    for (back = 0; back < P4EST_INSUL - 1; ++back) {
-      pos = (int) peer->send_first.elem_count - back - 1;
-      if (pos < 0) {
-        break;
-      }
-      s = (p4est_quadrant_t *) sc_array_index_int (&peer->send_first, pos);
-      if (p4est_quadrant_is_equal (s, q) && s->p.piggy2.which_tree == qtree
-          && s->p.piggy2.from_tree == q->p.piggy2.from_tree
-          && s->pad16 == q->pad16) {
-        found = 1;
+  }
+}
+
+/** Coarsen one range with the sliding window algorithm of the serial code.
+ * The range is compacted in place towards its beginning.
+ */
+static void
+p4est_coarsen_unit_window (p4est_t * p4est, p4est_coarsen_unit_t * unit,
+                           int coarsen_recursive, int callback_orphans,
+                           p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
+                           p4est_replace_t replace_fn)
+{
+  int                 isfamily;
+  size_t              zz, first, incount;
+  size_t              window, start, length, cidz;
+  p4est_topidx_t      jt = unit->which_tree;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  p4est_quadrant_t   *cfirst, *clast;
+  sc_array_t         *tquadrants;
+
+  tree = p4est_tree_array_index (p4est->trees, jt);
+  tquadrants = &tree->quadrants;
+
+  /* state information relative to the beginning of the range */
+  first = unit->begin;
+  incount = unit->end - unit->begin;
+  window = 0;
+  start = 1;
+  length = 0;
+
+  while (window + P4EST_CHILDREN + length <= incount) {
+    P4EST_ASSERT (window < start);
+
+    cidz = incount;
+    isfamily = 1;
+    for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+      c[zz] = p4est_quadrant_array_index
+        (tquadrants, first + window + zz + (window + zz < start ? 0 : length));
+
+      if (zz != (size_t) p4est_quadrant_child_id (c[zz])) {
+        isfamily = 0;
+        if (callback_orphans) {
+          c[1] = NULL;
+          (void) coarsen_fn (p4est, jt, c);
+        }
         break;
       }
     }
-    if (found) {
-      continue;
+    P4EST_ASSERT (!isfamily || p4est_quadrant_is_familypv (c));
+    if (isfamily && coarsen_fn (p4est, jt, c)) {
+      cfirst = c[0];
+      p4est_coarsen_family (p4est, jt, c, init_fn, replace_fn,
+                            unit->level_delta);
+      cidz = (size_t) p4est_quadrant_child_id (cfirst);
+      start = window + 1;
+      length += P4EST_CHILDREN - 1;
     }
 
-    /* copy quadrant into shipping list */
-    s = p4est_quadrant_array_push_copy (&peer->send_first, q);
-    s->p.piggy2.which_tree = qtree;     /* piggy back tree id */
+    if (cidz <= window && coarsen_recursive) {
+      window -= cidz;
+    }
+    else {
+      ++window;
+      if (window == start && start + length < incount) {
+        if (length > 0) {
+          cfirst = p4est_quadrant_array_index (tquadrants, first + start);
+          clast = p4est_quadrant_array_index (tquadrants,
+                                              first + start + length);
+          *cfirst = *clast;
+        }
+        start = window + 1;
+      }
+    }
+  }
 
-    /* update lowest and highest peer */
-    if (owner != rank) {
-      *first_peer = SC_MIN (owner, *first_peer);
-      *last_peer = SC_MAX (owner, *last_peer);
+  /* close the hole */
+  if (length > 0) {
+    for (zz = start + length; zz < incount; ++zz) {
+      cfirst = p4est_quadrant_array_index (tquadrants, first + zz - length);
+      clast = p4est_quadrant_array_index (tquadrants, first + zz);
+      *cfirst = *clast;
+    }
+  }
+  unit->count = incount - length;
+
+  /* call remaining orphans */
+  if (callback_orphans) {
+    c[1] = NULL;
+    for (zz = window; zz < unit->count; ++zz) {
+      c[0] = p4est_quadrant_array_index (tquadrants, first + zz);
+      (void) coarsen_fn (p4est, jt, c);
     }
   }
 }
 
+/** Find the positions of all families in a range without any callbacks. */
 static void
-p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
-                        p4est_connect_type_t balance, sc_array_t * borders)
+p4est_coarsen_unit_detect (p4est_t * p4est, p4est_coarsen_unit_t * unit)
+{
+  int                 len;
+  size_t              zz, incount;
+  p4est_tree_t       *tree;
+  sc_array_t         *tquadrants;
+
+  tree = p4est_tree_array_index (p4est->trees, unit->which_tree);
+  tquadrants = &tree->quadrants;
+  incount = tquadrants->elem_count;
+
+  for (zz = unit->begin; zz < unit->end; zz += (size_t) SC_MAX (len, 1)) {
+    for (len = 0; len < P4EST_CHILDREN && zz + len < incount; ++len) {
+      if (len != p4est_quadrant_child_id
+          (p4est_quadrant_array_index (tquadrants, zz + len))) {
+        break;
+      }
+    }
+    if (len == P4EST_CHILDREN) {
+      P4EST_ASSERT (zz + P4EST_CHILDREN <= unit->end);
+      *(size_t *) sc_array_push (&unit->families) = zz;
+    }
+  }
+}
+
+/** Call back on the families and orphans of a range in serial order.
+ * On output, the list of families only contains the coarsened ones.
+ */
+static void
+p4est_coarsen_unit_ordered (p4est_t * p4est, p4est_coarsen_unit_t * unit,
+                            int callback_orphans, p4est_coarsen_t coarsen_fn,
+                            p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  int                 i;
+  size_t              zz, kf, nf, nc;
+  p4est_topidx_t      jt = unit->which_tree;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  sc_array_t         *tquadrants;
+
+  tree = p4est_tree_array_index (p4est->trees, jt);
+  tquadrants = &tree->quadrants;
+
+  kf = nc = 0;
+  nf = unit->families.elem_count;
+  for (zz = unit->begin; zz < unit->end; ++zz) {
+    if (kf < nf && *(size_t *) sc_array_index (&unit->families, kf) == zz) {
+      ++kf;
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c[i] = p4est_quadrant_array_index (tquadrants, zz + i);
+      }
+      P4EST_ASSERT (p4est_quadrant_is_familypv (c));
+      if (coarsen_fn (p4est, jt, c)) {
+        p4est_coarsen_family (p4est, jt, c, init_fn, replace_fn,
+                              unit->level_delta);
+        *(size_t *) sc_array_index (&unit->families, nc++) = zz;
+        zz += P4EST_CHILDREN - 1;
+      }
+    }
+    else if (callback_orphans) {
+      c[0] = p4est_quadrant_array_index (tquadrants, zz);
+      c[1] = NULL;
+      (void) coarsen_fn (p4est, jt, c);
+    }
+  }
+  sc_array_resize (&unit->families, nc);
+}
+
+/** Compact a range in place after its families have been coarsened. */
+static void
+p4est_coarsen_unit_compact (p4est_t * p4est, p4est_coarsen_unit_t * unit)
+{
+  size_t              kf, rd, wr, n;
+  p4est_tree_t       *tree;
+  sc_array_t         *tquadrants;
+
+  tree = p4est_tree_array_index (p4est->trees, unit->which_tree);
+  tquadrants = &tree->quadrants;
+
+  rd = wr = unit->begin;
+  for (kf = 0; kf <= unit->families.elem_count; ++kf) {
+    /* keep all quadrants up to and including the next parent */
+    n = (kf < unit->families.elem_count ?
+         *(size_t *) sc_array_index (&unit->families, kf) + 1 : unit->end)
+      - rd;
+    if (n > 0 && wr != rd) {
+      memmove (sc_array_index (tquadrants, wr),
+               sc_array_index (tquadrants, rd),
+               n * sizeof (p4est_quadrant_t));
+    }
+    wr += n;
+    rd += n + P4EST_CHILDREN - 1;
+  }
+  unit->count = wr - unit->begin;
+}
+
+/** Coarsen the families of a tree that no single range could see.
+ * This applies to recursive coarsening after the ranges are concatenated.
+ * A family is new if its members stem from different ranges or from this
+ * function; all other families have been tried already.
+ */
+static void
+p4est_coarsen_merge (p4est_t * p4est, p4est_topidx_t which_tree,
+                     p4est_coarsen_unit_t * units, size_t num_units,
+                     p4est_coarsen_t coarsen_fn, p4est_init_t init_fn,
+                     p4est_replace_t replace_fn)
+{
+  int                 zz, isnew;
+  int                *origin;
+  size_t              ku, rd, wr, base, count;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  sc_array_t         *tquadrants;
+
+  if (num_units < 2) {
+    return;
+  }
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  tquadrants = &tree->quadrants;
+  count = tquadrants->elem_count;
+
+  /* remember for every quadrant which range it comes from */
+  origin = P4EST_ALLOC (int, count);
+  for (ku = 0; ku < num_units; ++ku) {
+    for (rd = 0; rd < units[ku].count; ++rd) {
+      origin[units[ku].offset + rd] = (int) ku;
+    }
+  }
+
+  /* push the quadrants onto a stack kept in place, starting before the
+     first range boundary, and coarsen new families on its top */
+  rd = wr = units[1].offset - SC_MIN (units[1].offset, P4EST_CHILDREN - 1);
+  for (; rd < count; ++rd) {
+    if (wr != rd) {
+      *p4est_quadrant_array_index (tquadrants, wr) =
+        *p4est_quadrant_array_index (tquadrants, rd);
+      origin[wr] = origin[rd];
+    }
+    ++wr;
+    while (wr >= P4EST_CHILDREN) {
+      base = wr - P4EST_CHILDREN;
+      isnew = 0;
+      for (zz = P4EST_CHILDREN - 1; zz >= 0; --zz) {
+        c[zz] = p4est_quadrant_array_index (tquadrants, base + zz);
+        if (zz != p4est_quadrant_child_id (c[zz])) {
+          break;
+        }
+        if (origin[base + zz] < 0 || origin[base + zz] != origin[base]) {
+          isnew = 1;
+        }
+      }
+      if (zz >= 0 || !isnew) {
+        break;
+      }
+      P4EST_ASSERT (p4est_quadrant_is_familypv (c));
+      if (!coarsen_fn (p4est, which_tree, c)) {
+        break;
+      }
+      p4est_coarsen_family (p4est, which_tree, c, init_fn, replace_fn,
+                            tree->quadrants_per_level);
+      origin[base] = -1;
+      wr = base + 1;
+    }
+  }
+  sc_array_resize (tquadrants, wr);
+  P4EST_FREE (origin);
+}
+
+void
+p4est_coarsen_threads (p4est_t * p4est, int coarsen_recursive,
+                       int callback_orphans, p4est_coarsen_t coarsen_fn,
+                       p4est_init_t init_fn, p4est_replace_t replace_fn,
+                       int num_threads, int concurrent_callbacks)
+{
+  int                 i, maxlevel;
+  long                lu, ku, num_units, first_unit;
+  size_t              zz, count, unit_size, next_cut, total;
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
+  p4est_coarsen_unit_t *unit;
+  sc_array_t         *units, quadrants;
+
+  num_threads = p4est_num_threads (num_threads);
+  if (num_threads == 1 || (coarsen_recursive && !concurrent_callbacks)) {
+    /* the serial algorithm is the reference; in recursive mode its order
+       of callbacks can only be reproduced sequentially */
+    p4est_coarsen_ext (p4est, coarsen_recursive, callback_orphans,
+                       coarsen_fn, init_fn, replace_fn);
+    return;
+  }
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_coarsen_threads with %lld total quadrants,"
+                            " %d threads\n",
+                            (long long) p4est->global_num_quadrants,
+                            num_threads);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (coarsen_fn != NULL);
+
+  /* remember input quadrant count; it will not increase */
+  old_gnq = p4est->global_num_quadrants;
+
+  /* cut the local quadrants into ranges aligned with family boundaries */
+  units = sc_array_new (sizeof (p4est_coarsen_unit_t));
+  unit_size = (size_t) p4est->local_num_quadrants /
+    (size_t) (4 * num_threads) + 1;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    count = tree->quadrants.elem_count;
+    for (zz = 0; zz < count; zz = unit->end) {
+      next_cut = ((size_t) tree->quadrants_offset + zz) / unit_size + 1;
+      unit = (p4est_coarsen_unit_t *) sc_array_push (units);
+      unit->which_tree = jt;
+      unit->begin = zz;
+      unit->end = SC_MIN (count, next_cut * unit_size -
+                          (size_t) tree->quadrants_offset);
+      while (unit->end < count &&
+             p4est_quadrant_child_id (p4est_quadrant_array_index
+                                      (&tree->quadrants, unit->end)) != 0) {
+        ++unit->end;
+      }
+      sc_array_init (&unit->families, sizeof (size_t));
+      for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+        unit->level_delta[i] = 0;
+      }
+    }
+  }
+  num_units = (long) units->elem_count;
+
+  if (concurrent_callbacks) {
+    /* coarsen all ranges independently */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+    for (lu = 0; lu < num_units; ++lu) {
+      p4est_coarsen_unit_window (p4est, (p4est_coarsen_unit_t *)
+                                 sc_array_index_long (units, lu),
+                                 coarsen_recursive, callback_orphans,
+                                 coarsen_fn, init_fn, replace_fn);
+    }
+  }
+  else {
+    /* find families in parallel and call back on them in serial order */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+    for (lu = 0; lu < num_units; ++lu) {
+      p4est_coarsen_unit_detect (p4est, (p4est_coarsen_unit_t *)
+                                 sc_array_index_long (units, lu));
+    }
+    for (lu = 0; lu < num_units; ++lu) {
+      p4est_coarsen_unit_ordered (p4est, (p4est_coarsen_unit_t *)
+                                  sc_array_index_long (units, lu),
+                                  callback_orphans, coarsen_fn,
+                                  init_fn, replace_fn);
+    }
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+    for (lu = 0; lu < num_units; ++lu) {
+      p4est_coarsen_unit_compact (p4est, (p4est_coarsen_unit_t *)
+                                  sc_array_index_long (units, lu));
+    }
+  }
+
+  /* concatenate the compacted ranges of every tree */
+  p4est->local_num_quadrants = 0;
+  lu = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+
+    /* prefix sum over the output counts */
+    total = 0;
+    first_unit = lu;
+    for (; lu < num_units; ++lu) {
+      unit = (p4est_coarsen_unit_t *) sc_array_index_long (units, lu);
+      if (unit->which_tree != jt) {
+        break;
+      }
+      unit->offset = total;
+      total += unit->count;
+      for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+        tree->quadrants_per_level[i] += unit->level_delta[i];
+      }
+      sc_array_reset (&unit->families);
+    }
+    if (total < tree->quadrants.elem_count) {
+      sc_array_init_size (&quadrants, sizeof (p4est_quadrant_t), total);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(num_threads)
+#endif
+      for (ku = first_unit; ku < lu; ++ku) {
+        unit = (p4est_coarsen_unit_t *) sc_array_index_long (units, ku);
+        if (unit->count > 0) {
+          memcpy (sc_array_index (&quadrants, unit->offset),
+                  sc_array_index (&tree->quadrants, unit->begin),
+                  unit->count * sizeof (p4est_quadrant_t));
+        }
+      }
+      sc_array_reset (&tree->quadrants);
+      tree->quadrants = quadrants;
+    }
+    if (coarsen_recursive) {
+      p4est_coarsen_merge (p4est, jt, (p4est_coarsen_unit_t *)
+                           sc_array_index_long (units, first_unit),
+                           (size_t) (lu - first_unit),
+                           coarsen_fn, init_fn, replace_fn);
+    }
+
+    /* compute maximum level */
+    maxlevel = 0;
+    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+      P4EST_ASSERT (tree->quadrants_per_level[i] >= 0);
+      if (tree->quadrants_per_level[i] > 0) {
+        maxlevel = i;
+      }
+    }
+    tree->maxlevel = (int8_t) maxlevel;
+    p4est->local_num_quadrants += (p4est_locidx_t) tree->quadrants.elem_count;
+
+    P4EST_ASSERT (p4est_tree_is_sorted (tree));
+    P4EST_ASSERT (p4est_tree_is_complete (tree));
+  }
+  P4EST_ASSERT (lu == num_units);
+  if (p4est->last_local_tree >= 0) {
+    for (; jt < p4est->connectivity->num_trees; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+  sc_array_destroy (units);
+
+  /* compute global number of quadrants */
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est->global_num_quadrants <= old_gnq);
+  if (old_gnq != p4est->global_num_quadrants) {
+    ++p4est->revision;
+  }
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_coarsen_threads with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
+
+/** Check if the insulation layer of a quadrant overlaps anybody.
+ * If yes, the quadrant itself is scheduled for sending.
+ * Both quadrants are in the receiving tree's coordinates.
+ * \param [in]  qtree       Tree id of the receiving tree.
+ * \param [in]  inter_tree  Boolean flag to specify inter-tree communication.
+ * \param [in]  q           The quadrant to be sent if there is overlap.
+ * \param [in]  insul       An insulation quadrant of \a q.
+ * \param [in,out]  first_peer  Lowest peer, will be updated.
+ * \param [in,out]  last_peer   Highest peer, will be updated.
+ */
+static void
+p4est_balance_schedule (p4est_t * p4est, p4est_balance_peer_t * peers,
+                        p4est_topidx_t qtree, int inter_tree,
+                        const p4est_quadrant_t * q,
+                        const p4est_quadrant_t * insul,
+                        int *first_peer, int *last_peer)
+{
+  const int           rank = p4est->mpirank;
+  int                 found;
+  int                 back, pos;
+  int                 owner, first_owner, last_owner;
+  p4est_gloidx_t     *global_first_quadrant = p4est->global_first_quadrant;
+  p4est_quadrant_t    ld, *s;
+  p4est_balance_peer_t *peer;
+
+  P4EST_QUADRANT_INIT (&ld);
+
+  /* querying insul is equivalent to querying first descendant */
+  first_owner = p4est_comm_find_owner (p4est, qtree, insul, rank);
+  /* querying last descendant */
+  p4est_quadrant_last_descendant (insul, &ld, P4EST_QMAXLEVEL);
+  last_owner = p4est_comm_find_owner (p4est, qtree, &ld, rank);
+
+  /* send to all processors possibly intersecting insulation */
+  for (owner = first_owner; owner <= last_owner; ++owner) {
+    if (owner == rank && !inter_tree) {
+      /* do not send to self for the same tree */
+      continue;
+    }
+    if (global_first_quadrant[owner] == global_first_quadrant[owner + 1]) {
+      /* do not send to empty processors */
+      continue;
+    }
+    peer = peers + owner;
+    /* avoid duplicates in the send array */
+    found = 0;
+    for (back = 0; back < P4EST_INSUL - 1; ++back) {
+      pos = (int) peer->send_first.elem_count - back - 1;
+      if (pos < 0) {
+        break;
+      }
+      s = (p4est_quadrant_t *) sc_array_index_int (&peer->send_first, pos);
+      if (p4est_quadrant_is_equal (s, q) && s->p.piggy2.which_tree == qtree
+          && s->p.piggy2.from_tree == q->p.piggy2.from_tree
+          && s->pad16 == q->pad16) {
+        found = 1;
+        break;
+      }
+    }
+    if (found) {
+      continue;
+    }
+
+    /* copy quadrant into shipping list */
+    s = p4est_quadrant_array_push_copy (&peer->send_first, q);
+    s->p.piggy2.which_tree = qtree;     /* piggy back tree id */
+
+    /* update lowest and highest peer */
+    if (owner != rank) {
+      *first_peer = SC_MIN (owner, *first_peer);
+      *last_peer = SC_MAX (owner, *last_peer);
+    }
+  }
+}
+
+/** Compute the response to the first round of balance messages.
+ * \param [in] borders  If NULL, the incoming quadrants are compared with
+ *                      all local quadrants, and the local quadrants they
+ *                      force to split are not recorded.  This is used by
+ *                      the incremental balance, which finds those by
+ *                      marking.  Otherwise the border quadrants of the
+ *                      local trees, which receive the seeds of the local
+ *                      quadrants forced to split.
+ */
+static void
+p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
+                        p4est_connect_type_t balance, sc_array_t * borders)
 {
   sc_array_t         *first_seeds = sc_array_new (sizeof (p4est_quadrant_t));
 
-/* compute and uniqify overlap quadrants */
-  p4est_tree_compute_overlap (p4est, &peer->recv_first,
-                              &peer->send_second, balance, borders,
-                              first_seeds);
-  /* replace peer->recv_first with first_seeds */
-  p4est_tree_uniqify_overlap (&peer->send_second);
-  p4est_tree_uniqify_overlap (first_seeds);
-  /* replace peer->recv_first with first_seeds */
-  sc_array_resize (&peer->recv_first, first_seeds->elem_count);
-  memcpy (peer->recv_first.array, first_seeds->array,
-          first_seeds->elem_size * first_seeds->elem_count);
-  sc_array_destroy (first_seeds);
+/* compute and uniqify overlap quadrants */
+  p4est_tree_compute_overlap (p4est, &peer->recv_first,
+                              &peer->send_second, balance, borders,
+                              first_seeds);
+  /* replace peer->recv_first with first_seeds */
+  p4est_tree_uniqify_overlap (&peer->send_second);
+  p4est_tree_uniqify_overlap (first_seeds);
+  /* replace peer->recv_first with first_seeds */
+  if (borders == NULL) {
+    sc_array_reset (first_seeds);
+  }
+  sc_array_resize (&peer->recv_first, first_seeds->elem_count);
+  memcpy (peer->recv_first.array, first_seeds->array,
+          first_seeds->elem_size * first_seeds->elem_count);
+  sc_array_destroy (first_seeds);
+
+  if (p4est->inspect) {
+    p4est->inspect->balance_comm_sent += peer->send_second.elem_count;
+    if (peer->send_second.elem_count) {
+      p4est->inspect->balance_comm_nzpeers++;
+    }
+  }
+}
+
+void
+p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
+               p4est_init_t init_fn)
+{
+  p4est_balance_ext (p4est, btype, init_fn, NULL);
+}
+
+/** Status of a split-phase 2:1 balance between begin and end. */
+struct p4est_balance_context
+{
+  p4est_t            *p4est;
+  p4est_connect_type_t btype;
+  p4est_init_t        init_fn;
+  p4est_replace_t     replace_fn;
+  int8_t             *tree_flags;
+  size_t              localcount;
+  sc_array_t         *borders;
+  p4est_balance_peer_t *peers;
+  int                 first_peer, last_peer;
+  size_t              all_incount;
+  p4est_locidx_t      skipped;
+  p4est_gloidx_t      old_gnq;
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size;
+#endif
+#ifdef P4_TO_P8
+  p8est_edge_info_t   ei;
+#endif
+  p4est_corner_info_t ci;
+  int                 incremental;
+  sc_array_t          candidates;
+  sc_array_t         *marks;
+#ifdef P4EST_ENABLE_MPI
+  int                 request_first_count, request_second_count;
+  int                 request_send_count;
+  int                 total_send_count, total_recv_count;
+  int                 send_zero[2], send_load[2];
+  int                 recv_zero[2], recv_load[2];
+  int                *wait_indices;
+  MPI_Request        *requests_first, *requests_second;
+  MPI_Request        *send_requests_first_count, *send_requests_first_load;
+  MPI_Request        *send_requests_second_count, *send_requests_second_load;
+  MPI_Status         *recv_statuses;
+#ifdef P4EST_ENABLE_DEBUG
+  sc_array_t          checkarray;
+#endif
+#endif
+};
+
+/** Check whether a tree is owned by this process in its entirety. */
+static int
+p4est_balance_tree_owned (p4est_t * p4est, p4est_topidx_t nt)
+{
+  int                 full_tree[2];
+
+  if (nt < p4est->first_local_tree || nt > p4est->last_local_tree) {
+    return 0;
+  }
+  p4est_comm_tree_info (p4est, nt, full_tree, NULL, NULL, NULL);
+  return full_tree[0] && full_tree[1];
+}
+
+/** Check whether a tree and all of its neighbors are owned by this process.
+ * Such a tree neither sends quadrants to nor receives quadrants from any
+ * other process, thus its first balance pass may wait for communication.
+ */
+static int
+p4est_balance_tree_interior (p4est_balance_context_t *ctx,
+                             p4est_topidx_t nt)
+{
+  p4est_t            *p4est = ctx->p4est;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  int                 face, corner;
+  size_t              ctree;
+  sc_array_t         *cta = &ctx->ci.corner_transforms;
+#ifdef P4_TO_P8
+  int                 edge;
+  size_t              etree;
+  sc_array_t         *eta = &ctx->ei.edge_transforms;
+#endif
+
+  if (!p4est_balance_tree_owned (p4est, nt)) {
+    return 0;
+  }
+  for (face = 0; face < P4EST_FACES; ++face) {
+    if (!p4est_balance_tree_owned
+        (p4est, conn->tree_to_tree[P4EST_FACES * nt + face])) {
+      return 0;
+    }
+  }
+#ifdef P4_TO_P8
+  for (edge = 0; edge < P8EST_EDGES; ++edge) {
+    p8est_find_edge_transform (conn, nt, edge, &ctx->ei);
+    for (etree = 0; etree < eta->elem_count; ++etree) {
+      if (!p4est_balance_tree_owned
+          (p4est, p8est_edge_array_index (eta, etree)->ntree)) {
+        return 0;
+      }
+    }
+  }
+#endif
+  for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+    p4est_find_corner_transform (conn, nt, corner, &ctx->ci);
+    for (ctree = 0; ctree < cta->elem_count; ++ctree) {
+      if (!p4est_balance_tree_owned
+          (p4est, p4est_corner_array_index (cta, ctree)->ntree)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/** Push a leaf of the local forest to the candidates if it exists. */
+static void
+p4est_balance_candidate (p4est_balance_context_t *ctx, p4est_topidx_t qtree,
+                         const p4est_quadrant_t * n)
+{
+  p4est_t            *p4est = ctx->p4est;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *s;
+
+  P4EST_ASSERT (p4est->first_local_tree <= qtree &&
+                qtree <= p4est->last_local_tree);
+  tree = p4est_tree_array_index (p4est->trees, qtree);
+  if (sc_array_bsearch (&tree->quadrants, n, p4est_quadrant_compare) >= 0) {
+    s = p4est_quadrant_array_push_copy (&ctx->candidates, n);
+    s->p.piggy2.which_tree = qtree;
+  }
+}
+
+/** Mark a leaf that may be forced to split by a changed quadrant.
+ * \param [in] qtree       Tree of the insulation quadrant.
+ * \param [in] n           Insulation quadrant in the coordinates of \a qtree.
+ *                         A leaf equal to it on any process is marked.
+ */
+static void
+p4est_balance_mark (p4est_balance_context_t *ctx, p4est_topidx_t qtree,
+                    const p4est_quadrant_t * n)
+{
+  p4est_t            *p4est = ctx->p4est;
+  const int           rank = p4est->mpirank;
+  int                 owner;
+  p4est_quadrant_t   *s;
+
+  /* a leaf equal to n is owned by the owner of its first descendant */
+  owner = p4est_comm_find_owner (p4est, qtree, n, rank);
+  P4EST_ASSERT (0 <= owner && owner < p4est->mpisize);
+  if (owner == rank) {
+    p4est_balance_candidate (ctx, qtree, n);
+  }
+  else if (p4est->global_first_quadrant[owner] <
+           p4est->global_first_quadrant[owner + 1]) {
+    s = p4est_quadrant_array_push_copy (&ctx->marks[owner], n);
+    s->p.piggy2.which_tree = qtree;
+  }
+}
+
+/** Visit the insulation layer of a quadrant.
+ * Each part of the layer is transformed into the tree it lies in.
+ * \param [in] nt           Tree of the quadrant.
+ * \param [in] tree_contact Face contact of the tree, see
+ *                          \ref p4est_comm_tree_info.
+ * \param [in] q            Quadrant in tree \a nt.
+ * \param [in] mark         If false, schedule \a q for sending to the
+ *                          owners of its insulation layer.  If true, mark
+ *                          the leaves equal to an insulation quadrant.
+ */
+static void
+p4est_balance_insulation (p4est_balance_context_t *ctx, p4est_topidx_t nt,
+                          const int *tree_contact,
+                          const p4est_quadrant_t * q, int mark)
+{
+  p4est_t            *p4est = ctx->p4est;
+  int                 k, l, m, which;
+  int                 face;
+  int                 quad_contact[P4EST_FACES];
+  size_t              ctree;
+  const p4est_qcoord_t qh = P4EST_QUADRANT_LEN (q->level);
+  const p4est_qcoord_t rh = P4EST_ROOT_LEN;
+  p4est_topidx_t      qtree;
+  p4est_quadrant_t    tosend, insulq, tempq;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  int                 ftransform[P4EST_FTRANSFORM];
+  int                 face_axis[3];     /* 3 not P4EST_DIM */
+  int                 contact_face_only;
+#ifdef P4_TO_P8
+  int                 contact_edge_only;
+  int                 edge;
+  size_t              etree;
+  p8est_edge_transform_t *et;
+  sc_array_t         *eta = &ctx->ei.edge_transforms;
+#endif
+  int                 corner;
+  p4est_corner_transform_t *ct;
+  sc_array_t         *cta = &ctx->ci.corner_transforms;
+
+  P4EST_QUADRANT_INIT (&tosend);
+  P4EST_QUADRANT_INIT (&insulq);
+  P4EST_QUADRANT_INIT (&tempq);
+
+#ifdef P4_TO_P8
+  for (m = 0; m < 3; ++m) {
+#if 0
+  }
+#endif
+#else
+  m = 0;
+#endif
+  for (k = 0; k < 3; ++k) {
+    for (l = 0; l < 3; ++l) {
+      which = m * 9 + k * 3 + l;    /* 2D: 0..8, 3D: 0..26 */
+      /* exclude myself from the queries */
+      if (which == P4EST_INSUL / 2) {
+        continue;
+      }
+      /* may modify insulq below, never modify q itself! */
+      insulq = *q;
+      insulq.x += (l - 1) * qh;
+      insulq.y += (k - 1) * qh;
+#ifdef P4_TO_P8
+      insulq.z += (m - 1) * qh;
+#endif
+      /* check boundary status of insulation quadrant */
+      quad_contact[0] = (insulq.x < 0);
+      quad_contact[1] = (insulq.x >= rh);
+      face_axis[0] = quad_contact[0] || quad_contact[1];
+      quad_contact[2] = (insulq.y < 0);
+      quad_contact[3] = (insulq.y >= rh);
+      face_axis[1] = quad_contact[2] || quad_contact[3];
+#ifndef P4_TO_P8
+      face_axis[2] = 0;
+#else
+      quad_contact[4] = (insulq.z < 0);
+      quad_contact[5] = (insulq.z >= rh);
+      face_axis[2] = quad_contact[4] || quad_contact[5];
+      edge = -1;
+      contact_edge_only = 0;
+#endif
+      contact_face_only = 0;
+      face = -1;
+      if (face_axis[0] || face_axis[1] || face_axis[2]) {
+        /* this quadrant is relevant for inter-tree balancing */
+        if (!face_axis[1] && !face_axis[2]) {
+          contact_face_only = 1;
+          face = 0 + quad_contact[1];
+        }
+        else if (!face_axis[0] && !face_axis[2]) {
+          contact_face_only = 1;
+          face = 2 + quad_contact[3];
+        }
+#ifdef P4_TO_P8
+        else if (!face_axis[0] && !face_axis[1]) {
+          contact_face_only = 1;
+          face = 4 + quad_contact[5];
+        }
+        else if (!face_axis[0]) {
+          contact_edge_only = 1;
+          edge = 0 + 2 * quad_contact[5] + quad_contact[3];
+        }
+        else if (!face_axis[1]) {
+          contact_edge_only = 1;
+          edge = 4 + 2 * quad_contact[5] + quad_contact[1];
+        }
+        else if (!face_axis[2]) {
+          contact_edge_only = 1;
+          edge = 8 + 2 * quad_contact[3] + quad_contact[1];
+        }
+#endif
+        if (contact_face_only) {
+          /* square contact across a face */
+#ifdef P4_TO_P8
+          P4EST_ASSERT (!contact_edge_only);
+#endif
+          P4EST_ASSERT (face >= 0 && face < P4EST_FACES);
+          P4EST_ASSERT (quad_contact[face]);
+          qtree = p4est_find_face_transform (conn, nt, face, ftransform);
+          if (qtree >= 0) {
+            P4EST_ASSERT (tree_contact[face]);
+            p4est_quadrant_transform_face (&insulq, &tempq, ftransform);
+            if (mark) {
+              p4est_balance_mark (ctx, qtree, &tempq);
+              continue;
+            }
+            p4est_quadrant_transform_face (q, &tosend, ftransform);
+            tosend.p.piggy2.from_tree = nt;
+            tosend.pad16 = face;
+            p4est_balance_schedule (p4est, ctx->peers, qtree, 1,
+                                    &tosend, &tempq,
+                                    &ctx->first_peer, &ctx->last_peer);
+          }
+          else {
+            /* goes across a face with no neighbor */
+            P4EST_ASSERT (!tree_contact[face]);
+          }
+        }
+#ifdef P4_TO_P8
+        else if (contact_edge_only) {
+          /* this quadrant crosses an edge */
+          P4EST_ASSERT (!contact_face_only);
+          P4EST_ASSERT (edge >= 0 && edge < P8EST_EDGES);
+          p8est_find_edge_transform (conn, nt, edge, &ctx->ei);
+          for (etree = 0; etree < eta->elem_count; ++etree) {
+            et = p8est_edge_array_index (eta, etree);
+            p8est_quadrant_transform_edge (&insulq, &tempq, &ctx->ei, et, 1);
+            if (mark) {
+              p4est_balance_mark (ctx, et->ntree, &tempq);
+              continue;
+            }
+            p8est_quadrant_transform_edge (q, &tosend, &ctx->ei, et, 0);
+            tosend.p.piggy2.from_tree = nt;
+            tosend.pad16 = edge;
+            p4est_balance_schedule (p4est, ctx->peers, et->ntree, 1,
+                                    &tosend, &tempq,
+                                    &ctx->first_peer, &ctx->last_peer);
+          }
+        }
+#endif
+        else {
+          /* this quadrant crosses a corner */
+          P4EST_ASSERT (face_axis[0] && face_axis[1]);
+          corner = quad_contact[1] + 2 * quad_contact[3];
+#ifdef P4_TO_P8
+          P4EST_ASSERT (face_axis[2]);
+          corner += 4 * quad_contact[5];
+#endif
+          P4EST_ASSERT (p4est_quadrant_touches_corner (q, corner, 1));
+          P4EST_ASSERT (p4est_quadrant_touches_corner
+                        (&insulq, corner, 0));
+          p4est_find_corner_transform (conn, nt, corner, &ctx->ci);
+          for (ctree = 0; ctree < cta->elem_count; ++ctree) {
+            ct = p4est_corner_array_index (cta, ctree);
+            tempq = insulq;
+            p4est_quadrant_transform_corner (&tempq, (int) ct->ncorner,
+                                             1);
+            if (mark) {
+              p4est_balance_mark (ctx, ct->ntree, &tempq);
+              continue;
+            }
+            tosend = *q;
+            p4est_quadrant_transform_corner (&tosend, (int) ct->ncorner,
+                                             0);
+            tosend.p.piggy2.from_tree = nt;
+            tosend.pad16 = corner;
+            p4est_balance_schedule (p4est, ctx->peers, ct->ntree, 1,
+                                    &tosend, &tempq, &ctx->first_peer,
+                                    &ctx->last_peer);
+          }
+        }
+      }
+      else if (mark) {
+        /* no inter-tree contact */
+        p4est_balance_mark (ctx, nt, &insulq);
+      }
+      else {
+        /* no inter-tree contact; without the local subtree pass of the
+           incremental mode we need to ask ourselves as well */
+        tosend = *q;
+        tosend.p.piggy2.from_tree = nt;
+        tosend.pad16 = -1;
+        p4est_balance_schedule (p4est, ctx->peers, nt, ctx->incremental,
+                                &tosend, &insulq, &ctx->first_peer,
+                                &ctx->last_peer);
+      }
+    }
+  }
+#ifdef P4_TO_P8
+#if 0
+  {
+#endif
+  }
+#endif
+}
+
+/** Run the first balance pass on one tree and schedule its border. */
+static void
+p4est_balance_tree_first (p4est_balance_context_t *ctx,
+                          p4est_topidx_t nt)
+{
+  p4est_t            *p4est = ctx->p4est;
+  int                 face;
+  int                 any_face, tree_contact[P4EST_FACES];
+  int                 tree_fully_owned, full_tree[2];
+  size_t              zz, treecount;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  sc_array_t         *qarray, *tquadrants;
+
+  p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
+  tree_fully_owned = full_tree[0] && full_tree[1];
+  any_face = 0;
+  for (face = 0; face < P4EST_FACES; ++face) {
+    any_face = any_face || tree_contact[face];
+  }
+  if (any_face) {
+    ctx->tree_flags[nt] |= any_face_flag;
+  }
+  tree = p4est_tree_array_index (p4est->trees, nt);
+  tquadrants = &tree->quadrants;
+  ctx->all_incount += tquadrants->elem_count;
+
+  /* initial log message for this tree */
+  P4EST_VERBOSEF ("Into balance tree %lld with %llu\n", (long long) nt,
+                  (unsigned long long) tquadrants->elem_count);
+
+  /* local balance first pass */
+  p4est_balance_subtree_ext (p4est, ctx->btype, nt,
+                             ctx->init_fn, ctx->replace_fn);
+  treecount = tquadrants->elem_count;
+  P4EST_VERBOSEF ("Balance tree %lld A %llu\n",
+                  (long long) nt, (unsigned long long) treecount);
+
+  /* check if this tree is not shared with other processors */
+  if (tree_fully_owned) {
+    /* all quadrants in this tree are owned by me */
+    ctx->tree_flags[nt] |= fully_owned_flag;
+    if (!any_face) {
+      /* this tree is isolated, no balance between trees */
+      return;
+    }
+  }
+
+  if (ctx->borders != NULL) {
+    qarray = (sc_array_t *)
+      sc_array_index (ctx->borders, (size_t) (nt - p4est->first_local_tree));
+  }
+  else {
+    qarray = NULL;
+  }
+
+  /* identify boundary quadrants and prepare them to be sent */
+  for (zz = 0; zz < treecount; ++zz) {
+    /* this quadrant may be on the boundary with a range of processors */
+    q = p4est_quadrant_array_index (tquadrants, zz);
+    if (p4est_comm_neighborhood_owned (p4est, nt,
+                                       full_tree, tree_contact, q)) {
+      /* this quadrant's 3x3 neighborhood is owned by this processor */
+      ++ctx->skipped;
+      continue;
+    }
+
+    if (qarray != NULL) {
+      (void) p4est_quadrant_array_push_copy (qarray, q);
+    }
+
+    p4est_balance_insulation (ctx, nt, tree_contact, q, 0);
+  }
+}
+
+/** Decide collectively whether the balance may run incrementally. */
+static int
+p4est_balance_log_usable (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  int                 mpiret;
+  int                 usable, global_usable;
+  p4est_balance_log_t *log = p4est->balance_log;
+
+  if (log == NULL) {
+    return 0;
+  }
+  usable = log->balanced && log->revision == p4est->revision &&
+    p4est_connect_type_int (btype) <= p4est_connect_type_int (log->btype) &&
+    P4EST_CHILDREN * balance_log_fraction * log->regions.elem_count <=
+    (size_t) p4est->local_num_quadrants;
+  mpiret = sc_MPI_Allreduce (&usable, &global_usable, 1, sc_MPI_INT,
+                             sc_MPI_MIN, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  return global_usable;
+}
 
-  if (p4est->inspect) {
-    p4est->inspect->balance_comm_sent += peer->send_second.elem_count;
-    if (peer->send_second.elem_count) {
-      p4est->inspect->balance_comm_nzpeers++;
+/** Sort an array of quadrants with tree numbers and remove duplicates. */
+static void
+p4est_balance_uniqify (sc_array_t * quadrants)
+{
+  size_t              zz, count;
+  p4est_quadrant_t   *q, *p;
+
+  p4est_quadrant_array_sort (quadrants, 1);
+  for (count = zz = 0; zz < quadrants->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    if (count > 0) {
+      p = p4est_quadrant_array_index (quadrants, count - 1);
+      if (p4est_quadrant_compare_piggy (p, q) == 0) {
+        continue;
+      }
     }
+    *p4est_quadrant_array_index (quadrants, count++) = *q;
   }
+  sc_array_resize (quadrants, count);
 }
 
-void
-p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
-               p4est_init_t init_fn)
+/** Replace the first balance pass by examining the logged changes.
+ * Only the changed leaves and the leaves that contain a changed leaf in
+ * their insulation layer can be forced to split, since the forest has
+ * been balanced before the changes.  These candidates are identified by
+ * marking the insulation quadrants of the changed leaves' ancestors and
+ * treated like border quadrants without a local subtree pass.
+ */
+static void
+p4est_balance_incremental_first (p4est_balance_context_t *ctx)
 {
-  p4est_balance_ext (p4est, btype, init_fn, NULL);
+  p4est_t            *p4est = ctx->p4est;
+  const p4est_topidx_t first_tree = p4est->first_local_tree;
+  int                 level;
+  int                 full_tree[2], tree_contact[P4EST_FACES];
+  size_t              zz, iz;
+  ssize_t             lb;
+  p4est_topidx_t      nt;
+  p4est_quadrant_t   *r, *d, *s;
+  p4est_quadrant_t    done[P4EST_QMAXLEVEL + 1];
+  p4est_tree_t       *tree;
+  sc_array_t         *regions = &p4est->balance_log->regions;
+  sc_array_t         *tquadrants, *qarray;
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p4est->mpisize;
+  int                 mpiret;
+  int                 j, k, rcount;
+  int                 num_receivers, num_senders;
+  int                *receivers, *senders;
+  sc_MPI_Request     *requests;
+  sc_MPI_Status       status;
+  sc_array_t          recv;
+#endif
+
+  /* sort the changed regions and drop those contained in others */
+  p4est_quadrant_array_sort (regions, 1);
+  for (iz = zz = 0; zz < regions->elem_count; ++zz) {
+    r = p4est_quadrant_array_index (regions, zz);
+    if (iz > 0) {
+      s = p4est_quadrant_array_index (regions, iz - 1);
+      if (s->p.which_tree == r->p.which_tree &&
+          (p4est_quadrant_is_equal (s, r) ||
+           p4est_quadrant_is_ancestor (s, r))) {
+        continue;
+      }
+    }
+    *p4est_quadrant_array_index (regions, iz++) = *r;
+  }
+  sc_array_resize (regions, iz);
+
+  /* the changed leaves and the insulation layers of their ancestors */
+  nt = -1;
+  tquadrants = NULL;
+  for (zz = 0; zz < regions->elem_count; ++zz) {
+    r = p4est_quadrant_array_index (regions, zz);
+    if (r->p.which_tree != nt) {
+      nt = r->p.which_tree;
+      P4EST_ASSERT (first_tree <= nt && nt <= p4est->last_local_tree);
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      tquadrants = &tree->quadrants;
+      p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
+      for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+        done[level].level = -1;
+      }
+    }
+
+    /* find the leaves inside the region or the one containing it */
+    lb = p4est_find_lower_bound (tquadrants, r, 0);
+    iz = lb < 0 ? tquadrants->elem_count : (size_t) lb;
+    if (iz > 0 && p4est_quadrant_is_ancestor
+        (p4est_quadrant_array_index (tquadrants, iz - 1), r)) {
+      --iz;
+    }
+    for (; iz < tquadrants->elem_count; ++iz) {
+      d = p4est_quadrant_array_index (tquadrants, iz);
+      if (!p4est_quadrant_is_equal (r, d) &&
+          !p4est_quadrant_is_ancestor (r, d) &&
+          !p4est_quadrant_is_ancestor (d, r)) {
+        break;
+      }
+      s = p4est_quadrant_array_push_copy (&ctx->candidates, d);
+      s->p.piggy2.which_tree = nt;
+
+      /* a leaf is only forced by quadrants at least two levels finer */
+      for (level = (int) d->level - 2; level >= 0; --level) {
+        if (done[level].level == level &&
+            p4est_quadrant_is_ancestor (&done[level], d)) {
+          /* this and all coarser ancestors have been visited */
+          break;
+        }
+        p4est_quadrant_ancestor (d, level, &done[level]);
+        p4est_balance_insulation (ctx, nt, tree_contact, &done[level], 1);
+      }
+    }
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* send the marks to the owners of the insulation quadrants */
+  receivers = P4EST_ALLOC (int, num_procs);
+  senders = P4EST_ALLOC (int, num_procs);
+  num_receivers = 0;
+  for (j = 0; j < num_procs; ++j) {
+    if (ctx->marks[j].elem_count > 0) {
+      receivers[num_receivers++] = j;
+    }
+  }
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  requests = P4EST_ALLOC (sc_MPI_Request, num_receivers);
+  for (k = 0; k < num_receivers; ++k) {
+    j = receivers[k];
+    qarray = &ctx->marks[j];
+    p4est_balance_uniqify (qarray);
+    mpiret = sc_MPI_Isend (qarray->array, (int) (qarray->elem_count *
+                                                 sizeof (p4est_quadrant_t)),
+                           sc_MPI_BYTE, j, P4EST_COMM_BALANCE_MARK,
+                           p4est->mpicomm, &requests[k]);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* receive marks in any order and look them up */
+  sc_array_init (&recv, sizeof (p4est_quadrant_t));
+  for (k = 0; k < num_senders; ++k) {
+    mpiret = sc_MPI_Probe (sc_MPI_ANY_SOURCE, P4EST_COMM_BALANCE_MARK,
+                           p4est->mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    mpiret = sc_MPI_Get_count (&status, sc_MPI_BYTE, &rcount);
+    SC_CHECK_MPI (mpiret);
+    SC_CHECK_ABORTF (rcount % (int) sizeof (p4est_quadrant_t) == 0,
+                     "Receive mark mismatch %d", rcount);
+    sc_array_resize (&recv, (size_t) rcount / sizeof (p4est_quadrant_t));
+    mpiret = sc_MPI_Recv (recv.array, rcount, sc_MPI_BYTE,
+                          status.MPI_SOURCE, P4EST_COMM_BALANCE_MARK,
+                          p4est->mpicomm, sc_MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    for (zz = 0; zz < recv.elem_count; ++zz) {
+      s = p4est_quadrant_array_index (&recv, zz);
+      p4est_balance_candidate (ctx, s->p.piggy2.which_tree, s);
+    }
+  }
+  sc_array_reset (&recv);
+  mpiret = sc_MPI_Waitall (num_receivers, requests, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (requests);
+  P4EST_FREE (receivers);
+  P4EST_FREE (senders);
+#endif /* P4EST_ENABLE_MPI */
+
+  /* schedule the candidates like border quadrants */
+  p4est_balance_uniqify (&ctx->candidates);
+  P4EST_VERBOSEF ("Balance incremental regions %llu candidates %llu\n",
+                  (unsigned long long) regions->elem_count,
+                  (unsigned long long) ctx->candidates.elem_count);
+  nt = -1;
+  qarray = NULL;
+  for (zz = 0; zz < ctx->candidates.elem_count; ++zz) {
+    d = p4est_quadrant_array_index (&ctx->candidates, zz);
+    if (d->p.piggy2.which_tree != nt) {
+      nt = d->p.piggy2.which_tree;
+      p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
+      qarray = (sc_array_t *)
+        sc_array_index (ctx->borders, (size_t) (nt - first_tree));
+    }
+    (void) p4est_quadrant_array_push_copy (qarray, d);
+    p4est_balance_insulation (ctx, nt, tree_contact, d, 0);
+  }
+  ctx->all_incount = (size_t) p4est->local_num_quadrants;
 }
 
-void
-p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
-                   p4est_init_t init_fn, p4est_replace_t replace_fn)
+#ifdef P4EST_ENABLE_MPI
+
+/** Process first round messages that have arrived.
+ * Incoming quadrant counts trigger the receive of their load, and each
+ * completed load is answered by the second round of sending.
+ * \param [in] blocking    If true, wait for at least one message.
+ */
+static void
+p4est_balance_first_round (p4est_balance_context_t *ctx, int blocking)
 {
+  p4est_t            *p4est = ctx->p4est;
   const int           rank = p4est->mpirank;
   const int           num_procs = p4est->mpisize;
-  int                 j, k, l, m, which;
-  int                 face;
-  int                 first_peer, last_peer;
-  int                 quad_contact[P4EST_FACES];
-  int                 any_face, tree_contact[P4EST_FACES];
-  int                 tree_fully_owned, full_tree[2];
-  int8_t             *tree_flags;
-  size_t              zz, treecount, ctree;
-  size_t              localcount;
+  int                 i, j;
+  int                 mpiret, rcount, outcount;
   size_t              qcount, qbytes;
-  size_t              all_incount, all_outcount;
-  p4est_qcoord_t      qh;
-  const p4est_qcoord_t rh = P4EST_ROOT_LEN;
-  p4est_topidx_t      qtree, nt;
-  p4est_topidx_t      first_tree, last_tree;
-  p4est_locidx_t      skipped;
-  p4est_gloidx_t      old_gnq;
-  p4est_balance_peer_t *peers, *peer;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t    mylow, nextlow;
-  p4est_quadrant_t    tosend, insulq, tempq;
-  p4est_quadrant_t   *q, *s;
-  p4est_connectivity_t *conn = p4est->connectivity;
-  sc_array_t         *qarray, *tquadrants;
-  sc_array_t         *borders;
+  p4est_balance_peer_t *peer;
+  MPI_Status         *jstatus;
 #ifdef P4EST_ENABLE_DEBUG
-  size_t              data_pool_size;
-#endif
-  int                 ftransform[P4EST_FTRANSFORM];
-  int                 face_axis[3];     /* 3 not P4EST_DIM */
-  int                 contact_face_only;
-#ifdef P4_TO_P8
-  int                 contact_edge_only;
-  int                 edge;
-  size_t              etree;
-  p8est_edge_info_t   ei;
-  p8est_edge_transform_t *et;
-  sc_array_t         *eta;
+  unsigned            checksum;
 #endif
-  int                 corner;
-  p4est_corner_info_t ci;
-  p4est_corner_transform_t *ct;
-  sc_array_t         *cta;
+
+  if (blocking) {
+    mpiret = sc_MPI_Waitsome (num_procs, ctx->requests_first,
+                              &outcount, ctx->wait_indices,
+                              ctx->recv_statuses);
+  }
+  else {
+    mpiret = MPI_Testsome (num_procs, ctx->requests_first,
+                           &outcount, ctx->wait_indices, ctx->recv_statuses);
+  }
+  SC_CHECK_MPI (mpiret);
+  P4EST_ASSERT (outcount != MPI_UNDEFINED);
+  P4EST_ASSERT (!blocking || outcount > 0);
+  for (i = 0; i < outcount; ++i) {
+    /* retrieve sender's rank */
+    j = ctx->wait_indices[i];
+    jstatus = &ctx->recv_statuses[i];
+    ctx->wait_indices[i] = -1;
+    P4EST_ASSERT (j != rank && 0 <= j && j < num_procs);
+    P4EST_ASSERT (ctx->requests_first[j] == MPI_REQUEST_NULL);
+    P4EST_ASSERT (jstatus->MPI_SOURCE == j);
+
+    /* check if we are in receiving count or load */
+    peer = ctx->peers + j;
+    P4EST_ASSERT (!peer->have_first_load);
+    if (!peer->have_first_count) {
+      /* verify message size */
+      P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_COUNT);
+      mpiret = sc_MPI_Get_count (jstatus, MPI_INT, &rcount);
+      SC_CHECK_MPI (mpiret);
+      SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch A %d", rcount);
+
+      /* process the count information received */
+      peer->have_first_count = 1;
+      qcount = (size_t) peer->recv_first_count;
+      if (qcount > 0) {
+        /* received nonzero count, post receive for load */
+        P4EST_LDEBUGF ("Balance A recv %llu quadrants from %d\n",
+                       (unsigned long long) qcount, j);
+        P4EST_ASSERT (peer->recv_first.elem_count == 0);
+        sc_array_resize (&peer->recv_first, qcount);
+        ctx->total_recv_count += qcount;
+        qbytes = qcount * sizeof (p4est_quadrant_t);
+        P4EST_ASSERT (ctx->requests_first[j] == MPI_REQUEST_NULL);
+        mpiret = MPI_Irecv (peer->recv_first.array, (int) qbytes, MPI_BYTE,
+                            j, P4EST_COMM_BALANCE_FIRST_LOAD,
+                            p4est->mpicomm, &ctx->requests_first[j]);
+        SC_CHECK_MPI (mpiret);
+        ++ctx->recv_load[0];
+      }
+      else {
+        /* will not receive load, close this request */
+        P4EST_ASSERT (qcount == 0);
+        P4EST_ASSERT (ctx->requests_first[j] == MPI_REQUEST_NULL);
+        --ctx->request_first_count;
+        ++ctx->recv_zero[0];
+      }
+    }
+    else {
+      /* verify received size */
+      P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_LOAD);
+      P4EST_ASSERT (peer->recv_first_count > 0);
+      mpiret = sc_MPI_Get_count (jstatus, MPI_BYTE, &rcount);
+      SC_CHECK_MPI (mpiret);
+      SC_CHECK_ABORTF (rcount ==
+                       peer->recv_first_count *
+                       (int) sizeof (p4est_quadrant_t),
+                       "Receive load mismatch A %d %dx%llu", rcount,
+                       peer->recv_first_count,
+                       (unsigned long long) sizeof (p4est_quadrant_t));
+
+      /* received load, close this request */
+      peer->have_first_load = 1;
+      P4EST_ASSERT (ctx->requests_first[j] == MPI_REQUEST_NULL);
+      --ctx->request_first_count;
+
+#ifdef P4EST_ENABLE_DEBUG
+      checksum =
+        p4est_quadrant_checksum (&peer->recv_first, &ctx->checkarray, 0);
+      P4EST_LDEBUGF ("Balance A recv checksum 0x%08x from %d\n", checksum,
+                     j);
+#endif /* P4EST_ENABLE_DEBUG */
+
+      /* process incoming quadrants to interleave with communication */
+      p4est_balance_response (p4est, peer, ctx->btype,
+                              ctx->incremental ? NULL : ctx->borders);
+      qcount = peer->send_second.elem_count;
+      if (qcount > 0) {
+        P4EST_LDEBUGF ("Balance B send %llu quadrants to %d\n",
+                       (unsigned long long) qcount, j);
+        ++ctx->send_load[1];
+      }
+      else {
+        ++ctx->send_zero[1];
+      }
+      peer->send_second_count = (int) qcount;
+      mpiret = MPI_Isend (&peer->send_second_count, 1, MPI_INT,
+                          j, P4EST_COMM_BALANCE_SECOND_COUNT,
+                          p4est->mpicomm,
+                          &ctx->send_requests_second_count[j]);
+      SC_CHECK_MPI (mpiret);
+      ++ctx->request_send_count;
+      if (qcount > 0) {
+
+#ifdef P4EST_ENABLE_DEBUG
+        checksum =
+          p4est_quadrant_checksum (&peer->send_second, &ctx->checkarray, 0);
+        P4EST_LDEBUGF ("Balance B send checksum 0x%08x to %d\n", checksum,
+                       j);
+#endif /* P4EST_ENABLE_DEBUG */
+
+        ctx->total_send_count += qcount;
+        qbytes = qcount * sizeof (p4est_quadrant_t);
+        mpiret = MPI_Isend (peer->send_second.array, (int) qbytes, MPI_BYTE,
+                            j, P4EST_COMM_BALANCE_SECOND_LOAD,
+                            p4est->mpicomm,
+                            &ctx->send_requests_second_load[j]);
+        SC_CHECK_MPI (mpiret);
+        ++ctx->request_send_count;
+      }
+    }
+  }
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+p4est_balance_context_t *
+p4est_balance_begin (p4est_t * p4est, p4est_connect_type_t btype,
+                     p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 j, k;
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_balance_peer_t *peers, *peer;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  sc_array_t         *qarray;
+  p4est_balance_context_t *ctx;
 #ifdef P4EST_ENABLE_MPI
 #ifdef P4EST_ENABLE_DEBUG
   unsigned            checksum;
-  sc_array_t          checkarray;
-  p4est_gloidx_t      ltotal[2], gtotal[2];
 #endif /* P4EST_ENABLE_DEBUG */
-  int                 i;
-  int                 mpiret, rcount;
+  const int           rank = p4est->mpirank;
+  int                 i, l;
+  int                 mpiret;
   int                 first_bound;
-  int                 request_first_count, request_second_count, outcount;
-  int                 request_send_count, total_send_count, total_recv_count;
   int                 nwin, maxpeers, maxwin, twomaxwin;
-  int                 send_zero[2], send_load[2];
-  int                 recv_zero[2], recv_load[2];
   int                 my_ranges[2 * p4est_num_ranges];
-  int                *wait_indices;
   int                *procs, *all_ranges;
   int                *receiver_ranks, *sender_ranks;
   int                 num_receivers, num_senders;
@@ -1320,10 +2990,9 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   int                 is_ranges_primary, is_balance_verify;
   int                 is_ranges_active, is_notify_active;
   int                 max_ranges;
+  size_t              qcount, qbytes;
   MPI_Request        *requests_first, *requests_second;
   MPI_Request        *send_requests_first_count, *send_requests_first_load;
-  MPI_Request        *send_requests_second_count, *send_requests_second_load;
-  MPI_Status         *recv_statuses, *jstatus;
 #endif /* P4EST_ENABLE_MPI */
 
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
@@ -1339,33 +3008,33 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
                 btype == P8EST_CONNECT_CORNER);
 #endif
 
+  ctx = P4EST_ALLOC_ZERO (p4est_balance_context_t, 1);
+  ctx->p4est = p4est;
+  ctx->btype = btype;
+  ctx->init_fn = init_fn;
+  ctx->replace_fn = replace_fn;
+
   /* remember input quadrant count; it will not decrease */
-  old_gnq = p4est->global_num_quadrants;
+  ctx->old_gnq = p4est->global_num_quadrants;
 
 #ifdef P4EST_ENABLE_DEBUG
-  data_pool_size = 0;
+  ctx->data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
-    data_pool_size = p4est->user_data_pool->elem_count;
+    ctx->data_pool_size = p4est->user_data_pool->elem_count;
   }
 #endif
 
-  P4EST_QUADRANT_INIT (&mylow);
-  P4EST_QUADRANT_INIT (&nextlow);
-  P4EST_QUADRANT_INIT (&tosend);
-  P4EST_QUADRANT_INIT (&insulq);
-  P4EST_QUADRANT_INIT (&tempq);
-
   /* tree status flags (max 8 per tree) */
-  tree_flags = P4EST_ALLOC (int8_t, conn->num_trees);
+  ctx->tree_flags = P4EST_ALLOC (int8_t, conn->num_trees);
   for (nt = 0; nt < conn->num_trees; ++nt) {
-    tree_flags[nt] = 0x00;
+    ctx->tree_flags[nt] = 0x00;
   }
 
-  localcount = (size_t) (p4est->last_local_tree + 1 -
-                         p4est->first_local_tree);
-  borders = sc_array_new_size (sizeof (sc_array_t), localcount);
-  for (zz = 0; zz < localcount; zz++) {
-    qarray = (sc_array_t *) sc_array_index (borders, zz);
+  ctx->localcount = (size_t) (p4est->last_local_tree + 1 -
+                              p4est->first_local_tree);
+  ctx->borders = sc_array_new_size (sizeof (sc_array_t), ctx->localcount);
+  for (zz = 0; zz < ctx->localcount; zz++) {
+    qarray = (sc_array_t *) sc_array_index (ctx->borders, zz);
     sc_array_init (qarray, sizeof (p4est_quadrant_t));
   }
 
@@ -1374,24 +3043,24 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   requests_second = requests_first + 1 * num_procs;
   send_requests_first_count = requests_first + 2 * num_procs;
   send_requests_first_load = requests_first + 3 * num_procs;
-  send_requests_second_count = requests_first + 4 * num_procs;
-  send_requests_second_load = requests_first + 5 * num_procs;
-  recv_statuses = P4EST_ALLOC (MPI_Status, num_procs);
-  for (j = 0; j < num_procs; ++j) {
-    requests_first[j] = requests_second[j] = MPI_REQUEST_NULL;
-    send_requests_first_count[j] = MPI_REQUEST_NULL;
-    send_requests_first_load[j] = MPI_REQUEST_NULL;
-    send_requests_second_count[j] = MPI_REQUEST_NULL;
-    send_requests_second_load[j] = MPI_REQUEST_NULL;
+  ctx->send_requests_second_count = requests_first + 4 * num_procs;
+  ctx->send_requests_second_load = requests_first + 5 * num_procs;
+  ctx->requests_first = requests_first;
+  ctx->requests_second = requests_second;
+  ctx->send_requests_first_count = send_requests_first_count;
+  ctx->send_requests_first_load = send_requests_first_load;
+  ctx->recv_statuses = P4EST_ALLOC (MPI_Status, num_procs);
+  for (j = 0; j < 6 * num_procs; ++j) {
+    requests_first[j] = MPI_REQUEST_NULL;
   }
-  wait_indices = P4EST_ALLOC (int, num_procs);
+  ctx->wait_indices = P4EST_ALLOC (int, num_procs);
 #ifdef P4EST_ENABLE_DEBUG
-  sc_array_init (&checkarray, 4);
+  sc_array_init (&ctx->checkarray, 4);
 #endif /* P4EST_ENABLE_DEBUG */
 #endif /* P4EST_ENABLE_MPI */
 
   /* allocate per peer storage and initialize requests */
-  peers = P4EST_ALLOC (p4est_balance_peer_t, num_procs);
+  ctx->peers = peers = P4EST_ALLOC (p4est_balance_peer_t, num_procs);
   for (j = 0; j < num_procs; ++j) {
     peer = peers + j;
     sc_array_init (&peer->send_first, sizeof (p4est_quadrant_t));
@@ -1404,257 +3073,43 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     peer->have_second_count = peer->have_second_load = 0;
   }
 #ifdef P4_TO_P8
-  eta = &ei.edge_transforms;
-  sc_array_init (eta, sizeof (p8est_edge_transform_t));
-#endif
-  cta = &ci.corner_transforms;
-  sc_array_init (cta, sizeof (p4est_corner_transform_t));
-
-  /* compute first quadrant on finest level */
-  mylow.x = p4est->global_first_position[rank].x;
-  mylow.y = p4est->global_first_position[rank].y;
-#ifdef P4_TO_P8
-  mylow.z = p4est->global_first_position[rank].z;
+  sc_array_init (&ctx->ei.edge_transforms, sizeof (p8est_edge_transform_t));
 #endif
-  mylow.level = P4EST_QMAXLEVEL;
+  sc_array_init (&ctx->ci.corner_transforms,
+                 sizeof (p4est_corner_transform_t));
 
-  /* and the first finest quadrant of the next processor */
-  nextlow.x = p4est->global_first_position[rank + 1].x;
-  nextlow.y = p4est->global_first_position[rank + 1].y;
-#ifdef P4_TO_P8
-  nextlow.z = p4est->global_first_position[rank + 1].z;
-#endif
-  nextlow.level = P4EST_QMAXLEVEL;
+  /* the logged changes since the last balance may suffice */
+  ctx->incremental = p4est_balance_log_usable (p4est, btype);
+  sc_array_init (&ctx->candidates, sizeof (p4est_quadrant_t));
+  ctx->marks = P4EST_ALLOC (sc_array_t, num_procs);
+  for (j = 0; j < num_procs; ++j) {
+    sc_array_init (&ctx->marks[j], sizeof (p4est_quadrant_t));
+  }
 
   /* start balance_A timing */
   if (p4est->inspect != NULL) {
     p4est->inspect->balance_A = -sc_MPI_Wtime ();
-    p4est->inspect->balance_A_count_in = 0;
-    p4est->inspect->balance_A_count_out = 0;
-    p4est->inspect->use_B = 0;
-  }
-
-  /* loop over all local trees to assemble first send list */
-  first_tree = p4est->first_local_tree;
-  last_tree = p4est->last_local_tree;
-  first_peer = num_procs;
-  last_peer = -1;
-  all_incount = 0;
-  skipped = 0;
-  for (nt = first_tree; nt <= last_tree; ++nt) {
-    p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
-    tree_fully_owned = full_tree[0] && full_tree[1];
-    any_face = 0;
-    for (face = 0; face < P4EST_FACES; ++face) {
-      any_face = any_face || tree_contact[face];
-    }
-    if (any_face) {
-      tree_flags[nt] |= any_face_flag;
-    }
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    tquadrants = &tree->quadrants;
-    all_incount += tquadrants->elem_count;
-
-    /* initial log message for this tree */
-    P4EST_VERBOSEF ("Into balance tree %lld with %llu\n", (long long) nt,
-                    (unsigned long long) tquadrants->elem_count);
-
-    /* local balance first pass */
-    p4est_balance_subtree_ext (p4est, btype, nt, init_fn, replace_fn);
-    treecount = tquadrants->elem_count;
-    P4EST_VERBOSEF ("Balance tree %lld A %llu\n",
-                    (long long) nt, (unsigned long long) treecount);
-
-    /* check if this tree is not shared with other processors */
-    if (tree_fully_owned) {
-      /* all quadrants in this tree are owned by me */
-      tree_flags[nt] |= fully_owned_flag;
-      if (!any_face) {
-        /* this tree is isolated, no balance between trees */
-        continue;
-      }
-    }
-
-    if (borders != NULL) {
-      qarray = (sc_array_t *) sc_array_index (borders,
-                                              (size_t) (nt - first_tree));
-    }
-    else {
-      qarray = NULL;
-    }
-
-    /* identify boundary quadrants and prepare them to be sent */
-    for (zz = 0; zz < treecount; ++zz) {
-      /* this quadrant may be on the boundary with a range of processors */
-      q = p4est_quadrant_array_index (tquadrants, zz);
-      qh = P4EST_QUADRANT_LEN (q->level);
-      if (p4est_comm_neighborhood_owned (p4est, nt,
-                                         full_tree, tree_contact, q)) {
-        /* this quadrant's 3x3 neighborhood is owned by this processor */
-        ++skipped;
-        continue;
-      }
-
-      if (qarray != NULL) {
-        (void) p4est_quadrant_array_push_copy (qarray, q);
-      }
-
-#ifdef P4_TO_P8
-      for (m = 0; m < 3; ++m) {
-#if 0
-      }
-#endif
-#else
-      m = 0;
-#endif
-      for (k = 0; k < 3; ++k) {
-        for (l = 0; l < 3; ++l) {
-          which = m * 9 + k * 3 + l;    /* 2D: 0..8, 3D: 0..26 */
-          /* exclude myself from the queries */
-          if (which == P4EST_INSUL / 2) {
-            continue;
-          }
-          /* may modify insulq below, never modify q itself! */
-          insulq = *q;
-          insulq.x += (l - 1) * qh;
-          insulq.y += (k - 1) * qh;
-#ifdef P4_TO_P8
-          insulq.z += (m - 1) * qh;
-#endif
-          /* check boundary status of insulation quadrant */
-          quad_contact[0] = (insulq.x < 0);
-          quad_contact[1] = (insulq.x >= rh);
-          face_axis[0] = quad_contact[0] || quad_contact[1];
-          quad_contact[2] = (insulq.y < 0);
-          quad_contact[3] = (insulq.y >= rh);
-          face_axis[1] = quad_contact[2] || quad_contact[3];
-#ifndef P4_TO_P8
-          face_axis[2] = 0;
-#else
-          quad_contact[4] = (insulq.z < 0);
-          quad_contact[5] = (insulq.z >= rh);
-          face_axis[2] = quad_contact[4] || quad_contact[5];
-          edge = -1;
-          contact_edge_only = 0;
-#endif
-          contact_face_only = 0;
-          face = -1;
-          if (face_axis[0] || face_axis[1] || face_axis[2]) {
-            /* this quadrant is relevant for inter-tree balancing */
-            if (!face_axis[1] && !face_axis[2]) {
-              contact_face_only = 1;
-              face = 0 + quad_contact[1];
-            }
-            else if (!face_axis[0] && !face_axis[2]) {
-              contact_face_only = 1;
-              face = 2 + quad_contact[3];
-            }
-#ifdef P4_TO_P8
-            else if (!face_axis[0] && !face_axis[1]) {
-              contact_face_only = 1;
-              face = 4 + quad_contact[5];
-            }
-            else if (!face_axis[0]) {
-              contact_edge_only = 1;
-              edge = 0 + 2 * quad_contact[5] + quad_contact[3];
-            }
-            else if (!face_axis[1]) {
-              contact_edge_only = 1;
-              edge = 4 + 2 * quad_contact[5] + quad_contact[1];
-            }
-            else if (!face_axis[2]) {
-              contact_edge_only = 1;
-              edge = 8 + 2 * quad_contact[3] + quad_contact[1];
-            }
-#endif
-            if (contact_face_only) {
-              /* square contact across a face */
-#ifdef P4_TO_P8
-              P4EST_ASSERT (!contact_edge_only);
-#endif
-              P4EST_ASSERT (face >= 0 && face < P4EST_FACES);
-              P4EST_ASSERT (quad_contact[face]);
-              qtree = p4est_find_face_transform (conn, nt, face, ftransform);
-              if (qtree >= 0) {
-                P4EST_ASSERT (tree_contact[face]);
-                p4est_quadrant_transform_face (q, &tosend, ftransform);
-                tosend.p.piggy2.from_tree = nt;
-                tosend.pad16 = face;
-                p4est_quadrant_transform_face (&insulq, &tempq, ftransform);
-                p4est_balance_schedule (p4est, peers, qtree, 1,
-                                        &tosend, &tempq,
-                                        &first_peer, &last_peer);
-              }
-              else {
-                /* goes across a face with no neighbor */
-                P4EST_ASSERT (!tree_contact[face]);
-              }
-            }
-#ifdef P4_TO_P8
-            else if (contact_edge_only) {
-              /* this quadrant crosses an edge */
-              P4EST_ASSERT (!contact_face_only);
-              P4EST_ASSERT (edge >= 0 && edge < P8EST_EDGES);
-              p8est_find_edge_transform (conn, nt, edge, &ei);
-              for (etree = 0; etree < eta->elem_count; ++etree) {
-                et = p8est_edge_array_index (eta, etree);
-                p8est_quadrant_transform_edge (q, &tosend, &ei, et, 0);
-                tosend.p.piggy2.from_tree = nt;
-                tosend.pad16 = edge;
-                p8est_quadrant_transform_edge (&insulq, &tempq, &ei, et, 1);
-                p4est_balance_schedule (p4est, peers, et->ntree, 1,
-                                        &tosend, &tempq,
-                                        &first_peer, &last_peer);
-              }
-            }
-#endif
-            else {
-              /* this quadrant crosses a corner */
-              P4EST_ASSERT (face_axis[0] && face_axis[1]);
-              corner = quad_contact[1] + 2 * quad_contact[3];
-#ifdef P4_TO_P8
-              P4EST_ASSERT (face_axis[2]);
-              corner += 4 * quad_contact[5];
-#endif
-              P4EST_ASSERT (p4est_quadrant_touches_corner (q, corner, 1));
-              P4EST_ASSERT (p4est_quadrant_touches_corner
-                            (&insulq, corner, 0));
-              p4est_find_corner_transform (conn, nt, corner, &ci);
-              for (ctree = 0; ctree < cta->elem_count; ++ctree) {
-                ct = p4est_corner_array_index (cta, ctree);
-                tosend = *q;
-                p4est_quadrant_transform_corner (&tosend, (int) ct->ncorner,
-                                                 0);
-                tosend.p.piggy2.from_tree = nt;
-                tosend.pad16 = corner;
-                tempq = insulq;
-                p4est_quadrant_transform_corner (&tempq, (int) ct->ncorner,
-                                                 1);
-                p4est_balance_schedule (p4est, peers, ct->ntree, 1,
-                                        &tosend, &tempq, &first_peer,
-                                        &last_peer);
-              }
-            }
-          }
-          else {
-            /* no inter-tree contact */
-            tosend = *q;
-            tosend.p.piggy2.from_tree = nt;
-            tosend.pad16 = -1;
-            p4est_balance_schedule (p4est, peers, nt, 0,
-                                    &tosend, &insulq, &first_peer,
-                                    &last_peer);
-          }
-        }
-      }
-#ifdef P4_TO_P8
-#if 0
-      {
-#endif
+    p4est->inspect->balance_A_count_in = 0;
+    p4est->inspect->balance_A_count_out = 0;
+    p4est->inspect->use_B = 0;
+  }
+
+  /* loop over all local trees that communicate to assemble send lists */
+  ctx->first_peer = num_procs;
+  ctx->last_peer = -1;
+  if (ctx->incremental) {
+    P4EST_GLOBAL_INFO ("Balance incremental\n");
+    p4est_balance_incremental_first (ctx);
+  }
+  else {
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      if (p4est_balance_tree_interior (ctx, nt)) {
+        /* the first pass of this tree is deferred to the end call */
+        ctx->tree_flags[nt] |= interior_flag;
+        continue;
       }
-#endif
+      p4est_balance_tree_first (ctx, nt);
     }
-    tquadrants = NULL;          /* safeguard */
   }
 
   /* end balance_A, start balance_comm */
@@ -1706,8 +3161,8 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     for (j = 0; j < num_procs; ++j) {
       procs[j] = (int) peers[j].send_first.elem_count;
     }
-    maxpeers = first_peer;
-    maxwin = last_peer;
+    maxpeers = ctx->first_peer;
+    maxwin = ctx->last_peer;
     max_ranges = p4est_num_ranges;
     if (p4est->inspect != NULL) {
       if (p4est->inspect->balance_max_ranges > 0 &&
@@ -1748,7 +3203,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
       /* original verification loop modified and partially redundant */
       k = 0;
-      for (j = first_peer; j <= last_peer; ++j) {
+      for (j = ctx->first_peer; j <= ctx->last_peer; ++j) {
         if (j == rank) {
           P4EST_ASSERT (k == num_receivers_ranges ||
                         receiver_ranks_ranges[k] != j);
@@ -1810,7 +3265,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     SC_FREE (all_ranges);
     P4EST_FREE (procs);
     P4EST_VERBOSEF ("Peer ranges %d/%d/%d first %d last %d\n",
-                    nwin, maxwin, max_ranges, first_peer, last_peer);
+                    nwin, maxwin, max_ranges, ctx->first_peer, ctx->last_peer);
   }
 
   /* determine asymmetric communication pattern by sc_notify function */
@@ -1918,10 +3373,13 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
    * loop over all peers and send first round of quadrants
    * for intra-tree balancing, each load is contained in one tree
    */
-  total_send_count = total_recv_count = 0;
-  request_first_count = request_second_count = request_send_count = 0;
-  send_zero[0] = send_load[0] = recv_zero[0] = recv_load[0] = 0;
-  send_zero[1] = send_load[1] = recv_zero[1] = recv_load[1] = 0;
+  ctx->total_send_count = ctx->total_recv_count = 0;
+  ctx->request_first_count = ctx->request_second_count = 0;
+  ctx->request_send_count = 0;
+  ctx->send_zero[0] = ctx->send_load[0] = 0;
+  ctx->recv_zero[0] = ctx->recv_load[0] = 0;
+  ctx->send_zero[1] = ctx->send_load[1] = 0;
+  ctx->recv_zero[1] = ctx->recv_load[1] = 0;
   if (is_ranges_primary) {
     P4EST_ASSERT (is_ranges_active);
     receiver_ranks = receiver_ranks_ranges;
@@ -1943,7 +3401,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   /* Use receiver_ranks array to send to them */
   for (k = 0; k < num_receivers; ++k) {
     j = receiver_ranks[k];
-    P4EST_ASSERT (j >= first_peer && j <= last_peer && j != rank);
+    P4EST_ASSERT (j >= ctx->first_peer && j <= ctx->last_peer && j != rank);
     peer = peers + j;
     qcount = peer->send_first.elem_count;
 
@@ -1951,40 +3409,41 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     if (qcount > 0) {
       P4EST_LDEBUGF ("Balance A send %llu quadrants to %d\n",
                      (unsigned long long) qcount, j);
-      ++send_load[0];
+      ++ctx->send_load[0];
     }
     else {
       P4EST_ASSERT (is_ranges_primary);
-      ++send_zero[0];
+      ++ctx->send_zero[0];
     }
     peer->send_first_count = (int) qcount;
     mpiret = MPI_Isend (&peer->send_first_count, 1, MPI_INT,
                         j, P4EST_COMM_BALANCE_FIRST_COUNT,
                         p4est->mpicomm, &send_requests_first_count[j]);
     SC_CHECK_MPI (mpiret);
-    ++request_send_count;
+    ++ctx->request_send_count;
 
     /* sort and send the actual quadrants and post receive for reply */
     if (qcount > 0) {
-      sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort (&peer->send_first, 1);
 
 #ifdef P4EST_ENABLE_DEBUG
-      checksum = p4est_quadrant_checksum (&peer->send_first, &checkarray, 0);
+      checksum =
+        p4est_quadrant_checksum (&peer->send_first, &ctx->checkarray, 0);
       P4EST_LDEBUGF ("Balance A send checksum 0x%08x to %d\n", checksum, j);
 #endif /* P4EST_ENABLE_DEBUG */
 
-      total_send_count += qcount;
+      ctx->total_send_count += qcount;
       qbytes = qcount * sizeof (p4est_quadrant_t);
       mpiret = MPI_Isend (peer->send_first.array, (int) qbytes, MPI_BYTE,
                           j, P4EST_COMM_BALANCE_FIRST_LOAD,
                           p4est->mpicomm, &send_requests_first_load[j]);
       SC_CHECK_MPI (mpiret);
-      ++request_send_count;
+      ++ctx->request_send_count;
       mpiret = MPI_Irecv (&peer->recv_second_count, 1, MPI_INT,
                           j, P4EST_COMM_BALANCE_SECOND_COUNT,
                           p4est->mpicomm, &requests_second[j]);
       SC_CHECK_MPI (mpiret);
-      ++request_second_count;
+      ++ctx->request_second_count;
     }
   }
   peer = NULL;
@@ -1995,7 +3454,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   /* find out who is sending to me and receive quadrant counts */
   for (k = 0; k < num_senders; ++k) {
     j = sender_ranks[k];
-    ++request_first_count;
+    ++ctx->request_first_count;
     mpiret = MPI_Irecv (&peers[j].recv_first_count, 1, MPI_INT,
                         j, P4EST_COMM_BALANCE_FIRST_COUNT,
                         p4est->mpicomm, &requests_first[j]);
@@ -2004,136 +3463,87 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   P4EST_FREE (sender_ranks_ranges);
   P4EST_FREE (sender_ranks_notify);
   sender_ranks = sender_ranks_ranges = sender_ranks_notify = NULL;
+#endif /* P4EST_ENABLE_MPI */
 
-  /* wait for quadrant counts and post receive and send for quadrants */
-  while (request_first_count > 0) {
-    mpiret = sc_MPI_Waitsome (num_procs, requests_first,
-                              &outcount, wait_indices, recv_statuses);
-    SC_CHECK_MPI (mpiret);
-    P4EST_ASSERT (outcount != MPI_UNDEFINED);
-    P4EST_ASSERT (outcount > 0);
-    for (i = 0; i < outcount; ++i) {
-      /* retrieve sender's rank */
-      j = wait_indices[i];
-      jstatus = &recv_statuses[i];
-      wait_indices[i] = -1;
-      P4EST_ASSERT (j != rank && 0 <= j && j < num_procs);
-      P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-      P4EST_ASSERT (jstatus->MPI_SOURCE == j);
-
-      /* check if we are in receiving count or load */
-      peer = peers + j;
-      P4EST_ASSERT (!peer->have_first_load);
-      if (!peer->have_first_count) {
-        /* verify message size */
-        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_COUNT);
-        mpiret = sc_MPI_Get_count (jstatus, MPI_INT, &rcount);
-        SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount == 1, "Receive count mismatch A %d", rcount);
-
-        /* process the count information received */
-        peer->have_first_count = 1;
-        qcount = (size_t) peer->recv_first_count;
-        if (qcount > 0) {
-          /* received nonzero count, post receive for load */
-          P4EST_LDEBUGF ("Balance A recv %llu quadrants from %d\n",
-                         (unsigned long long) qcount, j);
-          P4EST_ASSERT (peer->recv_first.elem_count == 0);
-          sc_array_resize (&peer->recv_first, qcount);
-          total_recv_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
-          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-          mpiret = MPI_Irecv (peer->recv_first.array, (int) qbytes, MPI_BYTE,
-                              j, P4EST_COMM_BALANCE_FIRST_LOAD,
-                              p4est->mpicomm, &requests_first[j]);
-          SC_CHECK_MPI (mpiret);
-          ++recv_load[0];
-        }
-        else {
-          /* will not receive load, close this request */
-          P4EST_ASSERT (qcount == 0);
-          P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-          --request_first_count;
-          ++recv_zero[0];
-        }
-      }
-      else {
-        /* verify received size */
-        P4EST_ASSERT (jstatus->MPI_TAG == P4EST_COMM_BALANCE_FIRST_LOAD);
-        P4EST_ASSERT (peer->recv_first_count > 0);
-        mpiret = sc_MPI_Get_count (jstatus, MPI_BYTE, &rcount);
-        SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount ==
-                         peer->recv_first_count *
-                         (int) sizeof (p4est_quadrant_t),
-                         "Receive load mismatch A %d %dx%llu", rcount,
-                         peer->recv_first_count,
-                         (unsigned long long) sizeof (p4est_quadrant_t));
-
-        /* received load, close this request */
-        peer->have_first_load = 1;
-        P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-        --request_first_count;
-
-#ifdef P4EST_ENABLE_DEBUG
-        checksum =
-          p4est_quadrant_checksum (&peer->recv_first, &checkarray, 0);
-        P4EST_LDEBUGF ("Balance A recv checksum 0x%08x from %d\n", checksum,
-                       j);
-#endif /* P4EST_ENABLE_DEBUG */
-
-        /* process incoming quadrants to interleave with communication */
-        p4est_balance_response (p4est, peer, btype, borders);
-        qcount = peer->send_second.elem_count;
-        if (qcount > 0) {
-          P4EST_LDEBUGF ("Balance B send %llu quadrants to %d\n",
-                         (unsigned long long) qcount, j);
-          ++send_load[1];
-        }
-        else {
-          ++send_zero[1];
-        }
-        peer->send_second_count = (int) qcount;
-        mpiret = MPI_Isend (&peer->send_second_count, 1, MPI_INT,
-                            j, P4EST_COMM_BALANCE_SECOND_COUNT,
-                            p4est->mpicomm, &send_requests_second_count[j]);
-        SC_CHECK_MPI (mpiret);
-        ++request_send_count;
-        if (qcount > 0) {
+  return ctx;
+}
 
+void
+p4est_balance_end (p4est_balance_context_t * ctx)
+{
+  p4est_t            *p4est = ctx->p4est;
+  const int           rank = p4est->mpirank;
+  const int           num_procs = p4est->mpisize;
+  const p4est_connect_type_t btype = ctx->btype;
+  const p4est_init_t  init_fn = ctx->init_fn;
+  const p4est_replace_t replace_fn = ctx->replace_fn;
+  int                 j;
+  int8_t             *tree_flags = ctx->tree_flags;
+  size_t              zz, treecount;
+  size_t              qcount, qbytes;
+  size_t              all_outcount;
+  double              interior_time;
+  p4est_topidx_t      qtree, nt;
+  p4est_topidx_t      first_tree, last_tree;
+  p4est_balance_peer_t *peers = ctx->peers, *peer;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *s;
+  p4est_connectivity_t *conn = p4est->connectivity;
+  sc_array_t         *qarray, *tquadrants;
+  sc_array_t         *borders = ctx->borders;
+#ifdef P4EST_ENABLE_MPI
 #ifdef P4EST_ENABLE_DEBUG
-          checksum =
-            p4est_quadrant_checksum (&peer->send_second, &checkarray, 0);
-          P4EST_LDEBUGF ("Balance B send checksum 0x%08x to %d\n", checksum,
-                         j);
+  unsigned            checksum;
+  p4est_gloidx_t      ltotal[2], gtotal[2];
 #endif /* P4EST_ENABLE_DEBUG */
+  int                 i, k;
+  int                 mpiret, rcount, outcount;
+  int                *wait_indices = ctx->wait_indices;
+  MPI_Request        *requests_second = ctx->requests_second;
+  MPI_Status         *recv_statuses = ctx->recv_statuses, *jstatus;
+#endif /* P4EST_ENABLE_MPI */
 
-          total_send_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
-          mpiret = MPI_Isend (peer->send_second.array, (int) qbytes, MPI_BYTE,
-                              j, P4EST_COMM_BALANCE_SECOND_LOAD,
-                              p4est->mpicomm, &send_requests_second_load[j]);
-          SC_CHECK_MPI (mpiret);
-          ++request_send_count;
-        }
+  /* first pass on the interior trees while messages are in flight */
+  first_tree = p4est->first_local_tree;
+  last_tree = p4est->last_local_tree;
+  interior_time = -sc_MPI_Wtime ();
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    if (tree_flags[nt] & interior_flag) {
+      p4est_balance_tree_first (ctx, nt);
+#ifdef P4EST_ENABLE_MPI
+      if (ctx->request_first_count > 0) {
+        p4est_balance_first_round (ctx, 0);
       }
+#endif
     }
   }
+  interior_time += sc_MPI_Wtime ();
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_A += interior_time;
+    p4est->inspect->balance_comm -= interior_time;
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* wait for quadrant counts and post receive and send for quadrants */
+  while (ctx->request_first_count > 0) {
+    p4est_balance_first_round (ctx, 1);
+  }
   for (j = 0; j < num_procs; ++j) {
-    P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
+    P4EST_ASSERT (ctx->requests_first[j] == MPI_REQUEST_NULL);
   }
 #endif /* P4EST_ENABLE_MPI */
 
   /* simulate send and receive with myself across tree boundaries */
   peer = peers + rank;
-  sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort (&peer->send_first, 1);
   qcount = peer->send_first.elem_count;
   peer->recv_first_count = peer->send_first_count = (int) qcount;
   qbytes = qcount * sizeof (p4est_quadrant_t);
   qarray = &peer->recv_first;
   sc_array_resize (qarray, qcount);
   memcpy (qarray->array, peer->send_first.array, qbytes);
-  p4est_balance_response (p4est, peer, btype, borders);
+  p4est_balance_response (p4est, peer, btype,
+                          ctx->incremental ? NULL : borders);
   qcount = peer->send_second.elem_count;
   peer->recv_second_count = peer->send_second_count = (int) qcount;
   qbytes = qcount * sizeof (p4est_quadrant_t);
@@ -2143,7 +3553,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
 #ifdef P4EST_ENABLE_MPI
   /* receive second round appending to the same receive buffer */
-  while (request_second_count > 0) {
+  while (ctx->request_second_count > 0) {
     mpiret = sc_MPI_Waitsome (num_procs, requests_second,
                               &outcount, wait_indices, recv_statuses);
     SC_CHECK_MPI (mpiret);
@@ -2177,21 +3587,21 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
                          (unsigned long long) qcount, j);
           P4EST_ASSERT (peer->recv_second.elem_count == 0);
           sc_array_resize (&peer->recv_second, qcount);
-          total_recv_count += qcount;
+          ctx->total_recv_count += qcount;
           qbytes = qcount * sizeof (p4est_quadrant_t);
           P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
           mpiret = MPI_Irecv (peer->recv_second.array, (int) qbytes,
                               MPI_BYTE, j, P4EST_COMM_BALANCE_SECOND_LOAD,
                               p4est->mpicomm, &requests_second[j]);
           SC_CHECK_MPI (mpiret);
-          ++recv_load[1];
+          ++ctx->recv_load[1];
         }
         else {
           /* will not receive load, close this request */
           P4EST_ASSERT (qcount == 0);
           P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-          --request_second_count;
-          ++recv_zero[1];
+          --ctx->request_second_count;
+          ++ctx->recv_zero[1];
         }
       }
       else {
@@ -2210,11 +3620,11 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
         /* received load, close this request */
         peer->have_second_load = 1;
         P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-        --request_second_count;
+        --ctx->request_second_count;
 
 #ifdef P4EST_ENABLE_DEBUG
         checksum =
-          p4est_quadrant_checksum (&peer->recv_second, &checkarray, 0);
+          p4est_quadrant_checksum (&peer->recv_second, &ctx->checkarray, 0);
         P4EST_LDEBUGF ("Balance B recv checksum 0x%08x from %d\n", checksum,
                        j);
 #endif /* P4EST_ENABLE_DEBUG */
@@ -2227,11 +3637,13 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
   /* print buffer statistics */
   P4EST_VERBOSEF ("first send Z %d L %d recv Z %d L %d\n",
-                  send_zero[0], send_load[0], recv_zero[0], recv_load[0]);
+                  ctx->send_zero[0], ctx->send_load[0],
+                  ctx->recv_zero[0], ctx->recv_load[0]);
   P4EST_VERBOSEF ("second send Z %d L %d recv Z %d L %d\n",
-                  send_zero[1], send_load[1], recv_zero[1], recv_load[1]);
-  P4EST_VERBOSEF ("total send %d recv %d\n", total_send_count,
-                  total_recv_count);
+                  ctx->send_zero[1], ctx->send_load[1],
+                  ctx->recv_zero[1], ctx->recv_load[1]);
+  P4EST_VERBOSEF ("total send %d recv %d\n", ctx->total_send_count,
+                  ctx->total_recv_count);
   for (j = 0; j < num_procs; ++j) {
     peer = peers + j;
     if (peer->send_first.elem_count > 0 || peer->recv_first_count > 0 ||
@@ -2254,8 +3666,8 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     p4est->inspect->use_B = 1;
 #ifdef P4EST_ENABLE_MPI
     for (k = 0; k < 2; ++k) {
-      p4est->inspect->balance_zero_sends[k] = send_zero[k];
-      p4est->inspect->balance_zero_receives[k] = recv_zero[k];
+      p4est->inspect->balance_zero_sends[k] = ctx->send_zero[k];
+      p4est->inspect->balance_zero_receives[k] = ctx->recv_zero[k];
     }
 #endif
   }
@@ -2312,7 +3724,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     tree->quadrants_offset = p4est->local_num_quadrants;
     tquadrants = &tree->quadrants;
     treecount = tquadrants->elem_count;
-    if (!(tree_flags[nt] & fully_owned_flag) ||
+    if (ctx->incremental || !(tree_flags[nt] & fully_owned_flag) ||
         (tree_flags[nt] & any_face_flag)) {
       /* we have most probably received quadrants, run sort and balance */
       /* balance the border, add it back into the tree, and linearize */
@@ -2339,17 +3751,17 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
 #ifdef P4EST_ENABLE_MPI
   /* wait for all send operations */
-  if (request_send_count > 0) {
-    mpiret = sc_MPI_Waitall (4 * num_procs,
-                             send_requests_first_count, MPI_STATUSES_IGNORE);
+  if (ctx->request_send_count > 0) {
+    mpiret = sc_MPI_Waitall (4 * num_procs, ctx->send_requests_first_count,
+                             MPI_STATUSES_IGNORE);
     SC_CHECK_MPI (mpiret);
   }
 
   /* compute global sum of send and receive counts */
 #ifdef P4EST_ENABLE_DEBUG
   gtotal[0] = gtotal[1] = 0;
-  ltotal[0] = (p4est_gloidx_t) total_send_count;
-  ltotal[1] = (p4est_gloidx_t) total_recv_count;
+  ltotal[0] = (p4est_gloidx_t) ctx->total_send_count;
+  ltotal[1] = (p4est_gloidx_t) ctx->total_recv_count;
   mpiret = MPI_Reduce (ltotal, gtotal, 2, P4EST_MPI_GLOIDX,
                        MPI_SUM, 0, p4est->mpicomm);
   SC_CHECK_MPI (mpiret);
@@ -2382,7 +3794,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   P4EST_FREE (peers);
 
   if (borders != NULL) {
-    for (zz = 0; zz < localcount; zz++) {
+    for (zz = 0; zz < ctx->localcount; zz++) {
       qarray = (sc_array_t *) sc_array_index (borders, zz);
       sc_array_reset (qarray);
     }
@@ -2390,390 +3802,814 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   }
 
 #ifdef P4_TO_P8
-  sc_array_reset (eta);
+  sc_array_reset (&ctx->ei.edge_transforms);
 #endif
-  sc_array_reset (cta);
+  sc_array_reset (&ctx->ci.corner_transforms);
+  sc_array_reset (&ctx->candidates);
+  for (j = 0; j < num_procs; ++j) {
+    sc_array_reset (&ctx->marks[j]);
+  }
+  P4EST_FREE (ctx->marks);
 
 #ifdef P4EST_ENABLE_MPI
-  P4EST_FREE (requests_first);  /* includes allocation for requests_second */
+  P4EST_FREE (ctx->requests_first);     /* includes all other requests */
   P4EST_FREE (recv_statuses);
   P4EST_FREE (wait_indices);
 #ifdef P4EST_ENABLE_DEBUG
-  sc_array_reset (&checkarray);
+  sc_array_reset (&ctx->checkarray);
 #endif /* P4EST_ENABLE_DEBUG */
 #endif /* P4EST_ENABLE_MPI */
 
   /* compute global number of quadrants */
   p4est_comm_count_quadrants (p4est);
-  P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
-  if (old_gnq != p4est->global_num_quadrants) {
+  P4EST_ASSERT (p4est->global_num_quadrants >= ctx->old_gnq);
+  if (ctx->old_gnq != p4est->global_num_quadrants) {
     ++p4est->revision;
   }
 
+  /* the forest is balanced and future changes are logged from here */
+  if (p4est->balance_log != NULL) {
+    sc_array_reset (&p4est->balance_log->regions);
+    p4est->balance_log->balanced = 1;
+    p4est->balance_log->btype = btype;
+    p4est->balance_log->revision = p4est->revision;
+    p4est->balance_log->num_incremental += ctx->incremental;
+  }
+
   /* some sanity checks */
   P4EST_ASSERT ((p4est_locidx_t) all_outcount == p4est->local_num_quadrants);
-  P4EST_ASSERT (all_outcount >= all_incount);
+  P4EST_ASSERT (all_outcount >= ctx->all_incount);
   if (p4est->user_data_pool != NULL) {
-    P4EST_ASSERT (data_pool_size + all_outcount - all_incount ==
+    P4EST_ASSERT (ctx->data_pool_size + all_outcount - ctx->all_incount ==
                   p4est->user_data_pool->elem_count);
   }
   P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
-  P4EST_VERBOSEF ("Balance skipped %lld\n", (long long) skipped);
+  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
+  P4EST_VERBOSEF ("Balance skipped %lld\n", (long long) ctx->skipped);
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_balance with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  P4EST_FREE (ctx);
+}
+
+void
+p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
+                   p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  p4est_balance_end (p4est_balance_begin (p4est, btype, init_fn, replace_fn));
+}
+
+void
+p4est_balance_track (p4est_t * p4est, int enable)
+{
+  p4est_balance_log_t *log = p4est->balance_log;
+
+  if (enable && log == NULL) {
+    log = p4est->balance_log = P4EST_ALLOC_ZERO (p4est_balance_log_t, 1);
+    sc_array_init (&log->regions, sizeof (p4est_quadrant_t));
+    log->balanced = 0;
+    log->revision = p4est->revision;
+  }
+  else if (!enable && log != NULL) {
+    sc_array_reset (&log->regions);
+    P4EST_FREE (log);
+    p4est->balance_log = NULL;
+  }
+}
+
+long
+p4est_balance_incremental_count (p4est_t * p4est)
+{
+  return p4est->balance_log == NULL ? 0 :
+    p4est->balance_log->num_incremental;
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Run the partition algorithm with given counts and update the revision.
+ * \return         The global number of shipped quadrants.
+ */
+static              p4est_gloidx_t
+p4est_partition_apply (p4est_t * p4est,
+                       const p4est_locidx_t * num_quadrants_in_proc)
+{
+  p4est_gloidx_t      global_shipped;
+  p4est_balance_log_t *log;
+
+  global_shipped = p4est_partition_given (p4est, num_quadrants_in_proc);
+  if (global_shipped) {
+    /* the partition of the forest has changed somewhere */
+    log = p4est_balance_log_current (p4est);
+    ++p4est->revision;
+    if (log != NULL && log->regions.elem_count == 0) {
+      /* the forest is still balanced and there are no changes to move */
+      log->revision = p4est->revision;
+    }
+  }
+  return global_shipped;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+void
+p4est_partition (p4est_t * p4est, int allow_for_coarsening,
+                 p4est_weight_t weight_fn)
+{
+  (void) p4est_partition_ext (p4est, allow_for_coarsening, weight_fn);
+}
+
+p4est_gloidx_t
+p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
+                     p4est_weight_t weight_fn)
+{
+  p4est_gloidx_t      global_shipped = 0;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  const int           num_procs = p4est->mpisize;
+  int                 p;
+  p4est_locidx_t      qlocal;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_gloidx_t      prev_quadrant, next_quadrant;
+  p4est_gloidx_t      qcount;
+  p4est_partition_sparse_t *sparse;
+  p4est_gloidx_t      num_corrected;
+#endif /* P4EST_ENABLE_MPI */
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING
+     "_partition with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
+
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
+
+    /* in particular, there is no need to bump the revision counter */
+    P4EST_ASSERT (global_shipped == 0);
+    return global_shipped;
+  }
+
+  p4est_log_indent_push ();
+
+#ifdef P4EST_ENABLE_MPI
+  /* allocate new quadrant distribution counts */
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+
+  if (weight_fn == NULL) {
+    /* Divide up the quadrants equally */
+    for (p = 0, next_quadrant = 0; p < num_procs; ++p) {
+      prev_quadrant = next_quadrant;
+      next_quadrant =
+        p4est_partition_cut_gloidx (global_num_quadrants, p + 1, num_procs);
+      qcount = next_quadrant - prev_quadrant;
+      P4EST_ASSERT (0 <= qcount
+                    && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+      num_quadrants_in_proc[p] = (p4est_locidx_t) (qcount);
+    }
+  }
+  else {
+    /* do a weighted partition; the cuts are found by a prefix sum */
+    sparse = p4est_partition_sparse_new (p4est, weight_fn);
+    P4EST_GLOBAL_VERBOSEF ("Global weight sum %lld\n",
+                           (long long) sparse->global_weight);
+
+    /* if all quadrants have zero weight we do nothing */
+    if (sparse->global_weight == 0) {
+      p4est_partition_sparse_destroy (sparse);
+      P4EST_FREE (num_quadrants_in_proc);
+      p4est_log_indent_pop ();
+      P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                               "_partition no shipping\n");
+
+      /* in particular, there is no need to bump the revision counter */
+      P4EST_ASSERT (global_shipped == 0);
+      return global_shipped;
+    }
+
+    /* communicate the quadrant ranges */
+    qcount = sparse->dest_end - sparse->dest_begin;
+    P4EST_LDEBUGF ("weighted partition count %lld\n", (long long) qcount);
+    P4EST_ASSERT (qcount >= 0 && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+    qlocal = (p4est_locidx_t) qcount;
+    mpiret = MPI_Allgather (&qlocal, 1, P4EST_MPI_LOCIDX,
+                            num_quadrants_in_proc, 1, P4EST_MPI_LOCIDX,
+                            p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    p4est_partition_sparse_destroy (sparse);
+
+#if(0)
+    /* run through the count array and repair zero ranges */
+    for (i = 0; i < num_procs; ++i) {
+      if (num_quadrants_in_proc[i] == 0) {
+        for (p = i - 1; p >= 0; --p) {
+          P4EST_ASSERT (num_quadrants_in_proc[p] > 0);
+          if (num_quadrants_in_proc[p] > 1) {
+            --num_quadrants_in_proc[p];
+            ++num_quadrants_in_proc[i];
+            break;
+          }
+        }
+        if (p < 0) {
+          for (p = i + 1; p < num_procs; ++p) {
+            P4EST_ASSERT (num_quadrants_in_proc[p] >= 0);
+            if (num_quadrants_in_proc[p] > 1) {
+              --num_quadrants_in_proc[p];
+              ++num_quadrants_in_proc[i];
+              break;
+            }
+          }
+          P4EST_ASSERT (p < num_procs);
+        }
+      }
+    }
+#endif
+  }
+
+  /* correct partition */
+  if (partition_for_coarsening) {
+    num_corrected =
+      p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
+    P4EST_GLOBAL_INFOF
+      ("Designated partition for coarsening %lld quadrants moved\n",
+       (long long) num_corrected);
+  }
+
+  /* run the partition algorithm with proper quadrant counts */
+  global_shipped = p4est_partition_apply (p4est, num_quadrants_in_proc);
+  P4EST_FREE (num_quadrants_in_proc);
+
+  /* check validity of the p4est */
+  P4EST_ASSERT (p4est_is_valid (p4est));
+#endif /* P4EST_ENABLE_MPI */
+
   p4est_log_indent_pop ();
-  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
-                            "_balance with %lld total quadrants\n",
-                            (long long) p4est->global_num_quadrants);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
+     (long long) global_shipped,
+     global_shipped * 100. / global_num_quadrants);
+
+  return global_shipped;
 }
 
-void
-p4est_partition (p4est_t * p4est, int allow_for_coarsening,
-                 p4est_weight_t weight_fn)
+#ifdef P4EST_ENABLE_MPI
+
+/** The best cut found by one process within the window of a boundary. */
+typedef struct p4est_multi_best
 {
-  (void) p4est_partition_ext (p4est, allow_for_coarsening, weight_fn);
+  double              key;              /**< Deviation to be minimized */
+  p4est_gloidx_t      position;         /**< Smallest position of that key */
+}
+p4est_multi_best_t;
+
+/** The part of a window between ideal cuts searched by this process. */
+typedef struct p4est_multi_search
+{
+  int                 cut;              /**< The process that begins here */
+  p4est_gloidx_t      window[2];        /**< First and last position */
+  p4est_multi_best_t  best;             /**< The local result */
 }
+p4est_multi_search_t;
+
+#endif /* P4EST_ENABLE_MPI */
 
 p4est_gloidx_t
-p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
-                     p4est_weight_t weight_fn)
+p4est_partition_multi (p4est_t * p4est, int num_weights,
+                       p4est_weights_t weights_fn, double tolerance)
 {
   p4est_gloidx_t      global_shipped = 0;
-  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
 #ifdef P4EST_ENABLE_MPI
   int                 mpiret;
-  int                 low_source, high_source;
   const int           num_procs = p4est->mpisize;
   const int           rank = p4est->mpirank;
-  const p4est_topidx_t first_tree = p4est->first_local_tree;
-  const p4est_topidx_t last_tree = p4est->last_local_tree;
   const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
-  int                 i, p;
-  int                 send_lowest, send_highest;
-  int                 num_sends, rcount, base_index;
+  const size_t        stride = (size_t) local_num_quadrants + 1;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+  const p4est_gloidx_t *gfq = p4est->global_first_quadrant;
+  const p4est_gloidx_t src_begin = gfq[rank];
+  const p4est_gloidx_t src_end = gfq[rank + 1];
+  int                 c, i, j, k, lowest, highest, within, global_within;
+  int                 first_cut, last_cut, num_cuts, num_searches;
+  int                 num_receivers, num_senders, num_requests;
+  int                 own_search;
+  int                *weights, *receivers, *senders;
   size_t              lz;
   ssize_t             lowers;
   p4est_topidx_t      nt;
-  p4est_locidx_t      kl, qlocal;
+  p4est_locidx_t      kl;
   p4est_locidx_t     *num_quadrants_in_proc;
-  p4est_gloidx_t      prev_quadrant, next_quadrant;
-  p4est_gloidx_t      send_index, recv_low, recv_high, qcount;
-  p4est_gloidx_t     *send_array;
-  int64_t             weight, weight_sum;
-  int64_t             cut, my_lowcut, my_highcut;
-  int64_t            *local_weights;    /* cumulative weights by quadrant */
-  int64_t            *global_weight_sums;
+  p4est_gloidx_t      x, xbegin, xend, pos, cut;
+  p4est_gloidx_t      window[2], recv_window[2];
+  p4est_gloidx_t     *ideals, *global_cuts;
+  int64_t             diff;
+  int64_t            *prefix, *local, *offsets, *totals, *targets;
+  double              dev, devmax, dev0, key;
+  double             *scale;
+  p4est_multi_best_t  best, recv_best;
+  p4est_multi_search_t *searches, *s;
   p4est_quadrant_t   *q;
   p4est_tree_t       *tree;
-  MPI_Request        *send_requests, recv_requests[2];
-  MPI_Status          recv_statuses[2];
-  p4est_gloidx_t      num_corrected;
+  sc_MPI_Request     *requests;
+  sc_MPI_Status       status;
 #endif /* P4EST_ENABLE_MPI */
 
   P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (num_weights > 0 && weights_fn != NULL);
+  P4EST_ASSERT (tolerance >= 0.);
   P4EST_GLOBAL_PRODUCTIONF
     ("Into " P4EST_STRING
-     "_partition with %lld total quadrants\n",
-     (long long) p4est->global_num_quadrants);
+     "_partition_multi with %lld total quadrants and %d weights\n",
+     (long long) p4est->global_num_quadrants, num_weights);
 
   /* this function does nothing in a serial setup */
   if (p4est->mpisize == 1) {
-    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
-
-    /* in particular, there is no need to bump the revision counter */
-    P4EST_ASSERT (global_shipped == 0);
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
     return global_shipped;
   }
 
   p4est_log_indent_push ();
 
 #ifdef P4EST_ENABLE_MPI
-  /* allocate new quadrant distribution counts */
-  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
-
-  if (weight_fn == NULL) {
-    /* Divide up the quadrants equally */
-    for (p = 0, next_quadrant = 0; p < num_procs; ++p) {
-      prev_quadrant = next_quadrant;
-      next_quadrant =
-        p4est_partition_cut_gloidx (global_num_quadrants, p + 1, num_procs);
-      qcount = next_quadrant - prev_quadrant;
-      P4EST_ASSERT (0 <= qcount
-                    && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
-      num_quadrants_in_proc[p] = (p4est_locidx_t) (qcount);
-    }
+  /* sum the weights of every constraint along the local quadrants */
+  prefix = P4EST_ALLOC (int64_t, stride * num_weights);
+  weights = P4EST_ALLOC (int, num_weights);
+  for (c = 0; c < num_weights; ++c) {
+    prefix[c * stride] = 0;
   }
-  else {
-    /* do a weighted partition */
-    local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
-    global_weight_sums = P4EST_ALLOC (int64_t, num_procs + 1);
-    P4EST_VERBOSEF ("local quadrant count %lld\n",
-                    (long long) local_num_quadrants);
-
-    /* linearly sum weights across all trees */
-    kl = 0;
-    local_weights[0] = 0;
-    for (nt = first_tree; nt <= last_tree; ++nt) {
-      tree = p4est_tree_array_index (p4est->trees, nt);
-      for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
-        q = p4est_quadrant_array_index (&tree->quadrants, lz);
-        weight = (int64_t) weight_fn (p4est, nt, q);
-        P4EST_ASSERT (weight >= 0);
-        local_weights[kl + 1] = local_weights[kl] + weight;
-      }
-    }
-    P4EST_ASSERT (kl == local_num_quadrants);
-    weight_sum = local_weights[local_num_quadrants];
-    P4EST_VERBOSEF ("local weight sum %lld\n", (long long) weight_sum);
-
-    /* distribute local weight sums */
-    global_weight_sums[0] = 0;
-    mpiret = MPI_Allgather (&weight_sum, 1, MPI_LONG_LONG_INT,
-                            &global_weight_sums[1], 1, MPI_LONG_LONG_INT,
-                            p4est->mpicomm);
-    SC_CHECK_MPI (mpiret);
-
-    /* adjust all arrays to reflect the global weight */
-    for (i = 0; i < num_procs; ++i) {
-      global_weight_sums[i + 1] += global_weight_sums[i];
-    }
-    if (rank > 0) {
-      weight_sum = global_weight_sums[rank];
-      for (kl = 0; kl <= local_num_quadrants; ++kl) {
-        local_weights[kl] += weight_sum;
+  kl = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, lz);
+      weights_fn (p4est, nt, q, weights);
+      for (c = 0; c < num_weights; ++c) {
+        P4EST_ASSERT (weights[c] >= 0);
+        prefix[c * stride + kl + 1] =
+          prefix[c * stride + kl] + (int64_t) weights[c];
       }
     }
-    P4EST_ASSERT (local_weights[0] == global_weight_sums[rank]);
-    P4EST_ASSERT (local_weights[local_num_quadrants] ==
-                  global_weight_sums[rank + 1]);
-    weight_sum = global_weight_sums[num_procs];
-
+  }
+  P4EST_ASSERT (kl == local_num_quadrants);
+  P4EST_FREE (weights);
+
+  /* make the sums global by a prefix sum over the processes */
+  local = P4EST_ALLOC (int64_t, 4 * num_weights);
+  offsets = local + num_weights;
+  totals = offsets + num_weights;
+  targets = totals + num_weights;
+  for (c = 0; c < num_weights; ++c) {
+    local[c] = prefix[c * stride + local_num_quadrants];
+    offsets[c] = 0;
+  }
+  mpiret = sc_MPI_Exscan (local, offsets, num_weights, sc_MPI_LONG_LONG_INT,
+                          sc_MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Allreduce (local, totals, num_weights,
+                             sc_MPI_LONG_LONG_INT, sc_MPI_SUM,
+                             p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  scale = P4EST_ALLOC (double, num_weights);
+  within = 0;
+  for (c = 0; c < num_weights; ++c) {
     if (rank == 0) {
-      for (i = 0; i <= num_procs; ++i) {
-        P4EST_GLOBAL_VERBOSEF ("Global weight sum [%d] %lld\n",
-                               i, (long long) global_weight_sums[i]);
-      }
+      /* the result of the exclusive scan is undefined on the first rank */
+      offsets[c] = 0;
+    }
+    for (kl = 0; kl <= local_num_quadrants; ++kl) {
+      prefix[c * stride + kl] += offsets[c];
     }
+    /* deviations are measured relative to the average process load */
+    scale[c] = totals[c] > 0 ? (double) num_procs / (double) totals[c] : 0.;
+    within = within || totals[c] > 0;
+    P4EST_GLOBAL_VERBOSEF ("Global weight sum [%d] %lld\n",
+                           c, (long long) totals[c]);
+  }
 
-    /* if all quadrants have zero weight we do nothing */
-    if (weight_sum == 0) {
-      P4EST_FREE (local_weights);
-      P4EST_FREE (global_weight_sums);
-      P4EST_FREE (num_quadrants_in_proc);
-      p4est_log_indent_pop ();
-      P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
-                               "_partition no shipping\n");
+  /* if all quadrants have zero weight we do nothing */
+  if (!within) {
+    P4EST_FREE (prefix);
+    P4EST_FREE (local);
+    P4EST_FREE (scale);
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
+    return global_shipped;
+  }
+  P4EST_ASSERT (global_num_quadrants > 0);
 
-      /* in particular, there is no need to bump the revision counter */
-      P4EST_ASSERT (global_shipped == 0);
-      return global_shipped;
+  /* the range of boundaries whose ideal cut is local for some constraint */
+  first_cut = num_procs;
+  last_cut = 0;
+  for (c = 0; c < num_weights; ++c) {
+    if (totals[c] == 0) {
+      continue;
     }
-
-    /* determine processor ids to send to */
-    send_lowest = num_procs;
-    send_highest = 0;
-    for (i = 1; i <= num_procs; ++i) {
-      cut = p4est_partition_cut_uint64 (weight_sum, i, num_procs);
-      if (global_weight_sums[rank] < cut &&
-          cut <= global_weight_sums[rank + 1]) {
-        send_lowest = SC_MIN (send_lowest, i);
-        send_highest = SC_MAX (send_highest, i);
-      }
+    /* on the first process this includes the cuts of zero weight */
+    lowest = rank == 0 ? 1 :
+      p4est_partition_cut_rank (totals[c], offsets[c], num_procs) + 1;
+    highest = SC_MIN (p4est_partition_cut_rank (totals[c],
+                                                offsets[c] + local[c],
+                                                num_procs), num_procs - 1);
+    if (lowest <= highest) {
+      first_cut = SC_MIN (first_cut, lowest);
+      last_cut = SC_MAX (last_cut, highest);
     }
-    /*
-     * send low cut to send_lowest..send_highest
-     * and high cut to send_lowest-1..send_highest-1
-     */
-    P4EST_LDEBUGF ("my send peers %d %d\n", send_lowest, send_highest);
+  }
+  num_cuts = SC_MAX (last_cut - first_cut + 1, 0);
 
-    num_sends = 2 * (send_highest - send_lowest + 1);
-    if (num_sends <= 0) {
-      num_sends = 0;
-      send_requests = NULL;
-      send_array = NULL;
+  /* the ideal cuts bound the window to search for each boundary */
+  ideals = P4EST_ALLOC (p4est_gloidx_t, 2 * num_cuts);
+  for (i = 0; i < num_cuts; ++i) {
+    ideals[2 * i] = global_num_quadrants;
+    ideals[2 * i + 1] = 0;
+  }
+  for (c = 0; c < num_weights; ++c) {
+    if (totals[c] == 0) {
+      continue;
     }
-    else {
-      send_requests = P4EST_ALLOC (MPI_Request, num_sends);
-      send_array = P4EST_ALLOC (p4est_gloidx_t, num_sends);
-      lowers = 0;
-      for (i = send_lowest; i <= send_highest; ++i) {
-        base_index = 2 * (i - send_lowest);
-        if (i < num_procs) {
-          /* do binary search in the weight array */
-          lowers = sc_search_lower_bound64 (p4est_partition_cut_uint64
-                                            (weight_sum, i, num_procs),
-                                            local_weights,
-                                            (size_t) local_num_quadrants + 1,
-                                            (size_t) lowers);
-          P4EST_ASSERT (lowers > 0
-                        && (p4est_locidx_t) lowers <= local_num_quadrants);
-
-          /* send low bound */
-          send_index = send_array[base_index + 1] =
-            (p4est_gloidx_t) lowers + p4est->global_first_quadrant[rank];
-          P4EST_LDEBUGF ("send A %d %d %d index %lld base %d to %d\n",
-                         send_lowest, i, send_highest,
-                         (long long) send_index, base_index + 1, i);
-          mpiret =
-            MPI_Isend (&send_array[base_index + 1], 1, P4EST_MPI_GLOIDX, i,
-                       P4EST_COMM_PARTITION_WEIGHTED_LOW, p4est->mpicomm,
-                       &send_requests[base_index + 1]);
-          SC_CHECK_MPI (mpiret);
-        }
-        else {
-          lowers = 0;
-          send_index = global_num_quadrants;
-          send_requests[base_index + 1] = MPI_REQUEST_NULL;
-          send_array[base_index + 1] = -1;
-        }
-
-        /* send high bound */
-        send_array[base_index] = send_index;
-        P4EST_LDEBUGF ("send B %d %d %d index %lld base %d to %d\n",
-                       send_lowest, i, send_highest,
-                       (long long) send_index, base_index, i - 1);
-        mpiret = MPI_Isend (&send_array[base_index], 1, P4EST_MPI_GLOIDX,
-                            i - 1, P4EST_COMM_PARTITION_WEIGHTED_HIGH,
-                            p4est->mpicomm, &send_requests[base_index]);
-        SC_CHECK_MPI (mpiret);
-      }
+    lowest = rank == 0 ? 1 :
+      p4est_partition_cut_rank (totals[c], offsets[c], num_procs) + 1;
+    highest = SC_MIN (p4est_partition_cut_rank (totals[c],
+                                                offsets[c] + local[c],
+                                                num_procs), num_procs - 1);
+    lowers = 0;
+    for (i = lowest; i <= highest; ++i) {
+      lowers = sc_search_lower_bound64
+        ((int64_t) p4est_partition_cut_uint64 ((uint64_t) totals[c], i,
+                                               num_procs),
+         prefix + c * stride, stride, (size_t) lowers);
+      P4EST_ASSERT (lowers >= 0 &&
+                    (p4est_locidx_t) lowers <= local_num_quadrants);
+      pos = src_begin + (p4est_gloidx_t) lowers;
+      k = 2 * (i - first_cut);
+      ideals[k] = SC_MIN (ideals[k], SC_MAX (pos - 1, 0));
+      ideals[k + 1] = SC_MAX (ideals[k + 1], pos);
     }
+  }
 
-    /* determine processor ids to receive from and post irecv */
-    i = 0;
-    my_lowcut = p4est_partition_cut_uint64 (weight_sum, rank, num_procs);
-    if (my_lowcut == 0) {
-      recv_low = 0;
-      recv_requests[0] = MPI_REQUEST_NULL;
-      low_source = -1;
+  /* send the ideal cuts to the process that begins at the boundary */
+  receivers = P4EST_ALLOC (int, num_cuts);
+  senders = P4EST_ALLOC (int, num_procs);
+  num_receivers = 0;
+  for (i = first_cut; i <= last_cut; ++i) {
+    k = 2 * (i - first_cut);
+    if (ideals[k] <= ideals[k + 1] && i != rank) {
+      receivers[num_receivers++] = i;
     }
-    else {
-      for (; i < num_procs; ++i) {
-        if (global_weight_sums[i] < my_lowcut &&
-            my_lowcut <= global_weight_sums[i + 1]) {
-          P4EST_LDEBUGF ("recv A from %d\n", i);
-          mpiret = MPI_Irecv (&recv_low, 1, P4EST_MPI_GLOIDX, i,
-                              P4EST_COMM_PARTITION_WEIGHTED_LOW,
-                              p4est->mpicomm, &recv_requests[0]);
-          SC_CHECK_MPI (mpiret);
-          break;
-        }
+  }
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  requests = P4EST_ALLOC (sc_MPI_Request, num_receivers);
+  for (k = 0; k < num_receivers; ++k) {
+    i = receivers[k];
+    mpiret = sc_MPI_Isend (&ideals[2 * (i - first_cut)], 2,
+                           P4EST_MPI_GLOIDX, i,
+                           P4EST_COMM_PARTITION_MULTI_IDEAL,
+                           p4est->mpicomm, &requests[k]);
+    SC_CHECK_MPI (mpiret);
+  }
+  window[0] = global_num_quadrants;
+  window[1] = 0;
+  if (first_cut <= rank && rank <= last_cut) {
+    window[0] = ideals[2 * (rank - first_cut)];
+    window[1] = ideals[2 * (rank - first_cut) + 1];
+  }
+  for (k = 0; k < num_senders; ++k) {
+    mpiret = sc_MPI_Recv (recv_window, 2, P4EST_MPI_GLOIDX,
+                          sc_MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_MULTI_IDEAL,
+                          p4est->mpicomm, sc_MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    window[0] = SC_MIN (window[0], recv_window[0]);
+    window[1] = SC_MAX (window[1], recv_window[1]);
+  }
+  mpiret = sc_MPI_Waitall (num_receivers, requests, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (requests);
+  P4EST_FREE (receivers);
+  P4EST_FREE (ideals);
+
+  /* send the window to the processes whose quadrants it covers */
+  num_receivers = 0;
+  own_search = 0;
+  receivers = NULL;
+  if (rank > 0) {
+    P4EST_ASSERT (0 <= window[0] && window[0] < global_num_quadrants);
+    P4EST_ASSERT (window[0] <= window[1] &&
+                  window[1] <= global_num_quadrants);
+    i = p4est_bsearch_partition (window[0], gfq, num_procs);
+    j = p4est_bsearch_partition (SC_MIN (window[1],
+                                         global_num_quadrants - 1),
+                                 gfq, num_procs);
+    receivers = P4EST_ALLOC (int, j - i + 1);
+    for (; i <= j; ++i) {
+      if (gfq[i] == gfq[i + 1]) {
+        continue;
+      }
+      if (i == rank) {
+        own_search = 1;
+      }
+      else {
+        receivers[num_receivers++] = i;
       }
-      P4EST_ASSERT (i < num_procs);
-      low_source = i;
     }
-    my_highcut = p4est_partition_cut_uint64 (weight_sum, rank + 1, num_procs);
-    if (my_highcut == 0) {
-      recv_high = 0;
-      recv_requests[1] = MPI_REQUEST_NULL;
-      high_source = -1;
+  }
+  mpiret = sc_notify (receivers, num_receivers, senders, &num_senders,
+                      p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  requests = P4EST_ALLOC (sc_MPI_Request, num_receivers + num_senders);
+  num_requests = 0;
+  for (k = 0; k < num_receivers; ++k) {
+    mpiret = sc_MPI_Isend (window, 2, P4EST_MPI_GLOIDX, receivers[k],
+                           P4EST_COMM_PARTITION_MULTI_WINDOW,
+                           p4est->mpicomm, &requests[num_requests++]);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* collect the windows that overlap the local quadrants */
+  searches = P4EST_ALLOC (p4est_multi_search_t, num_senders + 1);
+  num_searches = 0;
+  if (own_search) {
+    s = &searches[num_searches++];
+    s->cut = rank;
+    s->window[0] = window[0];
+    s->window[1] = window[1];
+  }
+  for (k = 0; k < num_senders; ++k) {
+    s = &searches[num_searches++];
+    mpiret = sc_MPI_Recv (s->window, 2, P4EST_MPI_GLOIDX, sc_MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_MULTI_WINDOW,
+                          p4est->mpicomm, &status);
+    SC_CHECK_MPI (mpiret);
+    s->cut = status.MPI_SOURCE;
+  }
+
+  /* search the local part of every window for the best cut */
+  for (k = 0; k < num_searches; ++k) {
+    s = &searches[k];
+    s->best.key = DBL_MAX;
+    s->best.position = global_num_quadrants;
+    xbegin = SC_MAX (s->window[0], src_begin);
+    xend = SC_MIN (s->window[1], src_end);
+    for (c = 0; c < num_weights; ++c) {
+      targets[c] = (int64_t) p4est_partition_cut_uint64
+        ((uint64_t) totals[c], s->cut, num_procs);
     }
-    else {
-      for (; i < num_procs; ++i) {
-        if (global_weight_sums[i] < my_highcut &&
-            my_highcut <= global_weight_sums[i + 1]) {
-          P4EST_LDEBUGF ("recv B from %d\n", i);
-          mpiret = MPI_Irecv (&recv_high, 1, P4EST_MPI_GLOIDX, i,
-                              P4EST_COMM_PARTITION_WEIGHTED_HIGH,
-                              p4est->mpicomm, &recv_requests[1]);
-          SC_CHECK_MPI (mpiret);
-          break;
+    for (x = xbegin; x <= xend; ++x) {
+      devmax = dev0 = 0.;
+      for (c = 0; c < num_weights; ++c) {
+        diff = prefix[c * stride + (x - src_begin)] - targets[c];
+        dev = (double) (diff < 0 ? -diff : diff) * scale[c];
+        devmax = SC_MAX (devmax, dev);
+        if (c == 0) {
+          dev0 = dev;
         }
       }
-      P4EST_ASSERT (i < num_procs);
-      high_source = i;
+      /* within tolerance we optimize the first constraint */
+      key = devmax <= tolerance ? dev0 : devmax;
+      if (key < s->best.key) {
+        s->best.key = key;
+        s->best.position = x;
+      }
     }
-    P4EST_LDEBUGF ("my recv peers %d %d cuts %lld %lld\n",
-                   low_source, high_source,
-                   (long long) my_lowcut, (long long) my_highcut);
-
-    /* free temporary memory */
-    P4EST_FREE (local_weights);
-    P4EST_FREE (global_weight_sums);
-
-    /* wait for sends and receives to complete */
-    if (num_sends > 0) {
-      mpiret = sc_MPI_Waitall (num_sends, send_requests, MPI_STATUSES_IGNORE);
+    if (s->cut != rank) {
+      mpiret = sc_MPI_Isend (&s->best, sizeof (p4est_multi_best_t),
+                             sc_MPI_BYTE, s->cut,
+                             P4EST_COMM_PARTITION_MULTI_BEST,
+                             p4est->mpicomm, &requests[num_requests++]);
       SC_CHECK_MPI (mpiret);
-      P4EST_FREE (send_requests);
-      P4EST_FREE (send_array);
     }
-    mpiret = sc_MPI_Waitall (2, recv_requests, recv_statuses);
+  }
+  P4EST_FREE (prefix);
+  P4EST_FREE (local);
+  P4EST_FREE (scale);
+
+  /* choose the first of the best positions over all processes */
+  best.key = DBL_MAX;
+  best.position = global_num_quadrants;
+  if (own_search) {
+    P4EST_ASSERT (searches[0].cut == rank);
+    best = searches[0].best;
+  }
+  for (k = 0; k < num_receivers; ++k) {
+    mpiret = sc_MPI_Recv (&recv_best, sizeof (p4est_multi_best_t),
+                          sc_MPI_BYTE, sc_MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_MULTI_BEST,
+                          p4est->mpicomm, sc_MPI_STATUS_IGNORE);
     SC_CHECK_MPI (mpiret);
-    if (my_lowcut != 0) {
-      SC_CHECK_ABORT (recv_statuses[0].MPI_SOURCE == low_source,
-                      "Wait low source");
-      SC_CHECK_ABORT (recv_statuses[0].MPI_TAG ==
-                      P4EST_COMM_PARTITION_WEIGHTED_LOW, "Wait low tag");
-      mpiret =
-        sc_MPI_Get_count (&recv_statuses[0], P4EST_MPI_GLOIDX, &rcount);
-      SC_CHECK_MPI (mpiret);
-      SC_CHECK_ABORTF (rcount == 1, "Wait low count %d", rcount);
-    }
-    if (my_highcut != 0) {
-      SC_CHECK_ABORT (recv_statuses[1].MPI_SOURCE == high_source,
-                      "Wait high source");
-      SC_CHECK_ABORT (recv_statuses[1].MPI_TAG ==
-                      P4EST_COMM_PARTITION_WEIGHTED_HIGH, "Wait high tag");
-      mpiret =
-        sc_MPI_Get_count (&recv_statuses[1], P4EST_MPI_GLOIDX, &rcount);
-      SC_CHECK_MPI (mpiret);
-      SC_CHECK_ABORTF (rcount == 1, "Wait high count %d", rcount);
+    if (recv_best.key < best.key || (recv_best.key == best.key &&
+                                     recv_best.position < best.position)) {
+      best = recv_best;
     }
+  }
+  mpiret = sc_MPI_Waitall (num_requests, requests, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (requests);
+  P4EST_FREE (searches);
+  P4EST_FREE (receivers);
+  P4EST_FREE (senders);
+
+  /* count the cuts within tolerance for the statistics */
+  cut = rank == 0 ? 0 : best.position;
+  within = rank > 0 && best.key <= tolerance;
+  mpiret = sc_MPI_Allreduce (&within, &global_within, 1, sc_MPI_INT,
+                             sc_MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_GLOBAL_INFOF ("Partition multi %d of %d cuts within tolerance\n",
+                      global_within, num_procs - 1);
+
+  /* the partition must be monotone even if the windows are not */
+  global_cuts = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  mpiret = sc_MPI_Allgather (&cut, 1, P4EST_MPI_GLOIDX,
+                             global_cuts, 1, P4EST_MPI_GLOIDX,
+                             p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  global_cuts[num_procs] = global_num_quadrants;
+  for (i = 0; i < num_procs; ++i) {
+    global_cuts[i + 1] = SC_MAX (global_cuts[i + 1], global_cuts[i]);
+    P4EST_ASSERT (global_cuts[i + 1] - global_cuts[i] <=
+                  (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+    num_quadrants_in_proc[i] =
+      (p4est_locidx_t) (global_cuts[i + 1] - global_cuts[i]);
+  }
+  P4EST_FREE (global_cuts);
 
-    /* communicate the quadrant ranges */
-    qcount = recv_high - recv_low;
-    P4EST_LDEBUGF ("weighted partition count %lld\n", (long long) qcount);
-    P4EST_ASSERT (qcount >= 0 && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
-    qlocal = (p4est_locidx_t) qcount;
-    mpiret = MPI_Allgather (&qlocal, 1, P4EST_MPI_LOCIDX,
-                            num_quadrants_in_proc, 1, P4EST_MPI_LOCIDX,
-                            p4est->mpicomm);
-    SC_CHECK_MPI (mpiret);
+  /* run the partition algorithm with proper quadrant counts */
+  global_shipped = p4est_partition_apply (p4est, num_quadrants_in_proc);
+  P4EST_FREE (num_quadrants_in_proc);
 
-#if(0)
-    /* run through the count array and repair zero ranges */
-    for (i = 0; i < num_procs; ++i) {
-      if (num_quadrants_in_proc[i] == 0) {
-        for (p = i - 1; p >= 0; --p) {
-          P4EST_ASSERT (num_quadrants_in_proc[p] > 0);
-          if (num_quadrants_in_proc[p] > 1) {
-            --num_quadrants_in_proc[p];
-            ++num_quadrants_in_proc[i];
-            break;
-          }
-        }
-        if (p < 0) {
-          for (p = i + 1; p < num_procs; ++p) {
-            P4EST_ASSERT (num_quadrants_in_proc[p] >= 0);
-            if (num_quadrants_in_proc[p] > 1) {
-              --num_quadrants_in_proc[p];
-              ++num_quadrants_in_proc[i];
-              break;
-            }
-          }
-          P4EST_ASSERT (p < num_procs);
-        }
+  /* check validity of the p4est */
+  P4EST_ASSERT (p4est_is_valid (p4est));
+#endif /* P4EST_ENABLE_MPI */
+
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition_multi shipped %lld quadrants %.3g%%\n",
+     (long long) global_shipped,
+     global_shipped * 100. / p4est->global_num_quadrants);
+
+  return global_shipped;
+}
+
+p4est_gloidx_t
+p4est_partition_repair (p4est_t * p4est, p4est_weight_t weight_fn,
+                        double tolerance, p4est_gloidx_t * bytes_moved)
+{
+  p4est_gloidx_t      global_shipped = 0;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
+  const p4est_gloidx_t *old_gfq = p4est->global_first_quadrant;
+  int                 i, num_moved;
+  size_t              lz;
+  ssize_t             lowers;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_gloidx_t     *new_gfq, *global_gfq;
+  int64_t             weight, target, ideal, band;
+  int64_t            *local_weights, *loads;
+  double              imbalance;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+#endif /* P4EST_ENABLE_MPI */
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (tolerance >= 0.);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING
+     "_partition_repair with %lld total quadrants\n",
+     (long long) p4est->global_num_quadrants);
+  if (bytes_moved != NULL) {
+    *bytes_moved = 0;
+  }
+
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_repair no shipping\n");
+    return global_shipped;
+  }
+
+  p4est_log_indent_push ();
+
+#ifdef P4EST_ENABLE_MPI
+  /* linearly sum weights across all trees */
+  local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
+  kl = 0;
+  local_weights[0] = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, lz);
+      weight = weight_fn == NULL ? 1 : (int64_t) weight_fn (p4est, nt, q);
+      P4EST_ASSERT (weight >= 0);
+      local_weights[kl + 1] = local_weights[kl] + weight;
+    }
+  }
+  P4EST_ASSERT (kl == local_num_quadrants);
+
+  /* the current load of every process in cumulative form */
+  loads = P4EST_ALLOC (int64_t, num_procs + 1);
+  loads[0] = 0;
+  mpiret = sc_MPI_Allgather (&local_weights[local_num_quadrants], 1,
+                             sc_MPI_LONG_LONG_INT, &loads[1], 1,
+                             sc_MPI_LONG_LONG_INT, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  imbalance = 0.;
+  for (i = 0; i < num_procs; ++i) {
+    imbalance = SC_MAX (imbalance, (double) loads[i + 1]);
+    loads[i + 1] += loads[i];
+  }
+  if (loads[num_procs] > 0) {
+    imbalance = imbalance * num_procs / (double) loads[num_procs] - 1.;
+  }
+  P4EST_GLOBAL_INFOF ("Partition repair imbalance %g tolerance %g\n",
+                      imbalance, tolerance);
+
+  /* nothing moves if all loads are within the tolerance */
+  if (loads[num_procs] == 0 || imbalance <= tolerance) {
+    P4EST_FREE (local_weights);
+    P4EST_FREE (loads);
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_repair no shipping\n");
+    return global_shipped;
+  }
+
+  /* move only the cuts outside of a band around their ideal position */
+  band = (int64_t) (.5 * tolerance * loads[num_procs] / num_procs);
+  new_gfq = P4EST_ALLOC (p4est_gloidx_t, 2 * (num_procs + 1));
+  global_gfq = new_gfq + num_procs + 1;
+  num_moved = 0;
+  new_gfq[0] = 0;
+  new_gfq[num_procs] = p4est->global_num_quadrants;
+  for (i = 1; i < num_procs; ++i) {
+    ideal = (int64_t) p4est_partition_cut_uint64
+      ((uint64_t) loads[num_procs], i, num_procs);
+    new_gfq[i] = old_gfq[i];
+    if (loads[i] < ideal - band) {
+      /* the first position that reaches into the band */
+      ++num_moved;
+      new_gfq[i] = -1;
+      target = ideal - band;
+      if (loads[rank] < target && target <= loads[rank + 1]) {
+        lowers = sc_search_lower_bound64 (target - loads[rank],
+                                          local_weights,
+                                          (size_t) local_num_quadrants + 1,
+                                          0);
+        P4EST_ASSERT (lowers > 0);
+        new_gfq[i] = old_gfq[rank] + (p4est_gloidx_t) lowers;
+      }
+    }
+    else if (loads[i] > ideal + band) {
+      /* the last position that remains within the band */
+      ++num_moved;
+      new_gfq[i] = -1;
+      target = ideal + band;
+      if (loads[rank] <= target && target < loads[rank + 1]) {
+        lowers = sc_search_lower_bound64 (target - loads[rank] + 1,
+                                          local_weights,
+                                          (size_t) local_num_quadrants + 1,
+                                          0);
+        P4EST_ASSERT (lowers > 0);
+        new_gfq[i] = old_gfq[rank] + (p4est_gloidx_t) lowers - 1;
       }
     }
-#endif
   }
+  P4EST_FREE (local_weights);
+  P4EST_FREE (loads);
+  P4EST_GLOBAL_INFOF ("Partition repair moves %d of %d cuts\n",
+                      num_moved, num_procs - 1);
+  mpiret = sc_MPI_Allreduce (new_gfq, global_gfq, num_procs + 1,
+                             P4EST_MPI_GLOIDX, sc_MPI_MAX, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
 
-  /* correct partition */
-  if (partition_for_coarsening) {
-    num_corrected =
-      p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
-    P4EST_GLOBAL_INFOF
-      ("Designated partition for coarsening %lld quadrants moved\n",
-       (long long) num_corrected);
+  /* the partition must be monotone even for a large tolerance */
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  for (i = 0; i < num_procs; ++i) {
+    global_gfq[i + 1] = SC_MAX (global_gfq[i + 1], global_gfq[i]);
+    P4EST_ASSERT (global_gfq[i + 1] - global_gfq[i] <=
+                  (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+    num_quadrants_in_proc[i] =
+      (p4est_locidx_t) (global_gfq[i + 1] - global_gfq[i]);
   }
+  P4EST_FREE (new_gfq);
 
   /* run the partition algorithm with proper quadrant counts */
-  global_shipped = p4est_partition_given (p4est, num_quadrants_in_proc);
-  if (global_shipped) {
-    /* the partition of the forest has changed somewhere */
-    ++p4est->revision;
-  }
+  global_shipped = p4est_partition_apply (p4est, num_quadrants_in_proc);
   P4EST_FREE (num_quadrants_in_proc);
+  if (bytes_moved != NULL) {
+    *bytes_moved = global_shipped *
+      (p4est_gloidx_t) (sizeof (p4est_quadrant_t) + p4est->data_size);
+  }
 
   /* check validity of the p4est */
   P4EST_ASSERT (p4est_is_valid (p4est));
@@ -2781,9 +4617,9 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF
-    ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
+    ("Done " P4EST_STRING "_partition_repair shipped %lld quadrants %.3g%%\n",
      (long long) global_shipped,
-     global_shipped * 100. / global_num_quadrants);
+     global_shipped * 100. / p4est->global_num_quadrants);
 
   return global_shipped;
 }
@@ -131,6 +131,12 @@ p4est_tree_t;
  */
 typedef struct p4est_inspect p4est_inspect_t;
 
+/** Record of the mesh changes since the last 2:1 balance.
+ * It is opaque and created by \ref p4est_balance_track.
+ * Declared in p4est_extended.h.
+ */
+typedef struct p4est_balance_log p4est_balance_log_t;
+
 /** The p4est forest datatype */
 typedef struct p4est
 {
@@ -169,6 +175,10 @@ typedef struct p4est
   sc_mempool_t       *quadrant_pool;  /**< memory allocator for temporary
                                            quadrants */
   p4est_inspect_t    *inspect;        /**< algorithmic switches */
+  p4est_balance_log_t *balance_log;    /**< changes since the last balance,
+                                         NULL unless tracking is enabled;
+                                         appended last since it changes
+                                         the size of this structure */
 }
 p4est_t;
 
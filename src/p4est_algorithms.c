@@ -1209,7 +1209,7 @@ p4est_tree_uniqify_overlap (sc_array_t * out)
   }
 
   /* sort array and remove duplicates */
-  sc_array_sort (out, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort (out, 1);
   dupcount = olcount = 0;
   iz = 0;                       /* read counter */
   jz = 0;                       /* write counter */
@@ -1940,7 +1940,7 @@ p4est_complete_or_balance_kernel (sc_array_t * inlist,
 
     /* sort inlist */
     if (inlist->elem_count > incount) {
-      sc_array_sort (inlist, p4est_quadrant_compare);
+      p4est_quadrant_array_sort (inlist, 0);
     }
   }
 
@@ -2454,7 +2454,7 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
   flist = sc_array_new (sizeof (p4est_quadrant_t));
 
   /* sort the border and remove duplicates */
-  sc_array_sort (qarray, p4est_quadrant_compare);
+  p4est_quadrant_array_sort (qarray, 0);
   jz = 1;                       /* number included */
   kz = 0;                       /* number skipped */
   p = p4est_quadrant_array_index (qarray, 0);
@@ -23,6 +23,9 @@
 */
 
 #include <p4est_base.h>
+#ifdef P4EST_ENABLE_OPENMP
+#include <omp.h>
+#endif
 
 int                 p4est_package_id = -1;
 int                 p4est_initialized = 0;
@@ -56,6 +59,19 @@ p4est_is_initialized (void)
   return p4est_initialized;
 }
 
+int
+p4est_num_threads (int num_threads)
+{
+#ifdef P4EST_ENABLE_OPENMP
+  if (num_threads < 1) {
+    num_threads = omp_get_max_threads ();
+  }
+  return SC_MAX (num_threads, 1);
+#else
+  return 1;
+#endif
+}
+
 #ifndef __cplusplus
 #undef P4EST_GLOBAL_LOGF
 #undef P4EST_LOGF
@@ -73,6 +73,13 @@
 /** We expose the \ref p4est_vtk_write_cell_datav function. */
 #define P4EST_VTK_CELL_DATAV
 
+/** The \ref p4est_balance_track function exists.
+ * To support it, the \ref p4est_t structure has a new last member.
+ * This changes its size, thus code compiled against older headers
+ * must be recompiled.
+ */
+#define P4EST_BALANCE_TRACK
+
 /*--------------------------------------------------------------------*/
 
 SC_EXTERN_C_BEGIN;
@@ -154,6 +161,12 @@ typedef enum p4est_comm_tag
   P4EST_COMM_LNODES_PASS,
   P4EST_COMM_LNODES_OWNED,
   P4EST_COMM_LNODES_ALL,
+  P4EST_COMM_BALANCE_MARK,
+  P4EST_COMM_PARTITION_SPARSE,
+  P4EST_COMM_GHOST_UPDATE,
+  P4EST_COMM_PARTITION_MULTI_IDEAL,
+  P4EST_COMM_PARTITION_MULTI_WINDOW,
+  P4EST_COMM_PARTITION_MULTI_BEST,
   P4EST_COMM_TAG_LAST
 }
 p4est_comm_tag_t;
@@ -358,6 +371,17 @@ void                p4est_init (sc_log_handler_t log_handler,
  */
 int                 p4est_is_initialized (void);
 
+/** Return the number of threads used by the threaded algorithms of p4est.
+ * Threads are only available if p4est is configured with OpenMP support.
+ * Otherwise this function always returns 1.
+ *
+ * \param [in] num_threads  Number of threads requested by the caller.
+ *                          If this is less than 1, the current maximum
+ *                          number of OpenMP threads is used.
+ * \return                  The number of threads to run with, at least 1.
+ */
+int                 p4est_num_threads (int num_threads);
+
 /** Compute hash value for two p4est_topidx_t integers.
  * \param [in] tt     Array of (at least) two values.
  * \return            An unsigned hash value.
@@ -507,6 +531,33 @@ p4est_partition_cut_uint64 (uint64_t global_num, int p, int num_procs)
   return result;
 }
 
+/** Return the largest process whose weight cut does not exceed \a weight.
+ * \return                  A number in [0, \a num_procs].
+ */
+/*@unused@*/
+static inline int
+p4est_partition_cut_rank (int64_t global_weight, int64_t weight,
+                          int num_procs)
+{
+  int                 low, high, mid;
+
+  /* the cut of process zero is always zero */
+  P4EST_ASSERT (0 <= weight && weight <= global_weight);
+  low = 0;
+  high = num_procs;
+  while (low < high) {
+    mid = high - (high - low) / 2;
+    if ((int64_t) p4est_partition_cut_uint64
+        ((uint64_t) global_weight, mid, num_procs) <= weight) {
+      low = mid;
+    }
+    else {
+      high = mid - 1;
+    }
+  }
+  return low;
+}
+
 /*@unused@*/
 static inline       p4est_gloidx_t
 p4est_partition_cut_gloidx (p4est_gloidx_t global_num, int p, int num_procs)
@@ -30,6 +30,12 @@
 #include <p4est_extended.h>
 #endif /* !P4_TO_P8 */
 
+/* bit deposit and extract instructions for Morton indices */
+#if defined (__BMI2__) && (defined (__x86_64__) || defined (_M_X64))
+#include <immintrin.h>
+#define P4EST_MORTON_BMI2
+#endif
+
 /* Function declarations for 128 bit unsigned integers
  * are in p{4,8}est_extended.h. */
 int
@@ -2229,6 +2235,68 @@ p4est_quadrant_shift_corner (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_touches_corner (r, corner, 1));
 }
 
+/* mask of the bits that belong to the x coordinate of a Morton index */
+#ifndef P4_TO_P8
+#define P4EST_MORTON_MASK 0x5555555555555555ULL
+#else
+#define P4EST_MORTON_MASK 0x1249249249249249ULL
+#endif
+
+/** Spread the low bits of a coordinate such that P4EST_DIM - 1 zero bits
+ * separate any two of them.  These are 32 bits in 2D and 21 bits in 3D.
+ * With BMI2 this is a single bit deposit instruction.
+ */
+static inline uint64_t
+p4est_morton_spread (uint64_t x)
+{
+#ifdef P4EST_MORTON_BMI2
+  return _pdep_u64 (x, P4EST_MORTON_MASK);
+#else
+#ifndef P4_TO_P8
+  x &= 0xffffffffULL;
+  x = (x | x << 16) & 0x0000ffff0000ffffULL;
+  x = (x | x << 8) & 0x00ff00ff00ff00ffULL;
+  x = (x | x << 4) & 0x0f0f0f0f0f0f0f0fULL;
+  x = (x | x << 2) & 0x3333333333333333ULL;
+  x = (x | x << 1) & 0x5555555555555555ULL;
+#else
+  x &= 0x1fffffULL;
+  x = (x | x << 32) & 0x001f00000000ffffULL;
+  x = (x | x << 16) & 0x001f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+#endif
+  return x;
+#endif
+}
+
+/** Inverse of \ref p4est_morton_spread. */
+static inline uint64_t
+p4est_morton_compact (uint64_t x)
+{
+#ifdef P4EST_MORTON_BMI2
+  return _pext_u64 (x, P4EST_MORTON_MASK);
+#else
+#ifndef P4_TO_P8
+  x &= 0x5555555555555555ULL;
+  x = (x | x >> 1) & 0x3333333333333333ULL;
+  x = (x | x >> 2) & 0x0f0f0f0f0f0f0f0fULL;
+  x = (x | x >> 4) & 0x00ff00ff00ff00ffULL;
+  x = (x | x >> 8) & 0x0000ffff0000ffffULL;
+  x = (x | x >> 16) & 0x00000000ffffffffULL;
+#else
+  x &= 0x1249249249249249ULL;
+  x = (x | x >> 2) & 0x10c30c30c30c30c3ULL;
+  x = (x | x >> 4) & 0x100f00f00f00f00fULL;
+  x = (x | x >> 8) & 0x001f0000ff0000ffULL;
+  x = (x | x >> 16) & 0x001f00000000ffffULL;
+  x = (x | x >> 32) & 0x00000000001fffffULL;
+#endif
+  return x;
+#endif
+}
+
 uint64_t
 p4est_quadrant_linear_id (const p4est_quadrant_t * quadrant, int level)
 {
@@ -2400,6 +2468,136 @@ p4est_quadrant_set_morton_ext128 (p4est_quadrant_t * quadrant,
   P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
 }
 
+void
+p4est_quadrant_array_linear_id (sc_array_t * quadrants, int level,
+                                uint64_t * ids)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const size_t        count = quadrants->elem_count;
+  size_t              zz;
+  uint64_t            mask;
+  const p4est_quadrant_t *q;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_MAXLEVEL);
+
+  /* keep level + 2 bits of each coordinate including the sign */
+  mask = ((uint64_t) 1 << (level + 2)) - 1;
+  q = (const p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < count; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_extended (&q[zz]));
+    ids[zz] = p4est_morton_spread ((uint64_t) (q[zz].x >> shift) & mask) |
+      p4est_morton_spread ((uint64_t) (q[zz].y >> shift) & mask) << 1
+#ifdef P4_TO_P8
+      | p4est_morton_spread ((uint64_t) (q[zz].z >> shift) & mask) << 2
+#endif
+      ;
+  }
+}
+
+void
+p4est_quadrant_array_set_morton (sc_array_t * quadrants, int level,
+                                 const uint64_t * ids)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const size_t        count = quadrants->elem_count;
+  size_t              zz;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
+
+  /* shift in unsigned arithmetic, which may set the sign bit */
+  q = (p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < count; ++zz) {
+    P4EST_ASSERT (ids[zz] < ((uint64_t) 1 << P4EST_DIM * (level + 2)));
+    q[zz].x = (p4est_qcoord_t)
+      (uint32_t) (p4est_morton_compact (ids[zz]) << shift);
+    q[zz].y = (p4est_qcoord_t)
+      (uint32_t) (p4est_morton_compact (ids[zz] >> 1) << shift);
+#ifdef P4_TO_P8
+    q[zz].z = (p4est_qcoord_t)
+      (uint32_t) (p4est_morton_compact (ids[zz] >> 2) << shift);
+#endif
+    q[zz].level = (int8_t) level;
+    P4EST_ASSERT (p4est_quadrant_is_extended (&q[zz]));
+  }
+}
+
+void
+p4est_quadrant_array_linear_id_ext128 (sc_array_t * quadrants, int level,
+                                       p4est_lid_t * ids)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const size_t        count = quadrants->elem_count;
+  size_t              zz;
+  uint64_t            x, y;
+#ifdef P4_TO_P8
+  uint64_t            z, lo, hi;
+#endif
+  uint64_t            mask;
+  const p4est_quadrant_t *q;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (0 <= level && level <= P4EST_MAXLEVEL);
+
+  mask = ((uint64_t) 1 << (level + 2)) - 1;
+  q = (const p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < count; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_extended (&q[zz]));
+    x = (uint64_t) (q[zz].x >> shift) & mask;
+    y = (uint64_t) (q[zz].y >> shift) & mask;
+#ifndef P4_TO_P8
+    ids[zz] = p4est_morton_spread (x) | p4est_morton_spread (y) << 1;
+#else
+    z = (uint64_t) (q[zz].z >> shift) & mask;
+
+    /* the low 21 bits of each coordinate fill 63 bits of the index */
+    lo = p4est_morton_spread (x) | p4est_morton_spread (y) << 1 |
+      p4est_morton_spread (z) << 2;
+    hi = p4est_morton_spread (x >> 21) | p4est_morton_spread (y >> 21) << 1 |
+      p4est_morton_spread (z >> 21) << 2;
+    sc_uint128_init (&ids[zz], hi >> 1, lo | hi << 63);
+#endif
+  }
+}
+
+void
+p4est_quadrant_array_set_morton_ext128 (sc_array_t * quadrants, int level,
+                                        const p4est_lid_t * ids)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const size_t        count = quadrants->elem_count;
+  size_t              zz;
+  uint64_t            x, y;
+#ifdef P4_TO_P8
+  uint64_t            z, lo, hi;
+#endif
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (0 <= level && level <= P4EST_QMAXLEVEL);
+
+  q = (p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < count; ++zz) {
+#ifndef P4_TO_P8
+    x = p4est_morton_compact (ids[zz]);
+    y = p4est_morton_compact (ids[zz] >> 1);
+#else
+    lo = ids[zz].low_bits & ~((uint64_t) 1 << 63);
+    hi = ids[zz].high_bits << 1 | ids[zz].low_bits >> 63;
+    x = p4est_morton_compact (lo) | p4est_morton_compact (hi) << 21;
+    y = p4est_morton_compact (lo >> 1) | p4est_morton_compact (hi >> 1) << 21;
+    z = p4est_morton_compact (lo >> 2) | p4est_morton_compact (hi >> 2) << 21;
+    q[zz].z = (p4est_qcoord_t) (uint32_t) (z << shift);
+#endif
+    q[zz].x = (p4est_qcoord_t) (uint32_t) (x << shift);
+    q[zz].y = (p4est_qcoord_t) (uint32_t) (y << shift);
+    q[zz].level = (int8_t) level;
+    P4EST_ASSERT (p4est_quadrant_is_extended (&q[zz]));
+  }
+}
+
 void
 p4est_quadrant_successor (const p4est_quadrant_t * quadrant,
                           p4est_quadrant_t * result)
@@ -2688,3 +2886,199 @@ p4est_quadrant_is_ancestor_corner (const p4est_quadrant_t * descendant,
 #endif
     );
 }
+
+/* the number of low bits of a key that store the quadrant level */
+#define P4EST_KEY_LEVEL_BITS 5
+
+uint64_t
+p4est_quadrant_key (const p4est_quadrant_t * q)
+{
+  const int           shift = P4EST_MAXLEVEL - P4EST_KEY_MAXLEVEL;
+  uint64_t            id;
+
+  P4EST_ASSERT (p4est_quadrant_is_keyable (q));
+
+  id = p4est_morton_spread ((uint64_t) (q->x >> shift)) |
+    p4est_morton_spread ((uint64_t) (q->y >> shift)) << 1;
+#ifdef P4_TO_P8
+  id |= p4est_morton_spread ((uint64_t) (q->z >> shift)) << 2;
+#endif
+  return id << P4EST_KEY_LEVEL_BITS | (uint64_t) q->level;
+}
+
+void
+p4est_quadrant_set_key (p4est_quadrant_t * q, uint64_t key)
+{
+  const int           shift = P4EST_MAXLEVEL - P4EST_KEY_MAXLEVEL;
+  const uint64_t      id = key >> P4EST_KEY_LEVEL_BITS;
+
+  q->x = (p4est_qcoord_t) p4est_morton_compact (id) << shift;
+  q->y = (p4est_qcoord_t) p4est_morton_compact (id >> 1) << shift;
+#ifdef P4_TO_P8
+  q->z = (p4est_qcoord_t) p4est_morton_compact (id >> 2) << shift;
+#endif
+  q->level = (int8_t) (key & ((1 << P4EST_KEY_LEVEL_BITS) - 1));
+
+  P4EST_ASSERT (p4est_quadrant_is_keyable (q));
+}
+
+int
+p4est_quadrant_is_keyable (const p4est_quadrant_t * q)
+{
+  return p4est_quadrant_is_inside_root (q) &&
+    0 <= q->level && q->level <= P4EST_KEY_MAXLEVEL;
+}
+
+int
+p4est_key_compare (const void *v1, const void *v2)
+{
+  const uint64_t      k1 = *(const uint64_t *) v1;
+  const uint64_t      k2 = *(const uint64_t *) v2;
+
+  return k1 < k2 ? -1 : k1 > k2;
+}
+
+int
+p4est_key_overlaps (uint64_t k1, uint64_t k2)
+{
+  const uint64_t      lmask = (1 << P4EST_KEY_LEVEL_BITS) - 1;
+  const uint64_t      m1 = k1 >> P4EST_KEY_LEVEL_BITS;
+  const uint64_t      m2 = k2 >> P4EST_KEY_LEVEL_BITS;
+  const uint64_t      s1 = (uint64_t) 1 <<
+    (P4EST_DIM * (P4EST_KEY_MAXLEVEL - (int) (k1 & lmask)));
+  const uint64_t      s2 = (uint64_t) 1 <<
+    (P4EST_DIM * (P4EST_KEY_MAXLEVEL - (int) (k2 & lmask)));
+
+  /* the Morton ranges covered by both quadrants intersect */
+  return (m1 < m2 + s2) & (m2 < m1 + s1);
+}
+
+ssize_t
+p4est_key_lower_bound (const uint64_t * keys, size_t num_keys, uint64_t key)
+{
+  size_t              low, high, guess;
+
+  low = 0;
+  high = num_keys;
+  while (low < high) {
+    guess = low + (high - low) / 2;
+    if (keys[guess] < key) {
+      low = guess + 1;
+    }
+    else {
+      high = guess;
+    }
+  }
+  return low < num_keys ? (ssize_t) low : -1;
+}
+
+/** Arrays shorter than this are sorted by comparison instead of radix. */
+#define P4EST_KEY_SORT_MIN 128
+
+/** An entry of the radix sort: the sort key and the original position. */
+typedef struct p4est_key_entry
+{
+  uint64_t            hi, lo;
+  size_t              index;
+}
+p4est_key_entry_t;
+
+/** Return one byte of the sort key of an entry.
+ * \param [in] e        The entry.
+ * \param [in] pass     The byte position from 0 (least significant) to 15.
+ */
+static inline int
+p4est_key_entry_digit (const p4est_key_entry_t * e, int pass)
+{
+  return (int) (((pass < 8 ? e->lo : e->hi) >> (8 * (pass % 8))) & 0xff);
+}
+
+void
+p4est_quadrant_array_sort (sc_array_t * quadrants, int piggy)
+{
+  const size_t        count = quadrants->elem_count;
+  int                 i, pass, digit, num_passes;
+  int                 passes[16];
+  size_t              zz, sum, n;
+  size_t             *hist, *h;
+  uint64_t            difflo, diffhi;
+  p4est_quadrant_t   *q;
+  p4est_key_entry_t  *entries, *buffer, *swap;
+  sc_array_t         *sorted;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  if (count <= 1) {
+    return;
+  }
+  if (count < P4EST_KEY_SORT_MIN) {
+    sc_array_sort (quadrants, piggy ? p4est_quadrant_compare_piggy :
+                   p4est_quadrant_compare);
+    return;
+  }
+
+  /* compute keys, or fall back if some quadrant is not representable */
+  entries = P4EST_ALLOC (p4est_key_entry_t, count);
+  difflo = diffhi = 0;
+  for (zz = 0; zz < count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    if (!p4est_quadrant_is_keyable (q) || (piggy && q->p.which_tree < 0)) {
+      P4EST_FREE (entries);
+      sc_array_sort (quadrants, piggy ? p4est_quadrant_compare_piggy :
+                     p4est_quadrant_compare);
+      return;
+    }
+    entries[zz].hi = piggy ? (uint64_t) q->p.which_tree : 0;
+    entries[zz].lo = p4est_quadrant_key (q);
+    entries[zz].index = zz;
+
+    /* collect the bits in which any key differs from the first */
+    difflo |= entries[zz].lo ^ entries[0].lo;
+    diffhi |= entries[zz].hi ^ entries[0].hi;
+  }
+
+  /* only the byte positions that are not constant need to be sorted */
+  num_passes = 0;
+  for (pass = 0; pass < 16; ++pass) {
+    if (((pass < 8 ? difflo : diffhi) >> (8 * (pass % 8))) & 0xff) {
+      passes[num_passes++] = pass;
+    }
+  }
+
+  /* histograms of these byte positions in one pass over the entries */
+  hist = P4EST_ALLOC_ZERO (size_t, 256 * num_passes);
+  for (zz = 0; zz < count; ++zz) {
+    for (i = 0; i < num_passes; ++i) {
+      ++hist[256 * i + p4est_key_entry_digit (entries + zz, passes[i])];
+    }
+  }
+
+  /* least significant digit radix sort */
+  buffer = P4EST_ALLOC (p4est_key_entry_t, count);
+  for (i = 0; i < num_passes; ++i) {
+    h = hist + 256 * i;
+    for (sum = 0, digit = 0; digit < 256; ++digit) {
+      n = h[digit];
+      h[digit] = sum;
+      sum += n;
+    }
+    for (zz = 0; zz < count; ++zz) {
+      buffer[h[p4est_key_entry_digit (entries + zz, passes[i])]++] =
+        entries[zz];
+    }
+    swap = entries;
+    entries = buffer;
+    buffer = swap;
+  }
+  P4EST_FREE (buffer);
+  P4EST_FREE (hist);
+
+  /* apply the permutation */
+  sorted = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  for (zz = 0; zz < count; ++zz) {
+    *p4est_quadrant_array_index (sorted, zz) =
+      *p4est_quadrant_array_index (quadrants, entries[zz].index);
+  }
+  memcpy (quadrants->array, sorted->array, count * sizeof (p4est_quadrant_t));
+  sc_array_destroy (sorted);
+  P4EST_FREE (entries);
+}
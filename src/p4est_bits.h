@@ -710,6 +710,29 @@ uint64_t            p4est_quadrant_linear_id (const p4est_quadrant_t *
 void                p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
                                                int level, uint64_t id);
 
+/** Compute the linear positions of an array of quadrants in a uniform grid.
+ * This is the batched version of \ref p4est_quadrant_linear_id.
+ * The bits are interleaved by a branch-free computation per quadrant, which
+ * uses the bit deposit instruction if the compiler targets BMI2.
+ * \param [in] quadrants    Array of extended quadrants.
+ * \param [in] level        Level of the regular grid.
+ * \param [out] ids         Array of length quadrants->elem_count.
+ */
+void                p4est_quadrant_array_linear_id (sc_array_t * quadrants,
+                                                    int level, uint64_t * ids);
+
+/** Set the Morton indices of an array of quadrants from linear positions.
+ * This is the batched version of \ref p4est_quadrant_set_morton.
+ * \param [in,out] quadrants    The coordinates and level of all
+ *                              quadrants->elem_count entries are set.
+ * \param [in] level        Level of the grid and of the resulting quadrants.
+ * \param [in] ids          Array of length quadrants->elem_count.
+ * \note The user_data of the quadrants is never modified.
+ */
+void                p4est_quadrant_array_set_morton (sc_array_t * quadrants,
+                                                     int level,
+                                                     const uint64_t * ids);
+
 /** Compute the successor according to the Morton index in a uniform mesh.
  * \param[in] quadrant  Quadrant whose Morton successor will be computed.
  *                      Must not be the last (top right) quadrant in the tree.
@@ -793,6 +816,74 @@ int                 p4est_quadrant_is_ancestor_corner (const p4est_quadrant_t
                                                        * ancestor,
                                                        int corner);
 
+/** The finest level of quadrants that can be encoded in a 64-bit key.
+ * A key holds the Morton index of the first descendant at this level,
+ * followed by 5 bits for the quadrant level.
+ */
+#define P4EST_KEY_MAXLEVEL 29
+
+/** Compute the packed 64-bit key of a quadrant.
+ * Comparing two keys as unsigned integers yields the same order as
+ * \ref p4est_quadrant_compare.
+ * \param [in] q        A quadrant inside the root quadrant with a level
+ *                      no larger than \ref P4EST_KEY_MAXLEVEL.
+ * \return              The packed key.
+ */
+uint64_t            p4est_quadrant_key (const p4est_quadrant_t * q);
+
+/** Set the coordinates and level of a quadrant from a packed key.
+ * This is the inverse operation of \ref p4est_quadrant_key.
+ * \param [out] q       The coordinates and level are set.
+ * \param [in] key      A key produced by \ref p4est_quadrant_key.
+ * \note The user_data of \a q is never modified.
+ */
+void                p4est_quadrant_set_key (p4est_quadrant_t * q,
+                                            uint64_t key);
+
+/** Check whether a quadrant can be represented by a packed key.
+ * \param [in] q        Any extended quadrant.
+ * \return              True if \a q is inside the root and its level is
+ *                      no larger than \ref P4EST_KEY_MAXLEVEL.
+ */
+int                 p4est_quadrant_is_keyable (const p4est_quadrant_t * q);
+
+/** Compare two packed keys, suitable for sc_array_sort.
+ * \param [in] v1, v2   Pointers to uint64_t keys.
+ * \return              Negative, zero or positive like strcmp.
+ */
+int                 p4est_key_compare (const void *v1, const void *v2);
+
+/** Test whether the quadrants of two packed keys overlap.
+ * Since quadrants are aligned, this means that one of them is equal to
+ * or an ancestor of the other.
+ * \param [in] k1, k2   Two packed keys.
+ * \return              True if the quadrants overlap.
+ */
+int                 p4est_key_overlaps (uint64_t k1, uint64_t k2);
+
+/** Find the lowest position in a sorted key array such that it is >= key.
+ * \param [in] keys     Array of keys in ascending order.
+ * \param [in] num_keys Number of entries in \a keys.
+ * \param [in] key      The key to search for.
+ * \return              Returns the matching position or -1 if all keys
+ *                      are smaller than \a key or the array is empty.
+ */
+ssize_t             p4est_key_lower_bound (const uint64_t * keys,
+                                           size_t num_keys, uint64_t key);
+
+/** Sort an array of quadrants by their packed keys.
+ * The resulting order is the one defined by \ref p4est_quadrant_compare,
+ * or by \ref p4est_quadrant_compare_piggy if \a piggy is true.
+ * The keys are sorted by a radix sort on plain integers, which visits
+ * only the bytes in which the keys differ.  Short arrays, and those with
+ * a quadrant that cannot be represented by a key, are sorted by
+ * comparison instead.
+ * \param [in,out] quadrants    Array of p4est_quadrant_t.
+ * \param [in] piggy    If true, sort by p.which_tree first.
+ */
+void                p4est_quadrant_array_sort (sc_array_t * quadrants,
+                                               int piggy);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_BITS_H */
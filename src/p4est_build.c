@@ -113,6 +113,7 @@ p4est_build_new (p4est_t * from, size_t data_size,
   p4est->user_data_pool = NULL;
   p4est->quadrant_pool = NULL;
   p4est->inspect = NULL;
+  p4est->balance_log = NULL;
 
   /* start populating missing members */
   p4est->global_first_quadrant =
@@ -1474,3 +1474,386 @@ p4est_transfer_items_end (p4est_transfer_context_t * tc)
 
   p4est_transfer_end (tc);
 }
+
+static void
+p4est_partition_range_push (sc_array_t * ranges, int rank,
+                            p4est_gloidx_t begin, p4est_gloidx_t end)
+{
+  p4est_partition_range_t *range;
+
+  P4EST_ASSERT (begin < end);
+  range = (p4est_partition_range_t *) sc_array_push (ranges);
+  range->rank = rank;
+  range->begin = begin;
+  range->end = end;
+}
+
+static int
+p4est_partition_range_compare (const void *v1, const void *v2)
+{
+  const p4est_partition_range_t *r1 = (const p4est_partition_range_t *) v1;
+  const p4est_partition_range_t *r2 = (const p4est_partition_range_t *) v2;
+
+  return p4est_gloidx_compare (&r1->begin, &r2->begin);
+}
+
+p4est_partition_sparse_t *
+p4est_partition_sparse_new (p4est_t * p4est, p4est_weight_t weight_fn)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
+  int                 i, lowest, highest, owner;
+  int                 num_cuts;
+  size_t              lz;
+  ssize_t             lowers;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl;
+  p4est_gloidx_t      begin, expected, *cuts;
+  int64_t             weight, local[2], offsets[2];
+  int64_t            *local_weights;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+  p4est_partition_sparse_t *sparse;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 num_requests;
+  int                 need_low, need_high;
+  size_t              zz;
+  p4est_gloidx_t      bounds[2];
+  p4est_partition_range_t *range;
+  sc_MPI_Request     *requests;
+  sc_MPI_Status       status;
+#endif
+
+  sparse = P4EST_ALLOC_ZERO (p4est_partition_sparse_t, 1);
+  sparse->mpicomm = p4est->mpicomm;
+  sparse->mpisize = num_procs;
+  sparse->mpirank = rank;
+  sparse->global_num_quadrants = p4est->global_num_quadrants;
+  sc_array_init (&sparse->senders, sizeof (p4est_partition_range_t));
+  sc_array_init (&sparse->receivers, sizeof (p4est_partition_range_t));
+
+  /* linearly sum weights across all local trees */
+  local_weights = P4EST_ALLOC (int64_t, local_num_quadrants + 1);
+  kl = 0;
+  local_weights[0] = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, lz);
+      weight = weight_fn == NULL ? 1 : (int64_t) weight_fn (p4est, nt, q);
+      P4EST_ASSERT (weight >= 0);
+      local_weights[kl + 1] = local_weights[kl] + weight;
+    }
+  }
+  P4EST_ASSERT (kl == local_num_quadrants);
+
+  /* the quadrant and weight offsets of this process by a prefix sum */
+  local[0] = (int64_t) local_num_quadrants;
+  local[1] = local_weights[local_num_quadrants];
+  offsets[0] = offsets[1] = 0;
+  sparse->global_weight = local[1];
+#ifdef P4EST_ENABLE_MPI
+  mpiret = sc_MPI_Exscan (local, offsets, 2, sc_MPI_LONG_LONG_INT,
+                          sc_MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  if (rank == 0) {
+    /* the result of the exclusive scan is undefined on the first rank */
+    offsets[0] = offsets[1] = 0;
+  }
+  mpiret = sc_MPI_Allreduce (&local[1], &sparse->global_weight, 1,
+                             sc_MPI_LONG_LONG_INT, sc_MPI_SUM,
+                             p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+#endif
+  sparse->src_begin = (p4est_gloidx_t) offsets[0];
+  sparse->src_end = sparse->src_begin + local_num_quadrants;
+  P4EST_ASSERT (sparse->src_begin == p4est->global_first_quadrant[rank]);
+  P4EST_ASSERT (sparse->src_end == p4est->global_first_quadrant[rank + 1]);
+  P4EST_VERBOSEF ("local weight range %lld %lld of %lld\n",
+                  (long long) offsets[1], (long long) (offsets[1] + local[1]),
+                  (long long) sparse->global_weight);
+
+  /* if all quadrants have zero weight the partition remains */
+  if (sparse->global_weight == 0) {
+    sparse->dest_begin = sparse->src_begin;
+    sparse->dest_end = sparse->src_end;
+    if (sparse->src_begin < sparse->src_end) {
+      p4est_partition_range_push (&sparse->senders, rank,
+                                  sparse->src_begin, sparse->src_end);
+      p4est_partition_range_push (&sparse->receivers, rank,
+                                  sparse->src_begin, sparse->src_end);
+    }
+    P4EST_FREE (local_weights);
+    return sparse;
+  }
+
+  /* the cuts within the local weight range and the new owners */
+  lowest = p4est_partition_cut_rank (sparse->global_weight, offsets[1],
+                                     num_procs) + 1;
+  highest = SC_MIN (p4est_partition_cut_rank (sparse->global_weight,
+                                              offsets[1] + local[1],
+                                              num_procs), num_procs - 1);
+  owner = SC_MIN (lowest - 1, num_procs - 1);
+  num_cuts = SC_MAX (highest - lowest + 1, 0);
+  cuts = P4EST_ALLOC (p4est_gloidx_t, num_cuts);
+  begin = sparse->src_begin;
+  lowers = 0;
+  for (i = lowest; i <= highest; ++i) {
+    /* do binary search in the local weight array */
+    weight = (int64_t) p4est_partition_cut_uint64
+      ((uint64_t) sparse->global_weight, i, num_procs) - offsets[1];
+    lowers = sc_search_lower_bound64 (weight, local_weights,
+                                      (size_t) local_num_quadrants + 1,
+                                      (size_t) lowers);
+    P4EST_ASSERT (lowers > 0 &&
+                  (p4est_locidx_t) lowers <= local_num_quadrants);
+    cuts[i - lowest] = sparse->src_begin + (p4est_gloidx_t) lowers;
+    if (cuts[i - lowest] > begin) {
+      p4est_partition_range_push (&sparse->receivers, owner,
+                                  begin, cuts[i - lowest]);
+    }
+    begin = cuts[i - lowest];
+    owner = i;
+  }
+  if (sparse->src_end > begin) {
+    p4est_partition_range_push (&sparse->receivers, owner,
+                                begin, sparse->src_end);
+  }
+  P4EST_FREE (local_weights);
+
+  /* the first and last cut of the new local range */
+  sparse->dest_begin = 0;
+  sparse->dest_end = rank == num_procs - 1 ?
+    sparse->global_num_quadrants : 0;
+#ifndef P4EST_ENABLE_MPI
+  P4EST_ASSERT (num_cuts == 0);
+#else
+  need_low = rank > 0 && p4est_partition_cut_uint64
+    ((uint64_t) sparse->global_weight, rank, num_procs) > 0;
+  need_high = rank < num_procs - 1 && p4est_partition_cut_uint64
+    ((uint64_t) sparse->global_weight, rank + 1, num_procs) > 0;
+  num_requests = 0;
+  requests = P4EST_ALLOC (sc_MPI_Request,
+                          2 * num_cuts + sparse->receivers.elem_count);
+  for (i = lowest; i <= highest; ++i) {
+    if (i == rank) {
+      sparse->dest_begin = cuts[i - lowest];
+      need_low = 0;
+    }
+    else {
+      mpiret = sc_MPI_Isend (&cuts[i - lowest], 1, P4EST_MPI_GLOIDX, i,
+                             P4EST_COMM_PARTITION_WEIGHTED_LOW,
+                             p4est->mpicomm, &requests[num_requests++]);
+      SC_CHECK_MPI (mpiret);
+    }
+    if (i - 1 == rank) {
+      sparse->dest_end = cuts[i - lowest];
+      need_high = 0;
+    }
+    else {
+      mpiret = sc_MPI_Isend (&cuts[i - lowest], 1, P4EST_MPI_GLOIDX, i - 1,
+                             P4EST_COMM_PARTITION_WEIGHTED_HIGH,
+                             p4est->mpicomm, &requests[num_requests++]);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* the senders of the cuts are not known without global information */
+  if (need_low) {
+    mpiret = sc_MPI_Recv (&sparse->dest_begin, 1, P4EST_MPI_GLOIDX,
+                          sc_MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_WEIGHTED_LOW,
+                          p4est->mpicomm, sc_MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+  if (need_high) {
+    mpiret = sc_MPI_Recv (&sparse->dest_end, 1, P4EST_MPI_GLOIDX,
+                          sc_MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_WEIGHTED_HIGH,
+                          p4est->mpicomm, sc_MPI_STATUS_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+  P4EST_ASSERT (0 <= sparse->dest_begin &&
+                sparse->dest_begin <= sparse->dest_end &&
+                sparse->dest_end <= sparse->global_num_quadrants);
+
+  /* tell the new owners which range they receive from us */
+  expected = sparse->dest_end - sparse->dest_begin;
+#ifdef P4EST_ENABLE_MPI
+  for (zz = 0; zz < sparse->receivers.elem_count; ++zz) {
+    range = (p4est_partition_range_t *)
+      sc_array_index (&sparse->receivers, zz);
+    if (range->rank == rank) {
+      p4est_partition_range_push (&sparse->senders, rank,
+                                  range->begin, range->end);
+      expected -= range->end - range->begin;
+    }
+    else {
+      mpiret = sc_MPI_Isend (&range->begin, 2, P4EST_MPI_GLOIDX,
+                             range->rank, P4EST_COMM_PARTITION_SPARSE,
+                             p4est->mpicomm, &requests[num_requests++]);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* receive until the new local range is covered */
+  while (expected > 0) {
+    mpiret = sc_MPI_Recv (bounds, 2, P4EST_MPI_GLOIDX, sc_MPI_ANY_SOURCE,
+                          P4EST_COMM_PARTITION_SPARSE, p4est->mpicomm,
+                          &status);
+    SC_CHECK_MPI (mpiret);
+    P4EST_ASSERT (sparse->dest_begin <= bounds[0] && bounds[0] < bounds[1]
+                  && bounds[1] <= sparse->dest_end);
+    p4est_partition_range_push (&sparse->senders, status.MPI_SOURCE,
+                                bounds[0], bounds[1]);
+    expected -= bounds[1] - bounds[0];
+  }
+  P4EST_ASSERT (expected == 0);
+  sc_array_sort (&sparse->senders, p4est_partition_range_compare);
+
+  mpiret = sc_MPI_Waitall (num_requests, requests, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (requests);
+#else
+  if (expected > 0) {
+    p4est_partition_range_push (&sparse->senders, rank,
+                                sparse->dest_begin, sparse->dest_end);
+  }
+#endif
+  P4EST_FREE (cuts);
+
+  return sparse;
+}
+
+void
+p4est_partition_sparse_destroy (p4est_partition_sparse_t * sparse)
+{
+  sc_array_reset (&sparse->senders);
+  sc_array_reset (&sparse->receivers);
+  P4EST_FREE (sparse->dest_gfq);
+  P4EST_FREE (sparse);
+}
+
+const p4est_gloidx_t *
+p4est_partition_sparse_gfq (p4est_partition_sparse_t * sparse)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+#endif
+
+  if (sparse->dest_gfq == NULL) {
+    sparse->dest_gfq = P4EST_ALLOC (p4est_gloidx_t, sparse->mpisize + 1);
+#ifdef P4EST_ENABLE_MPI
+    mpiret = sc_MPI_Allgather (&sparse->dest_begin, 1, P4EST_MPI_GLOIDX,
+                               sparse->dest_gfq, 1, P4EST_MPI_GLOIDX,
+                               sparse->mpicomm);
+    SC_CHECK_MPI (mpiret);
+#else
+    sparse->dest_gfq[0] = sparse->dest_begin;
+#endif
+    sparse->dest_gfq[sparse->mpisize] = sparse->global_num_quadrants;
+  }
+  return sparse->dest_gfq;
+}
+
+p4est_transfer_context_t *
+p4est_transfer_sparse_begin (const p4est_partition_sparse_t * sparse,
+                             int tag, void *dest_data, const void *src_data,
+                             size_t data_size)
+{
+  p4est_transfer_context_t *tc;
+  int                 mpiret;
+  size_t              zz, byte_len, cp_len;
+  char               *dest_cp;
+  const char         *src_cp;
+  const p4est_partition_range_t *range;
+  sc_MPI_Request     *rq;
+
+  /* setup context structure */
+  tc = P4EST_ALLOC_ZERO (p4est_transfer_context_t, 1);
+  tc->variable = 0;
+
+  /* there is nothing to do when there is no data */
+  if (data_size == 0) {
+    return tc;
+  }
+  dest_cp = NULL;
+  src_cp = NULL;
+  cp_len = 0;
+
+  /* receive the pieces of the new local range */
+  tc->num_senders = (int) sparse->senders.elem_count;
+  rq = tc->recv_req = P4EST_ALLOC (sc_MPI_Request, tc->num_senders);
+  for (zz = 0; zz < sparse->senders.elem_count; ++zz) {
+    range = (const p4est_partition_range_t *) sparse->senders.array + zz;
+    byte_len = (size_t) (range->end - range->begin) * data_size;
+    if (range->rank == sparse->mpirank) {
+      /* on the same rank we remember pointers for memcpy */
+      cp_len = byte_len;
+      dest_cp = (char *) dest_data +
+        (size_t) (range->begin - sparse->dest_begin) * data_size;
+      *rq++ = sc_MPI_REQUEST_NULL;
+    }
+    else {
+      mpiret = sc_MPI_Irecv ((char *) dest_data +
+                             (size_t) (range->begin - sparse->dest_begin) *
+                             data_size, byte_len, sc_MPI_BYTE, range->rank,
+                             tag, sparse->mpicomm, rq++);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* send the pieces of the current local range */
+  tc->num_receivers = (int) sparse->receivers.elem_count;
+  rq = tc->send_req = P4EST_ALLOC (sc_MPI_Request, tc->num_receivers);
+  for (zz = 0; zz < sparse->receivers.elem_count; ++zz) {
+    range = (const p4est_partition_range_t *) sparse->receivers.array + zz;
+    byte_len = (size_t) (range->end - range->begin) * data_size;
+    if (range->rank == sparse->mpirank) {
+      P4EST_ASSERT (cp_len == byte_len);
+      src_cp = (const char *) src_data +
+        (size_t) (range->begin - sparse->src_begin) * data_size;
+      *rq++ = sc_MPI_REQUEST_NULL;
+    }
+    else {
+      mpiret = sc_MPI_Isend ((char *) src_data +
+                             (size_t) (range->begin - sparse->src_begin) *
+                             data_size, byte_len, sc_MPI_BYTE, range->rank,
+                             tag, sparse->mpicomm, rq++);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+
+  /* copy the data that remains local */
+  P4EST_ASSERT ((dest_cp == NULL) == (src_cp == NULL));
+  if (cp_len > 0) {
+    memcpy (dest_cp, src_cp, cp_len);
+  }
+
+  /* the rest goes into the p4est_transfer_sparse_end function */
+  return tc;
+}
+
+void
+p4est_transfer_sparse (const p4est_partition_sparse_t * sparse, int tag,
+                       void *dest_data, const void *src_data,
+                       size_t data_size)
+{
+  p4est_transfer_context_t *tc;
+
+  tc = p4est_transfer_sparse_begin (sparse, tag, dest_data, src_data,
+                                    data_size);
+  p4est_transfer_sparse_end (tc);
+}
+
+void
+p4est_transfer_sparse_end (p4est_transfer_context_t * tc)
+{
+  P4EST_ASSERT (tc != NULL);
+  P4EST_ASSERT (tc->variable == 0);
+
+  p4est_transfer_end (tc);
+}
@@ -344,6 +344,31 @@ void                p4est_quadrant_set_morton_ext128 (p4est_quadrant_t *
                                                       quadrant, int level,
                                                       const p4est_lid_t * id);
 
+/** Compute the linear positions of an array of quadrants as p4est_lid_t.
+ * This is the batched version of \ref p4est_quadrant_linear_id_ext128.
+ * \param [in] quadrants    Array of extended quadrants.
+ * \param [in] level        Level of the regular grid.
+ * \param [out] ids         Array of length quadrants->elem_count.
+ */
+void                p4est_quadrant_array_linear_id_ext128 (sc_array_t *
+                                                           quadrants,
+                                                           int level,
+                                                           p4est_lid_t * ids);
+
+/** Set the Morton indices of an array of quadrants from p4est_lid_t.
+ * This is the batched version of \ref p4est_quadrant_set_morton_ext128.
+ * \param [in,out] quadrants    The coordinates and level of all
+ *                              quadrants->elem_count entries are set.
+ * \param [in] level        Level of the grid and of the resulting quadrants.
+ * \param [in] ids          Array of length quadrants->elem_count.
+ * \note The user_data of the quadrants is never modified.
+ */
+void                p4est_quadrant_array_set_morton_ext128 (sc_array_t *
+                                                            quadrants,
+                                                            int level,
+                                                            const p4est_lid_t
+                                                            * ids);
+
 /** Create a new forest.
  * This is a more general form of \ref p4est_new.
  * The forest created is either uniformly refined at a given level
@@ -399,6 +424,55 @@ p4est_mesh_t       *p4est_mesh_new_ext (p4est_t * p4est,
                                         int compute_level_lists,
                                         p4est_connect_type_t btype);
 
+/** Create a new mesh using multiple threads on each process.
+ * The local quadrants are cut into contiguous ranges that never cross a
+ * tree boundary.  The face neighbors, tree indices and level lists of the
+ * ranges are computed concurrently by searching the local and ghost
+ * quadrants, and the hanging faces and level lists are merged by prefix
+ * sums over the ranges.  Meanwhile, one thread collects the edge and
+ * corner information with the iterator and records the order in which it
+ * visits the hanging faces, by which they are renumbered at the end.
+ * The result is identical to the mesh created by \ref p4est_mesh_new_ext.
+ * Unlike \ref p4est_refine_threads, this function uses the range-based
+ * algorithm even if p4est is compiled without OpenMP.
+ * \param [in] p4est                A forest that is fully 2:1 balanced.
+ * \param [in] ghost                The ghost layer created from the
+ *                                  provided p4est.
+ * \param [in] compute_tree_index   Boolean to decide whether to allocate and
+ *                                  compute the quad_to_tree list.
+ * \param [in] compute_level_lists  Boolean to decide whether to compute the
+ *                                  level lists in quad_level.
+ * \param [in] btype                Which neighbors to store.
+ * \param [in] num_threads          Number of threads to use.  If less than
+ *                                  1, the maximum number of OpenMP threads
+ *                                  is used.
+ * \return                          A fully allocated mesh structure.
+ */
+p4est_mesh_t       *p4est_mesh_new_threads (p4est_t * p4est,
+                                            p4est_ghost_t * ghost,
+                                            int compute_tree_index,
+                                            int compute_level_lists,
+                                            p4est_connect_type_t btype,
+                                            int num_threads);
+
+/** Build a ghost layer of several layers.
+ * The result is the same as calling p4est_ghost_expand num_layers - 1
+ * times on the ghost layer created by p4est_ghost_new.
+ * A further layer may reach a peer through the quadrants of a third
+ * process, so each layer is added by one round of communication.
+ * The outermost layer is stored as the mirror front, such that
+ * p4est_ghost_expand can be used to add more layers.
+ * \param [in] p4est            The forest for which the ghost layer will be
+ *                              generated.
+ * \param [in] btype            Which ghosts to include (across face, corner
+ *                              or full).
+ * \param [in] num_layers       The number of layers, at least 1.
+ * \return                      A fully initialized ghost layer.
+ */
+p4est_ghost_t      *p4est_ghost_new_ext (p4est_t * p4est,
+                                         p4est_connect_type_t btype,
+                                         int num_layers);
+
 /** Make a deep copy of a p4est.
  * The connectivity is not duplicated.
  * Copying of quadrant user data is optional.
@@ -443,6 +517,44 @@ void                p4est_refine_ext (p4est_t * p4est,
                                       p4est_init_t init_fn,
                                       p4est_replace_t replace_fn);
 
+/** Refine a forest using multiple threads on each process.
+ * The local quadrants are cut into contiguous ranges that never cross a
+ * tree boundary, and the ranges are refined concurrently.  Each range is
+ * written into a private array, and the results are spliced into the
+ * tree arrays at the end.  The resulting forest, the per-level counters
+ * and the sequence of callbacks within one range are the same as with
+ * \ref p4est_refine_ext.
+ * If p4est is compiled without OpenMP or only one thread is requested,
+ * this function calls \ref p4est_refine_ext.
+ * Allocating user data is serialized internally, thus libsc must be safe
+ * to call from multiple threads, which is the case when it is configured
+ * with OpenMP as well.
+ * \param [in,out] p4est The forest is changed in place.
+ * \param [in] refine_recursive Boolean to decide on recursive refinement.
+ * \param [in] maxlevel   Maximum allowed refinement level (inclusive).
+ *                        If this is negative the level is restricted only
+ *                        by the compile-time constant QMAXLEVEL in p4est.h.
+ * \param [in] refine_fn  Callback function as in \ref p4est_refine_ext.
+ * \param [in] init_fn    Callback function to initialize the user_data for
+ *                        newly created quadrants; may be NULL.
+ * \param [in] replace_fn Callback function that allows the user to change
+ *                        incoming quadrants based on the quadrants they
+ *                        replace; may be NULL.
+ * \param [in] num_threads Number of threads to use.  If less than 1,
+ *                        the maximum number of OpenMP threads is used.
+ * \param [in] concurrent_callbacks If false, at most one thread calls any
+ *                        of the callbacks at a time.  If true, the
+ *                        callbacks may be called concurrently for different
+ *                        ranges and must be thread safe.
+ */
+void                p4est_refine_threads (p4est_t * p4est,
+                                          int refine_recursive, int maxlevel,
+                                          p4est_refine_t refine_fn,
+                                          p4est_init_t init_fn,
+                                          p4est_replace_t replace_fn,
+                                          int num_threads,
+                                          int concurrent_callbacks);
+
 /** Coarsen a forest.
  * \param [in,out] p4est The forest is changed in place.
  * \param [in] coarsen_recursive Boolean to decide on recursive coarsening.
@@ -470,6 +582,50 @@ void                p4est_coarsen_ext (p4est_t * p4est, int coarsen_recursive,
                                        p4est_init_t init_fn,
                                        p4est_replace_t replace_fn);
 
+/** Coarsen a forest using multiple threads on each process.
+ * The quadrants of each tree are cut into ranges that begin with a
+ * quadrant of child id zero, such that no family crosses a range boundary.
+ * Families are found in all ranges concurrently, the coarsened ranges are
+ * compacted in place and then concatenated by a prefix sum over their
+ * sizes.  The resulting forest is identical to \ref p4est_coarsen_ext.
+ * If p4est is compiled without OpenMP or only one thread is requested,
+ * this function calls \ref p4est_coarsen_ext.
+ * \param [in,out] p4est The forest is changed in place.
+ * \param [in] coarsen_recursive Boolean to decide on recursive coarsening.
+ *                        Families that span several ranges after the
+ *                        ranges have been coarsened are found in a
+ *                        sequential pass over the tree.
+ * \param [in] callback_orphans Boolean to enable calling coarsen_fn even on
+ *                        non-families as in \ref p4est_coarsen_ext.
+ *                        With coarsen_recursive true, orphan callbacks are
+ *                        only made from within each range.
+ * \param [in] coarsen_fn Callback function that returns true if a
+ *                        family of quadrants shall be coarsened.
+ * \param [in] init_fn    Callback function to initialize the user_data
+ *                        which is already allocated automatically.
+ * \param [in] replace_fn Callback function that allows the user to change
+ *                        incoming quadrants based on the quadrants they
+ *                        replace.
+ * \param [in] num_threads Number of threads to use.  If less than 1,
+ *                        the maximum number of OpenMP threads is used.
+ * \param [in] concurrent_callbacks If false, all callbacks are made by
+ *                        one thread in the same order as by
+ *                        \ref p4est_coarsen_ext, and only the search for
+ *                        families and the compaction are threaded.  In
+ *                        recursive mode this falls back to
+ *                        \ref p4est_coarsen_ext.  If true, the callbacks
+ *                        for different ranges are made concurrently and
+ *                        in no particular order and must be thread safe.
+ */
+void                p4est_coarsen_threads (p4est_t * p4est,
+                                           int coarsen_recursive,
+                                           int callback_orphans,
+                                           p4est_coarsen_t coarsen_fn,
+                                           p4est_init_t init_fn,
+                                           p4est_replace_t replace_fn,
+                                           int num_threads,
+                                           int concurrent_callbacks);
+
 /** 2:1 balance the size differences of neighboring elements in a forest.
  * \param [in,out] p4est  The p4est to be worked on.
  * \param [in] btype      Balance type (face or corner/full).
@@ -486,6 +642,62 @@ void                p4est_balance_ext (p4est_t * p4est,
                                        p4est_init_t init_fn,
                                        p4est_replace_t replace_fn);
 
+/** Opaque context of a split-phase 2:1 balance. */
+typedef struct p4est_balance_context p4est_balance_context_t;
+
+/** Begin a 2:1 balance whose communication overlaps with other work.
+ * The arguments are identical to \ref p4est_balance_ext.
+ * This function runs the local balance of all trees that touch a process
+ * boundary and posts the messages to the neighbor processes.  Trees that
+ * are owned by this process together with all of their neighbor trees are
+ * balanced in \ref p4est_balance_end while the messages are in flight.
+ * The forest must not be accessed or modified until the end call returns.
+ * \param [in,out] p4est  The forest to be balanced.
+ * \param [in] btype      Balance type (face, corner or full).
+ * \param [in] init_fn    Callback function to initialize the user_data.
+ * \param [in] replace_fn Callback function that allows the user to change
+ *                        incoming quadrants based on the ones they replace.
+ * \return                Context to be passed to \ref p4est_balance_end.
+ */
+p4est_balance_context_t *p4est_balance_begin (p4est_t * p4est,
+                                             p4est_connect_type_t btype,
+                                             p4est_init_t init_fn,
+                                             p4est_replace_t replace_fn);
+
+/** Complete a 2:1 balance started by \ref p4est_balance_begin.
+ * The resulting forest is identical to the one of \ref p4est_balance_ext.
+ * \param [in] ctx        Context created by \ref p4est_balance_begin.
+ *                        It is deallocated before this function returns.
+ */
+void                p4est_balance_end (p4est_balance_context_t * ctx);
+
+/** Enable or disable incremental 2:1 balance.
+ * If enabled, \ref p4est_balance_ext records the balanced state, and
+ * \ref p4est_refine_ext and \ref p4est_coarsen_ext log the quadrants they
+ * change.  The next balance with the same or a weaker connect type only
+ * examines the changed quadrants and those whose insulation layer
+ * contains a changed quadrant, such that its cost scales with the size of
+ * the change instead of the size of the forest.  The result is the same.
+ * A partition keeps the log valid if no quadrants have changed since the
+ * last balance.  Any other modification, including the threaded refine
+ * and coarsen functions, invalidates the log and the next balance runs the
+ * full algorithm, as does a change of more than a small fraction of the
+ * quadrants on any process.
+ * This function is collective.  The first balance after enabling is
+ * always a full one.
+ * \param [in,out] p4est  The forest.
+ * \param [in] enable     Boolean to enable or disable the tracking.
+ */
+void                p4est_balance_track (p4est_t * p4est, int enable);
+
+/** Return the number of balances that ran incrementally.
+ * The count starts at zero when \ref p4est_balance_track enables the
+ * tracking.  It is the same on all processes.
+ * \param [in] p4est  The forest.
+ * \return            The count, or zero if the tracking is disabled.
+ */
+long                p4est_balance_incremental_count (p4est_t * p4est);
+
 void                p4est_balance_subtree_ext (p4est_t * p4est,
                                                p4est_connect_type_t btype,
                                                p4est_topidx_t which_tree,
@@ -512,6 +724,77 @@ p4est_gloidx_t      p4est_partition_ext (p4est_t * p4est,
                                          int partition_for_coarsening,
                                          p4est_weight_t weight_fn);
 
+/** Callback function prototype to calculate several partition weights.
+ * \param [in] p4est       the forest
+ * \param [in] which_tree  the tree containing \a quadrant
+ * \param [in] quadrant    the quadrant to be weighted
+ * \param [out] weights    One 32bit integer >= 0 for each constraint.
+ * \note    The global sum of each weight must fit into a 64bit integer.
+ */
+typedef void        (*p4est_weights_t) (p4est_t * p4est,
+                                        p4est_topidx_t which_tree,
+                                        p4est_quadrant_t * quadrant,
+                                        int *weights);
+
+/** Repartition the forest to balance several weights at once.
+ *
+ * For each boundary between processors, the position along the
+ * space-filling curve is chosen that minimizes the largest deviation of
+ * any weight from its ideal cut, measured relative to the average weight
+ * per processor.  Among the positions where this deviation is within
+ * \a tolerance, the one closest to the ideal cut of the first weight is
+ * chosen.  Thus the load of every processor is within twice the tolerance
+ * of the average for every weight whenever such a partition exists.
+ * No per-process arrays are reduced: each boundary is searched only by
+ * the processes that hold quadrants between the ideal cuts of its weights,
+ * and only the chosen cuts are gathered for the final redistribution.
+ * The data is moved by \ref p4est_partition_given.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     num_weights        The number of weights per quadrant.
+ * \param [in]     weights_fn A callback that is called in order for all
+ *                            quadrants when running with mpisize > 1.
+ * \param [in]     tolerance  The admissible deviation of a cut, relative
+ *                            to the average weight per processor.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_multi (p4est_t * p4est,
+                                           int num_weights,
+                                           p4est_weights_t weights_fn,
+                                           double tolerance);
+
+/** Repair the partition of the forest by moving few quadrants.
+ *
+ * Unlike \ref p4est_partition_ext, which computes the ideal partition
+ * from scratch, this function keeps the current partition if the load of
+ * every processor exceeds the average by at most \a tolerance, relative
+ * to the average.  Otherwise it moves only those boundaries between
+ * processors that are farther than half the tolerance from their ideal
+ * position, and each by the minimum amount that brings it within.  Thus
+ * quadrants move mostly between processors adjacent along the
+ * space-filling curve, and a small imbalance after an adaptation step
+ * does not reshuffle the whole forest.  Afterwards, the load of every
+ * processor exceeds the average by at most \a tolerance plus the weight
+ * of a single quadrant.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     weight_fn  A weighting function or NULL for uniform
+ *                            weights.  Called in order for all quadrants
+ *                            when running with mpisize > 1.
+ * \param [in]     tolerance  The admissible imbalance, for example 0.05
+ *                            for five percent above the average load.
+ * \param [out]    bytes_moved        If not NULL, the global number of
+ *                            bytes of quadrants and their user data that
+ *                            have been sent to another processor.
+ * \return         The global number of shipped quadrants.  Application
+ *                 data may be moved accordingly by
+ *                 \ref p4est_transfer_fixed.
+ */
+p4est_gloidx_t      p4est_partition_repair (p4est_t * p4est,
+                                            p4est_weight_t weight_fn,
+                                            double tolerance,
+                                            p4est_gloidx_t * bytes_moved);
+
 /** Correct partition to allow one level of coarsening.
  *
  * \param [in] p4est                     forest whose partition is corrected
@@ -534,6 +817,39 @@ void                p4est_iterate_ext (p4est_t * p4est,
                                        p4est_iter_corner_t iter_corner,
                                        int remote);
 
+/** Iterate over the forest using multiple threads on each process.
+ * Each local tree is cut into search areas down to a level that yields
+ * enough work units for the threads.  A unit either visits everything
+ * inside of an area, the interfaces between the children of a coarser
+ * area, or the entities between one tree and its neighbors.  The units
+ * are distributed dynamically over the threads, each with its own search
+ * state.  Every volume, face and corner is visited exactly once, with the
+ * same information as in \ref p4est_iterate_ext, but the order of the
+ * callbacks is not defined.
+ * \param [in] remote       As in \ref p4est_iterate_ext.
+ * \param [in] num_threads  Number of threads to use.  If less than 1,
+ *                          the maximum number of OpenMP threads is used.
+ * \param [in] shared_writes If false, the callbacks may be called
+ *                          concurrently in any order and must be thread
+ *                          safe.  If true, the callbacks may write without
+ *                          synchronization to the data of the local
+ *                          quadrants they are passed, such as the quadrant
+ *                          user data.  The units are then run in phases:
+ *                          first all volume units, then the interfaces
+ *                          units level by level from fine to coarse, and
+ *                          finally the units between trees by one thread.
+ *                          No two units of a phase touch the same local
+ *                          quadrant.
+ */
+void                p4est_iterate_threads (p4est_t * p4est,
+                                           p4est_ghost_t * ghost_layer,
+                                           void *user_data,
+                                           p4est_iter_volume_t iter_volume,
+                                           p4est_iter_face_t iter_face,
+                                           p4est_iter_corner_t iter_corner,
+                                           int remote, int num_threads,
+                                           int shared_writes);
+
 /** Save the complete connectivity/p4est data to disk.  This is a collective
  * operation that all MPI processes need to call.  All processes write
  * into the same file, so the filename given needs to be identical over
@@ -57,6 +57,15 @@ typedef enum
 }
 p4est_ghost_tolerance_t;
 
+/** Operations on the previous ghosts encoded in a ghost update message */
+typedef enum
+{
+  P4EST_GHOST_UPDATE_KEEP,
+  P4EST_GHOST_UPDATE_SKIP,
+  P4EST_GHOST_UPDATE_ADD
+}
+p4est_ghost_update_kind_t;
+
 size_t
 p4est_ghost_memory_used (p4est_ghost_t * ghost)
 {
@@ -66,6 +75,528 @@ p4est_ghost_memory_used (p4est_ghost_t * ghost)
     (ghost->num_trees + 1) * sizeof (p4est_locidx_t);
 }
 
+size_t
+p4est_ghost_mirror_memory_used (p4est_ghost_t * ghost)
+{
+  size_t              mem;
+
+  mem = sc_array_memory_used (&ghost->mirrors, 0) +
+    (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
+    (ghost->num_trees + 1) * sizeof (p4est_locidx_t) +
+    ghost->mirror_proc_offsets[ghost->mpisize] * sizeof (p4est_locidx_t);
+  if (ghost->mirror_proc_fronts != ghost->mirror_proc_mirrors) {
+    mem += (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
+      ghost->mirror_proc_front_offsets[ghost->mpisize] *
+      sizeof (p4est_locidx_t);
+  }
+  return mem;
+}
+
+/** Number of entries decoded from one checkpoint of a compact array */
+static const p4est_locidx_t p4est_ghost_compact_block = 32;
+
+/** Quadrants sorted by owner and tree, coded with run lengths and deltas.
+ * The runs split the array into maximal ranges of equal owner and tree.
+ * For every entry the byte stream holds the differences of its coordinates,
+ * shifted by the trailing zero bits common to all entries, and of its local
+ * number to the previous entry as variable length integers, followed by its
+ * level.  The differences restart from zero at the beginning of every run
+ * and every block of entries.
+ */
+typedef struct p4est_ghost_coded
+{
+  p4est_locidx_t      num_entries;
+  p4est_locidx_t      num_runs;
+  int                 shift;            /**< Common trailing zero bits */
+  p4est_locidx_t     *run_offsets;      /**< num_runs + 1 entry indices */
+  int                *run_ranks;        /**< Owner of each run */
+  p4est_topidx_t     *run_trees;        /**< Tree of each run */
+  size_t             *block_offsets;    /**< Byte offset of every block */
+  size_t              num_bytes;
+  unsigned char      *bytes;
+}
+p4est_ghost_coded_t;
+
+#ifdef P4_TO_P8
+#define p4est_ghost_compact             p8est_ghost_compact
+#endif
+
+/** Ghost layer with run-length and delta coded quadrants. */
+struct p4est_ghost_compact
+{
+  int                 mpisize;
+  p4est_topidx_t      num_trees;
+  p4est_connect_type_t btype;
+  p4est_ghost_coded_t ghosts;
+  p4est_ghost_coded_t mirrors;
+
+  /* the mirror lists by process, restricted to the peer processes */
+  int                 num_peers;
+  int                *peer_ranks;
+  p4est_locidx_t     *peer_offsets;     /**< num_peers + 1 list indices */
+  size_t             *list_block_offsets;
+  size_t              num_list_bytes;
+  unsigned char      *list_bytes;
+};
+
+static void
+p4est_ghost_compact_put (sc_array_t * bytes, uint64_t value)
+{
+  unsigned char      *b;
+
+  /* seven bits per byte, the high bit flags continuation */
+  while (value >= 0x80) {
+    b = (unsigned char *) sc_array_push (bytes);
+    *b = (unsigned char) (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  b = (unsigned char *) sc_array_push (bytes);
+  *b = (unsigned char) value;
+}
+
+/** Move a coded byte stream into an allocation of exactly its size */
+static unsigned char *
+p4est_ghost_compact_fit (sc_array_t * stream, size_t *num_bytes)
+{
+  unsigned char      *bytes;
+
+  *num_bytes = stream->elem_count;
+  bytes = P4EST_ALLOC (unsigned char, *num_bytes);
+  if (*num_bytes > 0) {
+    memcpy (bytes, stream->array, *num_bytes);
+  }
+  sc_array_reset (stream);
+  return bytes;
+}
+
+static              uint64_t
+p4est_ghost_compact_get (const unsigned char **b)
+{
+  int                 shift;
+  uint64_t            value;
+
+  value = 0;
+  for (shift = 0;; shift += 7) {
+    value |= (uint64_t) (**b & 0x7F) << shift;
+    if (!(*(*b)++ & 0x80)) {
+      return value;
+    }
+  }
+}
+
+/** Map signed differences to small unsigned values */
+static              uint64_t
+p4est_ghost_compact_zigzag (int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static              int64_t
+p4est_ghost_compact_unzigzag (uint64_t value)
+{
+  return (int64_t) ((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static void
+p4est_ghost_coded_init (p4est_ghost_coded_t * coded, sc_array_t * quads,
+                        const p4est_locidx_t * proc_offsets)
+{
+  const p4est_locidx_t num_entries = (p4est_locidx_t) quads->elem_count;
+  const p4est_locidx_t nb = p4est_ghost_compact_block;
+  int                 proc, rank;
+  p4est_locidx_t      i, nr;
+  p4est_topidx_t      tree;
+  int                 j;
+  int64_t             coord[P4EST_DIM], base[P4EST_DIM];
+  p4est_locidx_t      base_num;
+  p4est_quadrant_t   *q;
+  unsigned char      *level;
+  sc_array_t          stream;
+
+  coded->num_entries = num_entries;
+  coded->shift = P4EST_MAXLEVEL;
+  sc_array_init (&stream, 1);
+  coded->block_offsets = P4EST_ALLOC (size_t, (num_entries + nb - 1) / nb);
+
+  /* count the runs of equal owner and tree */
+  for (nr = 0, proc = 0, i = 0; i < num_entries; ++i) {
+    q = p4est_quadrant_array_index (quads, (size_t) i);
+    while (proc_offsets != NULL && proc_offsets[proc + 1] <= i) {
+      ++proc;
+    }
+    if (i == 0 || (proc_offsets != NULL && proc_offsets[proc] == i) ||
+        q->p.piggy3.which_tree !=
+        p4est_quadrant_array_index (quads, (size_t) i - 1)->
+        p.piggy3.which_tree) {
+      ++nr;
+    }
+    coded->shift = SC_MIN (coded->shift, P4EST_MAXLEVEL - (int) q->level);
+  }
+  coded->num_runs = nr;
+  coded->run_offsets = P4EST_ALLOC (p4est_locidx_t, nr + 1);
+  coded->run_ranks = proc_offsets == NULL ? NULL : P4EST_ALLOC (int, nr);
+  coded->run_trees = P4EST_ALLOC (p4est_topidx_t, nr);
+
+  /* encode the entries and record the runs */
+  base_num = 0;
+  rank = -1;
+  tree = -1;
+  for (nr = 0, proc = 0, i = 0; i < num_entries; ++i) {
+    q = p4est_quadrant_array_index (quads, (size_t) i);
+    while (proc_offsets != NULL && proc_offsets[proc + 1] <= i) {
+      ++proc;
+    }
+    if (i == 0 || (proc_offsets != NULL && proc != rank) ||
+        q->p.piggy3.which_tree != tree) {
+      rank = proc;
+      tree = q->p.piggy3.which_tree;
+      coded->run_offsets[nr] = i;
+      if (coded->run_ranks != NULL) {
+        coded->run_ranks[nr] = rank;
+      }
+      coded->run_trees[nr++] = tree;
+    }
+    if (i % nb == 0 || coded->run_offsets[nr - 1] == i) {
+      if (i % nb == 0) {
+        coded->block_offsets[i / nb] = stream.elem_count;
+      }
+      memset (base, 0, sizeof (base));
+      base_num = 0;
+    }
+    coord[0] = (int64_t) q->x >> coded->shift;
+    coord[1] = (int64_t) q->y >> coded->shift;
+#ifdef P4_TO_P8
+    coord[2] = (int64_t) q->z >> coded->shift;
+#endif
+    for (j = 0; j < P4EST_DIM; ++j) {
+      p4est_ghost_compact_put (&stream,
+                               p4est_ghost_compact_zigzag (coord[j] -
+                                                           base[j]));
+      base[j] = coord[j];
+    }
+    P4EST_ASSERT (q->p.piggy3.local_num >= base_num);
+    p4est_ghost_compact_put (&stream,
+                             (uint64_t) (q->p.piggy3.local_num - base_num));
+    level = (unsigned char *) sc_array_push (&stream);
+    *level = (unsigned char) q->level;
+    base_num = q->p.piggy3.local_num;
+  }
+  P4EST_ASSERT (nr == coded->num_runs);
+  coded->run_offsets[nr] = num_entries;
+  coded->bytes = p4est_ghost_compact_fit (&stream, &coded->num_bytes);
+}
+
+static void
+p4est_ghost_coded_reset (p4est_ghost_coded_t * coded)
+{
+  P4EST_FREE (coded->run_offsets);
+  P4EST_FREE (coded->run_ranks);
+  P4EST_FREE (coded->run_trees);
+  P4EST_FREE (coded->block_offsets);
+  P4EST_FREE (coded->bytes);
+}
+
+static              size_t
+p4est_ghost_coded_memory_used (p4est_ghost_coded_t * coded)
+{
+  const p4est_locidx_t nb = p4est_ghost_compact_block;
+
+  return (coded->num_runs + 1) * sizeof (p4est_locidx_t) +
+    (coded->run_ranks != NULL ? coded->num_runs * sizeof (int) : 0) +
+    coded->num_runs * sizeof (p4est_topidx_t) +
+    (coded->num_entries + nb - 1) / nb * sizeof (size_t) +
+    coded->num_bytes;
+}
+
+/** Find the run containing an entry by binary search */
+static              p4est_locidx_t
+p4est_ghost_coded_run (p4est_ghost_coded_t * coded, p4est_locidx_t i)
+{
+  p4est_locidx_t      low, high, mid;
+
+  P4EST_ASSERT (0 <= i && i < coded->num_entries);
+  low = 0;
+  high = coded->num_runs - 1;
+  while (low < high) {
+    mid = (low + high + 1) / 2;
+    if (coded->run_offsets[mid] <= i) {
+      low = mid;
+    }
+    else {
+      high = mid - 1;
+    }
+  }
+  return low;
+}
+
+/** Decode one entry, returning its run */
+static              p4est_locidx_t
+p4est_ghost_coded_entry (p4est_ghost_coded_t * coded, p4est_locidx_t i,
+                         p4est_quadrant_t * q)
+{
+  const p4est_locidx_t nb = p4est_ghost_compact_block;
+  const p4est_locidx_t first = i / nb * nb;
+  p4est_locidx_t      run, k;
+  p4est_locidx_t      num;
+  int                 j;
+  int64_t             coord[P4EST_DIM];
+  const unsigned char *b;
+
+  run = p4est_ghost_coded_run (coded, i);
+
+  /* decode forward from the checkpoint of the block */
+  b = coded->bytes + coded->block_offsets[i / nb];
+  for (k = first;; ++k) {
+    if (k == first || k == coded->run_offsets[run]) {
+      /* entries before the start of the run only advance the stream */
+      memset (coord, 0, sizeof (coord));
+      num = 0;
+    }
+    for (j = 0; j < P4EST_DIM; ++j) {
+      coord[j] +=
+        p4est_ghost_compact_unzigzag (p4est_ghost_compact_get (&b));
+    }
+    num += (p4est_locidx_t) p4est_ghost_compact_get (&b);
+    if (k == i) {
+      break;
+    }
+    ++b;
+  }
+
+  P4EST_QUADRANT_INIT (q);
+  q->x = (p4est_qcoord_t) (coord[0] << coded->shift);
+  q->y = (p4est_qcoord_t) (coord[1] << coded->shift);
+#ifdef P4_TO_P8
+  q->z = (p4est_qcoord_t) (coord[2] << coded->shift);
+#endif
+  q->level = (int8_t) *b;
+  q->p.piggy3.which_tree = coded->run_trees[run];
+  q->p.piggy3.local_num = num;
+  return run;
+}
+
+p4est_ghost_compact_t *
+p4est_ghost_compact_new (p4est_ghost_t * ghost)
+{
+  const p4est_locidx_t nb = p4est_ghost_compact_block;
+  int                 p, peer;
+  p4est_locidx_t      k, kend, num_list, base;
+  p4est_ghost_compact_t *compact;
+  sc_array_t          stream;
+
+  compact = P4EST_ALLOC_ZERO (p4est_ghost_compact_t, 1);
+  compact->mpisize = ghost->mpisize;
+  compact->num_trees = ghost->num_trees;
+  compact->btype = ghost->btype;
+
+  /* the ghosts are sorted by owner and tree, the mirrors by tree */
+  p4est_ghost_coded_init (&compact->ghosts, &ghost->ghosts,
+                          ghost->proc_offsets);
+  p4est_ghost_coded_init (&compact->mirrors, &ghost->mirrors, NULL);
+
+  /* store the mirror lists of the peers only */
+  for (p = 0; p < ghost->mpisize; ++p) {
+    if (ghost->mirror_proc_offsets[p + 1] > ghost->mirror_proc_offsets[p]) {
+      ++compact->num_peers;
+    }
+  }
+  compact->peer_ranks = P4EST_ALLOC (int, compact->num_peers);
+  compact->peer_offsets = P4EST_ALLOC (p4est_locidx_t, compact->num_peers + 1);
+  num_list = ghost->mirror_proc_offsets[ghost->mpisize];
+  compact->list_block_offsets =
+    P4EST_ALLOC (size_t, (num_list + nb - 1) / nb);
+  sc_array_init (&stream, 1);
+  for (p = 0, peer = 0; p < ghost->mpisize; ++p) {
+    k = ghost->mirror_proc_offsets[p];
+    kend = ghost->mirror_proc_offsets[p + 1];
+    if (kend == k) {
+      continue;
+    }
+    compact->peer_ranks[peer] = p;
+    compact->peer_offsets[peer++] = k;
+
+    /* each list is ascending, so code its differences */
+    for (base = 0; k < kend; ++k) {
+      if (k % nb == 0) {
+        compact->list_block_offsets[k / nb] = stream.elem_count;
+        base = 0;
+      }
+      P4EST_ASSERT (ghost->mirror_proc_mirrors[k] >= base);
+      p4est_ghost_compact_put (&stream, (uint64_t)
+                               (ghost->mirror_proc_mirrors[k] - base));
+      base = ghost->mirror_proc_mirrors[k];
+    }
+  }
+  P4EST_ASSERT (peer == compact->num_peers);
+  compact->peer_offsets[peer] = num_list;
+  compact->list_bytes =
+    p4est_ghost_compact_fit (&stream, &compact->num_list_bytes);
+
+  P4EST_VERBOSEF ("Ghost layer memory %llu bytes full %llu bytes compact\n",
+                  (unsigned long long) (p4est_ghost_memory_used (ghost) +
+                                        p4est_ghost_mirror_memory_used
+                                        (ghost)),
+                  (unsigned long long)
+                  p4est_ghost_compact_memory_used (compact));
+  return compact;
+}
+
+void
+p4est_ghost_compact_destroy (p4est_ghost_compact_t * compact)
+{
+  p4est_ghost_coded_reset (&compact->ghosts);
+  p4est_ghost_coded_reset (&compact->mirrors);
+  P4EST_FREE (compact->peer_ranks);
+  P4EST_FREE (compact->peer_offsets);
+  P4EST_FREE (compact->list_block_offsets);
+  P4EST_FREE (compact->list_bytes);
+  P4EST_FREE (compact);
+}
+
+size_t
+p4est_ghost_compact_memory_used (p4est_ghost_compact_t * compact)
+{
+  const p4est_locidx_t nb = p4est_ghost_compact_block;
+
+  return sizeof (p4est_ghost_compact_t) +
+    p4est_ghost_coded_memory_used (&compact->ghosts) +
+    p4est_ghost_coded_memory_used (&compact->mirrors) +
+    compact->num_peers * sizeof (int) +
+    (compact->num_peers + 1) * sizeof (p4est_locidx_t) +
+    (compact->peer_offsets[compact->num_peers] + nb - 1) / nb *
+    sizeof (size_t) + compact->num_list_bytes;
+}
+
+p4est_locidx_t
+p4est_ghost_compact_num_ghosts (p4est_ghost_compact_t * compact)
+{
+  return compact->ghosts.num_entries;
+}
+
+p4est_locidx_t
+p4est_ghost_compact_num_mirrors (p4est_ghost_compact_t * compact)
+{
+  return compact->mirrors.num_entries;
+}
+
+int
+p4est_ghost_compact_ghost (p4est_ghost_compact_t * compact,
+                           p4est_locidx_t g, p4est_quadrant_t * q)
+{
+  return compact->ghosts.run_ranks[p4est_ghost_coded_entry
+                                   (&compact->ghosts, g, q)];
+}
+
+void
+p4est_ghost_compact_mirror (p4est_ghost_compact_t * compact,
+                            p4est_locidx_t m, p4est_quadrant_t * q)
+{
+  (void) p4est_ghost_coded_entry (&compact->mirrors, m, q);
+}
+
+/** Return the first run with at least the given rank or tree */
+static              p4est_locidx_t
+p4est_ghost_coded_lower (p4est_ghost_coded_t * coded, int rank,
+                         p4est_topidx_t tree)
+{
+  p4est_locidx_t      low, high, mid;
+
+  low = 0;
+  high = coded->num_runs;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (rank >= 0 ? coded->run_ranks[mid] < rank :
+        coded->run_trees[mid] < tree) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  return coded->run_offsets[low];
+}
+
+p4est_locidx_t
+p4est_ghost_compact_proc_offset (p4est_ghost_compact_t * compact, int p)
+{
+  P4EST_ASSERT (0 <= p && p <= compact->mpisize);
+  return p4est_ghost_coded_lower (&compact->ghosts, p, -1);
+}
+
+p4est_locidx_t
+p4est_ghost_compact_tree_offset (p4est_ghost_compact_t * compact,
+                                 p4est_topidx_t t)
+{
+  P4EST_ASSERT (0 <= t && t <= compact->num_trees);
+  return p4est_ghost_coded_lower (&compact->ghosts, -1, t);
+}
+
+p4est_locidx_t
+p4est_ghost_compact_mirror_tree_offset (p4est_ghost_compact_t * compact,
+                                        p4est_topidx_t t)
+{
+  P4EST_ASSERT (0 <= t && t <= compact->num_trees);
+  return p4est_ghost_coded_lower (&compact->mirrors, -1, t);
+}
+
+p4est_locidx_t
+p4est_ghost_compact_mirror_proc_offset (p4est_ghost_compact_t * compact,
+                                        int p)
+{
+  int                 low, high, mid;
+
+  P4EST_ASSERT (0 <= p && p <= compact->mpisize);
+  low = 0;
+  high = compact->num_peers;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (compact->peer_ranks[mid] < p) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  return compact->peer_offsets[low];
+}
+
+p4est_locidx_t
+p4est_ghost_compact_mirror_proc_mirror (p4est_ghost_compact_t * compact,
+                                        p4est_locidx_t k)
+{
+  const p4est_locidx_t nb = p4est_ghost_compact_block;
+  const p4est_locidx_t first = k / nb * nb;
+  int                 low, high, mid;
+  p4est_locidx_t      i, start, value;
+  const unsigned char *b;
+
+  P4EST_ASSERT (0 <= k && k < compact->peer_offsets[compact->num_peers]);
+
+  /* find the start of the list containing k */
+  low = 0;
+  high = compact->num_peers - 1;
+  while (low < high) {
+    mid = (low + high + 1) / 2;
+    if (compact->peer_offsets[mid] <= k) {
+      low = mid;
+    }
+    else {
+      high = mid - 1;
+    }
+  }
+  start = compact->peer_offsets[low];
+
+  /* decode forward from the checkpoint of the block */
+  b = compact->list_bytes + compact->list_block_offsets[k / nb];
+  for (value = 0, i = first; i <= k; ++i) {
+    if (i == first || i == start) {
+      value = 0;
+    }
+    value += (p4est_locidx_t) p4est_ghost_compact_get (&b);
+  }
+  return value;
+}
+
 #ifdef P4EST_ENABLE_MPI
 
 static inline sc_array_t *
@@ -78,7 +609,8 @@ p4est_ghost_array_index (sc_array_t * array, int i)
 
 static p4est_ghost_t *p4est_ghost_new_check (p4est_t * p4est,
                                              p4est_connect_type_t btype,
-                                             p4est_ghost_tolerance_t tol);
+                                             p4est_ghost_tolerance_t tol,
+                                             p4est_ghost_t * update);
 
 int
 p4est_quadrant_find_owner (p4est_t * p4est, p4est_topidx_t treeid,
@@ -834,7 +1366,8 @@ p4est_is_balanced (p4est_t * p4est, p4est_connect_type_t btype)
 #endif
   p4est_ghost_t      *gl;
 
-  gl = p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_FAIL);
+  gl = p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_FAIL,
+                              NULL);
   if (gl == NULL) {
     return 0;
   }
@@ -1382,11 +1915,263 @@ p4est_ghost_test_add (p4est_t * p4est, p4est_ghost_mirror_t * m,
   }
 }
 
+/** Append the run of one kind to the operations of a ghost update message.
+ * Consecutive runs of equal kind and local number shift are merged.
+ */
+static void
+p4est_ghost_update_op (sc_array_t * ops, p4est_locidx_t kind,
+                       p4est_locidx_t delta)
+{
+  p4est_locidx_t     *op;
+
+  if (ops->elem_count > 0) {
+    op = (p4est_locidx_t *) sc_array_index (ops, ops->elem_count - 3);
+    if (op[0] == kind && op[2] == delta) {
+      ++op[1];
+      return;
+    }
+  }
+  op = (p4est_locidx_t *) sc_array_push_count (ops, 3);
+  op[0] = kind;
+  op[1] = 1;
+  op[2] = delta;
+}
+
+/** Encode the difference between the previous and the new mirrors of a peer.
+ * Both lists are in p4est_quadrant_compare_piggy order.  The message holds
+ * two counts, the triples (kind, count, local number shift) of operations
+ * on the previous list, and the quadrants added in sequence.
+ * \param [in] old      The previous ghost layer.
+ * \param [in] proc     The peer process.
+ * \param [in] buf      The new mirrors for the peer with piggy3 data.
+ * \param [out] msg     Initialized byte array, filled with the message.
+ */
+static void
+p4est_ghost_update_encode (p4est_ghost_t * old, int proc, sc_array_t * buf,
+                           sc_array_t * msg)
+{
+  int                 cmp;
+  size_t              nz;
+  p4est_locidx_t      ok, oend;
+  p4est_locidx_t     *head;
+  p4est_quadrant_t   *oq, *nq;
+  sc_array_t          ops, added;
+
+  sc_array_init (&ops, sizeof (p4est_locidx_t));
+  sc_array_init (&added, sizeof (p4est_quadrant_t));
+
+  /* merge the sorted lists of previous and new mirrors */
+  ok = old->mirror_proc_offsets[proc];
+  oend = old->mirror_proc_offsets[proc + 1];
+  nz = 0;
+  while (ok < oend || nz < buf->elem_count) {
+    oq = ok < oend ? p4est_quadrant_array_index
+      (&old->mirrors, (size_t) old->mirror_proc_mirrors[ok]) : NULL;
+    nq = nz < buf->elem_count ? p4est_quadrant_array_index (buf, nz) : NULL;
+    cmp = oq == NULL ? 1 : nq == NULL ? -1 :
+      p4est_quadrant_compare_piggy (oq, nq);
+    if (cmp == 0) {
+      p4est_ghost_update_op (&ops, P4EST_GHOST_UPDATE_KEEP,
+                             nq->p.piggy3.local_num - oq->p.piggy3.local_num);
+      ++ok;
+      ++nz;
+    }
+    else if (cmp < 0) {
+      p4est_ghost_update_op (&ops, P4EST_GHOST_UPDATE_SKIP, 0);
+      ++ok;
+    }
+    else {
+      p4est_ghost_update_op (&ops, P4EST_GHOST_UPDATE_ADD, 0);
+      p4est_quadrant_array_push_copy (&added, nq);
+      ++nz;
+    }
+  }
+
+  /* assemble the message */
+  sc_array_resize (msg, 2 * sizeof (p4est_locidx_t) +
+                   ops.elem_count * sizeof (p4est_locidx_t) +
+                   added.elem_count * sizeof (p4est_quadrant_t));
+  head = (p4est_locidx_t *) msg->array;
+  head[0] = (p4est_locidx_t) ops.elem_count / 3;
+  head[1] = (p4est_locidx_t) added.elem_count;
+  memcpy (head + 2, ops.array, ops.elem_count * sizeof (p4est_locidx_t));
+  memcpy (head + 2 + ops.elem_count, added.array,
+          added.elem_count * sizeof (p4est_quadrant_t));
+
+  sc_array_reset (&ops);
+  sc_array_reset (&added);
+}
+
+/** Patch the previous ghosts of a peer with its message and append them.
+ * \param [in] old      The previous ghost layer.
+ * \param [in] proc     The peer process.
+ * \param [in] msg      The message received from the peer.
+ * \param [in,out] ghosts       The new ghosts are appended to this array.
+ */
+static void
+p4est_ghost_update_decode (p4est_ghost_t * old, int proc, sc_array_t * msg,
+                           sc_array_t * ghosts)
+{
+  p4est_locidx_t      num_ops, num_added, io, ia;
+  p4est_locidx_t      kind, count, delta, k;
+  p4est_locidx_t      ok, oend;
+  const p4est_locidx_t *head, *op;
+  const char         *added;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (msg->elem_count >= 2 * sizeof (p4est_locidx_t));
+  head = (const p4est_locidx_t *) msg->array;
+  num_ops = head[0];
+  num_added = head[1];
+  P4EST_ASSERT (msg->elem_count == 2 * sizeof (p4est_locidx_t) +
+                3 * num_ops * sizeof (p4est_locidx_t) +
+                num_added * sizeof (p4est_quadrant_t));
+  added = (const char *) (head + 2 + 3 * num_ops);
+
+  ok = old->proc_offsets[proc];
+  oend = old->proc_offsets[proc + 1];
+  for (io = 0, ia = 0; io < num_ops; ++io) {
+    op = head + 2 + 3 * io;
+    kind = op[0];
+    count = op[1];
+    delta = op[2];
+    if (kind == P4EST_GHOST_UPDATE_KEEP) {
+      /* the ghost is unchanged but its owner's numbering may have shifted */
+      P4EST_ASSERT (ok + count <= oend);
+      for (k = 0; k < count; ++k) {
+        q = p4est_quadrant_array_push_copy
+          (ghosts, p4est_quadrant_array_index (&old->ghosts, (size_t) ok++));
+        q->p.piggy3.local_num += delta;
+      }
+    }
+    else if (kind == P4EST_GHOST_UPDATE_SKIP) {
+      P4EST_ASSERT (ok + count <= oend);
+      ok += count;
+    }
+    else {
+      P4EST_ASSERT (kind == P4EST_GHOST_UPDATE_ADD);
+      P4EST_ASSERT (ia + count <= num_added);
+      q = (p4est_quadrant_t *) sc_array_push_count (ghosts, (size_t) count);
+      memcpy (q, added + ia * sizeof (p4est_quadrant_t),
+              count * sizeof (p4est_quadrant_t));
+      ia += count;
+    }
+  }
+  P4EST_ASSERT (ok == oend);
+  P4EST_ASSERT (ia == num_added);
+}
+
+/** Exchange the changes of the mirrors and patch the previous ghost layer.
+ * This relies on the same symmetry of peer processes as the full exchange.
+ * Every peer receives one message, and its size only depends on the number
+ * of changed mirrors and the number of runs of local number shifts.
+ * \param [in] p4est            The forest with unchanged partition.
+ * \param [in] old              The previous ghost layer.
+ * \param [in] send_bufs        The new mirrors for each process.
+ * \param [in,out] gl           The ghosts and their process offsets are
+ *                              populated.
+ */
+static void
+p4est_ghost_update_exchange (p4est_t * p4est, p4est_ghost_t * old,
+                             sc_array_t * send_bufs, p4est_ghost_t * gl)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 mpiret;
+  int                 i, peer, num_peers, rcount;
+  size_t              sent_bytes;
+  sc_array_t         *buf, *msgs, rmsg;
+  MPI_Request        *send_request;
+  MPI_Status          status;
+
+  P4EST_ASSERT (old->mpisize == num_procs);
+  P4EST_ASSERT (gl->ghosts.elem_count == 0);
+
+  /* count the peers of the new ghost layer */
+  for (i = 0, num_peers = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    if (buf->elem_count > 0)
+      ++num_peers;
+  }
+  msgs = P4EST_ALLOC (sc_array_t, num_peers);
+  send_request = P4EST_ALLOC (MPI_Request, num_peers);
+
+  /* send the changes of the mirrors to every peer */
+  sent_bytes = 0;
+  for (i = 0, peer = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    if (buf->elem_count > 0) {
+      P4EST_ASSERT (i != p4est->mpirank);
+      sc_array_init (msgs + peer, 1);
+      p4est_ghost_update_encode (old, i, buf, msgs + peer);
+      sent_bytes += msgs[peer].elem_count;
+      mpiret = MPI_Isend (msgs[peer].array, (int) msgs[peer].elem_count,
+                          MPI_BYTE, i, P4EST_COMM_GHOST_UPDATE,
+                          p4est->mpicomm, send_request + peer);
+      SC_CHECK_MPI (mpiret);
+      ++peer;
+    }
+  }
+  P4EST_VERBOSEF ("Ghost update sends %llu bytes to %d peers\n",
+                  (unsigned long long) sent_bytes, num_peers);
+
+  /* receive from the same peers in order and patch their ghosts */
+  sc_array_init (&rmsg, 1);
+  for (i = 0; i < num_procs; ++i) {
+    buf = p4est_ghost_array_index (send_bufs, i);
+    if (buf->elem_count > 0) {
+      mpiret = MPI_Probe (i, P4EST_COMM_GHOST_UPDATE, p4est->mpicomm,
+                          &status);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Get_count (&status, MPI_BYTE, &rcount);
+      SC_CHECK_MPI (mpiret);
+      sc_array_resize (&rmsg, (size_t) rcount);
+      mpiret = MPI_Recv (rmsg.array, rcount, MPI_BYTE, i,
+                         P4EST_COMM_GHOST_UPDATE, p4est->mpicomm,
+                         MPI_STATUS_IGNORE);
+      SC_CHECK_MPI (mpiret);
+      p4est_ghost_update_decode (old, i, &rmsg, &gl->ghosts);
+    }
+    gl->proc_offsets[i + 1] = (p4est_locidx_t) gl->ghosts.elem_count;
+  }
+  sc_array_reset (&rmsg);
+
+  /* wait for the sends and clean up */
+  mpiret = sc_MPI_Waitall (num_peers, send_request, MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  for (peer = 0; peer < num_peers; ++peer) {
+    sc_array_reset (msgs + peer);
+  }
+  P4EST_FREE (msgs);
+  P4EST_FREE (send_request);
+}
+
 #endif /* P4EST_ENABLE_MPI */
 
+/** Hash the first positions of all processes in the forest. */
+static uint64_t
+p4est_ghost_partition_hash (p4est_t * p4est)
+{
+  int                 p;
+  uint64_t            hash;
+  const p4est_quadrant_t *pos;
+
+  /* FNV-1a over the tree and coordinates of every partition boundary */
+  hash = 14695981039346656037ULL;
+  for (p = 0; p <= p4est->mpisize; ++p) {
+    pos = p4est->global_first_position + p;
+    hash = (hash ^ (uint64_t) pos->p.which_tree) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t) (uint32_t) pos->x) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t) (uint32_t) pos->y) * 1099511628211ULL;
+#ifdef P4_TO_P8
+    hash = (hash ^ (uint64_t) (uint32_t) pos->z) * 1099511628211ULL;
+#endif
+  }
+  return hash;
+}
+
 static p4est_ghost_t *
 p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
-                       p4est_ghost_tolerance_t tol)
+                       p4est_ghost_tolerance_t tol, p4est_ghost_t * update)
 {
   const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
   const int           num_procs = p4est->mpisize;
@@ -1470,6 +2255,7 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   gl->mirror_proc_offsets = P4EST_ALLOC (p4est_locidx_t, num_procs + 1);
   gl->mirror_proc_fronts = NULL;
   gl->mirror_proc_front_offsets = NULL;
+  gl->partition_hash = p4est_ghost_partition_hash (p4est);
 
   gl->proc_offsets[0] = 0;
   gl->mirror_proc_offsets[0] = 0;
@@ -1970,6 +2756,13 @@ failtest:
     SC_CHECK_ABORT (!failed, "Ghost layer");
   }
 
+  if (update != NULL) {
+    /* only the differences to the previous ghost layer are exchanged */
+    p4est_ghost_mirror_reset (gl, &m, 1);
+    p4est_ghost_update_exchange (p4est, update, &send_bufs, gl);
+    goto sendcleanup;
+  }
+
   /* Count the number of peers that I send to and receive from */
   for (i = 0, num_peers = 0; i < num_procs; ++i) {
     buf = p4est_ghost_array_index (&send_bufs, i);
@@ -2129,6 +2922,7 @@ failtest:
   P4EST_FREE (recv_request);
   P4EST_FREE (send_request);
 
+sendcleanup:
   for (i = 0; i < num_procs; ++i) {
     buf = p4est_ghost_array_index (&send_bufs, i);
     sc_array_reset (buf);
@@ -2179,7 +2973,49 @@ failtest:
 p4est_ghost_t      *
 p4est_ghost_new (p4est_t * p4est, p4est_connect_type_t btype)
 {
-  return p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW);
+  return p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW,
+                                NULL);
+}
+
+p4est_ghost_t      *
+p4est_ghost_new_ext (p4est_t * p4est, p4est_connect_type_t btype,
+                     int num_layers)
+{
+  int                 layer;
+  p4est_ghost_t      *ghost;
+
+  P4EST_ASSERT (num_layers >= 1);
+
+  /* a layer may reach a peer through the quadrants of a third process,
+   * which only that process knows; this takes one round per layer */
+  ghost = p4est_ghost_new_check (p4est, btype, P4EST_GHOST_UNBALANCED_ALLOW,
+                                 NULL);
+  for (layer = 1; layer < num_layers; ++layer) {
+    p4est_ghost_expand (p4est, ghost);
+  }
+  return ghost;
+}
+
+void
+p4est_ghost_update (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  p4est_ghost_t      *gl, swap;
+
+  P4EST_ASSERT (ghost->mpisize == p4est->mpisize);
+  P4EST_ASSERT (ghost->num_trees == p4est->connectivity->num_trees);
+  P4EST_ASSERT (ghost->mirror_proc_fronts == ghost->mirror_proc_mirrors);
+  SC_CHECK_ABORT (ghost->partition_hash == p4est_ghost_partition_hash (p4est),
+                  "Ghost update requires an unchanged partition");
+
+  /* build the new mirrors and patch the previous ghosts */
+  gl = p4est_ghost_new_check (p4est, ghost->btype,
+                              P4EST_GHOST_UNBALANCED_ALLOW, ghost);
+
+  /* the caller's structure takes over the new contents */
+  swap = *ghost;
+  *ghost = *gl;
+  *gl = swap;
+  p4est_ghost_destroy (gl);
 }
 
 void
@@ -2461,6 +3297,9 @@ p4est_ghost_exchange_custom_end (p4est_ghost_exchange_t * exc)
   /* don't confuse it with p4est_ghost_exchange_custom_levels_end either */
   P4EST_ASSERT (!exc->is_levels);
 
+  /* nor with p4est_ghost_exchange_fields_end */
+  P4EST_ASSERT (exc->fields == NULL);
+
   /* wait for messages to complete and clean up */
   mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
                            exc->requests.array, sc_MPI_STATUSES_IGNORE);
@@ -2717,6 +3556,565 @@ p4est_ghost_exchange_custom_levels_end (p4est_ghost_exchange_t * exc)
   P4EST_FREE (exc);
 }
 
+void
+p4est_ghost_exchange_strided (p4est_t * p4est, p4est_ghost_t * ghost,
+                              size_t data_size,
+                              const void *local_data, size_t local_stride,
+                              void *ghost_data, size_t ghost_stride)
+{
+  p4est_ghost_exchange_strided_end (p4est_ghost_exchange_strided_begin
+                                    (p4est, ghost, data_size,
+                                     local_data, local_stride,
+                                     ghost_data, ghost_stride));
+}
+
+p4est_ghost_exchange_t *
+p4est_ghost_exchange_strided_begin (p4est_t * p4est, p4est_ghost_t * ghost,
+                                    size_t data_size,
+                                    const void *local_data,
+                                    size_t local_stride,
+                                    void *ghost_data, size_t ghost_stride)
+{
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p4est->mpisize;
+  int                 mpiret;
+  int                 q;
+  int                *blocklens;
+  p4est_locidx_t      ng_excl, ng_incl, ng, theg, max_ng;
+  p4est_locidx_t      mirr;
+  p4est_quadrant_t   *m;
+  MPI_Aint           *displs;
+  MPI_Datatype        item_type, ghost_type, send_type;
+  sc_MPI_Request     *r;
+#endif
+  p4est_ghost_exchange_t *exc;
+
+  P4EST_ASSERT (local_stride >= data_size);
+  P4EST_ASSERT (ghost_stride >= data_size);
+
+  /* the transient storage is shared with p4est_ghost_exchange_custom */
+  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
+  exc->is_custom = 1;
+  exc->p4est = p4est;
+  exc->ghost = ghost;
+  exc->minlevel = 0;
+  exc->maxlevel = P4EST_QMAXLEVEL;
+  exc->data_size = data_size;
+  exc->ghost_data = ghost_data;
+  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->sbuffers, sizeof (char *));
+
+  /* return early if there is nothing to do */
+  if (data_size == 0) {
+    return exc;
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* one item of data, laid out with the stride of the ghost array */
+  mpiret = MPI_Type_contiguous ((int) data_size, MPI_BYTE, &item_type);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_create_resized (item_type, 0, (MPI_Aint) ghost_stride,
+                                    &ghost_type);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_commit (&ghost_type);
+  SC_CHECK_MPI (mpiret);
+
+  /* receive directly into the caller's ghost array */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = MPI_Irecv ((char *) ghost_data + ng_excl * ghost_stride,
+                          (int) ng, ghost_type, q,
+                          P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+      ng_excl = ng_incl;
+    }
+  }
+  P4EST_ASSERT (ng_excl == (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  /* the displacement arrays are reused for every peer */
+  max_ng = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng = ghost->mirror_proc_offsets[q + 1] - ghost->mirror_proc_offsets[q];
+    max_ng = SC_MAX (max_ng, ng);
+  }
+  blocklens = P4EST_ALLOC (int, max_ng);
+  displs = P4EST_ALLOC (MPI_Aint, max_ng);
+  for (theg = 0; theg < max_ng; ++theg) {
+    blocklens[theg] = 1;
+  }
+
+  /* send directly from the caller's local array */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      for (theg = 0; theg < ng; ++theg) {
+        mirr = ghost->mirror_proc_mirrors[ng_excl + theg];
+        P4EST_ASSERT (0 <= mirr && (size_t) mirr < ghost->mirrors.elem_count);
+        m = p4est_quadrant_array_index (&ghost->mirrors, (size_t) mirr);
+        displs[theg] = (MPI_Aint) m->p.piggy3.local_num *
+          (MPI_Aint) local_stride;
+      }
+      mpiret = MPI_Type_create_hindexed ((int) ng, blocklens, displs,
+                                         item_type, &send_type);
+      SC_CHECK_MPI (mpiret);
+      mpiret = MPI_Type_commit (&send_type);
+      SC_CHECK_MPI (mpiret);
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = MPI_Isend ((void *) local_data, 1, send_type, q,
+                          P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+
+      /* a datatype in use by pending messages may be freed */
+      mpiret = MPI_Type_free (&send_type);
+      SC_CHECK_MPI (mpiret);
+      ng_excl = ng_incl;
+    }
+  }
+  P4EST_FREE (blocklens);
+  P4EST_FREE (displs);
+
+  mpiret = MPI_Type_free (&ghost_type);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Type_free (&item_type);
+  SC_CHECK_MPI (mpiret);
+#else
+  /* without MPI there are no ghosts to exchange */
+  P4EST_ASSERT (ghost->ghosts.elem_count == 0);
+  P4EST_ASSERT (ghost->mirror_proc_offsets[p4est->mpisize] == 0);
+#endif
+
+  /* we are done posting the messages */
+  return exc;
+}
+
+void
+p4est_ghost_exchange_strided_end (p4est_ghost_exchange_t * exc)
+{
+  /* there are no send buffers, so the custom completion applies */
+  p4est_ghost_exchange_custom_end (exc);
+}
+
+void
+p4est_ghost_exchange_fields (p4est_t * p4est, p4est_ghost_t * ghost,
+                             int num_fields,
+                             const p4est_ghost_field_t * fields)
+{
+  p4est_ghost_exchange_fields_end (p4est_ghost_exchange_fields_begin
+                                   (p4est, ghost, num_fields, fields));
+}
+
+p4est_ghost_exchange_t *
+p4est_ghost_exchange_fields_begin (p4est_t * p4est, p4est_ghost_t * ghost,
+                                   int num_fields,
+                                   const p4est_ghost_field_t * fields)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 mpiret;
+  int                 q, f;
+  char               *mem, **rbuf, **sbuf;
+  size_t              item_size, data_size;
+  p4est_locidx_t      ng_excl, ng_incl, ng, theg;
+  p4est_locidx_t      mirr;
+  p4est_quadrant_t   *m;
+  p4est_ghost_exchange_t *exc;
+  sc_MPI_Request     *r;
+
+  P4EST_ASSERT (num_fields >= 0);
+  P4EST_ASSERT (num_fields == 0 || fields != NULL);
+
+  /* initialize transient storage */
+  exc = P4EST_ALLOC_ZERO (p4est_ghost_exchange_t, 1);
+  exc->is_custom = 1;
+  exc->p4est = p4est;
+  exc->ghost = ghost;
+  exc->minlevel = 0;
+  exc->maxlevel = P4EST_QMAXLEVEL;
+  sc_array_init (&exc->requests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->sbuffers, sizeof (char *));
+  sc_array_init (&exc->rrequests, sizeof (sc_MPI_Request));
+  sc_array_init (&exc->rbuffers, sizeof (char *));
+
+  /* the descriptors are needed again for unpacking */
+  exc->num_fields = num_fields;
+  exc->fields = P4EST_ALLOC (p4est_ghost_field_t, num_fields);
+  item_size = 0;
+  for (f = 0; f < num_fields; ++f) {
+    exc->fields[f] = fields[f];
+    item_size += fields[f].data_size;
+  }
+  exc->data_size = item_size;
+
+  /* return early if there is nothing to do */
+  if (item_size == 0) {
+    return exc;
+  }
+
+  /* receive one message with all fields from other processors */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      rbuf = (char **) sc_array_push (&exc->rbuffers);
+      *rbuf = P4EST_ALLOC (char, ng * item_size);
+      r = (sc_MPI_Request *) sc_array_push (&exc->rrequests);
+      mpiret = sc_MPI_Irecv (*rbuf, ng * item_size, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+      ng_excl = ng_incl;
+    }
+  }
+  P4EST_ASSERT (ng_excl == (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  /* send one message with all fields to other processors */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      /* the message holds one contiguous section per field */
+      sbuf = (char **) sc_array_push (&exc->sbuffers);
+      mem = *sbuf = P4EST_ALLOC (char, ng * item_size);
+      for (f = 0; f < num_fields; ++f) {
+        data_size = fields[f].data_size;
+        for (theg = 0; theg < ng; ++theg) {
+          mirr = ghost->mirror_proc_mirrors[ng_excl + theg];
+          P4EST_ASSERT (0 <= mirr &&
+                        (size_t) mirr < ghost->mirrors.elem_count);
+          m = p4est_quadrant_array_index (&ghost->mirrors, (size_t) mirr);
+          memcpy (mem, (const char *) fields[f].local_data +
+                  m->p.piggy3.local_num * data_size, data_size);
+          mem += data_size;
+        }
+      }
+      r = (sc_MPI_Request *) sc_array_push (&exc->requests);
+      mpiret = sc_MPI_Isend (*sbuf, ng * item_size, sc_MPI_BYTE, q,
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+      ng_excl = ng_incl;
+    }
+  }
+
+  /* we are done posting the messages */
+  return exc;
+}
+
+void
+p4est_ghost_exchange_fields_end (p4est_ghost_exchange_t * exc)
+{
+  p4est_ghost_t      *ghost = exc->ghost;
+  const int           num_procs = exc->p4est->mpisize;
+  int                 mpiret;
+  int                 q, f, i;
+  char               *mem, **rbuf, **sbuf;
+  size_t              zz, data_size;
+  p4est_locidx_t      ng_excl, ng_incl, ng;
+  const p4est_ghost_field_t *field;
+
+  /* make sure that the begin function matches the end function */
+  P4EST_ASSERT (exc->is_custom);
+  P4EST_ASSERT (!exc->is_levels);
+  P4EST_ASSERT (exc->fields != NULL || exc->num_fields == 0);
+
+  /* wait for the receives and unpack every field */
+  mpiret = sc_MPI_Waitall (exc->rrequests.elem_count, (sc_MPI_Request *)
+                           exc->rrequests.array, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  i = 0;
+  ng_excl = 0;
+  for (q = 0; q < num_procs && exc->rbuffers.elem_count > 0; ++q) {
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    if (ng > 0) {
+      rbuf = (char **) sc_array_index_int (&exc->rbuffers, i++);
+      mem = *rbuf;
+      for (f = 0; f < exc->num_fields; ++f) {
+        field = exc->fields + f;
+        data_size = field->data_size;
+        memcpy ((char *) field->ghost_data + ng_excl * data_size, mem,
+                ng * data_size);
+        mem += ng * data_size;
+      }
+      P4EST_FREE (*rbuf);
+      ng_excl = ng_incl;
+    }
+  }
+  P4EST_ASSERT (i == (int) exc->rbuffers.elem_count);
+  sc_array_reset (&exc->rrequests);
+  sc_array_reset (&exc->rbuffers);
+
+  /* wait for sends and clean up */
+  mpiret = sc_MPI_Waitall (exc->requests.elem_count, (sc_MPI_Request *)
+                           exc->requests.array, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  sc_array_reset (&exc->requests);
+  for (zz = 0; zz < exc->sbuffers.elem_count; ++zz) {
+    sbuf = (char **) sc_array_index (&exc->sbuffers, zz);
+    P4EST_FREE (*sbuf);
+  }
+  sc_array_reset (&exc->sbuffers);
+
+  /* free temporary storage */
+  P4EST_FREE (exc->fields);
+  P4EST_FREE (exc);
+}
+
+p4est_ghost_plan_t *
+p4est_ghost_plan_new (p4est_t * p4est, p4est_ghost_t * ghost,
+                      size_t data_size, void *ghost_data, int persistent)
+{
+  const int           num_procs = p4est->mpisize;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  sc_MPI_Request     *r;
+#endif
+  int                 q, i;
+  size_t              zz, user_size;
+  p4est_locidx_t      ng, num_send_items, offset;
+  p4est_topidx_t      which_tree;
+  p4est_locidx_t      which_quad;
+  p4est_quadrant_t   *mirror, *quad;
+  p4est_tree_t       *tree;
+  p4est_ghost_plan_t *plan;
+
+  P4EST_ASSERT (data_size > 0);
+  P4EST_ASSERT (ghost_data != NULL || ghost->ghosts.elem_count == 0);
+
+  plan = P4EST_ALLOC_ZERO (p4est_ghost_plan_t, 1);
+  plan->p4est = p4est;
+  plan->ghost = ghost;
+  plan->data_size = data_size;
+  plan->ghost_data = ghost_data;
+#ifdef P4EST_ENABLE_MPI
+  plan->persistent = persistent;
+#endif
+  plan->revision = p4est->revision;
+
+  /* count the peers in both directions */
+  for (q = 0; q < num_procs; ++q) {
+    if (ghost->proc_offsets[q + 1] > ghost->proc_offsets[q]) {
+      ++plan->num_recvs;
+    }
+    if (ghost->mirror_proc_offsets[q + 1] > ghost->mirror_proc_offsets[q]) {
+      ++plan->num_sends;
+    }
+  }
+  plan->peers = P4EST_ALLOC (int, plan->num_recvs + plan->num_sends);
+  plan->peer_counts =
+    P4EST_ALLOC (p4est_locidx_t, plan->num_recvs + plan->num_sends);
+  plan->requests =
+    P4EST_ALLOC (sc_MPI_Request, plan->num_recvs + plan->num_sends);
+
+  /* record receive and send peers in ascending rank order */
+  i = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng = ghost->proc_offsets[q + 1] - ghost->proc_offsets[q];
+    if (ng > 0) {
+      P4EST_ASSERT (q != p4est->mpirank);
+      plan->peers[i] = q;
+      plan->peer_counts[i++] = ng;
+    }
+  }
+  P4EST_ASSERT (i == plan->num_recvs);
+  for (q = 0; q < num_procs; ++q) {
+    ng = ghost->mirror_proc_offsets[q + 1] - ghost->mirror_proc_offsets[q];
+    if (ng > 0) {
+      P4EST_ASSERT (q != p4est->mpirank);
+      plan->peers[i] = q;
+      plan->peer_counts[i++] = ng;
+    }
+  }
+  P4EST_ASSERT (i == plan->num_recvs + plan->num_sends);
+
+  /* the send items are the concatenated per-peer mirror lists */
+  num_send_items = ghost->mirror_proc_offsets[num_procs];
+  plan->sbuffer = P4EST_ALLOC (char, num_send_items * data_size);
+
+  /* resolve the quadrant user data of each send item once */
+  user_size = p4est->data_size == 0 ? sizeof (void *) : p4est->data_size;
+  if (data_size == user_size) {
+    plan->send_user = P4EST_ALLOC (void *, num_send_items);
+    for (offset = 0; offset < num_send_items; ++offset) {
+      zz = (size_t) ghost->mirror_proc_mirrors[offset];
+      P4EST_ASSERT (zz < ghost->mirrors.elem_count);
+      mirror = p4est_quadrant_array_index (&ghost->mirrors, zz);
+      which_tree = mirror->p.piggy3.which_tree;
+      P4EST_ASSERT (p4est->first_local_tree <= which_tree &&
+                    which_tree <= p4est->last_local_tree);
+      tree = p4est_tree_array_index (p4est->trees, which_tree);
+      which_quad = mirror->p.piggy3.local_num - tree->quadrants_offset;
+      P4EST_ASSERT (0 <= which_quad &&
+                    which_quad < (p4est_locidx_t) tree->quadrants.elem_count);
+      quad = p4est_quadrant_array_index (&tree->quadrants, which_quad);
+      plan->send_user[offset] =
+        p4est->data_size == 0 ? &quad->p.user_data : quad->p.user_data;
+    }
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* initialize the persistent requests once for all exchanges */
+  if (plan->persistent) {
+    offset = 0;
+    for (i = 0; i < plan->num_recvs; ++i) {
+      r = plan->requests + i;
+      mpiret = MPI_Recv_init ((char *) ghost_data + offset * data_size,
+                              plan->peer_counts[i] * data_size, MPI_BYTE,
+                              plan->peers[i], P4EST_COMM_GHOST_EXCHANGE,
+                              p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+      offset += plan->peer_counts[i];
+    }
+    P4EST_ASSERT (offset == (p4est_locidx_t) ghost->ghosts.elem_count);
+    offset = 0;
+    for (; i < plan->num_recvs + plan->num_sends; ++i) {
+      r = plan->requests + i;
+      mpiret = MPI_Send_init (plan->sbuffer + offset * data_size,
+                              plan->peer_counts[i] * data_size, MPI_BYTE,
+                              plan->peers[i], P4EST_COMM_GHOST_EXCHANGE,
+                              p4est->mpicomm, r);
+      SC_CHECK_MPI (mpiret);
+      offset += plan->peer_counts[i];
+    }
+    P4EST_ASSERT (offset == num_send_items);
+  }
+#endif
+
+  return plan;
+}
+
+void
+p4est_ghost_plan_destroy (p4est_ghost_plan_t * plan)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i;
+#endif
+
+  P4EST_ASSERT (!plan->active);
+
+#ifdef P4EST_ENABLE_MPI
+  if (plan->persistent) {
+    for (i = 0; i < plan->num_recvs + plan->num_sends; ++i) {
+      mpiret = MPI_Request_free (plan->requests + i);
+      SC_CHECK_MPI (mpiret);
+    }
+  }
+#endif
+
+  P4EST_FREE (plan->peers);
+  P4EST_FREE (plan->peer_counts);
+  P4EST_FREE (plan->requests);
+  P4EST_FREE (plan->send_user);
+  P4EST_FREE (plan->sbuffer);
+  P4EST_FREE (plan);
+}
+
+void
+p4est_ghost_plan_start (p4est_ghost_plan_t * plan, void **mirror_data)
+{
+  p4est_t            *p4est = plan->p4est;
+  p4est_ghost_t      *ghost = plan->ghost;
+  const size_t        data_size = plan->data_size;
+  const p4est_locidx_t num_send_items =
+    ghost->mirror_proc_offsets[p4est->mpisize];
+  int                 mpiret;
+  int                 i;
+  char               *mem;
+  p4est_locidx_t      offset;
+
+  P4EST_ASSERT (!plan->active);
+  P4EST_ASSERT (plan->revision == p4est->revision);
+  P4EST_ASSERT (mirror_data != NULL || plan->send_user != NULL);
+  plan->active = 1;
+
+  /* post the receives first to have them ready for arriving messages */
+#ifdef P4EST_ENABLE_MPI
+  if (plan->persistent) {
+    mpiret = MPI_Startall (plan->num_recvs, plan->requests);
+    SC_CHECK_MPI (mpiret);
+  }
+  else
+#endif
+  {
+    mem = (char *) plan->ghost_data;
+    for (i = 0; i < plan->num_recvs; ++i) {
+      mpiret = sc_MPI_Irecv (mem, plan->peer_counts[i] * data_size,
+                             sc_MPI_BYTE, plan->peers[i],
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm,
+                             plan->requests + i);
+      SC_CHECK_MPI (mpiret);
+      mem += plan->peer_counts[i] * data_size;
+    }
+  }
+
+  /* pack all send items in one pass over the precomputed order */
+  mem = plan->sbuffer;
+  if (mirror_data != NULL) {
+    for (offset = 0; offset < num_send_items; ++offset) {
+      memcpy (mem, mirror_data[ghost->mirror_proc_mirrors[offset]],
+              data_size);
+      mem += data_size;
+    }
+  }
+  else {
+    for (offset = 0; offset < num_send_items; ++offset) {
+      memcpy (mem, plan->send_user[offset], data_size);
+      mem += data_size;
+    }
+  }
+
+  /* post the sends */
+#ifdef P4EST_ENABLE_MPI
+  if (plan->persistent) {
+    mpiret = MPI_Startall (plan->num_sends, plan->requests + plan->num_recvs);
+    SC_CHECK_MPI (mpiret);
+  }
+  else
+#endif
+  {
+    mem = plan->sbuffer;
+    for (i = plan->num_recvs; i < plan->num_recvs + plan->num_sends; ++i) {
+      mpiret = sc_MPI_Isend (mem, plan->peer_counts[i] * data_size,
+                             sc_MPI_BYTE, plan->peers[i],
+                             P4EST_COMM_GHOST_EXCHANGE, p4est->mpicomm,
+                             plan->requests + i);
+      SC_CHECK_MPI (mpiret);
+      mem += plan->peer_counts[i] * data_size;
+    }
+  }
+}
+
+void
+p4est_ghost_plan_wait (p4est_ghost_plan_t * plan)
+{
+  int                 mpiret;
+
+  P4EST_ASSERT (plan->active);
+
+  /* persistent requests become inactive and can be started again */
+  mpiret = sc_MPI_Waitall (plan->num_recvs + plan->num_sends,
+                           plan->requests, sc_MPI_STATUSES_IGNORE);
+  SC_CHECK_MPI (mpiret);
+  plan->active = 0;
+}
+
+void
+p4est_ghost_plan_exchange (p4est_ghost_plan_t * plan, void **mirror_data)
+{
+  p4est_ghost_plan_start (plan, mirror_data);
+  p4est_ghost_plan_wait (plan);
+}
+
 #ifdef P4EST_ENABLE_MPI
 
 static void
@@ -3480,7 +4878,7 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
     }
 
     if (buf->elem_count) {
-      sc_array_sort (buf, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort (buf, 1);
       sc_array_uniq (buf, p4est_quadrant_compare_piggy_proc);
     }
     send_counts[peer] = (p4est_locidx_t) buf->elem_count;
@@ -3713,14 +5111,14 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
     for (p = 0; p < mpisize; p++) {
       buf = (sc_array_t *) sc_array_index_int (send_bufs, p);
 
-      sc_array_sort (buf, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort (buf, 1);
       sc_array_uniq (buf, p4est_quadrant_compare_piggy);
     }
 
     sc_array_resize (ghost_layer, (size_t) (old_num_ghosts + num_new_ghosts));
     if (num_new_ghosts) {
       /* update the ghost layer */
-      sc_array_sort (ghost_layer, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort (ghost_layer, 1);
       sc_array_uniq (ghost_layer, p4est_quadrant_compare_piggy);
 
       num_new_ghosts = ghost_layer->elem_count - old_num_ghosts;
@@ -3773,7 +5171,7 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
               buf->array, buf->elem_count * buf->elem_size);
     }
   }
-  sc_array_sort (new_mirrors, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort (new_mirrors, 1);
   sc_array_uniq (new_mirrors, p4est_quadrant_compare_piggy);
   new_num_mirrors = (p4est_locidx_t) new_mirrors->elem_count;
   P4EST_ASSERT (new_num_mirrors >= old_num_mirrors);
@@ -2694,6 +2694,58 @@ p4est_volume_iterate_simple (p4est_t * p4est, p4est_ghost_t * ghost_layer,
   }
 }
 
+/* run the face, edge and corner iterators on all interfaces between the
+ * children of a search area, where loop_args->level is the level of the
+ * children */
+static void
+p4est_volume_iterate_interfaces (p4est_iter_volume_args_t * args,
+                                 void *user_data,
+                                 p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                                 p8est_iter_edge_t iter_edge,
+#endif
+                                 p4est_iter_corner_t iter_corner)
+{
+  int                 dir, side;
+  p4est_iter_loop_args_t *loop_args = args->loop_args;
+
+  /* for each direction */
+  for (dir = 0; dir < P4EST_DIM; dir++) {
+    for (side = 0; side < P4EST_CHILDREN / 2; side++) {
+      p4est_iter_copy_indices (loop_args,
+                               args->face_args[dir][side].start_idx2, 1, 2);
+      p4est_face_iterate (&(args->face_args[dir][side]), user_data,
+                          iter_face,
+#ifdef P4_TO_P8
+                          iter_edge,
+#endif
+                          iter_corner);
+    }
+  }
+#ifdef P4_TO_P8
+  /* if there is an edge or a corner callback, we need to use
+   * edge_iterate, so we set up the common corners and edge ids
+   * for all of the edges between the search areas */
+  if (loop_args->loop_edge) {
+    for (dir = 0; dir < P4EST_DIM; dir++) {
+      for (side = 0; side < 2; side++) {
+        p4est_iter_copy_indices (loop_args,
+                                 args->edge_args[dir][side].start_idx2, 1, 4);
+        p8est_edge_iterate (&(args->edge_args[dir][side]), user_data,
+                            iter_edge, iter_corner);
+      }
+    }
+  }
+#endif
+  /* if there is a corner callback, we need to call corner_iterate on
+   * the corner in the middle of the search areas */
+  if (loop_args->loop_corner) {
+    p4est_iter_copy_indices (loop_args, args->corner_args.start_idx2, 1,
+                             P4EST_CHILDREN);
+    p4est_corner_iterate (&(args->corner_args), user_data, iter_corner);
+  }
+}
+
 static void
 p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
                       p4est_iter_volume_t iter_volume,
@@ -2706,7 +2758,7 @@ p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
   const int           local = 0;
   const int           ghost = 1;
 
-  int                 dir, side, type;
+  int                 type;
 
   p4est_iter_loop_args_t *loop_args = args->loop_args;
   int                 start_level = loop_args->level;
@@ -2810,43 +2862,11 @@ p4est_volume_iterate (p4est_iter_volume_args_t * args, void *user_data,
        * this level. we can now run the face_iterate for all of the faces between
        * search areas on the level*/
       if (level_num[*Level] == P4EST_CHILDREN) {
-        /* for each direction */
-        for (dir = 0; dir < P4EST_DIM; dir++) {
-          for (side = 0; side < P4EST_CHILDREN / 2; side++) {
-            p4est_iter_copy_indices (loop_args,
-                                     args->face_args[dir][side].start_idx2,
-                                     1, 2);
-            p4est_face_iterate (&(args->face_args[dir][side]), user_data,
-                                iter_face,
+        p4est_volume_iterate_interfaces (args, user_data, iter_face,
 #ifdef P4_TO_P8
-                                iter_edge,
+                                         iter_edge,
 #endif
-                                iter_corner);
-          }
-        }
-#ifdef P4_TO_P8
-        /* if there is an edge or a corner callback, we need to use
-         * edge_iterate, so we set up the common corners and edge ids
-         * for all of the edges between the search areas */
-        if (loop_args->loop_edge) {
-          for (dir = 0; dir < P4EST_DIM; dir++) {
-            for (side = 0; side < 2; side++) {
-              p4est_iter_copy_indices (loop_args,
-                                       args->edge_args[dir][side].start_idx2,
-                                       1, 4);
-              p8est_edge_iterate (&(args->edge_args[dir][side]), user_data,
-                                  iter_edge, iter_corner);
-            }
-          }
-        }
-#endif
-        /* if there is a corner callback, we need to call corner_iterate on
-         * the corner in the middle of the search areas */
-        if (loop_args->loop_corner) {
-          p4est_iter_copy_indices (loop_args, args->corner_args.start_idx2, 1,
-                                   P4EST_CHILDREN);
-          p4est_corner_iterate (&(args->corner_args), user_data, iter_corner);
-        }
+                                         iter_corner);
         /* we are done at the level, so we go up a level and over a branch */
         level_num[--(*Level)]++;
         level_idx2 -= P4EST_ITER_STRIDE;
@@ -3148,6 +3168,79 @@ p4est_iter_get_boundaries (p4est_t * p4est, p4est_topidx_t * last_run_tree,
   return owned;
 }
 
+/* run the face, edge and corner iterators on the entities between trees
+ * that are marked in the touch mask of tree t */
+static void
+p4est_iter_tree_boundaries (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                            p4est_iter_loop_args_t * loop_args,
+                            p4est_topidx_t t, int32_t touch, int remote,
+                            void *user_data, p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                            p8est_iter_edge_t iter_edge,
+#endif
+                            p4est_iter_corner_t iter_corner)
+{
+  int                 f, c;
+  int32_t             mask;
+  p4est_iter_face_args_t face_args;
+#ifdef P4_TO_P8
+  int                 e;
+  p8est_iter_edge_args_t edge_args;
+#endif
+  p4est_iter_corner_args_t corner_args;
+
+  face_args.remote = remote;
+#ifdef P4_TO_P8
+  edge_args.remote = remote;
+#endif
+  corner_args.remote = remote;
+
+  mask = 0x00000001;
+  /* Now we need to run face_iterate on the faces between trees */
+  for (f = 0; f < 2 * P4EST_DIM; f++, mask <<= 1) {
+    if ((touch & mask) == 0) {
+      continue;
+    }
+    p4est_iter_init_face (&face_args, p4est, ghost_layer, loop_args, t, f);
+    p4est_face_iterate (&face_args, user_data, iter_face,
+#ifdef P4_TO_P8
+                        iter_edge,
+#endif
+                        iter_corner);
+    p4est_iter_reset_face (&face_args);
+  }
+
+  /* if there is an edge or a corner callback, we need to run
+   * edge_iterate on the edges between trees */
+#ifdef P4_TO_P8
+  if (loop_args->loop_edge) {
+    for (e = 0; e < 12; e++, mask <<= 1) {
+      if ((touch & mask) == 0) {
+        continue;
+      }
+      p8est_iter_init_edge (&edge_args, p4est, ghost_layer, loop_args, t, e);
+      p8est_edge_iterate (&edge_args, user_data, iter_edge, iter_corner);
+      p8est_iter_reset_edge (&edge_args);
+    }
+  }
+  else {
+    mask <<= 12;
+  }
+#endif
+
+  if (loop_args->loop_corner) {
+    for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
+      if ((touch & mask) == 0) {
+        continue;
+      }
+      p4est_iter_init_corner (&corner_args, p4est, ghost_layer, loop_args,
+                              t, c);
+      p4est_corner_iterate (&corner_args, user_data, iter_corner);
+      p4est_iter_reset_corner (&corner_args);
+    }
+  }
+}
+
 void
 p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
                    void *user_data, p4est_iter_volume_t iter_volume,
@@ -3157,7 +3250,6 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
 #endif
                    p4est_iter_corner_t iter_corner, int remote)
 {
-  int                 f, c;
   p4est_topidx_t      t;
   p4est_ghost_t       empty_ghost_layer;
   p4est_ghost_t      *ghost_layer;
@@ -3165,18 +3257,11 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
   p4est_connectivity_t *conn = p4est->connectivity;
   size_t              global_num_trees = trees->elem_count;
   p4est_iter_loop_args_t *loop_args;
-  p4est_iter_face_args_t face_args;
-#ifdef P4_TO_P8
-  int                 e;
-  p8est_iter_edge_args_t edge_args;
-#endif
-  p4est_iter_corner_args_t corner_args;
   p4est_iter_volume_args_t args;
   p4est_topidx_t      first_local_tree = p4est->first_local_tree;
   p4est_topidx_t      last_local_tree = p4est->last_local_tree;
   p4est_topidx_t      last_run_tree;
   int32_t            *owned;
-  int32_t             mask, touch;
 
   P4EST_ASSERT (p4est_is_valid (p4est));
 
@@ -3230,11 +3315,6 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
   /* start with the assumption that we only run on entities touches by the
    * local processor's domain */
   args.remote = remote;
-  face_args.remote = remote;
-#ifdef P4_TO_P8
-  edge_args.remote = remote;
-#endif
-  corner_args.remote = remote;
 
   /** we have to loop over all trees and not just local trees because of the
    * ghost layer */
@@ -3251,78 +3331,866 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
       p4est_iter_reset_volume (&args);
     }
 
-    touch = owned[t];
-    if (!touch) {
-      continue;
-    }
-    mask = 0x00000001;
-    /* Now we need to run face_iterate on the faces between trees */
-    for (f = 0; f < 2 * P4EST_DIM; f++, mask <<= 1) {
-      if ((touch & mask) == 0) {
-        continue;
-      }
-      p4est_iter_init_face (&face_args, p4est, ghost_layer, loop_args, t, f);
-      p4est_face_iterate (&face_args, user_data, iter_face,
+    /* Now we need to run the iterators on the entities between trees */
+    if (owned[t]) {
+      p4est_iter_tree_boundaries (p4est, ghost_layer, loop_args, t, owned[t],
+                                  remote, user_data, iter_face,
 #ifdef P4_TO_P8
-                          iter_edge,
+                                  iter_edge,
 #endif
-                          iter_corner);
-      p4est_iter_reset_face (&face_args);
+                                  iter_corner);
     }
+  }
 
-    /* if there is an edge or a corner callback, we need to run
-     * edge_iterate on the edges between trees */
+  if (Ghost_layer == NULL) {
+    P4EST_FREE (empty_ghost_layer.tree_offsets);
+    P4EST_FREE (empty_ghost_layer.proc_offsets);
+  }
+
+  P4EST_FREE (owned);
+  p4est_iter_loop_args_destroy (loop_args);
+}
+
+void
+p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
+               p4est_iter_volume_t iter_volume, p4est_iter_face_t iter_face,
 #ifdef P4_TO_P8
-    if (loop_args->loop_edge) {
-      for (e = 0; e < 12; e++, mask <<= 1) {
-        if ((touch & mask) == 0) {
+               p8est_iter_edge_t iter_edge,
+#endif
+               p4est_iter_corner_t iter_corner)
+{
+  p4est_iterate_ext (p4est, Ghost_layer, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                     iter_edge,
+#endif
+                     iter_corner, 0);
+}
+
+/* the kinds of work units of the threaded iteration */
+enum
+{
+  P4EST_ITER_UNIT_VOLUME,       /* everything inside of a search area */
+  P4EST_ITER_UNIT_INTERFACES,   /* the interfaces between its children */
+  P4EST_ITER_UNIT_BOUNDARY      /* the entities between trees */
+};
+
+/* a work unit of the threaded iteration */
+typedef struct p4est_iter_unit
+{
+  p4est_topidx_t      which_tree;
+  int                 kind;
+  int                 phase;    /* units of one phase never touch the same
+                                   local quadrant */
+  p4est_quadrant_t    area;     /* the search area of the unit */
+  p4est_locidx_t      first, last;      /* local quadrants inside the area */
+}
+p4est_iter_unit_t;
+
+static int
+p4est_iter_unit_compare (const void *a, const void *b)
+{
+  const p4est_iter_unit_t *A = (const p4est_iter_unit_t *) a;
+  const p4est_iter_unit_t *B = (const p4est_iter_unit_t *) b;
+
+  if (A->phase != B->phase) {
+    return A->phase - B->phase;
+  }
+  if (A->which_tree != B->which_tree) {
+    return A->which_tree < B->which_tree ? -1 : 1;
+  }
+  if (A->kind != B->kind) {
+    return A->kind - B->kind;
+  }
+  return p4est_quadrant_compare (&A->area, &B->area);
+}
+
+static p4est_iter_unit_t *
+p4est_iter_unit_push (sc_array_t * units, p4est_topidx_t t, int kind,
+                      int phase, const p4est_quadrant_t * area)
+{
+  p4est_iter_unit_t  *unit;
+
+  unit = (p4est_iter_unit_t *) sc_array_push (units);
+  unit->which_tree = t;
+  unit->kind = kind;
+  unit->phase = phase;
+  if (area != NULL) {
+    unit->area = *area;
+  }
+  else {
+    p4est_quadrant_set_morton (&unit->area, 0, 0);
+  }
+  unit->first = unit->last = 0;
+  return unit;
+}
+
+/* Cut the local trees into search areas no larger than split_level.  A
+ * volume unit is created for every area containing local quadrants and an
+ * interfaces unit for every coarser area that contains such an area.  The
+ * interfaces units run after the volume units, deepest level first. */
+static void
+p4est_iter_units_volume (p4est_t * p4est, int split_level, int with_faces,
+                         sc_array_t * units)
+{
+  int                 k, level;
+  size_t              current;
+  p4est_topidx_t      t;
+  p4est_locidx_t      zz, num_quads;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, area, anc[P4EST_QMAXLEVEL + 1];
+  p4est_iter_unit_t  *unit;
+
+  for (t = p4est->first_local_tree; t <= p4est->last_local_tree; t++) {
+    tree = p4est_tree_array_index (p4est->trees, t);
+    num_quads = (p4est_locidx_t) tree->quadrants.elem_count;
+    current = units->elem_count;
+    for (k = 0; k < split_level; k++) {
+      anc[k].level = -1;
+    }
+    for (zz = 0; zz < num_quads; zz++) {
+      q = p4est_quadrant_array_index (&tree->quadrants, (size_t) zz);
+      level = SC_MIN ((int) q->level, split_level);
+      if (level == (int) q->level) {
+        p4est_quadrant_copy (q, &area);
+      }
+      else {
+        p4est_quadrant_ancestor (q, level, &area);
+      }
+      if (current < units->elem_count) {
+        unit = (p4est_iter_unit_t *) sc_array_index (units, current);
+        if (p4est_quadrant_is_equal (&unit->area, &area)) {
+          unit->last = zz;
           continue;
         }
-        p8est_iter_init_edge (&edge_args, p4est, ghost_layer, loop_args, t,
-                              e);
-        p8est_edge_iterate (&edge_args, user_data, iter_edge, iter_corner);
-        p8est_iter_reset_edge (&edge_args);
+      }
+      current = units->elem_count;
+      unit = p4est_iter_unit_push (units, t, P4EST_ITER_UNIT_VOLUME, 0,
+                                   &area);
+      unit->first = unit->last = zz;
+      if (!with_faces) {
+        continue;
+      }
+      for (k = 0; k < level; k++) {
+        p4est_quadrant_ancestor (q, k, &area);
+        if ((int) anc[k].level == k &&
+            p4est_quadrant_is_equal (&anc[k], &area)) {
+          continue;
+        }
+        anc[k] = area;
+        p4est_iter_unit_push (units, t, P4EST_ITER_UNIT_INTERFACES,
+                              split_level - k, &area);
       }
     }
+  }
+}
+
+/* Descend the search tree of the volume arguments into an area, such that
+ * the index arrays hold the bounds of the area at its level.  If children
+ * is true, descend one more level to the bounds of its children. */
+static void
+p4est_iter_descend (p4est_iter_volume_args_t * args,
+                    const p4est_quadrant_t * area, int children)
+{
+  int                 k, type, quad_idx2;
+  int                 level = (int) area->level + (children ? 1 : 0);
+  p4est_iter_loop_args_t *loop_args = args->loop_args;
+  size_t            **zindex = loop_args->index;
+  size_t              first_index, count;
+  p4est_quadrant_t   *test;
+  sc_array_t          test_view;
+
+  for (k = 0; k < level; k++) {
+    quad_idx2 = k * P4EST_ITER_STRIDE +
+      (k == 0 ? 0 : p4est_quadrant_ancestor_id (area, k));
+    for (type = 0; type < 2; type++) {
+      first_index = zindex[type][quad_idx2];
+      count = zindex[type][quad_idx2 + 1] - first_index;
+      test = NULL;
+      if (count) {
+        test = p4est_quadrant_array_index (loop_args->quadrants[type],
+                                           first_index);
+      }
+      sc_array_init_view (&test_view, loop_args->quadrants[type],
+                          first_index, count);
+      p4est_iter_tier_insert (&test_view, k,
+                              zindex[type] + (k + 1) * P4EST_ITER_STRIDE,
+                              first_index, loop_args->tier_rings, test);
+    }
+  }
+  loop_args->level = level;
+  args->start_idx2 = (children || area->level == 0) ? 0 :
+    p4est_quadrant_child_id (area);
+}
+
+static void
+p4est_iter_run_unit (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                     const p4est_iter_unit_t * unit, const int32_t * owned,
+                     int remote, void *user_data,
+                     p4est_iter_volume_t iter_volume,
+                     p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                     p8est_iter_edge_t iter_edge,
+#endif
+                     p4est_iter_corner_t iter_corner)
+{
+  p4est_locidx_t      zz;
+  p4est_tree_t       *tree;
+  p4est_iter_loop_args_t *loop_args;
+  p4est_iter_volume_args_t args;
+  p4est_iter_volume_info_t *info;
+
+  /* with only a volume callback the area is a range of quadrants */
+  if (iter_face == NULL && iter_corner == NULL
+#ifdef P4_TO_P8
+      && iter_edge == NULL
+#endif
+    ) {
+    info = &args.info;
+    info->p4est = p4est;
+    info->ghost_layer = ghost_layer;
+    info->treeid = unit->which_tree;
+    tree = p4est_tree_array_index (p4est->trees, unit->which_tree);
+    for (zz = unit->first; zz <= unit->last; zz++) {
+      info->quad = p4est_quadrant_array_index (&tree->quadrants, (size_t) zz);
+      info->quadid = zz;
+      iter_volume (info, user_data);
+    }
+    return;
+  }
+
+  loop_args = p4est_iter_loop_args_new (p4est->connectivity,
+#ifdef P4_TO_P8
+                                        iter_edge,
+#endif
+                                        iter_corner, ghost_layer,
+                                        p4est->mpisize);
+  if (unit->kind == P4EST_ITER_UNIT_BOUNDARY) {
+    p4est_iter_tree_boundaries (p4est, ghost_layer, loop_args,
+                                unit->which_tree, owned[unit->which_tree],
+                                remote, user_data, iter_face,
+#ifdef P4_TO_P8
+                                iter_edge,
+#endif
+                                iter_corner);
+  }
+  else {
+    args.remote = remote;
+    p4est_iter_init_volume (&args, p4est, ghost_layer, loop_args,
+                            unit->which_tree);
+    p4est_iter_descend (&args, &unit->area,
+                        unit->kind == P4EST_ITER_UNIT_INTERFACES);
+    if (unit->kind == P4EST_ITER_UNIT_VOLUME) {
+      p4est_volume_iterate (&args, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                            iter_edge,
+#endif
+                            iter_corner);
+    }
     else {
-      mask <<= 12;
+      /* split the area and visit the interfaces between its children */
+      P4EST_ASSERT (unit->kind == P4EST_ITER_UNIT_INTERFACES);
+      P4EST_ASSERT ((int) unit->area.level < P4EST_QMAXLEVEL);
+      p4est_volume_iterate_interfaces (&args, user_data, iter_face,
+#ifdef P4_TO_P8
+                                       iter_edge,
+#endif
+                                       iter_corner);
     }
+    p4est_iter_reset_volume (&args);
+  }
+  p4est_iter_loop_args_destroy (loop_args);
+}
+
+void
+p4est_iterate_threads (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
+                       void *user_data, p4est_iter_volume_t iter_volume,
+                       p4est_iter_face_t iter_face,
+#ifdef P4_TO_P8
+                       p8est_iter_edge_t iter_edge,
+#endif
+                       p4est_iter_corner_t iter_corner, int remote,
+                       int num_threads, int shared_writes)
+{
+  int                 split_level, with_faces;
+#ifdef P4EST_ENABLE_OPENMP
+  int                 phase_threads;
 #endif
+  long                lu, num_areas;
+  size_t              first, last, num_units;
+  p4est_topidx_t      t;
+  p4est_topidx_t      last_run_tree;
+  p4est_ghost_t       empty_ghost_layer;
+  p4est_ghost_t      *ghost_layer;
+  size_t              global_num_trees = p4est->trees->elem_count;
+  int32_t            *owned = NULL;
+  sc_array_t         *units;
+  p4est_iter_unit_t  *unit;
 
-    if (loop_args->loop_corner) {
-      for (c = 0; c < P4EST_CHILDREN; c++, mask <<= 1) {
-        if ((touch & mask) == 0) {
-          continue;
-        }
-        p4est_iter_init_corner (&corner_args, p4est, ghost_layer, loop_args,
-                                t, c);
-        p4est_corner_iterate (&corner_args, user_data, iter_corner);
-        p4est_iter_reset_corner (&corner_args);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  if (p4est->first_local_tree < 0 ||
+      (iter_face == NULL && iter_corner == NULL &&
+#ifdef P4_TO_P8
+       iter_edge == NULL &&
+#endif
+       iter_volume == NULL)) {
+    return;
+  }
+  num_threads = p4est_num_threads (num_threads);
+  with_faces = (iter_face != NULL || iter_corner != NULL
+#ifdef P4_TO_P8
+                || iter_edge != NULL
+#endif
+    );
+
+  if (Ghost_layer == NULL) {
+    sc_array_init (&(empty_ghost_layer.ghosts), sizeof (p4est_quadrant_t));
+    empty_ghost_layer.tree_offsets = P4EST_ALLOC_ZERO (p4est_locidx_t,
+                                                       global_num_trees + 1);
+    empty_ghost_layer.proc_offsets = P4EST_ALLOC_ZERO (p4est_locidx_t,
+                                                       p4est->mpisize + 1);
+    ghost_layer = &empty_ghost_layer;
+  }
+  else {
+    ghost_layer = Ghost_layer;
+  }
+
+  /* cut the local trees into enough search areas to keep all threads busy */
+  num_areas = (long) (p4est->last_local_tree - p4est->first_local_tree + 1);
+  for (split_level = 0; num_areas < 16L * num_threads &&
+       split_level < P4EST_QMAXLEVEL; ++split_level) {
+    num_areas *= P4EST_CHILDREN;
+  }
+  units = sc_array_new (sizeof (p4est_iter_unit_t));
+  p4est_iter_units_volume (p4est, split_level, with_faces, units);
+
+  /* the entities between trees are visited per tree after all volumes */
+  if (with_faces) {
+    owned = p4est_iter_get_boundaries (p4est, &last_run_tree, remote);
+    last_run_tree = SC_MAX (last_run_tree, p4est->last_local_tree);
+    for (t = p4est->first_local_tree; t <= last_run_tree; t++) {
+      if (owned[t]) {
+        p4est_iter_unit_push (units, t, P4EST_ITER_UNIT_BOUNDARY,
+                              split_level + 1, NULL);
       }
     }
+  }
 
+  /* with shared writes, the units are run phase by phase; otherwise all
+   * units form a single phase */
+  if (shared_writes) {
+    sc_array_sort (units, p4est_iter_unit_compare);
+  }
+  num_units = units->elem_count;
+  for (first = 0; first < num_units; first = last) {
+    unit = (p4est_iter_unit_t *) sc_array_index (units, first);
+    last = num_units;
+    if (shared_writes) {
+      for (last = first + 1; last < num_units; ++last) {
+        if (((p4est_iter_unit_t *) sc_array_index (units, last))->phase !=
+            unit->phase) {
+          break;
+        }
+      }
+    }
+#ifdef P4EST_ENABLE_OPENMP
+    /* the units between trees may touch the same quadrants */
+    phase_threads = (shared_writes &&
+                     unit->kind == P4EST_ITER_UNIT_BOUNDARY) ? 1 :
+      num_threads;
+#pragma omp parallel for schedule(dynamic) num_threads(phase_threads)
+#endif
+    for (lu = (long) first; lu < (long) last; ++lu) {
+      p4est_iter_run_unit (p4est, ghost_layer,
+                           (p4est_iter_unit_t *) sc_array_index_long (units,
+                                                                      lu),
+                           owned, remote, user_data, iter_volume, iter_face,
+#ifdef P4_TO_P8
+                           iter_edge,
+#endif
+                           iter_corner);
+    }
   }
 
   if (Ghost_layer == NULL) {
     P4EST_FREE (empty_ghost_layer.tree_offsets);
     P4EST_FREE (empty_ghost_layer.proc_offsets);
   }
-
   P4EST_FREE (owned);
-  p4est_iter_loop_args_destroy (loop_args);
+  sc_array_destroy (units);
+}
+
+static p4est_iter_schedule_side_t *
+p4est_iter_schedule_push (sc_array_t * entities, sc_array_t * sides,
+                          int num_sides, int orientation, int tree_boundary)
+{
+  p4est_iter_schedule_entity_t *entity;
+
+  entity = (p4est_iter_schedule_entity_t *) sc_array_push (entities);
+  entity->first_side = (p4est_locidx_t) sides->elem_count;
+  entity->num_sides = num_sides;
+  entity->orientation = (int8_t) orientation;
+  entity->tree_boundary = (int8_t) tree_boundary;
+
+  return (p4est_iter_schedule_side_t *)
+    sc_array_push_count (sides, (size_t) num_sides);
+}
+
+static void
+p4est_iter_record_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  int                 i, j;
+  int                 num_sides = (int) info->sides.elem_count;
+  p4est_iter_schedule_t *schedule = (p4est_iter_schedule_t *) user_data;
+  p4est_iter_schedule_side_t *rside;
+  p4est_iter_face_side_t *side;
+
+  rside = p4est_iter_schedule_push (&schedule->faces, &schedule->face_sides,
+                                    num_sides, info->orientation,
+                                    info->tree_boundary);
+  for (i = 0; i < num_sides; i++, rside++) {
+    side = p4est_iter_fside_array_index_int (&info->sides, i);
+    memset (rside, 0, sizeof (p4est_iter_schedule_side_t));
+    rside->treeid = side->treeid;
+    rside->entity = side->face;
+    rside->is_hanging = side->is_hanging;
+    if (side->is_hanging) {
+      for (j = 0; j < P4EST_HALF; j++) {
+        rside->is_ghost[j] = side->is.hanging.is_ghost[j];
+        rside->quadid[j] = side->is.hanging.quadid[j];
+      }
+    }
+    else {
+      rside->is_ghost[0] = side->is.full.is_ghost;
+      rside->quadid[0] = side->is.full.quadid;
+    }
+  }
+}
+
+#ifdef P4_TO_P8
+static void
+p8est_iter_record_edge (p8est_iter_edge_info_t * info, void *user_data)
+{
+  int                 i, j;
+  int                 num_sides = (int) info->sides.elem_count;
+  p4est_iter_schedule_t *schedule = (p4est_iter_schedule_t *) user_data;
+  p4est_iter_schedule_side_t *rside;
+  p8est_iter_edge_side_t *side;
+
+  rside = p4est_iter_schedule_push (&schedule->edges, &schedule->edge_sides,
+                                    num_sides, 0, info->tree_boundary);
+  for (i = 0; i < num_sides; i++, rside++) {
+    side = p8est_iter_eside_array_index_int (&info->sides, i);
+    memset (rside, 0, sizeof (p4est_iter_schedule_side_t));
+    rside->treeid = side->treeid;
+    rside->entity = side->edge;
+    rside->orientation = side->orientation;
+    rside->is_hanging = side->is_hanging;
+    if (side->is_hanging) {
+      for (j = 0; j < 2; j++) {
+        rside->is_ghost[j] = side->is.hanging.is_ghost[j];
+        rside->quadid[j] = side->is.hanging.quadid[j];
+      }
+    }
+    else {
+      rside->is_ghost[0] = side->is.full.is_ghost;
+      rside->quadid[0] = side->is.full.quadid;
+    }
+    rside->faces[0] = side->faces[0];
+    rside->faces[1] = side->faces[1];
+  }
+}
+#endif
+
+static void
+p4est_iter_record_corner (p4est_iter_corner_info_t * info, void *user_data)
+{
+  int                 i, j;
+  int                 num_sides = (int) info->sides.elem_count;
+  p4est_iter_schedule_t *schedule = (p4est_iter_schedule_t *) user_data;
+  p4est_iter_schedule_side_t *rside;
+  p4est_iter_corner_side_t *side;
+
+  rside = p4est_iter_schedule_push (&schedule->corners,
+                                    &schedule->corner_sides, num_sides, 0,
+                                    info->tree_boundary);
+  for (i = 0; i < num_sides; i++, rside++) {
+    side = p4est_iter_cside_array_index_int (&info->sides, i);
+    memset (rside, 0, sizeof (p4est_iter_schedule_side_t));
+    rside->treeid = side->treeid;
+    rside->entity = side->corner;
+    rside->is_ghost[0] = side->is_ghost;
+    rside->quadid[0] = side->quadid;
+    for (j = 0; j < P4EST_DIM; j++) {
+      rside->faces[j] = side->faces[j];
+#ifdef P4_TO_P8
+      rside->edges[j] = side->edges[j];
+#endif
+    }
+  }
+}
+
+p4est_iter_schedule_t *
+p4est_iterate_record (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                      p4est_connect_type_t btype)
+{
+  p4est_iter_schedule_t *schedule;
+
+  P4EST_ASSERT (btype >= P4EST_CONNECT_FACE);
+
+  schedule = P4EST_ALLOC (p4est_iter_schedule_t, 1);
+  schedule->p4est = p4est;
+  schedule->ghost_layer = ghost_layer;
+  schedule->revision = p4est->revision;
+  schedule->btype = btype;
+  sc_array_init (&schedule->faces, sizeof (p4est_iter_schedule_entity_t));
+  sc_array_init (&schedule->face_sides, sizeof (p4est_iter_schedule_side_t));
+#ifdef P4_TO_P8
+  sc_array_init (&schedule->edges, sizeof (p4est_iter_schedule_entity_t));
+  sc_array_init (&schedule->edge_sides, sizeof (p4est_iter_schedule_side_t));
+#endif
+  sc_array_init (&schedule->corners, sizeof (p4est_iter_schedule_entity_t));
+  sc_array_init (&schedule->corner_sides,
+                 sizeof (p4est_iter_schedule_side_t));
+
+  p4est_iterate (p4est, ghost_layer, schedule, NULL, p4est_iter_record_face,
+#ifdef P4_TO_P8
+                 btype >= P8EST_CONNECT_EDGE ? p8est_iter_record_edge : NULL,
+#endif
+                 btype == P4EST_CONNECT_FULL ? p4est_iter_record_corner :
+                 NULL);
+
+  return schedule;
 }
 
 void
-p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
-               p4est_iter_volume_t iter_volume, p4est_iter_face_t iter_face,
+p4est_iter_schedule_destroy (p4est_iter_schedule_t * schedule)
+{
+  sc_array_reset (&schedule->faces);
+  sc_array_reset (&schedule->face_sides);
 #ifdef P4_TO_P8
-               p8est_iter_edge_t iter_edge,
+  sc_array_reset (&schedule->edges);
+  sc_array_reset (&schedule->edge_sides);
 #endif
-               p4est_iter_corner_t iter_corner)
+  sc_array_reset (&schedule->corners);
+  sc_array_reset (&schedule->corner_sides);
+  P4EST_FREE (schedule);
+}
+
+/* look up a recorded quadrant by its index */
+static p4est_quadrant_t *
+p4est_iter_schedule_quad (p4est_iter_schedule_t * schedule,
+                          p4est_topidx_t treeid, int is_ghost,
+                          p4est_locidx_t quadid)
 {
-  p4est_iterate_ext (p4est, Ghost_layer, user_data, iter_volume, iter_face,
+  p4est_tree_t       *tree;
+
+  if (quadid < 0) {
+    return NULL;
+  }
+  if (is_ghost) {
+    return p4est_quadrant_array_index (&schedule->ghost_layer->ghosts,
+                                       (size_t) quadid);
+  }
+  tree = p4est_tree_array_index (schedule->p4est->trees, treeid);
+  return p4est_quadrant_array_index (&tree->quadrants, (size_t) quadid);
+}
+
+void
+p4est_iterate_replay (p4est_iter_schedule_t * schedule, void *user_data,
+                      p4est_iter_volume_t iter_volume,
+                      p4est_iter_face_t iter_face,
 #ifdef P4_TO_P8
-                     iter_edge,
+                      p8est_iter_edge_t iter_edge,
 #endif
-                     iter_corner, 0);
+                      p4est_iter_corner_t iter_corner)
+{
+  int                 i, j;
+  size_t              zz;
+  p4est_t            *p4est = schedule->p4est;
+  p4est_ghost_t       empty_ghost_layer;
+  p4est_ghost_t      *ghost_layer;
+  p4est_iter_schedule_entity_t *entity;
+  p4est_iter_schedule_side_t *rside;
+  p4est_iter_face_info_t finfo;
+  p4est_iter_face_side_t *fside;
+#ifdef P4_TO_P8
+  p8est_iter_edge_info_t einfo;
+  p8est_iter_edge_side_t *eside;
+#endif
+  p4est_iter_corner_info_t cinfo;
+  p4est_iter_corner_side_t *cside;
+
+  P4EST_ASSERT (schedule->revision == p4est->revision);
+  P4EST_ASSERT (iter_face == NULL ||
+                schedule->btype >= P4EST_CONNECT_FACE);
+#ifdef P4_TO_P8
+  P4EST_ASSERT (iter_edge == NULL ||
+                schedule->btype >= P8EST_CONNECT_EDGE);
+#endif
+  P4EST_ASSERT (iter_corner == NULL ||
+                schedule->btype == P4EST_CONNECT_FULL);
+
+  if (p4est->first_local_tree < 0) {
+    return;
+  }
+
+  ghost_layer = schedule->ghost_layer;
+  if (ghost_layer == NULL) {
+    sc_array_init (&(empty_ghost_layer.ghosts), sizeof (p4est_quadrant_t));
+    empty_ghost_layer.tree_offsets =
+      P4EST_ALLOC_ZERO (p4est_locidx_t, p4est->trees->elem_count + 1);
+    empty_ghost_layer.proc_offsets = P4EST_ALLOC_ZERO (p4est_locidx_t,
+                                                       p4est->mpisize + 1);
+    ghost_layer = &empty_ghost_layer;
+  }
+
+  if (iter_volume != NULL) {
+    p4est_volume_iterate_simple (p4est, ghost_layer, user_data, iter_volume);
+  }
+
+  if (iter_face != NULL) {
+    finfo.p4est = p4est;
+    finfo.ghost_layer = ghost_layer;
+    sc_array_init (&finfo.sides, sizeof (p4est_iter_face_side_t));
+    for (zz = 0; zz < schedule->faces.elem_count; zz++) {
+      entity = (p4est_iter_schedule_entity_t *)
+        sc_array_index (&schedule->faces, zz);
+      finfo.orientation = entity->orientation;
+      finfo.tree_boundary = entity->tree_boundary;
+      sc_array_resize (&finfo.sides, (size_t) entity->num_sides);
+      rside = (p4est_iter_schedule_side_t *)
+        sc_array_index (&schedule->face_sides, (size_t) entity->first_side);
+      for (i = 0; i < entity->num_sides; i++, rside++) {
+        fside = p4est_iter_fside_array_index_int (&finfo.sides, i);
+        fside->treeid = rside->treeid;
+        fside->face = rside->entity;
+        fside->is_hanging = rside->is_hanging;
+        if (rside->is_hanging) {
+          for (j = 0; j < P4EST_HALF; j++) {
+            fside->is.hanging.is_ghost[j] = rside->is_ghost[j];
+            fside->is.hanging.quadid[j] = rside->quadid[j];
+            fside->is.hanging.quad[j] =
+              p4est_iter_schedule_quad (schedule, rside->treeid,
+                                        rside->is_ghost[j], rside->quadid[j]);
+          }
+        }
+        else {
+          fside->is.full.is_ghost = rside->is_ghost[0];
+          fside->is.full.quadid = rside->quadid[0];
+          fside->is.full.quad =
+            p4est_iter_schedule_quad (schedule, rside->treeid,
+                                      rside->is_ghost[0], rside->quadid[0]);
+        }
+      }
+      iter_face (&finfo, user_data);
+    }
+    sc_array_reset (&finfo.sides);
+  }
+
+#ifdef P4_TO_P8
+  if (iter_edge != NULL) {
+    einfo.p4est = p4est;
+    einfo.ghost_layer = ghost_layer;
+    sc_array_init (&einfo.sides, sizeof (p8est_iter_edge_side_t));
+    for (zz = 0; zz < schedule->edges.elem_count; zz++) {
+      entity = (p4est_iter_schedule_entity_t *)
+        sc_array_index (&schedule->edges, zz);
+      einfo.tree_boundary = entity->tree_boundary;
+      sc_array_resize (&einfo.sides, (size_t) entity->num_sides);
+      rside = (p4est_iter_schedule_side_t *)
+        sc_array_index (&schedule->edge_sides, (size_t) entity->first_side);
+      for (i = 0; i < entity->num_sides; i++, rside++) {
+        eside = p8est_iter_eside_array_index_int (&einfo.sides, i);
+        eside->treeid = rside->treeid;
+        eside->edge = rside->entity;
+        eside->orientation = rside->orientation;
+        eside->is_hanging = rside->is_hanging;
+        if (rside->is_hanging) {
+          for (j = 0; j < 2; j++) {
+            eside->is.hanging.is_ghost[j] = rside->is_ghost[j];
+            eside->is.hanging.quadid[j] = rside->quadid[j];
+            eside->is.hanging.quad[j] =
+              p4est_iter_schedule_quad (schedule, rside->treeid,
+                                        rside->is_ghost[j], rside->quadid[j]);
+          }
+        }
+        else {
+          eside->is.full.is_ghost = rside->is_ghost[0];
+          eside->is.full.quadid = rside->quadid[0];
+          eside->is.full.quad =
+            p4est_iter_schedule_quad (schedule, rside->treeid,
+                                      rside->is_ghost[0], rside->quadid[0]);
+        }
+        eside->faces[0] = rside->faces[0];
+        eside->faces[1] = rside->faces[1];
+      }
+      iter_edge (&einfo, user_data);
+    }
+    sc_array_reset (&einfo.sides);
+  }
+#endif
+
+  if (iter_corner != NULL) {
+    cinfo.p4est = p4est;
+    cinfo.ghost_layer = ghost_layer;
+    sc_array_init (&cinfo.sides, sizeof (p4est_iter_corner_side_t));
+    for (zz = 0; zz < schedule->corners.elem_count; zz++) {
+      entity = (p4est_iter_schedule_entity_t *)
+        sc_array_index (&schedule->corners, zz);
+      cinfo.tree_boundary = entity->tree_boundary;
+      sc_array_resize (&cinfo.sides, (size_t) entity->num_sides);
+      rside = (p4est_iter_schedule_side_t *)
+        sc_array_index (&schedule->corner_sides,
+                        (size_t) entity->first_side);
+      for (i = 0; i < entity->num_sides; i++, rside++) {
+        cside = p4est_iter_cside_array_index_int (&cinfo.sides, i);
+        cside->treeid = rside->treeid;
+        cside->corner = rside->entity;
+        cside->is_ghost = rside->is_ghost[0];
+        cside->quadid = rside->quadid[0];
+        cside->quad = p4est_iter_schedule_quad (schedule, rside->treeid,
+                                                rside->is_ghost[0],
+                                                rside->quadid[0]);
+        for (j = 0; j < P4EST_DIM; j++) {
+          cside->faces[j] = rside->faces[j];
+#ifdef P4_TO_P8
+          cside->edges[j] = rside->edges[j];
+#endif
+        }
+      }
+      iter_corner (&cinfo, user_data);
+    }
+    sc_array_reset (&cinfo.sides);
+  }
+
+  if (schedule->ghost_layer == NULL) {
+    P4EST_FREE (empty_ghost_layer.tree_offsets);
+    P4EST_FREE (empty_ghost_layer.proc_offsets);
+  }
+}
+
+/* the number of faces collected in a batch before it is passed on */
+#define P4EST_ITER_SPAN_SIZE 1024
+
+/* the state of p4est_iterate_spans: one batch for each level and direction,
+ * each holding the first quadrants of its faces followed by the second */
+typedef struct p4est_iter_spans
+{
+  void               *user_data;
+  p4est_iter_face_span_t iter_face_span;
+  p4est_iter_face_t   iter_face;
+  p4est_locidx_t     *batch[(P4EST_QMAXLEVEL + 1) * P4EST_DIM];
+  p4est_locidx_t      count[(P4EST_QMAXLEVEL + 1) * P4EST_DIM];
+  p4est_iter_face_span_info_t info;
+}
+p4est_iter_spans_t;
+
+static void
+p4est_iter_spans_flush (p4est_iter_spans_t * spans, int b)
+{
+  p4est_iter_face_span_info_t *info = &spans->info;
+
+  if (spans->count[b] > 0) {
+    info->level = (int8_t) (b / P4EST_DIM);
+    info->direction = (int8_t) (b % P4EST_DIM);
+    info->count = spans->count[b];
+    info->quadid[0] = spans->batch[b];
+    info->quadid[1] = spans->batch[b] + P4EST_ITER_SPAN_SIZE;
+    spans->iter_face_span (info, spans->user_data);
+    spans->count[b] = 0;
+  }
+}
+
+static void
+p4est_iter_spans_face (p4est_iter_face_info_t * info, void *user_data)
+{
+  int                 b;
+  p4est_locidx_t      offset;
+  p4est_iter_spans_t *spans = (p4est_iter_spans_t *) user_data;
+  p4est_iter_face_side_t *side[2];
+
+  if (spans->iter_face_span != NULL && !info->tree_boundary) {
+    P4EST_ASSERT (info->sides.elem_count == 2);
+    side[0] = p4est_iter_fside_array_index (&info->sides, 0);
+    side[1] = p4est_iter_fside_array_index (&info->sides, 1);
+    if (!side[0]->is_hanging && !side[1]->is_hanging &&
+        !side[0]->is.full.is_ghost && !side[1]->is.full.is_ghost) {
+      P4EST_ASSERT (side[0]->face == side[1]->face + 1);
+      offset = p4est_tree_array_index (info->p4est->trees,
+                                       side[0]->treeid)->quadrants_offset;
+      b = (int) side[0]->is.full.quad->level * P4EST_DIM + side[1]->face / 2;
+      if (spans->batch[b] == NULL) {
+        spans->batch[b] = P4EST_ALLOC (p4est_locidx_t,
+                                       2 * P4EST_ITER_SPAN_SIZE);
+      }
+      spans->batch[b][spans->count[b]] = offset + side[0]->is.full.quadid;
+      spans->batch[b][P4EST_ITER_SPAN_SIZE + spans->count[b]] =
+        offset + side[1]->is.full.quadid;
+      if (++spans->count[b] == P4EST_ITER_SPAN_SIZE) {
+        p4est_iter_spans_flush (spans, b);
+      }
+      return;
+    }
+  }
+  if (spans->iter_face != NULL) {
+    spans->iter_face (info, spans->user_data);
+  }
+}
+
+void
+p4est_iterate_spans (p4est_t * p4est, p4est_ghost_t * ghost_layer,
+                     void *user_data,
+                     p4est_iter_volume_span_t iter_volume_span,
+                     p4est_iter_face_span_t iter_face_span,
+                     p4est_iter_face_t iter_face)
+{
+  int                 b;
+  p4est_topidx_t      t;
+  p4est_tree_t       *tree;
+  p4est_iter_volume_span_info_t vinfo;
+  p4est_iter_spans_t  spans;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  if (p4est->first_local_tree < 0) {
+    return;
+  }
+
+  if (iter_volume_span != NULL) {
+    vinfo.p4est = p4est;
+    vinfo.ghost_layer = ghost_layer;
+    for (t = p4est->first_local_tree; t <= p4est->last_local_tree; t++) {
+      tree = p4est_tree_array_index (p4est->trees, t);
+      if (tree->quadrants.elem_count == 0) {
+        continue;
+      }
+      vinfo.treeid = t;
+      vinfo.quads = p4est_quadrant_array_index (&tree->quadrants, 0);
+      vinfo.count = (p4est_locidx_t) tree->quadrants.elem_count;
+      vinfo.offset = tree->quadrants_offset;
+      iter_volume_span (&vinfo, user_data);
+    }
+  }
+
+  if (iter_face_span == NULL && iter_face == NULL) {
+    return;
+  }
+  memset (&spans, 0, sizeof (p4est_iter_spans_t));
+  spans.user_data = user_data;
+  spans.iter_face_span = iter_face_span;
+  spans.iter_face = iter_face;
+  spans.info.p4est = p4est;
+  spans.info.ghost_layer = ghost_layer;
+  p4est_iterate (p4est, ghost_layer, &spans, NULL, p4est_iter_spans_face,
+#ifdef P4_TO_P8
+                 NULL,
+#endif
+                 NULL);
+  for (b = 0; b < (P4EST_QMAXLEVEL + 1) * P4EST_DIM; b++) {
+    if (spans.batch[b] != NULL) {
+      p4est_iter_spans_flush (&spans, b);
+      P4EST_FREE (spans.batch[b]);
+    }
+  }
 }
@@ -1143,31 +1143,47 @@ p4est_mesh_new (p4est_t * p4est, p4est_ghost_t * ghost,
   return p4est_mesh_new_ext (p4est, ghost, 0, 0, btype);
 }
 
-p4est_mesh_t       *
-p4est_mesh_new_ext (p4est_t * p4est, p4est_ghost_t * ghost,
-                    int compute_tree_index, int compute_level_lists,
-                    p4est_connect_type_t btype)
+/** Record the owner process of every ghost quadrant. */
+static void
+mesh_ghost_to_proc (p4est_t * p4est, p4est_ghost_t * ghost,
+                    p4est_mesh_t * mesh)
+{
+  int                 rank;
+  p4est_locidx_t      jl;
+
+  rank = 0;
+  for (jl = 0; jl < mesh->ghost_num_quadrants; ++jl) {
+    while (ghost->proc_offsets[rank + 1] <= jl) {
+      ++rank;
+      P4EST_ASSERT (rank < p4est->mpisize);
+    }
+    mesh->ghost_to_proc[jl] = rank;
+  }
+}
+
+/** Allocate a mesh and initialize its arrays to the values that the
+ *  constructors expect before they fill in the neighborhood information.
+ */
+static p4est_mesh_t *
+mesh_allocate (p4est_t * p4est, p4est_ghost_t * ghost,
+               int compute_tree_index, int compute_level_lists,
+               p4est_connect_type_t btype)
 {
   int                 do_corner = 0;
 #ifdef P4_TO_P8
   int                 do_edge = 0;
 #endif /* P4_TO_P8 */
-  int                 do_volume = 0;
-  int                 rank;
   p4est_locidx_t      lq, ng;
   p4est_locidx_t      jl;
   p4est_mesh_t       *mesh;
 
-  /* check whether input condition for p4est is met */
-  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
-
   mesh = P4EST_ALLOC_ZERO (p4est_mesh_t, 1);
 
   /* number of local quadrants and number of local ghost cells */
   lq = mesh->local_num_quadrants = p4est->local_num_quadrants;
   ng = mesh->ghost_num_quadrants = (p4est_locidx_t) ghost->ghosts.elem_count;
 
-  /* decide which callback function have to be activated */
+  /* decide which optional arrays have to be allocated */
 #ifdef P4_TO_P8
   if (btype >= P8EST_CONNECT_EDGE) {
     do_edge = 1;
@@ -1176,7 +1192,6 @@ p4est_mesh_new_ext (p4est_t * p4est, p4est_ghost_t * ghost,
   if (btype >= P4EST_CONNECT_FULL) {
     do_corner = 1;
   }
-  do_volume = compute_tree_index || compute_level_lists;
 
   /* Optional map of tree index for each quadrant */
   if (compute_tree_index) {
@@ -1199,14 +1214,7 @@ p4est_mesh_new_ext (p4est_t * p4est, p4est_ghost_t * ghost,
   }
 
   /* Populate ghost information */
-  rank = 0;
-  for (jl = 0; jl < ng; ++jl) {
-    while (ghost->proc_offsets[rank + 1] <= jl) {
-      ++rank;
-      P4EST_ASSERT (rank < p4est->mpisize);
-    }
-    mesh->ghost_to_proc[jl] = rank;
-  }
+  mesh_ghost_to_proc (p4est, ghost, mesh);
 
   /* Fill face arrays with default values */
   memset (mesh->quad_to_quad, (char) -1,
@@ -1242,19 +1250,652 @@ p4est_mesh_new_ext (p4est_t * p4est, p4est_ghost_t * ghost,
     mesh->corner_corner = sc_array_new (sizeof (int8_t));
   }
 
+  return mesh;
+}
+
+p4est_mesh_t       *
+p4est_mesh_new_ext (p4est_t * p4est, p4est_ghost_t * ghost,
+                    int compute_tree_index, int compute_level_lists,
+                    p4est_connect_type_t btype)
+{
+  int                 do_volume;
+  p4est_mesh_t       *mesh;
+
+  /* check whether input condition for p4est is met */
+  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
+
+  mesh = mesh_allocate (p4est, ghost, compute_tree_index,
+                        compute_level_lists, btype);
+  do_volume = compute_tree_index || compute_level_lists;
+
   /* Call the forest iterator to collect face connectivity */
   p4est_iterate (p4est,         /* p4est */
                  ghost,         /* ghost layer */
                  mesh,          /* user_data */
                  (do_volume ? mesh_iter_volume : NULL), mesh_iter_face,
 #ifdef P4_TO_P8
-                 (do_edge ? mesh_iter_edge : NULL),
+                 (mesh->quad_to_edge != NULL ? mesh_iter_edge : NULL),
 #endif /* P4_TO_P8 */
-                 (do_corner ? mesh_iter_corner : NULL));
+                 (mesh->quad_to_corner != NULL ? mesh_iter_corner : NULL));
+
+  return mesh;
+}
+
+/** Record the order in which the iterator visits the hanging faces.
+ * For each hanging face with a local large quadrant, \ref mesh_iter_face
+ * pushes an entry to quad_to_half.  Here the entry is pushed as well, but
+ * it only holds the quad_to_quad index of the large quadrant's face.
+ * It is filled in later by \ref mesh_half_renumber.
+ */
+static void
+mesh_iter_half (p4est_iter_face_info_t * info, void *user_data)
+{
+  p4est_mesh_t       *mesh = (p4est_mesh_t *) user_data;
+  p4est_locidx_t     *halfentries;
+  p4est_tree_t       *tree;
+  p4est_iter_face_side_t *side, *side2;
+
+  if (info->sides.elem_count == 1) {
+    return;
+  }
+  P4EST_ASSERT (info->sides.elem_count == 2);
+  side = (p4est_iter_face_side_t *) sc_array_index (&info->sides, 0);
+  side2 = (p4est_iter_face_side_t *) sc_array_index (&info->sides, 1);
+  if (!side->is_hanging && !side2->is_hanging) {
+    return;
+  }
+  if (side->is_hanging) {
+    side = side2;
+  }
+  if (!side->is.full.is_ghost) {
+    tree = p4est_tree_array_index (info->p4est->trees, side->treeid);
+    halfentries = (p4est_locidx_t *) sc_array_push (mesh->quad_to_half);
+    halfentries[0] = P4EST_FACES *
+      (side->is.full.quadid + tree->quadrants_offset) + side->face;
+  }
+}
+
+/** Fill in one hanging face recorded by \ref mesh_iter_half. */
+static void
+mesh_half_move (p4est_mesh_t * mesh, sc_array_t * staging, size_t zk)
+{
+  p4est_locidx_t      in_qtoq;
+  p4est_locidx_t     *halfentries;
+
+  halfentries = (p4est_locidx_t *) sc_array_index (mesh->quad_to_half, zk);
+  in_qtoq = halfentries[0];
+  P4EST_ASSERT (mesh->quad_to_face[in_qtoq] < 0);
+  memcpy (halfentries, sc_array_index (staging, (size_t)
+                                       mesh->quad_to_quad[in_qtoq]),
+          P4EST_HALF * sizeof (p4est_locidx_t));
+  mesh->quad_to_quad[in_qtoq] = (p4est_locidx_t) zk;
+}
+
+/** Renumber the hanging faces into the order of the iterator.
+ * \param [in,out] mesh   On input, the quad_to_quad entries of hanging
+ *                        faces index into \a staging and quad_to_half has
+ *                        been recorded by \ref mesh_iter_half.  On output,
+ *                        the hanging faces are numbered as by
+ *                        \ref p4est_mesh_new_ext.
+ * \param [in] staging    The hanging faces in any order.
+ * \param [in] num_threads  The number of threads to use.
+ */
+static void
+mesh_half_renumber (p4est_mesh_t * mesh, sc_array_t * staging,
+                    int num_threads)
+{
+  long                lk, num_halves;
+
+  P4EST_ASSERT (staging->elem_count == mesh->quad_to_half->elem_count);
+  num_halves = (long) staging->elem_count;
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(num_threads)
+#endif
+  for (lk = 0; lk < num_halves; ++lk) {
+    mesh_half_move (mesh, staging, (size_t) lk);
+  }
+}
+
+/** A contiguous range of local quadrants processed by one thread. */
+typedef struct p4est_mesh_unit
+{
+  p4est_topidx_t      which_tree;       /**< The local tree of this range */
+  size_t              begin, end;       /**< Range in tree->quadrants */
+  p4est_locidx_t      half_offset;      /**< Position in staging array */
+  sc_array_t          halves;           /**< Hanging faces of this range */
+  p4est_locidx_t      per_level[P4EST_QMAXLEVEL + 1];   /**< Counts per level,
+                                                             then offsets */
+}
+p4est_mesh_unit_t;
+
+/** Find the local or ghost leaf that overlaps a given quadrant.
+ * \param [in] p4est    The forest.
+ * \param [in] ghost    The ghost layer of the forest.
+ * \param [in] treeid   The tree of the quadrant.
+ * \param [in] q        The quadrant to look for.
+ * \param [out] leaf    The leaf overlapping q if one is found.
+ * \return              The mesh index of the leaf, that is the local
+ *                      number for local quadrants and the ghost number
+ *                      plus local_num_quadrants for ghosts, or -1.
+ */
+static              p4est_locidx_t
+mesh_find_leaf (p4est_t * p4est, p4est_ghost_t * ghost,
+                p4est_topidx_t treeid, const p4est_quadrant_t * q,
+                const p4est_quadrant_t ** leaf)
+{
+  ssize_t             pos;
+  p4est_locidx_t      goffset;
+  p4est_tree_t       *tree;
+  sc_array_t          view;
+
+  if (p4est->first_local_tree <= treeid && treeid <= p4est->last_local_tree) {
+    tree = p4est_tree_array_index (p4est->trees, treeid);
+    pos = sc_array_bsearch (&tree->quadrants, q, p4est_quadrant_disjoint);
+    if (pos >= 0) {
+      *leaf = p4est_quadrant_array_index (&tree->quadrants, (size_t) pos);
+      return tree->quadrants_offset + (p4est_locidx_t) pos;
+    }
+  }
+
+  goffset = ghost->tree_offsets[treeid];
+  if (ghost->tree_offsets[treeid + 1] > goffset) {
+    sc_array_init_view (&view, &ghost->ghosts, (size_t) goffset,
+                        (size_t) (ghost->tree_offsets[treeid + 1] - goffset));
+    pos = sc_array_bsearch (&view, q, p4est_quadrant_disjoint);
+    if (pos >= 0) {
+      *leaf = p4est_quadrant_array_index (&view, (size_t) pos);
+      return p4est->local_num_quadrants + goffset + (p4est_locidx_t) pos;
+    }
+  }
+  return -1;
+}
+
+/** Compute the face neighbor of one local quadrant across one face.
+ * The encoding is the same as that of \ref mesh_iter_face.
+ * For a hanging face, the small neighbors are pushed to an array and the
+ * quad_to_quad entry is set to their position in this array.
+ * \param [in] p4est    The forest.
+ * \param [in] ghost    The ghost layer of the forest.
+ * \param [in,out] mesh The quad_to_quad and quad_to_face entries are set.
+ * \param [in] treeid   The tree of the quadrant.
+ * \param [in] q        The quadrant.
+ * \param [in] jl       The local number of the quadrant.
+ * \param [in] f        The face of the quadrant.
+ * \param [in,out] halves  Array of P4EST_HALF local indices per entry.
+ */
+static void
+mesh_quad_face (p4est_t * p4est, p4est_ghost_t * ghost, p4est_mesh_t * mesh,
+                p4est_topidx_t treeid, const p4est_quadrant_t * q,
+                p4est_locidx_t jl, int f, sc_array_t * halves)
+{
+  int                 nf, o, h, pos;
+  int                 nface;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      jn, in_qtoq;
+  p4est_locidx_t     *halfentries;
+  p4est_quadrant_t    n, child;
+  const p4est_quadrant_t *leaf;
+
+  in_qtoq = P4EST_FACES * jl + f;
+  nt = p4est_quadrant_face_neighbor_extra (q, treeid, f, &n,
+                                           &nface, p4est->connectivity);
+  if (nt < 0) {
+    /* this face is on an outside boundary of the forest */
+    mesh->quad_to_quad[in_qtoq] = jl;
+    mesh->quad_to_face[in_qtoq] = (int8_t) f;
+    return;
+  }
+  nf = nface % P4EST_FACES;
+  o = nface / P4EST_FACES;
+  jn = mesh_find_leaf (p4est, ghost, nt, &n, &leaf);
+  P4EST_ASSERT (jn >= 0);
+
+  if (leaf->level == n.level) {
+    /* same-size face neighbor */
+    mesh->quad_to_quad[in_qtoq] = jn;
+    mesh->quad_to_face[in_qtoq] = (int8_t) (P4EST_FACES * o + nf);
+  }
+  else if (leaf->level < n.level) {
+    /* double-size face neighbor: find our position on its face */
+    P4EST_ASSERT (leaf->level == n.level - 1);
+    pos = p4est_corner_face_corners[p4est_quadrant_child_id (q)][f];
+    for (h = 0; h < P4EST_HALF; ++h) {
+      if (p4est_connectivity_face_neighbor_face_corner (h, nf, f, o) == pos) {
+        break;
+      }
+    }
+    P4EST_ASSERT (h < P4EST_HALF);
+    mesh->quad_to_quad[in_qtoq] = jn;
+    mesh->quad_to_face[in_qtoq] =
+      (int8_t) (P4EST_FACES * (o + (h + 1) * P4EST_HALF) + nf);
+  }
+  else {
+    /* half-size face neighbors in the order of our face corners */
+    mesh->quad_to_quad[in_qtoq] = (p4est_locidx_t) halves->elem_count;
+    mesh->quad_to_face[in_qtoq] =
+      (int8_t) (P4EST_FACES * (o - P4EST_HALF) + nf);
+    halfentries = (p4est_locidx_t *) sc_array_push (halves);
+    for (h = 0; h < P4EST_HALF; ++h) {
+      pos = p4est_connectivity_face_neighbor_face_corner (h, f, nf, o);
+      p4est_quadrant_child (&n, &child, p4est_face_corners[nf][pos]);
+      halfentries[h] = mesh_find_leaf (p4est, ghost, nt, &child, &leaf);
+      P4EST_ASSERT (halfentries[h] >= 0 && leaf->level == child.level);
+    }
+  }
+}
+
+/** Compute the face neighbors, tree indices and level counts of a range.
+ * Hanging faces are collected in the range and the quad_to_quad entries
+ * of the large quadrants point into this private list for now.
+ */
+static void
+mesh_unit_faces (p4est_t * p4est, p4est_ghost_t * ghost,
+                 p4est_mesh_t * mesh, p4est_mesh_unit_t * unit)
+{
+  int                 f;
+  size_t              zz;
+  p4est_locidx_t      jl;
+  p4est_tree_t       *tree;
+  const p4est_quadrant_t *q;
+
+  tree = p4est_tree_array_index (p4est->trees, unit->which_tree);
+  for (zz = unit->begin; zz < unit->end; ++zz) {
+    q = p4est_quadrant_array_index (&tree->quadrants, zz);
+    jl = tree->quadrants_offset + (p4est_locidx_t) zz;
+    ++unit->per_level[q->level];
+    if (mesh->quad_to_tree != NULL) {
+      mesh->quad_to_tree[jl] = unit->which_tree;
+    }
+    for (f = 0; f < P4EST_FACES; ++f) {
+      mesh_quad_face (p4est, ghost, mesh, unit->which_tree, q, jl, f,
+                      &unit->halves);
+    }
+  }
+}
+
+/** Move the hanging faces of a range to the staging array of all ranges
+ * and its level lists into the mesh. */
+static void
+mesh_unit_merge (p4est_t * p4est, p4est_mesh_t * mesh,
+                 p4est_mesh_unit_t * unit, sc_array_t * staging)
+{
+  int                 f;
+  size_t              zz;
+  p4est_locidx_t      jl, in_qtoq;
+  p4est_tree_t       *tree;
+  const p4est_quadrant_t *q;
+
+  tree = p4est_tree_array_index (p4est->trees, unit->which_tree);
+  for (zz = unit->begin; zz < unit->end; ++zz) {
+    jl = tree->quadrants_offset + (p4est_locidx_t) zz;
+    if (unit->halves.elem_count > 0) {
+      for (f = 0; f < P4EST_FACES; ++f) {
+        in_qtoq = P4EST_FACES * jl + f;
+        if (mesh->quad_to_face[in_qtoq] < 0) {
+          mesh->quad_to_quad[in_qtoq] += unit->half_offset;
+        }
+      }
+    }
+    if (mesh->quad_level != NULL) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      *(p4est_locidx_t *) sc_array_index
+        (mesh->quad_level + q->level, unit->per_level[q->level]++) = jl;
+    }
+  }
+  if (unit->halves.elem_count > 0) {
+    memcpy (sc_array_index (staging, unit->half_offset),
+            unit->halves.array,
+            unit->halves.elem_count * unit->halves.elem_size);
+  }
+  sc_array_reset (&unit->halves);
+}
+
+p4est_mesh_t       *
+p4est_mesh_new_threads (p4est_t * p4est, p4est_ghost_t * ghost,
+                        int compute_tree_index, int compute_level_lists,
+                        p4est_connect_type_t btype, int num_threads)
+{
+  int                 level;
+  long                lu, num_units;
+  size_t              zz, count, unit_size, next_cut;
+  p4est_locidx_t      num_halves, per_level[P4EST_QMAXLEVEL + 1];
+  p4est_topidx_t      nt;
+  p4est_tree_t       *tree;
+  p4est_mesh_t       *mesh;
+  p4est_mesh_unit_t  *unit;
+  sc_array_t         *units, *staging;
+
+  /* check whether input condition for p4est is met */
+  P4EST_ASSERT (p4est_is_balanced (p4est, btype));
+
+  num_threads = p4est_num_threads (num_threads);
+  mesh = mesh_allocate (p4est, ghost, compute_tree_index,
+                        compute_level_lists, btype);
+
+  /* cut the local quadrants into ranges that do not cross tree boundaries */
+  units = sc_array_new (sizeof (p4est_mesh_unit_t));
+  unit_size = (size_t) p4est->local_num_quadrants /
+    (size_t) (4 * num_threads) + 1;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    count = tree->quadrants.elem_count;
+    for (zz = 0; zz < count; zz = unit->end) {
+      next_cut = ((size_t) tree->quadrants_offset + zz) / unit_size + 1;
+      unit = (p4est_mesh_unit_t *) sc_array_push (units);
+      memset (unit, 0, sizeof (p4est_mesh_unit_t));
+      unit->which_tree = nt;
+      unit->begin = zz;
+      unit->end = SC_MIN (count, next_cut * unit_size -
+                          (size_t) tree->quadrants_offset);
+      sc_array_init (&unit->halves, P4EST_HALF * sizeof (p4est_locidx_t));
+    }
+  }
+  num_units = (long) units->elem_count;
+
+  /* count and fill the face information of all ranges independently,
+   * while the first task collects edges and corners with the iterator and
+   * records the order of the hanging faces in quad_to_half */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (lu = -1; lu < num_units; ++lu) {
+    if (lu < 0) {
+      p4est_iterate (p4est, ghost, mesh, NULL, mesh_iter_half,
+#ifdef P4_TO_P8
+                     (mesh->quad_to_edge != NULL ? mesh_iter_edge : NULL),
+#endif
+                     (mesh->quad_to_corner != NULL ? mesh_iter_corner : NULL));
+    }
+    else {
+      mesh_unit_faces (p4est, ghost, mesh, (p4est_mesh_unit_t *)
+                       sc_array_index_long (units, lu));
+    }
+  }
+
+  /* the prefix sums over the ranges are their output positions */
+  num_halves = 0;
+  memset (per_level, 0, sizeof (per_level));
+  for (lu = 0; lu < num_units; ++lu) {
+    unit = (p4est_mesh_unit_t *) sc_array_index_long (units, lu);
+    unit->half_offset = num_halves;
+    num_halves += (p4est_locidx_t) unit->halves.elem_count;
+    for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+      count = (size_t) unit->per_level[level];
+      unit->per_level[level] = per_level[level];
+      per_level[level] += (p4est_locidx_t) count;
+    }
+  }
+  P4EST_ASSERT ((size_t) num_halves == mesh->quad_to_half->elem_count);
+  staging = sc_array_new_count (P4EST_HALF * sizeof (p4est_locidx_t),
+                                (size_t) num_halves);
+  if (mesh->quad_level != NULL) {
+    for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+      sc_array_resize (mesh->quad_level + level, (size_t) per_level[level]);
+    }
+  }
+
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (lu = 0; lu < num_units; ++lu) {
+    mesh_unit_merge (p4est, mesh, (p4est_mesh_unit_t *)
+                     sc_array_index_long (units, lu), staging);
+  }
+  sc_array_destroy (units);
+
+  /* number the hanging faces in the order of the serial constructor */
+  mesh_half_renumber (mesh, staging, num_threads);
+  sc_array_destroy (staging);
 
   return mesh;
 }
 
+void
+p4est_mesh_record_replace (sc_array_t * replaced, p4est_topidx_t which_tree,
+                           int num_outgoing, p4est_quadrant_t * outgoing[],
+                           int num_incoming, p4est_quadrant_t * incoming[])
+{
+  p4est_quadrant_t   *family;
+
+  P4EST_ASSERT (replaced->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT ((num_outgoing == 1 && num_incoming == P4EST_CHILDREN) ||
+                (num_outgoing == P4EST_CHILDREN && num_incoming == 1));
+
+  /* store the parent of the family and the change in the leaf count */
+  family = (p4est_quadrant_t *) sc_array_push (replaced);
+  *family = *(num_outgoing == 1 ? outgoing[0] : incoming[0]);
+  family->p.piggy3.which_tree = which_tree;
+  family->p.piggy3.local_num = num_incoming - num_outgoing;
+}
+
+/** Test whether a local quadrant lies in a region of replaced families. */
+static int
+mesh_region_contains (const p4est_quadrant_t * region,
+                      p4est_topidx_t which_tree, const p4est_quadrant_t * q)
+{
+  return region->p.piggy3.which_tree == which_tree &&
+    (p4est_quadrant_is_equal (region, q) ||
+     p4est_quadrant_is_ancestor (region, q));
+}
+
+/** Merge the recorded families into disjoint regions of the forest.
+ * Each region is a recorded family that is not contained in another one.
+ * Its leaf count change is the sum of those of the families inside.
+ */
+static void
+mesh_replaced_regions (sc_array_t * replaced)
+{
+  size_t              zz, nr;
+  p4est_quadrant_t   *family, *region;
+
+  sc_array_sort (replaced, p4est_quadrant_compare_piggy);
+  region = NULL;
+  nr = 0;
+  for (zz = 0; zz < replaced->elem_count; ++zz) {
+    family = p4est_quadrant_array_index (replaced, zz);
+    if (region != NULL &&
+        mesh_region_contains (region, family->p.piggy3.which_tree, family)) {
+      region->p.piggy3.local_num += family->p.piggy3.local_num;
+      continue;
+    }
+    region = p4est_quadrant_array_index (replaced, nr++);
+    if (region != family) {
+      *region = *family;
+    }
+  }
+  sc_array_resize (replaced, nr);
+}
+
+void
+p4est_mesh_update (p4est_t * p4est, p4est_ghost_t * ghost,
+                   p4est_mesh_t * mesh, sc_array_t * replaced)
+{
+  int                 f, h, level, remap;
+  size_t              zz, iz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      jl, jo, lq, old_lq, inside, k;
+  p4est_locidx_t      in_qtoq, v;
+  p4est_locidx_t     *old_to_new, *new_to_old;
+  p4est_locidx_t     *old_qtq, *oldhalf, *halfentries;
+  int8_t             *old_qtf;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *region;
+  sc_array_t         *old_half, *staging;
+
+  P4EST_ASSERT (replaced->elem_size == sizeof (p4est_quadrant_t));
+  mesh_replaced_regions (replaced);
+
+  /* match the unchanged local quadrants in the old and new numbering */
+  old_lq = mesh->local_num_quadrants;
+  lq = p4est->local_num_quadrants;
+  old_to_new = P4EST_ALLOC (p4est_locidx_t, old_lq);
+  new_to_old = P4EST_ALLOC (p4est_locidx_t, lq);
+  jo = 0;
+  iz = 0;
+  inside = 0;
+  region = NULL;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      jl = tree->quadrants_offset + (p4est_locidx_t) zz;
+
+      /* skip the old quadrants of all regions that end before q */
+      for (; iz < replaced->elem_count; ++iz) {
+        region = p4est_quadrant_array_index (replaced, iz);
+        if (mesh_region_contains (region, nt, q) ||
+            region->p.piggy3.which_tree > nt ||
+            (region->p.piggy3.which_tree == nt &&
+             p4est_quadrant_compare (region, q) > 0)) {
+          break;
+        }
+        for (k = inside - region->p.piggy3.local_num; k > 0; --k) {
+          P4EST_ASSERT (jo < old_lq);
+          old_to_new[jo++] = -1;
+        }
+        inside = 0;
+      }
+
+      if (iz < replaced->elem_count && mesh_region_contains (region, nt, q)) {
+        new_to_old[jl] = -1;
+        ++inside;
+      }
+      else {
+        P4EST_ASSERT (jo < old_lq);
+        old_to_new[jo] = jl;
+        new_to_old[jl] = jo++;
+      }
+    }
+  }
+  for (; iz < replaced->elem_count; ++iz) {
+    region = p4est_quadrant_array_index (replaced, iz);
+    for (k = inside - region->p.piggy3.local_num; k > 0; --k) {
+      P4EST_ASSERT (jo < old_lq);
+      old_to_new[jo++] = -1;
+    }
+    inside = 0;
+  }
+  P4EST_ASSERT (jo == old_lq);
+
+  /* the new ghost layer is numbered from scratch */
+  old_qtq = mesh->quad_to_quad;
+  old_qtf = mesh->quad_to_face;
+  old_half = mesh->quad_to_half;
+  mesh->local_num_quadrants = lq;
+  mesh->ghost_num_quadrants = (p4est_locidx_t) ghost->ghosts.elem_count;
+  mesh->ghost_to_proc = P4EST_REALLOC (mesh->ghost_to_proc, int,
+                                       mesh->ghost_num_quadrants);
+  mesh_ghost_to_proc (p4est, ghost, mesh);
+  mesh->quad_to_quad = P4EST_ALLOC (p4est_locidx_t, P4EST_FACES * lq);
+  mesh->quad_to_face = P4EST_ALLOC (int8_t, P4EST_FACES * lq);
+  if (mesh->quad_to_tree != NULL) {
+    mesh->quad_to_tree = P4EST_REALLOC (mesh->quad_to_tree,
+                                        p4est_topidx_t, lq);
+  }
+  if (mesh->quad_level != NULL) {
+    for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+      sc_array_truncate (mesh->quad_level + level);
+    }
+  }
+
+  /* renumber the faces between unchanged local quadrants and search the
+   * neighbors of all other faces, in order of the local quadrants;
+   * the hanging faces are collected in a staging array for now */
+  staging = sc_array_new (P4EST_HALF * sizeof (p4est_locidx_t));
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      jl = tree->quadrants_offset + (p4est_locidx_t) zz;
+      jo = new_to_old[jl];
+      if (mesh->quad_to_tree != NULL) {
+        mesh->quad_to_tree[jl] = nt;
+      }
+      if (mesh->quad_level != NULL) {
+        *(p4est_locidx_t *) sc_array_push (mesh->quad_level + q->level) = jl;
+      }
+
+      for (f = 0; f < P4EST_FACES; ++f) {
+        in_qtoq = P4EST_FACES * jl + f;
+        remap = 0;
+        if (jo >= 0) {
+          v = old_qtq[P4EST_FACES * jo + f];
+          if (old_qtf[P4EST_FACES * jo + f] >= 0) {
+            if (v < old_lq && old_to_new[v] >= 0) {
+              mesh->quad_to_quad[in_qtoq] = old_to_new[v];
+              remap = 1;
+            }
+          }
+          else {
+            oldhalf = (p4est_locidx_t *) sc_array_index (old_half, v);
+            for (h = 0; h < P4EST_HALF; ++h) {
+              if (oldhalf[h] >= old_lq || old_to_new[oldhalf[h]] < 0) {
+                break;
+              }
+            }
+            if (h == P4EST_HALF) {
+              mesh->quad_to_quad[in_qtoq] =
+                (p4est_locidx_t) staging->elem_count;
+              halfentries = (p4est_locidx_t *) sc_array_push (staging);
+              for (h = 0; h < P4EST_HALF; ++h) {
+                halfentries[h] = old_to_new[oldhalf[h]];
+              }
+              remap = 1;
+            }
+          }
+        }
+        if (remap) {
+          mesh->quad_to_face[in_qtoq] = old_qtf[P4EST_FACES * jo + f];
+        }
+        else {
+          mesh_quad_face (p4est, ghost, mesh, nt, q, jl, f, staging);
+        }
+      }
+    }
+  }
+  P4EST_FREE (old_qtq);
+  P4EST_FREE (old_qtf);
+  sc_array_destroy (old_half);
+  P4EST_FREE (old_to_new);
+  P4EST_FREE (new_to_old);
+
+  /* edges and corners are collected anew by the iterator, which also
+   * records the order of the hanging faces */
+  mesh->quad_to_half = sc_array_new (P4EST_HALF * sizeof (p4est_locidx_t));
+#ifdef P4_TO_P8
+  if (mesh->quad_to_edge != NULL) {
+    mesh->quad_to_edge = P4EST_REALLOC (mesh->quad_to_edge,
+                                        p4est_locidx_t, P8EST_EDGES * lq);
+    memset (mesh->quad_to_edge, (char) -1,
+            P8EST_EDGES * lq * sizeof (p4est_locidx_t));
+    mesh->local_num_edges = 0;
+    sc_array_resize (mesh->edge_offset, 1);
+    sc_array_truncate (mesh->edge_quad);
+    sc_array_truncate (mesh->edge_edge);
+  }
+#endif /* P4_TO_P8 */
+  if (mesh->quad_to_corner != NULL) {
+    mesh->quad_to_corner = P4EST_REALLOC (mesh->quad_to_corner,
+                                          p4est_locidx_t,
+                                          P4EST_CHILDREN * lq);
+    memset (mesh->quad_to_corner, (char) -1,
+            P4EST_CHILDREN * lq * sizeof (p4est_locidx_t));
+    mesh->local_num_corners = 0;
+    sc_array_resize (mesh->corner_offset, 1);
+    sc_array_truncate (mesh->corner_quad);
+    sc_array_truncate (mesh->corner_corner);
+  }
+  p4est_iterate (p4est, ghost, mesh, NULL, mesh_iter_half,
+#ifdef P4_TO_P8
+                 (mesh->quad_to_edge != NULL ? mesh_iter_edge : NULL),
+#endif
+                 (mesh->quad_to_corner != NULL ? mesh_iter_corner : NULL));
+
+  /* number the hanging faces in the order of the serial constructor */
+  mesh_half_renumber (mesh, staging, 1);
+  sc_array_destroy (staging);
+}
+
 void
 p4est_mesh_destroy (p4est_mesh_t * mesh)
 {
@@ -2271,3 +2912,138 @@ p4est_mesh_face_neighbor_data (p4est_mesh_face_neighbor_t * mfn,
     return (void *) ((char *) ghost_data + data_size * qtq);
   }
 }
+
+/** One face of the face list under construction */
+typedef struct mesh_face_entry
+{
+  p4est_locidx_t      quads[2];
+  int8_t              faces[2];
+}
+mesh_face_entry_t;
+
+static void
+mesh_faces_push (sc_array_t * list, p4est_locidx_t first,
+                 p4est_locidx_t second, int face, int code)
+{
+  mesh_face_entry_t  *entry = (mesh_face_entry_t *) sc_array_push (list);
+
+  entry->quads[0] = first;
+  entry->quads[1] = second;
+  entry->faces[0] = (int8_t) face;
+  entry->faces[1] = (int8_t) code;
+}
+
+static void
+mesh_faces_copy (p4est_mesh_faces_t * faces, sc_array_t * list,
+                 p4est_locidx_t offset)
+{
+  size_t              zz;
+  mesh_face_entry_t  *entry;
+
+  for (zz = 0; zz < list->elem_count; ++zz) {
+    entry = (mesh_face_entry_t *) sc_array_index (list, zz);
+    faces->quads[2 * (offset + zz)] = entry->quads[0];
+    faces->quads[2 * (offset + zz) + 1] = entry->quads[1];
+    faces->faces[2 * (offset + zz)] = entry->faces[0];
+    faces->faces[2 * (offset + zz) + 1] = entry->faces[1];
+  }
+}
+
+p4est_mesh_faces_t *
+p4est_mesh_faces_new (p4est_mesh_t * mesh, p4est_locidx_t block_size)
+{
+  const int           same = P4EST_FACES * P4EST_HALF;
+  const p4est_locidx_t lq = mesh->local_num_quadrants;
+  int                 f, h, v, nf, rnf;
+  p4est_locidx_t      b, jl, jlend, qtq, *halves;
+  p4est_locidx_t      num_hanging;
+  sc_array_t          conforming, hanging;
+  p4est_mesh_faces_t *faces;
+
+  P4EST_ASSERT (block_size > 0);
+
+  faces = P4EST_ALLOC_ZERO (p4est_mesh_faces_t, 1);
+  faces->block_size = block_size;
+  faces->num_blocks = (lq + block_size - 1) / block_size;
+  faces->conforming_offsets =
+    P4EST_ALLOC (p4est_locidx_t, faces->num_blocks + 1);
+  faces->hanging_offsets =
+    P4EST_ALLOC (p4est_locidx_t, faces->num_blocks + 1);
+
+  /* the quadrants are visited in order, which sorts the faces by block */
+  sc_array_init (&conforming, sizeof (mesh_face_entry_t));
+  sc_array_init (&hanging, sizeof (mesh_face_entry_t));
+  for (b = 0; b < faces->num_blocks; ++b) {
+    faces->conforming_offsets[b] = (p4est_locidx_t) conforming.elem_count;
+    faces->hanging_offsets[b] = (p4est_locidx_t) hanging.elem_count;
+    jlend = SC_MIN ((b + 1) * block_size, lq);
+    for (jl = b * block_size; jl < jlend; ++jl) {
+      for (f = 0; f < P4EST_FACES; ++f) {
+        qtq = mesh->quad_to_quad[P4EST_FACES * jl + f];
+        v = (int) mesh->quad_to_face[P4EST_FACES * jl + f];
+        if (v >= same) {
+          /* a small quadrant stores its face with the large neighbor */
+          mesh_faces_push (&hanging, jl, qtq, f, v);
+        }
+        else if (v >= 0) {
+          /* the lower local quadrant stores a same-size face */
+          nf = v % P4EST_FACES;
+          if (qtq < jl || (qtq == jl && nf >= f)) {
+            /* the face is stored by the neighbor or on the boundary */
+            continue;
+          }
+          mesh_faces_push (&conforming, jl, qtq, f, v);
+        }
+        else {
+          /* a large quadrant stores the faces of its small ghosts */
+          halves = (p4est_locidx_t *)
+            sc_array_index (mesh->quad_to_half, (size_t) qtq);
+          rnf = v + same;
+          for (h = 0; h < P4EST_HALF; ++h) {
+            if (halves[h] >= lq) {
+              mesh_faces_push (&hanging, halves[h], jl, rnf % P4EST_FACES,
+                               (h + 1) * same + rnf - rnf % P4EST_FACES +
+                               f);
+            }
+          }
+        }
+      }
+    }
+  }
+  faces->num_conforming = (p4est_locidx_t) conforming.elem_count;
+  num_hanging = (p4est_locidx_t) hanging.elem_count;
+  faces->num_faces = faces->num_conforming + num_hanging;
+  faces->conforming_offsets[faces->num_blocks] = faces->num_conforming;
+  faces->hanging_offsets[faces->num_blocks] = num_hanging;
+  for (b = 0; b <= faces->num_blocks; ++b) {
+    faces->hanging_offsets[b] += faces->num_conforming;
+  }
+
+  /* store both kinds of faces in one flat list */
+  faces->quads = P4EST_ALLOC (p4est_locidx_t, 2 * faces->num_faces);
+  faces->faces = P4EST_ALLOC (int8_t, 2 * faces->num_faces);
+  mesh_faces_copy (faces, &conforming, 0);
+  mesh_faces_copy (faces, &hanging, faces->num_conforming);
+  sc_array_reset (&conforming);
+  sc_array_reset (&hanging);
+
+  return faces;
+}
+
+void
+p4est_mesh_faces_destroy (p4est_mesh_faces_t * faces)
+{
+  P4EST_FREE (faces->conforming_offsets);
+  P4EST_FREE (faces->hanging_offsets);
+  P4EST_FREE (faces->quads);
+  P4EST_FREE (faces->faces);
+  P4EST_FREE (faces);
+}
+
+size_t
+p4est_mesh_faces_memory_used (p4est_mesh_faces_t * faces)
+{
+  return sizeof (p4est_mesh_faces_t) +
+    2 * (faces->num_blocks + 1) * sizeof (p4est_locidx_t) +
+    2 * faces->num_faces * (sizeof (p4est_locidx_t) + sizeof (int8_t));
+}
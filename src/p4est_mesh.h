@@ -151,6 +151,40 @@ typedef struct
 }
 p4est_mesh_face_neighbor_t;
 
+/** A flat list of the interior faces of a mesh for streaming flux kernels.
+ * Every face between two quadrants of which at least one is local is
+ * stored exactly once as a pair of quadrant numbers, encoded as in
+ * quad_to_quad, in the quads array.  The faces array stores two codes per
+ * face: the face number of the first quadrant, and the quad_to_face value
+ * that describes the second quadrant as seen from the first.
+ * The conforming faces between same-size quadrants come first, such that
+ * the second code is in 0..7.  They are followed by the hanging faces,
+ * each of which pairs a small quadrant with its double-size neighbor,
+ * such that the second code is in 8..23 and encodes the subface.
+ * A large face with P4EST_HALF small neighbors yields P4EST_HALF entries.
+ * The faces are grouped into blocks of consecutive local quadrants in the
+ * Morton order of the forest, such that the data touched by one block can
+ * be kept in cache.  A conforming face belongs to the block of its lower
+ * local quadrant, a hanging face to the block of its small quadrant if that
+ * is local and to the block of its large quadrant otherwise.  Within both
+ * the conforming and the hanging faces the blocks appear in order.
+ */
+typedef struct
+{
+  p4est_locidx_t      block_size;       /**< Local quadrants per block */
+  p4est_locidx_t      num_blocks;
+  p4est_locidx_t      num_conforming;   /**< Same-size faces */
+  p4est_locidx_t      num_faces;        /**< Conforming and hanging faces */
+  p4est_locidx_t     *conforming_offsets;       /**< num_blocks + 1 face
+                                                     indices into the
+                                                     conforming faces */
+  p4est_locidx_t     *hanging_offsets;  /**< num_blocks + 1 face indices,
+                                             starting at num_conforming */
+  p4est_locidx_t     *quads;            /**< Two quadrants per face */
+  int8_t             *faces;            /**< Two codes per face */
+}
+p4est_mesh_faces_t;
+
 /** Calculate the memory usage of the mesh structure.
  * \param [in] mesh     Mesh structure.
  * \return              Memory used in bytes.
@@ -174,6 +208,47 @@ p4est_mesh_t       *p4est_mesh_new (p4est_t * p4est,
  */
 void                p4est_mesh_destroy (p4est_mesh_t * mesh);
 
+/** Record a replaced family of quadrants for \ref p4est_mesh_update.
+ * This function may be called from a \ref p4est_replace_t callback passed
+ * to p4est_refine_ext, p4est_coarsen_ext or p4est_balance_ext.
+ * \param [in,out] replaced  Array of p4est_quadrant_t.  One entry is added
+ *                           that holds the parent of the family, its tree
+ *                           and the change in the number of leaves.
+ * \param [in] which_tree    The tree of the family.
+ * \param [in] num_outgoing  The arguments of the replace callback.
+ * \param [in] outgoing      The arguments of the replace callback.
+ * \param [in] num_incoming  The arguments of the replace callback.
+ * \param [in] incoming      The arguments of the replace callback.
+ */
+void                p4est_mesh_record_replace (sc_array_t * replaced,
+                                               p4est_topidx_t which_tree,
+                                               int num_outgoing,
+                                               p4est_quadrant_t * outgoing[],
+                                               int num_incoming,
+                                               p4est_quadrant_t * incoming[]);
+
+/** Update a mesh after the forest has been refined, coarsened or balanced.
+ * The result is the same as destroying the mesh and creating it anew with
+ * \ref p4est_mesh_new_ext and the same parameters.  The faces between
+ * local quadrants that have not been replaced are renumbered from the old
+ * mesh by a compact map from old to new local indices.  The faces of
+ * replaced quadrants and those towards ghosts are found by searching the
+ * forest and the new ghost layer.  The level lists and tree indices are
+ * refilled, and edge and corner information, if present, is collected anew.
+ * The partition must not have changed since the mesh was created.
+ * \param [in] p4est         The forest after adaptation and 2:1 balance.
+ * \param [in] ghost         The ghost layer of the adapted forest.
+ * \param [in,out] mesh      A mesh of the forest before the adaptation.
+ * \param [in,out] replaced  All families replaced since the mesh was
+ *                           created, recorded by
+ *                           \ref p4est_mesh_record_replace in any order.
+ *                           On output it holds one entry for each maximal
+ *                           region of the forest that has changed.
+ */
+void                p4est_mesh_update (p4est_t * p4est, p4est_ghost_t * ghost,
+                                       p4est_mesh_t * mesh,
+                                       sc_array_t * replaced);
+
 /** Access a process-local quadrant inside a forest.
  * Needs a mesh with populated quad_to_tree array.
  * This is a special case of \ref p4est_mesh_quadrant_cumulative.
@@ -313,6 +388,27 @@ p4est_quadrant_t   *p4est_mesh_face_neighbor_next (p4est_mesh_face_neighbor_t
 void               *p4est_mesh_face_neighbor_data (p4est_mesh_face_neighbor_t
                                                    * mfn, void *ghost_data);
 
+/** Create the face list of a mesh.
+ * \param [in] mesh        A mesh created by p4est_mesh_new.
+ * \param [in] block_size  The number of local quadrants per block, which
+ *                         should be chosen such that the data of twice as
+ *                         many quadrants fits into the L2 cache.
+ * \return                 A face list that is independent of the mesh.
+ */
+p4est_mesh_faces_t *p4est_mesh_faces_new (p4est_mesh_t * mesh,
+                                        p4est_locidx_t block_size);
+
+/** Destroy a face list.
+ * \param [in] faces       A face list created by p4est_mesh_faces_new.
+ */
+void                p4est_mesh_faces_destroy (p4est_mesh_faces_t * faces);
+
+/** Calculate the memory usage of a face list.
+ * \param [in] faces       A face list created by p4est_mesh_faces_new.
+ * \return                 Memory used in bytes.
+ */
+size_t              p4est_mesh_faces_memory_used (p4est_mesh_faces_t * faces);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_MESH_H */
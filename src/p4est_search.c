@@ -768,6 +768,273 @@ p4est_search_local (p4est_t * p4est,
   }
 }
 
+/** The context of the fallback search in \ref p4est_search_local_points. */
+typedef struct p4est_points_fallback
+{
+  p4est_search_local_t point_fn;        /**< The user's point callback. */
+  sc_array_t         *points;           /**< The user's points. */
+  p4est_locidx_t     *owners;           /**< The owner of each point. */
+}
+p4est_points_fallback_t;
+
+/** A point searched for by the recursion of the fallback search. */
+typedef struct p4est_points_entry
+{
+  p4est_points_fallback_t *fallback;    /**< The common context. */
+  size_t              index;            /**< The index of the point. */
+}
+p4est_points_entry_t;
+
+static int
+p4est_points_fallback_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                          p4est_quadrant_t * quadrant,
+                          p4est_locidx_t local_num, void *point)
+{
+  p4est_points_entry_t *entry = (p4est_points_entry_t *) point;
+  p4est_points_fallback_t *fallback = entry->fallback;
+
+  if (!fallback->point_fn (p4est, which_tree, quadrant, local_num,
+                           sc_array_index (fallback->points, entry->index))) {
+    return 0;
+  }
+  if (local_num >= 0 && fallback->owners[entry->index] < 0) {
+    fallback->owners[entry->index] = local_num;
+  }
+  return 1;
+}
+
+/** A point ordered by its tree and the packed key of its position. */
+typedef struct p4est_points_key
+{
+  uint64_t            key;              /**< Key of the position at level
+                                             \ref P4EST_KEY_MAXLEVEL or
+                                             finer, zero without a key */
+  p4est_topidx_t      which_tree;       /**< The tree of the point, or the
+                                             number of trees without a key */
+  p4est_locidx_t      index;            /**< The index of the point */
+}
+p4est_points_key_t;
+
+static int
+p4est_points_key_compare (const void *v1, const void *v2)
+{
+  const p4est_points_key_t *k1 = (const p4est_points_key_t *) v1;
+  const p4est_points_key_t *k2 = (const p4est_points_key_t *) v2;
+
+  if (k1->which_tree != k2->which_tree) {
+    return k1->which_tree < k2->which_tree ? -1 : 1;
+  }
+  return p4est_key_compare (&k1->key, &k2->key);
+}
+
+/** Find the last quadrant in a sorted array not after a key.
+ * \param [in] quadrants    Sorted array of quadrants no finer than
+ *                          \ref P4EST_KEY_MAXLEVEL.
+ * \param [in] lo           Index of a quadrant not after the key.
+ * \param [in] key          The packed key to search for.
+ * \return                  The largest index with a quadrant not after
+ *                          the key, found by a galloping search from lo.
+ */
+static size_t
+p4est_points_gallop (sc_array_t * quadrants, size_t lo, uint64_t key)
+{
+  size_t              hi, mid, step;
+  size_t              count = quadrants->elem_count;
+
+  P4EST_ASSERT (lo < count);
+  P4EST_ASSERT (p4est_quadrant_key
+                (p4est_quadrant_array_index (quadrants, lo)) <= key);
+
+  for (step = 1, hi = lo + 1; hi < count; step *= 2, hi = lo + step) {
+    if (p4est_quadrant_key (p4est_quadrant_array_index (quadrants, hi)) >
+        key) {
+      break;
+    }
+    lo = hi;
+  }
+  hi = SC_MIN (hi, count);
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if (p4est_quadrant_key (p4est_quadrant_array_index (quadrants, mid)) <=
+        key) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/** Compute, sort and merge the keys of a chunk of points.
+ * Points without a key are marked with owner -2.
+ */
+static void
+p4est_points_chunk (p4est_t * p4est, p4est_search_point_key_t key_fn,
+                    sc_array_t * points, sc_array_t * quads,
+                    sc_array_t * keys, p4est_locidx_t * owners,
+                    size_t first, size_t last)
+{
+  const p4est_qcoord_t mask = ~(P4EST_QUADRANT_LEN (P4EST_QMAXLEVEL) - 1);
+  int                 deep = 0;
+  size_t              zz, lo;
+  ssize_t             hi;
+  p4est_topidx_t      jt, tt;
+  p4est_tree_t       *tree = NULL;
+  p4est_quadrant_t   *quad;
+#if P4EST_QMAXLEVEL > P4EST_KEY_MAXLEVEL
+  p4est_quadrant_t    coarse;
+#endif
+  p4est_points_key_t *key;
+  sc_array_t          chunk;
+
+  /* compute the positions and their packed keys */
+  for (zz = first; zz < last; ++zz) {
+    quad = p4est_quadrant_array_index (quads, zz);
+    key = (p4est_points_key_t *) sc_array_index (keys, zz);
+    P4EST_QUADRANT_INIT (quad);
+    owners[zz] = -1;
+    key->index = (p4est_locidx_t) zz;
+    if (key_fn != NULL &&
+        key_fn (p4est, sc_array_index (points, zz), quad)) {
+      P4EST_ASSERT (0 <= quad->p.which_tree &&
+                    quad->p.which_tree < p4est->connectivity->num_trees);
+      P4EST_ASSERT (0 <= quad->x && quad->x < P4EST_ROOT_LEN);
+      P4EST_ASSERT (0 <= quad->y && quad->y < P4EST_ROOT_LEN);
+      quad->x &= mask;
+      quad->y &= mask;
+#ifdef P4_TO_P8
+      P4EST_ASSERT (0 <= quad->z && quad->z < P4EST_ROOT_LEN);
+      quad->z &= mask;
+#endif
+      quad->level = P4EST_QMAXLEVEL;
+      key->which_tree = quad->p.which_tree;
+
+#if P4EST_QMAXLEVEL > P4EST_KEY_MAXLEVEL
+      /* the key of a position finer than representable is its ancestor */
+      p4est_quadrant_ancestor (quad, P4EST_KEY_MAXLEVEL, &coarse);
+      key->key = p4est_quadrant_key (&coarse);
+#else
+      key->key = p4est_quadrant_key (quad);
+#endif
+    }
+    else {
+      /* sort points without a key after all trees */
+      key->which_tree = p4est->connectivity->num_trees;
+      key->key = 0;
+      owners[zz] = -2;
+    }
+  }
+
+  /* sort the keys and merge them with the local quadrants */
+  sc_array_init_view (&chunk, keys, first, last - first);
+  sc_array_sort (&chunk, p4est_points_key_compare);
+  tt = -1;
+  lo = 0;
+  for (zz = 0; zz < chunk.elem_count; ++zz) {
+    key = (p4est_points_key_t *) sc_array_index (&chunk, zz);
+    jt = key->which_tree;
+    if (jt < p4est->first_local_tree || jt > p4est->last_local_tree) {
+      continue;
+    }
+    quad = p4est_quadrant_array_index (quads, (size_t) key->index);
+    if (jt != tt) {
+      /* the first key in a tree is searched from its first quadrant */
+      tt = jt;
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      deep = tree->maxlevel > P4EST_KEY_MAXLEVEL;
+      lo = 0;
+      if (tree->quadrants.elem_count == 0 ||
+          p4est_quadrant_compare (p4est_quadrant_array_index
+                                  (&tree->quadrants, 0), quad) > 0) {
+        /* this key lies before the local quadrants; search again */
+        tt = -1;
+        continue;
+      }
+    }
+    if (deep) {
+      /* keys do not order the points within the finest keyable quadrant */
+      hi = p4est_find_higher_bound (&tree->quadrants, quad, lo);
+      P4EST_ASSERT (hi >= 0);
+      lo = (size_t) hi;
+    }
+    else {
+      lo = p4est_points_gallop (&tree->quadrants, lo, key->key);
+    }
+    if (p4est_quadrant_overlaps
+        (p4est_quadrant_array_index (&tree->quadrants, lo), quad)) {
+      owners[key->index] = tree->quadrants_offset + (p4est_locidx_t) lo;
+    }
+  }
+  sc_array_reset (&chunk);
+}
+
+void
+p4est_search_local_points (p4est_t * p4est,
+                           p4est_search_point_key_t key_fn,
+                           p4est_search_local_t point_fn,
+                           sc_array_t * points, sc_array_t * owners,
+                           int num_threads)
+{
+  long                lc, num_chunks;
+  size_t              zz, num_points;
+  p4est_locidx_t     *owner;
+  p4est_points_entry_t *entry;
+  p4est_points_fallback_t fallback;
+  sc_array_t         *quads, *keys, *entries;
+
+  P4EST_ASSERT (p4est != NULL);
+  P4EST_ASSERT (points != NULL && owners != NULL);
+  P4EST_ASSERT (owners->elem_size == sizeof (p4est_locidx_t));
+  P4EST_ASSERT (points->elem_count <= (size_t) P4EST_LOCIDX_MAX);
+
+  num_points = points->elem_count;
+  num_threads = p4est_num_threads (num_threads);
+  sc_array_resize (owners, num_points);
+  if (num_points == 0) {
+    return;
+  }
+  owner = (p4est_locidx_t *) owners->array;
+
+  /* locate the points with keys in chunks of roughly equal size */
+  quads = sc_array_new_count (sizeof (p4est_quadrant_t), num_points);
+  keys = sc_array_new_count (sizeof (p4est_points_key_t), num_points);
+  num_chunks = SC_MIN (4L * num_threads, (long) num_points);
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (lc = 0; lc < num_chunks; ++lc) {
+    p4est_points_chunk (p4est, key_fn, points, quads, keys, owner,
+                        (size_t) ((int64_t) lc * (int64_t) num_points /
+                                  num_chunks),
+                        (size_t) ((int64_t) (lc + 1) * (int64_t) num_points /
+                                  num_chunks));
+  }
+  sc_array_destroy (quads);
+  sc_array_destroy (keys);
+
+  /* locate the remaining points by the recursion */
+  entries = sc_array_new (sizeof (p4est_points_entry_t));
+  fallback.point_fn = point_fn;
+  fallback.points = points;
+  fallback.owners = owner;
+  for (zz = 0; zz < num_points; ++zz) {
+    if (owner[zz] == -2) {
+      /* without a point callback the point stays unowned */
+      owner[zz] = -1;
+      if (point_fn != NULL) {
+        entry = (p4est_points_entry_t *) sc_array_push (entries);
+        entry->fallback = &fallback;
+        entry->index = zz;
+      }
+    }
+  }
+  if (entries->elem_count > 0) {
+    p4est_search_local (p4est, 0, NULL, p4est_points_fallback_fn, entries);
+  }
+  sc_array_destroy (entries);
+}
+
 /* The recursion may overwrite the \a quadrant input argument contents. */
 static void
 p4est_reorder_recursion (const p4est_local_recursion_t * rec,
@@ -1951,3 +2218,169 @@ p4est_search_all (p4est_t * p4est,
   sc_array_destroy (tree_offsets);
   sc_array_reset (&position_array);
 }
+
+/* number of grid quadrants per process in the partition index */
+#define P4EST_PARTITION_INDEX_RATIO (4)
+
+struct p4est_partition_index
+{
+  p4est_t            *p4est;            /**< The indexed forest. */
+  long                revision;         /**< Revision the index is valid for */
+  int                 level;            /**< Level of the grid quadrants. */
+  p4est_gloidx_t      tree_cells;       /**< Grid quadrants per tree. */
+  int                *owners;           /**< Owner of the first position of
+                                             each grid quadrant, followed by
+                                             the last process. */
+};
+
+/** Compare a partition boundary with a position in a tree.
+ * \return          True if the boundary is not after the position.
+ */
+static int
+p4est_partition_index_le (const p4est_quadrant_t * gfp,
+                          p4est_topidx_t which_tree,
+                          const p4est_quadrant_t * position)
+{
+  return gfp->p.which_tree < which_tree ||
+    (gfp->p.which_tree == which_tree &&
+     p4est_quadrant_compare (gfp, position) <= 0);
+}
+
+static void
+p4est_partition_index_build (p4est_partition_index_t * index)
+{
+  p4est_t            *p4est = index->p4est;
+  const p4est_quadrant_t *gfp = p4est->global_first_position;
+  const p4est_topidx_t num_trees = p4est->connectivity->num_trees;
+  int                 level, p;
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      gc, cell;
+  p4est_quadrant_t    position;
+
+  /* choose a level with a few grid quadrants per process */
+  level = 0;
+  while (level < P4EST_QMAXLEVEL &&
+         ((p4est_gloidx_t) num_trees << (P4EST_DIM * level)) <
+         (p4est_gloidx_t) P4EST_PARTITION_INDEX_RATIO * p4est->mpisize) {
+    ++level;
+  }
+  index->level = level;
+  index->tree_cells = (p4est_gloidx_t) 1 << (P4EST_DIM * level);
+
+  /* sweep the grid quadrants and the partition boundaries together */
+  P4EST_FREE (index->owners);
+  index->owners = P4EST_ALLOC (int, num_trees * index->tree_cells + 1);
+  P4EST_QUADRANT_INIT (&position);
+  p = 0;
+  cell = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    for (gc = 0; gc < index->tree_cells; ++gc, ++cell) {
+      p4est_quadrant_set_morton (&position, level, (uint64_t) gc);
+      position.level = P4EST_QMAXLEVEL;
+      while (p4est_partition_index_le (&gfp[p + 1], jt, &position)) {
+        ++p;
+      }
+      P4EST_ASSERT (p < p4est->mpisize);
+      index->owners[cell] = p;
+    }
+  }
+  index->owners[cell] = p4est->mpisize - 1;
+  index->revision = p4est->revision;
+}
+
+p4est_partition_index_t *
+p4est_partition_index_new (p4est_t * p4est)
+{
+  p4est_partition_index_t *index;
+
+  P4EST_ASSERT (p4est != NULL);
+
+  index = P4EST_ALLOC_ZERO (p4est_partition_index_t, 1);
+  index->p4est = p4est;
+  p4est_partition_index_build (index);
+
+  return index;
+}
+
+void
+p4est_partition_index_destroy (p4est_partition_index_t * index)
+{
+  P4EST_FREE (index->owners);
+  P4EST_FREE (index);
+}
+
+/** Find the owner of a position given by a quadrant's coordinates. */
+static int
+p4est_partition_index_find (p4est_partition_index_t * index,
+                            p4est_topidx_t which_tree,
+                            const p4est_quadrant_t * position)
+{
+  const p4est_quadrant_t *gfp = index->p4est->global_first_position;
+  int                 lo, hi, mid;
+  p4est_gloidx_t      cell;
+
+  P4EST_ASSERT (position->level == P4EST_QMAXLEVEL);
+
+  /* the owners of this and the next grid quadrant bound the search */
+  cell = which_tree * index->tree_cells +
+    (p4est_gloidx_t) p4est_quadrant_linear_id (position, index->level);
+  lo = index->owners[cell];
+  hi = index->owners[cell + 1];
+  P4EST_ASSERT (lo <= hi);
+
+  /* the owner is the last process whose first position is not after */
+  while (lo < hi) {
+    mid = hi - (hi - lo) / 2;
+    if (p4est_partition_index_le (&gfp[mid], which_tree, position)) {
+      lo = mid;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+  P4EST_ASSERT (!p4est_partition_index_le (&gfp[lo + 1], which_tree,
+                                           position));
+  return lo;
+}
+
+int
+p4est_partition_index_owner (p4est_partition_index_t * index,
+                             p4est_topidx_t which_tree,
+                             const p4est_quadrant_t * q)
+{
+  p4est_quadrant_t    position;
+
+  P4EST_ASSERT (index != NULL && index->p4est != NULL);
+  P4EST_ASSERT (0 <= which_tree &&
+                which_tree < index->p4est->connectivity->num_trees);
+  P4EST_ASSERT (p4est_quadrant_is_node (q, 1) || p4est_quadrant_is_valid (q));
+
+  if (index->revision != index->p4est->revision) {
+    p4est_partition_index_build (index);
+  }
+
+  P4EST_QUADRANT_INIT (&position);
+  position.x = q->x;
+  position.y = q->y;
+#ifdef P4_TO_P8
+  position.z = q->z;
+#endif
+  position.level = P4EST_QMAXLEVEL;
+  return p4est_partition_index_find (index, which_tree, &position);
+}
+
+void
+p4est_partition_index_range (p4est_partition_index_t * index,
+                             p4est_topidx_t which_tree,
+                             const p4est_quadrant_t * q,
+                             int *pfirst, int *plast)
+{
+  p4est_quadrant_t    position;
+
+  P4EST_ASSERT (p4est_quadrant_is_valid (q));
+  P4EST_ASSERT (pfirst != NULL && plast != NULL);
+
+  *pfirst = p4est_partition_index_owner (index, which_tree, q);
+  p4est_quadrant_last_descendant (q, &position, P4EST_QMAXLEVEL);
+  *plast = p4est_partition_index_find (index, which_tree, &position);
+}
@@ -278,6 +278,53 @@ void                p4est_search_local (p4est_t * p4est, int call_post,
                                         p4est_search_local_t point_fn,
                                         sc_array_t * points);
 
+/** Callback function to locate a point for \ref p4est_search_local_points.
+ * \param [in] p4est        The forest to be searched.
+ * \param [in] point        Pointer to a user-defined point object.
+ * \param [out] key         If the position of the point is known in
+ *                          reference coordinates, set key->p.which_tree
+ *                          to its tree and the coordinates key->x, key->y
+ *                          to its integer position in [0, P4EST_ROOT_LEN).
+ * \return                  True if \b key is set, false if the point can
+ *                          only be located by the point callback, e.g.,
+ *                          because its position depends on the geometry.
+ */
+typedef int         (*p4est_search_point_key_t) (p4est_t * p4est,
+                                                 void *point,
+                                                 p4est_quadrant_t * key);
+
+/** Locate a batch of points in the local part of a forest.
+ * Points with a known position in reference coordinates are located by
+ * their Morton keys instead of the top-down recursion: the points are cut
+ * into chunks, each chunk is sorted by \ref p4est_quadrant_key and merged
+ * against the local quadrants.  Trees with quadrants finer than
+ * \ref P4EST_KEY_MAXLEVEL are searched by comparison instead.
+ * The chunks are processed concurrently by multiple threads.
+ * The remaining points are located by \ref p4est_search_local with the
+ * point callback, which then runs on a single thread.
+ * \param [in] p4est        The forest to be searched.
+ * \param [in] key_fn       Called for each point, possibly concurrently.
+ *                          If NULL, all points use \b point_fn.
+ * \param [in] point_fn     Point callback as in \ref p4est_search_local.
+ *                          A point is owned by the first local leaf it
+ *                          returns true for.  May be NULL, in which case
+ *                          the points without a key are left at -1.
+ * \param [in] points       User-defined array of points.
+ * \param [out] owners      Array of \ref p4est_locidx_t, resized to the
+ *                          number of points.  On output, it holds the
+ *                          local number of the quadrant owning each point,
+ *                          or -1 if no local quadrant owns the point.
+ * \param [in] num_threads  Number of threads to use.  If less than 1,
+ *                          the maximum number of OpenMP threads is used.
+ */
+void                p4est_search_local_points (p4est_t * p4est,
+                                               p4est_search_point_key_t
+                                               key_fn,
+                                               p4est_search_local_t point_fn,
+                                               sc_array_t * points,
+                                               sc_array_t * owners,
+                                               int num_threads);
+
 /** This function is provided for backwards compatibility.
  * We call \ref p4est_search_local with call_post = 0.
  */
@@ -452,6 +499,60 @@ void                p4est_search_partition_gfx
    p4est_search_partition_t quadrant_fn, p4est_search_partition_t point_fn,
    sc_array_t *points);
 
+/** Lookup index for the owners of positions in the global partition.
+ * It stores the owner ranks at the corners of a regular grid of
+ * quadrants at a fixed level in every tree, fine enough to have a few
+ * grid quadrants per process.  Finding the owner of a quadrant takes one
+ * table lookup and a binary search over the few processes in between.
+ * The index is rebuilt when the revision of the forest changes.
+ */
+typedef struct p4est_partition_index p4est_partition_index_t;
+
+/** Create a partition lookup index for a forest.
+ * This is not a collective function.  It does not communicate.
+ * \param [in] p4est        The forest whose partition is indexed.
+ *                          It must remain alive while the index is used.
+ * \return                  The index, to be freed with
+ *                          \ref p4est_partition_index_destroy.
+ */
+p4est_partition_index_t *p4est_partition_index_new (p4est_t * p4est);
+
+/** Free the memory of a partition lookup index.
+ * \param [in] index        Index created by \ref p4est_partition_index_new.
+ */
+void                p4est_partition_index_destroy (p4est_partition_index_t *
+                                                   index);
+
+/** Find the owner of the first descendant of a quadrant.
+ * The result is the same as that of \ref p4est_comm_find_owner.
+ * If the revision of the forest has changed since the last call, the
+ * index is rebuilt first, which must not happen concurrently.
+ * \param [in] index        Index created by \ref p4est_partition_index_new.
+ * \param [in] which_tree   The tree of the quadrant.
+ * \param [in] q            A valid quadrant or a node at P4EST_QMAXLEVEL.
+ * \return                  The non-empty process that owns the position.
+ */
+int                 p4est_partition_index_owner (p4est_partition_index_t *
+                                                 index,
+                                                 p4est_topidx_t which_tree,
+                                                 const p4est_quadrant_t * q);
+
+/** Find the range of processes that own parts of a quadrant.
+ * The range is the same as passed to a \ref p4est_search_partition_t
+ * callback for this quadrant.  The index is rebuilt if needed as in
+ * \ref p4est_partition_index_owner.
+ * \param [in] index        Index created by \ref p4est_partition_index_new.
+ * \param [in] which_tree   The tree of the quadrant.
+ * \param [in] q            A valid quadrant.
+ * \param [out] pfirst      The lowest process owning part of \b q.
+ * \param [out] plast       The highest process owning part of \b q.
+ */
+void                p4est_partition_index_range (p4est_partition_index_t *
+                                                 index,
+                                                 p4est_topidx_t which_tree,
+                                                 const p4est_quadrant_t * q,
+                                                 int *pfirst, int *plast);
+
 /** Callback function for the top-down search through the whole forest.
  * \param [in] p4est        The forest to search.
  *                          We recurse through the trees one after another.
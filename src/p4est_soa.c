@@ -0,0 +1,272 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_communication.h>
+#include <p4est_soa.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_communication.h>
+#include <p8est_soa.h>
+#endif
+
+/* htonl is in either of these three */
+#ifdef P4EST_HAVE_ARPA_NET_H
+#include <arpa/inet.h>
+#endif
+#ifdef P4EST_HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if defined P4EST_HAVE_WINSOCK2_H || defined _WIN32
+#include <winsock2.h>
+#endif
+
+p4est_soa_t        *
+p4est_soa_new (p4est_t * p4est, int with_data, int release)
+{
+  p4est_topidx_t      jt, num_trees;
+  p4est_locidx_t      lnum;
+  size_t              zz;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_soa_t        *soa;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (!release || with_data || p4est->data_size == 0);
+
+  soa = P4EST_ALLOC_ZERO (p4est_soa_t, 1);
+  soa->first_local_tree = p4est->first_local_tree;
+  soa->last_local_tree = p4est->last_local_tree;
+  soa->num_quadrants = p4est->local_num_quadrants;
+  soa->revision = p4est->revision;
+
+  num_trees = p4est->last_local_tree - p4est->first_local_tree + 1;
+  soa->tree_offsets = P4EST_ALLOC (p4est_locidx_t, num_trees + 1);
+  soa->x = P4EST_ALLOC (p4est_qcoord_t, soa->num_quadrants);
+  soa->y = P4EST_ALLOC (p4est_qcoord_t, soa->num_quadrants);
+#ifdef P4_TO_P8
+  soa->z = P4EST_ALLOC (p4est_qcoord_t, soa->num_quadrants);
+#endif
+  soa->level = P4EST_ALLOC (int8_t, soa->num_quadrants);
+  if (with_data) {
+    soa->user_data = P4EST_ALLOC (void *, soa->num_quadrants);
+  }
+
+  lnum = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    P4EST_ASSERT (tree->quadrants_offset == lnum);
+    soa->tree_offsets[jt - p4est->first_local_tree] = lnum;
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lnum) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      soa->x[lnum] = q->x;
+      soa->y[lnum] = q->y;
+#ifdef P4_TO_P8
+      soa->z[lnum] = q->z;
+#endif
+      soa->level[lnum] = q->level;
+      if (with_data) {
+        soa->user_data[lnum] = q->p.user_data;
+      }
+    }
+    if (release) {
+      sc_array_reset (&tree->quadrants);
+    }
+  }
+  P4EST_ASSERT (lnum == soa->num_quadrants);
+  soa->tree_offsets[num_trees] = lnum;
+  soa->released = release;
+
+  return soa;
+}
+
+void
+p4est_soa_destroy (p4est_soa_t * soa)
+{
+  P4EST_ASSERT (!soa->released);
+
+  P4EST_FREE (soa->tree_offsets);
+  P4EST_FREE (soa->x);
+  P4EST_FREE (soa->y);
+#ifdef P4_TO_P8
+  P4EST_FREE (soa->z);
+#endif
+  P4EST_FREE (soa->level);
+  P4EST_FREE (soa->user_data);
+  P4EST_FREE (soa);
+}
+
+void
+p4est_soa_restore (p4est_soa_t * soa, p4est_t * p4est)
+{
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lnum, lbegin, lend;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (soa->released);
+  P4EST_ASSERT (soa->first_local_tree == p4est->first_local_tree);
+  P4EST_ASSERT (soa->last_local_tree == p4est->last_local_tree);
+  P4EST_ASSERT (soa->revision == p4est->revision);
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    P4EST_ASSERT (tree->quadrants.elem_count == 0);
+    lbegin = soa->tree_offsets[jt - p4est->first_local_tree];
+    lend = soa->tree_offsets[jt - p4est->first_local_tree + 1];
+    sc_array_resize (&tree->quadrants, (size_t) (lend - lbegin));
+    for (lnum = lbegin; lnum < lend; ++lnum) {
+      p4est_soa_quadrant (soa, lnum, p4est_quadrant_array_index
+                          (&tree->quadrants, (size_t) (lnum - lbegin)));
+    }
+  }
+  soa->released = 0;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+}
+
+int
+p4est_soa_is_current (p4est_soa_t * soa, p4est_t * p4est)
+{
+  return soa->revision == p4est->revision &&
+    soa->first_local_tree == p4est->first_local_tree &&
+    soa->last_local_tree == p4est->last_local_tree &&
+    soa->num_quadrants == p4est->local_num_quadrants;
+}
+
+p4est_locidx_t
+p4est_soa_lower_bound (p4est_soa_t * soa, p4est_topidx_t which_tree,
+                       const p4est_quadrant_t * q)
+{
+  int                 coord_diff;
+  p4est_locidx_t      low, high, guess;
+  p4est_qcoord_t      a[P4EST_DIM], b[P4EST_DIM];
+
+  P4EST_ASSERT (soa->first_local_tree <= which_tree &&
+                which_tree <= soa->last_local_tree);
+
+  low = soa->tree_offsets[which_tree - soa->first_local_tree];
+  high = soa->tree_offsets[which_tree - soa->first_local_tree + 1];
+  b[0] = q->x;
+  b[1] = q->y;
+#ifdef P4_TO_P8
+  b[2] = q->z;
+#endif
+
+  /* binary search for the first quadrant that is not less than q */
+  while (low < high) {
+    guess = low + (high - low) / 2;
+    a[0] = soa->x[guess];
+    a[1] = soa->y[guess];
+#ifdef P4_TO_P8
+    a[2] = soa->z[guess];
+#endif
+    coord_diff = p4est_coordinates_compare (a, b);
+    if (coord_diff < 0 || (coord_diff == 0 && soa->level[guess] < q->level)) {
+      low = guess + 1;
+    }
+    else {
+      high = guess;
+    }
+  }
+
+  return low < soa->tree_offsets[which_tree - soa->first_local_tree + 1] ?
+    low : -1;
+}
+
+#ifdef P4_TO_P8
+
+/** Encode a coordinate as \ref p4est_quadrant_checksum does. */
+static              uint32_t
+p4est_soa_check_coordinate (p4est_qcoord_t c, int8_t level)
+{
+  const int           level_difference = P4EST_MAXLEVEL - P4EST_OLD_MAXLEVEL;
+
+  if (level <= P4EST_OLD_QMAXLEVEL) {
+    /* shift the quadrant coordinates to ensure backward compatibility */
+    /* *INDENT-OFF* */
+    return htonl ((c < 0) ? -(((uint32_t) -c) >> level_difference) :
+                            (((uint32_t) c) >> level_difference));
+    /* *INDENT-ON* */
+  }
+  return htonl ((uint32_t) c);
+}
+
+#endif
+
+unsigned
+p4est_soa_checksum (p4est_soa_t * soa, p4est_t * p4est)
+{
+#ifdef P4EST_HAVE_ZLIB
+  unsigned            crc;
+  size_t              count;
+  p4est_locidx_t      lnum;
+  uint32_t           *check;
+  sc_array_t         *checkarray;
+
+  P4EST_ASSERT (p4est_soa_is_current (soa, p4est));
+
+  /* the encoding of p4est_quadrant_checksum for all local quadrants */
+  count = (size_t) soa->num_quadrants * (P4EST_DIM + 1);
+  checkarray = sc_array_new_count (4, count);
+  check = (uint32_t *) checkarray->array;
+  for (lnum = 0; lnum < soa->num_quadrants; ++lnum) {
+#ifndef P4_TO_P8
+    check[0] = htonl ((uint32_t) soa->x[lnum]);
+    check[1] = htonl ((uint32_t) soa->y[lnum]);
+#else
+    check[0] = p4est_soa_check_coordinate (soa->x[lnum], soa->level[lnum]);
+    check[1] = p4est_soa_check_coordinate (soa->y[lnum], soa->level[lnum]);
+    check[2] = p4est_soa_check_coordinate (soa->z[lnum], soa->level[lnum]);
+#endif
+    check[P4EST_DIM] = htonl ((uint32_t) soa->level[lnum]);
+    check += P4EST_DIM + 1;
+  }
+  crc = sc_array_checksum (checkarray);
+  sc_array_destroy (checkarray);
+
+  return p4est_comm_checksum (p4est, crc, 4 * count);
+#else
+  sc_abort_collective
+    ("Configure did not find a recent enough zlib.  Abort.\n");
+
+  return 0;
+#endif /* !P4EST_HAVE_ZLIB */
+}
+
+size_t
+p4est_soa_memory_used (p4est_soa_t * soa)
+{
+  size_t              per_quadrant;
+
+  per_quadrant = P4EST_DIM * sizeof (p4est_qcoord_t) + sizeof (int8_t);
+  if (soa->user_data != NULL) {
+    per_quadrant += sizeof (void *);
+  }
+  return sizeof (p4est_soa_t) + per_quadrant * (size_t) soa->num_quadrants +
+    (size_t) (soa->last_local_tree - soa->first_local_tree + 2) *
+    sizeof (p4est_locidx_t);
+}
@@ -58,6 +58,7 @@
 #define P4EST_OLD_MAXLEVEL              P8EST_OLD_MAXLEVEL
 #define P4EST_OLD_QMAXLEVEL             P8EST_OLD_QMAXLEVEL
 #define P4EST_ROOT_LEN                  P8EST_ROOT_LEN
+#define P4EST_KEY_MAXLEVEL              P8EST_KEY_MAXLEVEL
 #define P4EST_QUADRANT_LEN              P8EST_QUADRANT_LEN
 #define P4EST_QUADRANT_MASK             P8EST_QUADRANT_MASK
 #define P4EST_LAST_OFFSET               P8EST_LAST_OFFSET
@@ -139,13 +140,18 @@
 #define p4est_tree_t                    p8est_tree_t
 #define p4est_quadrant_t                p8est_quadrant_t
 #define p4est_inspect_t                 p8est_inspect_t
+#define p4est_balance_log_t             p8est_balance_log_t
 #define p4est_position_t                p8est_position_t
 #define p4est_init_t                    p8est_init_t
 #define p4est_refine_t                  p8est_refine_t
 #define p4est_coarsen_t                 p8est_coarsen_t
 #define p4est_weight_t                  p8est_weight_t
+#define p4est_weights_t                 p8est_weights_t
 #define p4est_ghost_t                   p8est_ghost_t
 #define p4est_ghost_exchange_t          p8est_ghost_exchange_t
+#define p4est_ghost_field_t             p8est_ghost_field_t
+#define p4est_ghost_plan_t              p8est_ghost_plan_t
+#define p4est_ghost_compact_t           p8est_ghost_compact_t
 #define p4est_indep_t                   p8est_indep_t
 #define p4est_nodes_t                   p8est_nodes_t
 #define p4est_lid_t                     p8est_lid_t
@@ -161,23 +167,38 @@
 #define p4est_iter_corner_t             p8est_iter_corner_t
 #define p4est_iter_corner_side_t        p8est_iter_corner_side_t
 #define p4est_iter_corner_info_t        p8est_iter_corner_info_t
+#define p4est_iter_schedule_side_t      p8est_iter_schedule_side_t
+#define p4est_iter_schedule_entity_t    p8est_iter_schedule_entity_t
+#define p4est_iter_schedule_t           p8est_iter_schedule_t
+#define p4est_iter_volume_span_t        p8est_iter_volume_span_t
+#define p4est_iter_volume_span_info_t   p8est_iter_volume_span_info_t
+#define p4est_iter_face_span_t          p8est_iter_face_span_t
+#define p4est_iter_face_span_info_t     p8est_iter_face_span_info_t
 #define p4est_search_query_t            p8est_search_query_t
 #define p4est_search_local_t            p8est_search_local_t
+#define p4est_search_point_key_t        p8est_search_point_key_t
 #define p4est_search_reorder_t          p8est_search_reorder_t
 #define p4est_search_partition_t        p8est_search_partition_t
 #define p4est_search_all_t              p8est_search_all_t
+#define p4est_partition_index           p8est_partition_index
+#define p4est_partition_index_t         p8est_partition_index_t
 #define p4est_build                     p8est_build
 #define p4est_build_t                   p8est_build_t
 #define p4est_transfer_comm_t           p8est_transfer_comm_t
 #define p4est_transfer_context_t        p8est_transfer_context_t
+#define p4est_partition_range_t         p8est_partition_range_t
+#define p4est_partition_sparse_t        p8est_partition_sparse_t
 #define p4est_mesh_t                    p8est_mesh_t
 #define p4est_mesh_face_neighbor_t      p8est_mesh_face_neighbor_t
+#define p4est_mesh_faces_t              p8est_mesh_faces_t
 #define p4est_wrap_t                    p8est_wrap_t
 #define p4est_wrap_leaf_t               p8est_wrap_leaf_t
 #define p4est_wrap_flags_t              p8est_wrap_flags_t
 #define p4est_vtk_context_t             p8est_vtk_context_t
 #define p4est_file_context_t            p8est_file_context_t
+#define p4est_balance_context_t         p8est_balance_context_t
 #define p4est_file_section_metadata_t   p8est_file_section_metadata_t
+#define p4est_soa_t                     p8est_soa_t
 
 /* redefine external variables */
 #define p4est_face_corners              p8est_face_corners
@@ -280,14 +301,28 @@
 #define p4est_lid_bitwise_and_inplace   p8est_lid_bitwise_and_inplace
 #define p4est_quadrant_linear_id_ext128 p8est_quadrant_linear_id_ext128
 #define p4est_quadrant_set_morton_ext128 p8est_quadrant_set_morton_ext128
+#define p4est_quadrant_array_linear_id_ext128 \
+        p8est_quadrant_array_linear_id_ext128
+#define p4est_quadrant_array_set_morton_ext128 \
+        p8est_quadrant_array_set_morton_ext128
 #define p4est_new_ext                   p8est_new_ext
 #define p4est_mesh_new_ext              p8est_mesh_new_ext
+#define p4est_mesh_new_threads          p8est_mesh_new_threads
+#define p4est_ghost_new_ext             p8est_ghost_new_ext
 #define p4est_copy_ext                  p8est_copy_ext
 #define p4est_refine_ext                p8est_refine_ext
+#define p4est_refine_threads            p8est_refine_threads
 #define p4est_coarsen_ext               p8est_coarsen_ext
+#define p4est_coarsen_threads           p8est_coarsen_threads
 #define p4est_balance_ext               p8est_balance_ext
+#define p4est_balance_begin             p8est_balance_begin
+#define p4est_balance_end               p8est_balance_end
+#define p4est_balance_track             p8est_balance_track
+#define p4est_balance_incremental_count p8est_balance_incremental_count
 #define p4est_balance_subtree_ext       p8est_balance_subtree_ext
 #define p4est_partition_ext             p8est_partition_ext
+#define p4est_partition_multi           p8est_partition_multi
+#define p4est_partition_repair          p8est_partition_repair
 #define p4est_partition_for_coarsening  p8est_partition_for_coarsening
 #define p4est_save_ext                  p8est_save_ext
 #define p4est_load_ext                  p8est_load_ext
@@ -303,6 +338,11 @@
 /* functions in p4est_iterate */
 #define p4est_iterate                   p8est_iterate
 #define p4est_iterate_ext               p8est_iterate_ext
+#define p4est_iterate_threads           p8est_iterate_threads
+#define p4est_iterate_record            p8est_iterate_record
+#define p4est_iterate_replay            p8est_iterate_replay
+#define p4est_iter_schedule_destroy     p8est_iter_schedule_destroy
+#define p4est_iterate_spans             p8est_iterate_spans
 #define p4est_iter_fside_array_index    p8est_iter_fside_array_index
 #define p4est_iter_fside_array_index_int p8est_iter_fside_array_index_int
 #define p4est_iter_cside_array_index    p8est_iter_cside_array_index
@@ -318,6 +358,13 @@
 #define p4est_quadrant_overlaps         p8est_quadrant_overlaps
 #define p4est_quadrant_is_equal_piggy   p8est_quadrant_is_equal_piggy
 #define p4est_quadrant_compare          p8est_quadrant_compare
+#define p4est_quadrant_key              p8est_quadrant_key
+#define p4est_quadrant_set_key          p8est_quadrant_set_key
+#define p4est_quadrant_is_keyable       p8est_quadrant_is_keyable
+#define p4est_key_compare               p8est_key_compare
+#define p4est_key_overlaps              p8est_key_overlaps
+#define p4est_key_lower_bound           p8est_key_lower_bound
+#define p4est_quadrant_array_sort       p8est_quadrant_array_sort
 #define p4est_coordinates_compare       p8est_coordinates_compare
 #define p4est_quadrant_disjoint         p8est_quadrant_disjoint
 #define p4est_quadrant_compare_piggy    p8est_quadrant_compare_piggy
@@ -387,6 +434,8 @@
 #define p4est_quadrant_shift_corner     p8est_quadrant_shift_corner
 #define p4est_quadrant_linear_id        p8est_quadrant_linear_id
 #define p4est_quadrant_set_morton       p8est_quadrant_set_morton
+#define p4est_quadrant_array_linear_id  p8est_quadrant_array_linear_id
+#define p4est_quadrant_array_set_morton p8est_quadrant_array_set_morton
 #define p4est_quadrant_successor        p8est_quadrant_successor
 #define p4est_quadrant_predecessor      p8est_quadrant_predecessor
 #define p4est_quadrant_srand            p8est_quadrant_srand
@@ -408,9 +457,14 @@
 #define p4est_find_range_boundaries     p8est_find_range_boundaries
 #define p4est_search                    p8est_search
 #define p4est_search_local              p8est_search_local
+#define p4est_search_local_points       p8est_search_local_points
 #define p4est_search_reorder            p8est_search_reorder
 #define p4est_search_partition          p8est_search_partition
 #define p4est_search_partition_gfx      p8est_search_partition_gfx
+#define p4est_partition_index_new       p8est_partition_index_new
+#define p4est_partition_index_destroy   p8est_partition_index_destroy
+#define p4est_partition_index_owner     p8est_partition_index_owner
+#define p4est_partition_index_range     p8est_partition_index_range
 #define p4est_search_all                p8est_search_all
 #define p4est_build_new                 p8est_build_new
 #define p4est_build_init_add            p8est_build_init_add
@@ -480,6 +534,12 @@
 #define p4est_transfer_items_begin      p8est_transfer_items_begin
 #define p4est_transfer_items_end        p8est_transfer_items_end
 #define p4est_transfer_end              p8est_transfer_end
+#define p4est_transfer_sparse           p8est_transfer_sparse
+#define p4est_transfer_sparse_begin     p8est_transfer_sparse_begin
+#define p4est_transfer_sparse_end       p8est_transfer_sparse_end
+#define p4est_partition_sparse_new      p8est_partition_sparse_new
+#define p4est_partition_sparse_destroy  p8est_partition_sparse_destroy
+#define p4est_partition_sparse_gfq      p8est_partition_sparse_gfq
 
 /* functions in p4est_io */
 #define p4est_deflate_quadrants         p8est_deflate_quadrants
@@ -528,8 +588,25 @@
 /* functions in p4est_ghost */
 #define p4est_quadrant_find_owner       p8est_quadrant_find_owner
 #define p4est_ghost_memory_used         p8est_ghost_memory_used
+#define p4est_ghost_mirror_memory_used  p8est_ghost_mirror_memory_used
+#define p4est_ghost_compact_new         p8est_ghost_compact_new
+#define p4est_ghost_compact_destroy     p8est_ghost_compact_destroy
+#define p4est_ghost_compact_memory_used p8est_ghost_compact_memory_used
+#define p4est_ghost_compact_num_ghosts  p8est_ghost_compact_num_ghosts
+#define p4est_ghost_compact_num_mirrors p8est_ghost_compact_num_mirrors
+#define p4est_ghost_compact_ghost       p8est_ghost_compact_ghost
+#define p4est_ghost_compact_mirror      p8est_ghost_compact_mirror
+#define p4est_ghost_compact_proc_offset p8est_ghost_compact_proc_offset
+#define p4est_ghost_compact_tree_offset p8est_ghost_compact_tree_offset
+#define p4est_ghost_compact_mirror_tree_offset \
+        p8est_ghost_compact_mirror_tree_offset
+#define p4est_ghost_compact_mirror_proc_offset \
+        p8est_ghost_compact_mirror_proc_offset
+#define p4est_ghost_compact_mirror_proc_mirror \
+        p8est_ghost_compact_mirror_proc_mirror
 #define p4est_ghost_new                 p8est_ghost_new
 #define p4est_ghost_destroy             p8est_ghost_destroy
+#define p4est_ghost_update              p8est_ghost_update
 #define p4est_ghost_exchange_data       p8est_ghost_exchange_data
 #define p4est_ghost_exchange_data_begin p8est_ghost_exchange_data_begin
 #define p4est_ghost_exchange_data_end   p8est_ghost_exchange_data_end
@@ -549,6 +626,20 @@
 #define p4est_is_balanced               p8est_is_balanced
 #define p4est_ghost_checksum            p8est_ghost_checksum
 #define p4est_ghost_expand              p8est_ghost_expand
+#define p4est_ghost_exchange_strided    p8est_ghost_exchange_strided
+#define p4est_ghost_exchange_strided_begin      \
+        p8est_ghost_exchange_strided_begin
+#define p4est_ghost_exchange_strided_end        \
+        p8est_ghost_exchange_strided_end
+#define p4est_ghost_exchange_fields     p8est_ghost_exchange_fields
+#define p4est_ghost_exchange_fields_begin       \
+        p8est_ghost_exchange_fields_begin
+#define p4est_ghost_exchange_fields_end p8est_ghost_exchange_fields_end
+#define p4est_ghost_plan_new            p8est_ghost_plan_new
+#define p4est_ghost_plan_destroy        p8est_ghost_plan_destroy
+#define p4est_ghost_plan_start          p8est_ghost_plan_start
+#define p4est_ghost_plan_wait           p8est_ghost_plan_wait
+#define p4est_ghost_plan_exchange       p8est_ghost_plan_exchange
 
 /* functions in p4est_nodes */
 #define p4est_nodes_new                 p8est_nodes_new
@@ -586,6 +677,11 @@
 #define p4est_mesh_face_neighbor_init2  p8est_mesh_face_neighbor_init2
 #define p4est_mesh_face_neighbor_next   p8est_mesh_face_neighbor_next
 #define p4est_mesh_face_neighbor_data   p8est_mesh_face_neighbor_data
+#define p4est_mesh_faces_new            p8est_mesh_faces_new
+#define p4est_mesh_faces_destroy        p8est_mesh_faces_destroy
+#define p4est_mesh_faces_memory_used    p8est_mesh_faces_memory_used
+#define p4est_mesh_record_replace       p8est_mesh_record_replace
+#define p4est_mesh_update               p8est_mesh_update
 
 /* functions in p4est_balance */
 #define p4est_balance_seeds_face        p8est_balance_seeds_face
@@ -616,6 +712,22 @@
 #define p4est_get_plex_data             p8est_get_plex_data
 #define p4est_get_plex_data_ext         p8est_get_plex_data_ext
 
+/* functions in p4est_soa */
+#define p4est_soa_index                 p8est_soa_index
+#define p4est_soa_quadrant              p8est_soa_quadrant
+#define p4est_soa_new                   p8est_soa_new
+#define p4est_soa_destroy               p8est_soa_destroy
+#define p4est_soa_restore               p8est_soa_restore
+#define p4est_soa_is_current            p8est_soa_is_current
+#define p4est_soa_lower_bound           p8est_soa_lower_bound
+#define p4est_soa_checksum              p8est_soa_checksum
+#define p4est_soa_memory_used           p8est_soa_memory_used
+#define P4EST_SOA_X                     P8EST_SOA_X
+#define P4EST_SOA_Y                     P8EST_SOA_Y
+#define P4EST_SOA_Z                     P8EST_SOA_Z
+#define P4EST_SOA_LEVEL                 P8EST_SOA_LEVEL
+#define P4EST_SOA_DATA                  P8EST_SOA_DATA
+
 /* functions in p4est_connrefine */
 #define p4est_connectivity_refine       p8est_connectivity_refine
 
@@ -127,6 +127,12 @@ p8est_tree_t;
  */
 typedef struct p8est_inspect p8est_inspect_t;
 
+/** Record of the mesh changes since the last 2:1 balance.
+ * It is opaque and created by \ref p8est_balance_track.
+ * Declared in p8est_extended.h.
+ */
+typedef struct p8est_balance_log p8est_balance_log_t;
+
 /** The p8est forest datatype */
 typedef struct p8est
 {
@@ -165,6 +171,10 @@ typedef struct p8est
   sc_mempool_t       *quadrant_pool;  /**< memory allocator for temporary
                                            quadrants */
   p8est_inspect_t    *inspect;        /**< algorithmic switches */
+  p8est_balance_log_t *balance_log;    /**< changes since the last balance,
+                                         NULL unless tracking is enabled;
+                                         appended last since it changes
+                                         the size of this structure */
 }
 p8est_t;
 
@@ -565,6 +565,109 @@ void                p8est_transfer_items_end (p8est_transfer_context_t * tc);
  */
 void                p8est_transfer_end (p8est_transfer_context_t * tc);
 
+/** A contiguous range of global quadrant indices on one process. */
+typedef struct p8est_partition_range
+{
+  int                 rank;             /**< The process in question */
+  p4est_gloidx_t      begin;            /**< First global quadrant index */
+  p4est_gloidx_t      end;              /**< One past the last index */
+}
+p8est_partition_range_t;
+
+/** A weighted repartition as seen by one process.
+ * It is computed without storing any per-process information:
+ * the local weight offset is obtained by a prefix sum and the cuts are
+ * only computed for the processes that exchange quadrants with this one.
+ * The complete target partition can be obtained on demand by
+ * \ref p8est_partition_sparse_gfq.
+ */
+typedef struct p8est_partition_sparse
+{
+  sc_MPI_Comm         mpicomm;          /**< Communicator of the forest */
+  int                 mpisize;          /**< Number of processes */
+  int                 mpirank;          /**< Rank of this process */
+  p4est_gloidx_t      global_num_quadrants;     /**< Total quadrants */
+  int64_t             global_weight;    /**< Total weight of the forest;
+                                             if zero, nothing moves */
+  p4est_gloidx_t      src_begin;        /**< Current local range begins */
+  p4est_gloidx_t      src_end;          /**< Current local range ends */
+  p4est_gloidx_t      dest_begin;       /**< New local range begins */
+  p4est_gloidx_t      dest_end;         /**< New local range ends */
+  sc_array_t          senders;          /**< The pieces of the new local
+                                             range by their current owners,
+                                             sorted p8est_partition_range_t */
+  sc_array_t          receivers;        /**< The pieces of the current
+                                             local range by their new
+                                             owners, sorted likewise */
+  p4est_gloidx_t     *dest_gfq;         /**< NULL until materialized */
+}
+p8est_partition_sparse_t;
+
+/** Compute a weighted repartition without global per-process arrays.
+ * The cut points are the same as those of \ref p8est_partition_ext
+ * without partitioning for coarsening.  The forest is not modified.
+ * This function is collective.
+ * \param [in] p4est        The forest to be repartitioned.
+ * \param [in] weight_fn    A weighting function or NULL for equal weights.
+ * \return                  The new partition from the perspective of
+ *                          this process.  Free with
+ *                          \ref p8est_partition_sparse_destroy.
+ */
+p8est_partition_sparse_t *p8est_partition_sparse_new (p8est_t * p4est,
+                                                      p8est_weight_t
+                                                      weight_fn);
+
+/** Free a sparse partition and its materialized arrays. */
+void                p8est_partition_sparse_destroy (p8est_partition_sparse_t
+                                                    * sparse);
+
+/** Materialize the target partition as a global first quadrant array.
+ * The array is computed on the first call, which must be collective,
+ * and stored with the sparse partition.
+ * \param [in,out] sparse   The sparse partition.
+ * \return                  Array of \b mpisize + 1 entries owned by \a
+ *                          sparse, suitable for \ref p8est_partition_given
+ *                          after differencing, or for the transfer
+ *                          functions as \b dest_gfq.
+ */
+const p4est_gloidx_t *p8est_partition_sparse_gfq (p8est_partition_sparse_t *
+                                                  sparse);
+
+/** Transfer fixed-size quadrant data according to a sparse partition.
+ * This is the equivalent of \ref p8est_transfer_fixed that only
+ * communicates with the processes listed in \a sparse.
+ * \param [in] sparse       The sparse partition from
+ *                          \ref p8est_partition_sparse_new.
+ * \param [in] tag          This tag is used in all messages.
+ * \param [out] dest_data   Memory of size \b data_size times the length of
+ *                          the new local range is received into.
+ * \param [in] src_data     Memory of size \b data_size times the length of
+ *                          the current local range is sent from.
+ * \param [in] data_size    Fixed data size per quadrant.
+ */
+void                p8est_transfer_sparse (const p8est_partition_sparse_t *
+                                           sparse, int tag, void *dest_data,
+                                           const void *src_data,
+                                           size_t data_size);
+
+/** Initiate a fixed-size data transfer according to a sparse partition.
+ * See \ref p8est_transfer_sparse for a full description.
+ * Must be matched with \ref p8est_transfer_sparse_end for completion.
+ * \return                  The transfer context.
+ */
+p8est_transfer_context_t *p8est_transfer_sparse_begin (const
+                                                       p8est_partition_sparse_t
+                                                       * sparse, int tag,
+                                                       void *dest_data,
+                                                       const void *src_data,
+                                                       size_t data_size);
+
+/** Complete a sparse data transfer.
+ * \param [in] tc       Context data from \ref p8est_transfer_sparse_begin.
+ *                      Is deallocated before this function returns.
+ */
+void                p8est_transfer_sparse_end (p8est_transfer_context_t * tc);
+
 SC_EXTERN_C_END;
 
 #endif /* !P8EST_COMMUNICATION_H */
@@ -74,6 +74,9 @@ typedef struct
   p4est_locidx_t     *mirror_proc_front_offsets;        /**< NULL until
                                                            p8est_ghost_expand is
                                                            called */
+  uint64_t            partition_hash;   /**< hash of the partition of the
+                                             forest at construction, checked
+                                             by p8est_ghost_update */
 }
 p8est_ghost_t;
 
@@ -98,6 +101,106 @@ int                 p8est_ghost_is_valid (p8est_t * p8est,
  */
 size_t              p8est_ghost_memory_used (p8est_ghost_t * ghost);
 
+/** Calculate the memory usage of the mirrors of the ghost layer.
+ * This counts the mirror array and the mirror lists by process,
+ * which are not included in p8est_ghost_memory_used.
+ * \param [in] ghost    Ghost layer structure.
+ * \return              Memory used in bytes.
+ */
+size_t              p8est_ghost_mirror_memory_used (p8est_ghost_t *
+                                                    ghost);
+
+/** Compact representation of a ghost layer.
+ * The ghosts and mirrors are stored without full quadrant records: their
+ * owner process and tree are run-length encoded and their Morton indices
+ * and local numbers are delta-coded in a byte stream with checkpoints.
+ * The mirror lists by process are delta-coded similarly.
+ * It can be kept in place of the ghost layer where memory is scarce and
+ * its contents are read by the access functions below.
+ */
+typedef struct p8est_ghost_compact p8est_ghost_compact_t;
+
+/** Create a compact copy of a ghost layer.
+ * \param [in] ghost    Valid ghost layer, possibly expanded.
+ *                      It may be destroyed afterwards.
+ * \return              Compact representation of the same contents.
+ */
+p8est_ghost_compact_t *p8est_ghost_compact_new (p8est_ghost_t * ghost);
+
+/** Free the memory of a compact ghost layer. */
+void                p8est_ghost_compact_destroy (p8est_ghost_compact_t *
+                                                 compact);
+
+/** Calculate the memory usage of a compact ghost layer.
+ * Compare with the sum of p8est_ghost_memory_used and
+ * p8est_ghost_mirror_memory_used for the full representation.
+ * \param [in] compact  Compact ghost layer.
+ * \return              Memory used in bytes.
+ */
+size_t              p8est_ghost_compact_memory_used (p8est_ghost_compact_t *
+                                                     compact);
+
+/** Return the number of ghosts in a compact ghost layer. */
+p4est_locidx_t      p8est_ghost_compact_num_ghosts (p8est_ghost_compact_t *
+                                                    compact);
+
+/** Return the number of mirrors in a compact ghost layer. */
+p4est_locidx_t      p8est_ghost_compact_num_mirrors (p8est_ghost_compact_t *
+                                                     compact);
+
+/** Decode a ghost of a compact ghost layer.
+ * The cost is logarithmic in the number of runs plus a small constant.
+ * \param [in] compact  Compact ghost layer.
+ * \param [in] g        Ghost index in [0, number of ghosts).
+ * \param [out] q       The ghost quadrant with its piggy3 data member
+ *                      filled as in the ghosts array of p8est_ghost_t.
+ * \return              The owner process of the ghost.
+ */
+int                 p8est_ghost_compact_ghost (p8est_ghost_compact_t *
+                                               compact, p4est_locidx_t g,
+                                               p8est_quadrant_t * q);
+
+/** Decode a mirror of a compact ghost layer.
+ * \param [in] compact  Compact ghost layer.
+ * \param [in] m        Mirror index in [0, number of mirrors).
+ * \param [out] q       The mirror quadrant with its piggy3 data member
+ *                      filled as in the mirrors array of p8est_ghost_t.
+ */
+void                p8est_ghost_compact_mirror (p8est_ghost_compact_t *
+                                                compact, p4est_locidx_t m,
+                                                p8est_quadrant_t * q);
+
+/** Return the entry p of the proc_offsets array of p8est_ghost_t.
+ * \param [in] p        Process number in [0, mpisize].
+ */
+p4est_locidx_t      p8est_ghost_compact_proc_offset (p8est_ghost_compact_t *
+                                                     compact, int p);
+
+/** Return the entry t of the tree_offsets array of p8est_ghost_t.
+ * \param [in] t        Tree number in [0, num_trees].
+ */
+p4est_locidx_t      p8est_ghost_compact_tree_offset (p8est_ghost_compact_t *
+                                                     compact,
+                                                     p4est_topidx_t t);
+
+/** Return the entry t of the mirror_tree_offsets array of p8est_ghost_t.
+ * \param [in] t        Tree number in [0, num_trees].
+ */
+p4est_locidx_t      p8est_ghost_compact_mirror_tree_offset
+  (p8est_ghost_compact_t * compact, p4est_topidx_t t);
+
+/** Return the entry p of the mirror_proc_offsets array of p8est_ghost_t.
+ * \param [in] p        Process number in [0, mpisize].
+ */
+p4est_locidx_t      p8est_ghost_compact_mirror_proc_offset
+  (p8est_ghost_compact_t * compact, int p);
+
+/** Return the entry k of the mirror_proc_mirrors array of p8est_ghost_t.
+ * \param [in] k        Index below the last mirror_proc_offsets entry.
+ */
+p4est_locidx_t      p8est_ghost_compact_mirror_proc_mirror
+  (p8est_ghost_compact_t * compact, p4est_locidx_t k);
+
 /** Gets the processor id of a quadrant's owner.
  * The quadrant can lie outside of a tree across faces (and only faces).
  *
@@ -130,6 +233,27 @@ int                 p8est_quadrant_find_owner (p8est_t * p8est,
 p8est_ghost_t      *p8est_ghost_new (p8est_t * p8est,
                                      p8est_connect_type_t btype);
 
+/** Update a ghost layer after the forest has been adapted locally.
+ * This function is collective and equivalent to destroying the ghost layer
+ * and calling p8est_ghost_new with the same connection type.
+ * The new mirrors are computed locally as usual, but only the differences
+ * to the previous mirrors are sent to the peer processes.  The ghosts of
+ * each peer are patched from the previous ghost layer, such that the
+ * communication volume scales with the number of changed mirrors.
+ * Only the communication is incremental: the local work of finding the
+ * mirrors is the same as in p8est_ghost_new.
+ * The partition must not have changed since \a ghost was created, while
+ * any refinement, coarsening and balancing is allowed.  This is checked
+ * and the function aborts otherwise.
+ * \param [in] p8est            The forest for which the ghost layer was
+ *                              created.  Its partition must be unchanged.
+ * \param [in,out] ghost        A ghost layer created by p8est_ghost_new or
+ *                              a previous update and not expanded since.
+ *                              Its contents are replaced in place.
+ */
+void                p8est_ghost_update (p8est_t * p8est,
+                                        p8est_ghost_t * ghost);
+
 /** Frees all memory used for the ghost layer. */
 void                p8est_ghost_destroy (p8est_ghost_t * ghost);
 
@@ -251,6 +375,16 @@ void                p8est_ghost_exchange_data (p8est_t * p8est,
                                                p8est_ghost_t * ghost,
                                                void *ghost_data);
 
+/** Description of one field in a fused ghost exchange. */
+typedef struct p8est_ghost_field
+{
+  const void         *local_data;       /**< Source indexed by local quadrant
+                                             number, read for the mirrors */
+  void               *ghost_data;       /**< Destination indexed by ghost */
+  size_t              data_size;        /**< Bytes per quadrant */
+}
+p8est_ghost_field_t;
+
 /** Transient storage for asynchronous ghost exchange. */
 typedef struct p8est_ghost_exchange
 {
@@ -264,6 +398,8 @@ typedef struct p8est_ghost_exchange
   int                *qactive, *qbuffer;
   sc_array_t          requests, sbuffers;
   sc_array_t          rrequests, rbuffers;
+  int                 num_fields;       /**< Meaningful with fields */
+  p8est_ghost_field_t *fields;          /**< Used by fused exchange only */
 }
 p8est_ghost_exchange_t;
 
@@ -372,6 +508,180 @@ p8est_ghost_exchange_t *p8est_ghost_exchange_custom_levels_begin
 void                p8est_ghost_exchange_custom_levels_end
   (p8est_ghost_exchange_t * exc);
 
+/** Transfer data for local quadrants that are ghosts to other processors.
+ * The local data is read from a contiguous array indexed by the local
+ * quadrant number, and the ghost data is written into a contiguous array
+ * indexed by the ghost number.  Both arrays may have a larger stride than
+ * the transferred data, for example to exchange one member of a struct.
+ * The data moves without intermediate copies or per-mirror pointers:
+ * With MPI, messages are described by derived datatypes on both ends.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] data_size        The data size to transfer per quadrant.
+ * \param [in] local_data       Data of the local quadrant number i is at
+ *                              byte offset i * \a local_stride.
+ * \param [in] local_stride     Byte distance of consecutive local items.
+ *                              Must be at least \a data_size.
+ * \param [in,out] ghost_data   Data of the ghost number i is received at
+ *                              byte offset i * \a ghost_stride.
+ * \param [in] ghost_stride     Byte distance of consecutive ghost items.
+ *                              Must be at least \a data_size.
+ */
+void                p8est_ghost_exchange_strided (p8est_t * p8est,
+                                                  p8est_ghost_t * ghost,
+                                                  size_t data_size,
+                                                  const void *local_data,
+                                                  size_t local_stride,
+                                                  void *ghost_data,
+                                                  size_t ghost_stride);
+
+/** Begin an asynchronous ghost data exchange by posting messages.
+ * The arguments are identical to p8est_ghost_exchange_strided.
+ * The return type is always non-NULL and must be passed to
+ * p8est_ghost_exchange_strided_end to complete the exchange.
+ * Neither the local nor the ghost data must be modified before completion,
+ * and the ghost data must not be accessed either.
+ * \param [in]      local_data  Must stay alive into the completion call.
+ * \param [in,out]  ghost_data  Must stay alive into the completion call.
+ * \return          Transient storage for messages in progress.
+ */
+p8est_ghost_exchange_t *p8est_ghost_exchange_strided_begin
+  (p8est_t * p8est, p8est_ghost_t * ghost, size_t data_size,
+   const void *local_data, size_t local_stride,
+   void *ghost_data, size_t ghost_stride);
+
+/** Complete an asynchronous ghost data exchange.
+ * This function waits for all pending MPI communications.
+ * \param [in,out]  Data created ONLY by p8est_ghost_exchange_strided_begin.
+ *                  It is deallocated before this function returns.
+ */
+void                p8est_ghost_exchange_strided_end
+  (p8est_ghost_exchange_t * exc);
+
+/** Transfer the data of several fields for the mirrors in one exchange.
+ * All fields for one peer process are packed into a single message, such
+ * that the number of messages does not grow with the number of fields.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] num_fields       Number of field descriptors.
+ * \param [in] fields           Array of \a num_fields descriptors.  Each
+ *                              local data array must hold \a data_size
+ *                              bytes for every local quadrant in sequence,
+ *                              each ghost data array \a data_size bytes for
+ *                              every ghost in sequence.
+ */
+void                p8est_ghost_exchange_fields (p8est_t * p8est,
+                                                 p8est_ghost_t * ghost,
+                                                 int num_fields,
+                                                 const p8est_ghost_field_t *
+                                                 fields);
+
+/** Begin an asynchronous fused ghost exchange by posting messages.
+ * The arguments are identical to p8est_ghost_exchange_fields.
+ * The return type is always non-NULL and must be passed to
+ * p8est_ghost_exchange_fields_end to complete the exchange.
+ * The ghost data must not be accessed before completion.
+ * The local data is copied into internal send buffers and the descriptors
+ * are copied as well, so both can be modified right after this returns.
+ * \param [in]      fields      The ghost data arrays referenced must stay
+ *                              alive into the completion call.
+ * \return          Transient storage for messages in progress.
+ */
+p8est_ghost_exchange_t *p8est_ghost_exchange_fields_begin
+  (p8est_t * p8est, p8est_ghost_t * ghost,
+   int num_fields, const p8est_ghost_field_t * fields);
+
+/** Complete an asynchronous fused ghost exchange.
+ * This function waits for all pending MPI communications and unpacks the
+ * received messages into the ghost data of every field.
+ * \param [in,out]  Data created ONLY by p8est_ghost_exchange_fields_begin.
+ *                  It is deallocated before this function returns.
+ */
+void                p8est_ghost_exchange_fields_end
+  (p8est_ghost_exchange_t * exc);
+
+/** Persistent plan for repeated ghost exchanges on an unchanged ghost layer.
+ * The peer lists, the pack order and all message buffers are set up once
+ * by p8est_ghost_plan_new.  Each p8est_ghost_plan_start and
+ * p8est_ghost_plan_wait pair then runs without memory allocation.
+ * The plan is invalidated by any change to the forest or the ghost layer.
+ */
+typedef struct p8est_ghost_plan
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost;
+  size_t              data_size;        /**< Bytes sent per quadrant */
+  void               *ghost_data;       /**< Registered receive array */
+  int                 persistent;       /**< Using MPI persistent requests */
+  int                 active;   /**< True between start and wait */
+  long                revision; /**< Forest revision at creation */
+  int                 num_recvs;        /**< Number of sending peers */
+  int                 num_sends;        /**< Number of receiving peers */
+  int                *peers;    /**< Receive ranks, then send ranks */
+  p4est_locidx_t     *peer_counts;      /**< Quadrants per peer message */
+  void              **send_user;        /**< Quadrant data per send item,
+                                             NULL if data_size does not
+                                             match the forest's user data */
+  char               *sbuffer;  /**< Data for all sends in sequence */
+  sc_MPI_Request     *requests; /**< Receives, then sends */
+}
+p8est_ghost_plan_t;
+
+/** Create a persistent ghost exchange plan.
+ * The send items are ordered as in ghost->mirror_proc_mirrors and packed
+ * into a single contiguous buffer owned by the plan.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ *                              Must stay alive and unchanged with the plan.
+ * \param [in] data_size        The data size to transfer per quadrant.
+ *                              If it equals the size exchanged by
+ *                              p8est_ghost_exchange_data, the plan can
+ *                              pack directly from the quadrant user data.
+ * \param [in,out] ghost_data   Contiguous data for all ghosts in sequence
+ *                              that receives the messages of every
+ *                              exchange.  Must stay alive with the plan.
+ * \param [in] persistent       If true and MPI is configured, use MPI
+ *                              persistent requests initialized here.
+ * \return                      Plan to pass to start, wait and destroy.
+ */
+p8est_ghost_plan_t *p8est_ghost_plan_new (p8est_t * p8est,
+                                          p8est_ghost_t * ghost,
+                                          size_t data_size,
+                                          void *ghost_data, int persistent);
+
+/** Free all memory of a ghost exchange plan.
+ * \param [in] plan     Must not have an exchange in progress.
+ */
+void                p8est_ghost_plan_destroy (p8est_ghost_plan_t * plan);
+
+/** Pack the mirror data into the plan's buffer and post all messages.
+ * The ghost data must not be accessed before p8est_ghost_plan_wait.
+ * \param [in,out] plan         Must not have an exchange in progress.
+ * \param [in] mirror_data      One data pointer per mirror quadrant as
+ *                              in p8est_ghost_exchange_custom.  May be
+ *                              NULL to send the quadrant user data as in
+ *                              p8est_ghost_exchange_data, which is only
+ *                              allowed if the plan's data size matches.
+ *                              Not required to stay alive any longer.
+ */
+void                p8est_ghost_plan_start (p8est_ghost_plan_t * plan,
+                                            void **mirror_data);
+
+/** Complete an exchange started by p8est_ghost_plan_start.
+ * This function waits for all pending MPI communications.
+ * Afterwards, the plan can be started again.
+ * \param [in,out] plan         Must have an exchange in progress.
+ */
+void                p8est_ghost_plan_wait (p8est_ghost_plan_t * plan);
+
+/** Run a complete ghost exchange with a persistent plan.
+ * This is p8est_ghost_plan_start followed by p8est_ghost_plan_wait.
+ * \param [in,out] plan         Must not have an exchange in progress.
+ * \param [in] mirror_data      See p8est_ghost_plan_start.
+ */
+void                p8est_ghost_plan_exchange (p8est_ghost_plan_t * plan,
+                                               void **mirror_data);
+
 /** Expand the size of the ghost layer and mirrors by one additional layer of
  * adjacency.
  * \param [in] p8est            The forest from which the ghost layer was
@@ -320,6 +320,174 @@ void                p8est_iterate (p8est_t * p4est,
                                    p8est_iter_edge_t iter_edge,
                                    p8est_iter_corner_t iter_corner);
 
+/** One side of a face, edge or corner recorded in a p8est_iter_schedule_t.
+ * It holds the same information as the side passed to the callbacks, with
+ * the quadrant pointers replaced by their indices: a local quadrant is
+ * indexed in its tree's array, a ghost in the ghosts array, and a missing
+ * ghost has index -1.  If the side is not hanging, only the first quadrant
+ * is used.
+ */
+typedef struct p8est_iter_schedule_side
+{
+  p4est_topidx_t      treeid;   /**< the tree on this side */
+  int8_t              entity;   /**< the face, edge or corner of the
+                                     quadrants */
+  int8_t              orientation;      /**< orientation of an edge side */
+  int8_t              is_hanging;       /**< boolean: hanging face or edge
+                                             side */
+  int8_t              is_ghost[P8EST_HALF];     /**< boolean: local (0) or
+                                                     ghost (1) */
+  int8_t              faces[3]; /**< work data of an edge or corner side */
+  int8_t              edges[3]; /**< work data of a corner side */
+  p4est_locidx_t      quadid[P8EST_HALF];       /**< index in tree or ghost
+                                                     array */
+}
+p8est_iter_schedule_side_t;
+
+/** One face, edge or corner recorded in a p8est_iter_schedule_t. */
+typedef struct p8est_iter_schedule_entity
+{
+  p4est_locidx_t      first_side;       /**< index of the first side */
+  int                 num_sides;        /**< number of sides */
+  int8_t              orientation;      /**< orientation of a face */
+  int8_t              tree_boundary;    /**< as in the callback info */
+}
+p8est_iter_schedule_entity_t;
+
+/** The callback infos of one run of p8est_iterate, recorded for replay.
+ * The entities and their sides are stored in traversal order as flat
+ * arrays of index tuples that may also be handed to a user kernel.  The
+ * sides of an entity are the \a num_sides elements of the side array
+ * beginning at its \a first_side.
+ */
+typedef struct p8est_iter_schedule
+{
+  p8est_t            *p4est;    /**< the recorded forest */
+  p8est_ghost_t      *ghost_layer;      /**< the recorded ghost layer */
+  long                revision; /**< revision of the recorded forest */
+  p8est_connect_type_t btype;   /**< the kind of entities recorded */
+  sc_array_t          faces;    /**< p8est_iter_schedule_entity_t */
+  sc_array_t          face_sides;       /**< p8est_iter_schedule_side_t */
+  sc_array_t          edges;    /**< p8est_iter_schedule_entity_t */
+  sc_array_t          edge_sides;       /**< p8est_iter_schedule_side_t */
+  sc_array_t          corners;  /**< p8est_iter_schedule_entity_t */
+  sc_array_t          corner_sides;     /**< p8est_iter_schedule_side_t */
+}
+p8est_iter_schedule_t;
+
+/** Record the callback infos of p8est_iterate for repeated use.
+ * While the forest does not change, replaying the schedule saves the
+ * traversal of the forest, the search for neighbors and the sorting of
+ * the sides.
+ * \param[in] p4est          the forest
+ * \param[in] ghost_layer    optional ghost layer as in p8est_iterate;
+ *                           it must not change while the schedule is used
+ * \param[in] btype          P8EST_CONNECT_FACE records the faces,
+ *                           P8EST_CONNECT_EDGE the faces and edges,
+ *                           P8EST_CONNECT_FULL all three
+ * \return                   the schedule, to be freed with
+ *                           p8est_iter_schedule_destroy
+ */
+p8est_iter_schedule_t *p8est_iterate_record (p8est_t * p4est,
+                                             p8est_ghost_t * ghost_layer,
+                                             p8est_connect_type_t btype);
+
+/** Execute the callbacks on a recorded schedule.
+ * The callbacks receive the same information as with p8est_iterate.  The
+ * volume callbacks run first in Morton order, followed by all face, then
+ * all edge and then all corner callbacks in traversal order, which
+ * satisfies the rules listed for p8est_iterate.  Any of the callbacks may
+ * be NULL.
+ * \param[in] schedule       recorded on the unchanged forest, including
+ *                           the entities of all non-NULL callbacks
+ * \param[in,out] user_data  optional context to supply to each callback
+ */
+void                p8est_iterate_replay (p8est_iter_schedule_t * schedule,
+                                          void *user_data,
+                                          p8est_iter_volume_t iter_volume,
+                                          p8est_iter_face_t iter_face,
+                                          p8est_iter_edge_t iter_edge,
+                                          p8est_iter_corner_t iter_corner);
+
+/** Free a schedule recorded by p8est_iterate_record. */
+void                p8est_iter_schedule_destroy (p8est_iter_schedule_t *
+                                                 schedule);
+
+/** A contiguous run of local quadrants passed to p8est_iter_volume_span_t.
+ * The quadrants are \a quads[0] to \a quads[count - 1], which are the
+ * tree quadrants with local numbers \a offset to \a offset + \a count - 1.
+ */
+typedef struct p8est_iter_volume_span_info
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost_layer;
+  p4est_topidx_t      treeid;   /**< the tree containing the quadrants */
+  p8est_quadrant_t   *quads;    /**< the first quadrant of the run */
+  p4est_locidx_t      count;    /**< number of quadrants in the run */
+  p4est_locidx_t      offset;   /**< local number of the first quadrant */
+}
+p8est_iter_volume_span_info_t;
+
+/** The prototype for a function that p8est_iterate_spans will execute on
+ * runs of local quadrants, covering every local quadrant once.
+ * \param [in] info          information about the run of quadrants
+ * \param [in,out] user_data the user context passed to p8est_iterate_spans()
+ */
+typedef void        (*p8est_iter_volume_span_t) (p8est_iter_volume_span_info_t
+                                                 * info, void *user_data);
+
+/** A batch of conforming faces passed to p8est_iter_face_span_t.
+ * All faces lie in the interior of a tree between two local quadrants of
+ * the same \a level, and are normal to the axis \a direction.  Face i is
+ * between the local quadrants numbered \a quadid[0][i] and
+ * \a quadid[1][i], where the first quadrant touches the face with its face
+ * 2 * \a direction + 1 and the second with its face 2 * \a direction.
+ */
+typedef struct p8est_iter_face_span_info
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost_layer;
+  int8_t              level;    /**< level of all quadrants in the batch */
+  int8_t              direction;        /**< the axis normal to the faces */
+  p4est_locidx_t      count;    /**< number of faces in the batch */
+  const p4est_locidx_t *quadid[2];      /**< local quadrant numbers */
+}
+p8est_iter_face_span_info_t;
+
+/** The prototype for a function that p8est_iterate_spans will execute on
+ * batches of conforming faces.
+ * \param [in] info          information about the batch of faces
+ * \param [in,out] user_data the user context passed to p8est_iterate_spans()
+ */
+typedef void        (*p8est_iter_face_span_t) (p8est_iter_face_span_info_t *
+                                               info, void *user_data);
+
+/** Execute callbacks on runs of quadrants and batches of faces.
+ * Calling a kernel once per run instead of once per quadrant or face
+ * allows for tight loops over the quadrants of a tree.  The volume
+ * callbacks cover each local tree with one run.  They are executed before
+ * the face callbacks.  Faces in the interior of a tree between two local
+ * quadrants of the same size are collected into batches by level and
+ * direction and passed to \a iter_face_span.  All other faces, i.e. those
+ * on tree boundaries, hanging faces and faces touching ghosts, are passed
+ * to \a iter_face as by p8est_iterate.  Any of the callbacks may be NULL.
+ * If \a iter_face_span is NULL, all faces are passed to \a iter_face.
+ * \param[in] p4est          the forest
+ * \param[in] ghost_layer    optional ghost layer as in p8est_iterate
+ * \param[in,out] user_data  optional context to supply to each callback
+ * \param[in] iter_volume_span  callback function for runs of quadrants
+ * \param[in] iter_face_span    callback function for batches of faces
+ * \param[in] iter_face      callback function for the remaining faces
+ */
+void                p8est_iterate_spans (p8est_t * p4est,
+                                         p8est_ghost_t * ghost_layer,
+                                         void *user_data,
+                                         p8est_iter_volume_span_t
+                                         iter_volume_span,
+                                         p8est_iter_face_span_t
+                                         iter_face_span,
+                                         p8est_iter_face_t iter_face);
+
 /** Return a pointer to a iter_corner_side array element indexed by a int.
  */
 /*@unused@*/
@@ -0,0 +1,204 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+/** \file p8est_soa.h
+ *
+ * Structure-of-arrays storage of the local quadrants of a forest.
+ *
+ * The regular storage of quadrants in p8est_tree_t is an array of
+ * structures, each of which carries padding and a union of user data.
+ * Many kernels need only the coordinates and the level of a quadrant.
+ * The structure-of-arrays form keeps these in separate dense arrays
+ * indexed by the local quadrant number, which reduces the memory
+ * traffic of such kernels.  It needs 13 bytes per quadrant, plus
+ * the size of a pointer if the user data is stored as well.
+ *
+ * The dense form is either maintained alongside the regular storage or
+ * replaces it temporarily: \ref p8est_soa_new can release the quadrant
+ * arrays of the trees and \ref p8est_soa_restore rebuilds them.
+ *
+ * \ingroup p8est
+ */
+
+#ifndef P8EST_SOA_H
+#define P8EST_SOA_H
+
+#include <p8est.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** The local quadrants of a forest in structure-of-arrays form.
+ * All arrays are indexed by the local quadrant number, which is the
+ * quadrants_offset of the tree plus the position in the tree.
+ */
+typedef struct p8est_soa
+{
+  p4est_topidx_t      first_local_tree;     /**< Copied from the forest */
+  p4est_topidx_t      last_local_tree;      /**< Copied from the forest */
+  p4est_locidx_t      num_quadrants;        /**< Number of local quadrants */
+  long                revision;             /**< Revision of the forest
+                                                 when this was built */
+  p4est_locidx_t     *tree_offsets;         /**< For every local tree, the
+                                                 number of its first quadrant;
+                                                 one entry more than local
+                                                 trees */
+  p4est_qcoord_t     *x;                    /**< x coordinates */
+  p4est_qcoord_t     *y;                    /**< y coordinates */
+  p4est_qcoord_t     *z;                    /**< z coordinates */
+  int8_t             *level;                /**< Quadrant levels */
+  void              **user_data;            /**< User data pointers or NULL
+                                                 if not stored */
+  int                 released;             /**< Boolean: the tree arrays
+                                                 of the forest are released */
+}
+p8est_soa_t;
+
+/** Access the x coordinate of a quadrant by local number. */
+#define P8EST_SOA_X(s,i) ((s)->x[i])
+
+/** Access the y coordinate of a quadrant by local number. */
+#define P8EST_SOA_Y(s,i) ((s)->y[i])
+
+/** Access the z coordinate of a quadrant by local number. */
+#define P8EST_SOA_Z(s,i) ((s)->z[i])
+
+/** Access the level of a quadrant by local number. */
+#define P8EST_SOA_LEVEL(s,i) ((s)->level[i])
+
+/** Access the user data of a quadrant by local number.
+ * Only valid if the structure has been created with data. */
+#define P8EST_SOA_DATA(s,i) ((s)->user_data[i])
+
+/** Return the local number of a quadrant given by tree and position.
+ * \param [in] soa          Structure-of-arrays storage.
+ * \param [in] which_tree   A local tree of the forest.
+ * \param [in] position     Position of the quadrant within the tree.
+ * \return                  Index into the arrays of \a soa.
+ */
+/*@unused@*/
+static inline p4est_locidx_t
+p8est_soa_index (const p8est_soa_t * soa, p4est_topidx_t which_tree,
+                 p4est_locidx_t position)
+{
+  P4EST_ASSERT (soa->first_local_tree <= which_tree &&
+                which_tree <= soa->last_local_tree);
+  P4EST_ASSERT (0 <= position && position <
+                soa->tree_offsets[which_tree - soa->first_local_tree + 1] -
+                soa->tree_offsets[which_tree - soa->first_local_tree]);
+
+  return soa->tree_offsets[which_tree - soa->first_local_tree] + position;
+}
+
+/** Copy a quadrant from the structure-of-arrays form.
+ * \param [in] soa          Structure-of-arrays storage.
+ * \param [in] lnum         Local number of the quadrant.
+ * \param [out] q           The coordinates and level are set.  If the
+ *                          user data is stored, so is q->p.user_data.
+ *                          Otherwise the union p is set to zero.
+ */
+/*@unused@*/
+static inline void
+p8est_soa_quadrant (const p8est_soa_t * soa, p4est_locidx_t lnum,
+                    p8est_quadrant_t * q)
+{
+  P4EST_ASSERT (0 <= lnum && lnum < soa->num_quadrants);
+
+  P4EST_QUADRANT_INIT (q);
+  q->x = soa->x[lnum];
+  q->y = soa->y[lnum];
+  q->z = soa->z[lnum];
+  q->level = soa->level[lnum];
+  q->pad8 = 0;
+  q->pad16 = 0;
+  q->p.user_data = soa->user_data != NULL ? soa->user_data[lnum] : NULL;
+}
+
+/** Create the structure-of-arrays form of the local quadrants.
+ * \param [in,out] p8est   The forest is not changed unless \a release.
+ * \param [in] with_data    Boolean: store the user data pointers as well.
+ * \param [in] release      Boolean: free the quadrant arrays of the trees.
+ *                          Then only the dense form holds the quadrants
+ *                          and the forest must not be used in any way
+ *                          until \ref p8est_soa_restore is called.
+ *                          Requires \a with_data if the data size of the
+ *                          forest is positive.
+ * \return                  The dense storage, which is independent of the
+ *                          forest unless released.
+ */
+p8est_soa_t        *p8est_soa_new (p8est_t * p8est, int with_data,
+                                   int release);
+
+/** Free the memory of a structure-of-arrays storage.
+ * \param [in] soa          Must not hold the only copy of the quadrants.
+ */
+void                p8est_soa_destroy (p8est_soa_t * soa);
+
+/** Rebuild the quadrant arrays of a forest from the dense form.
+ * This is the inverse of \ref p8est_soa_new with \a release true.
+ * \param [in,out] soa      The dense storage, which remains valid.
+ * \param [in,out] p8est   The forest that has been released.
+ *                          Its quadrant arrays are restored.
+ */
+void                p8est_soa_restore (p8est_soa_t * soa, p8est_t * p8est);
+
+/** Check whether the dense form matches the current state of a forest.
+ * \param [in] soa          Structure-of-arrays storage.
+ * \param [in] p8est       The forest this has been created from.
+ * \return                  True if the forest has not been changed since.
+ */
+int                 p8est_soa_is_current (p8est_soa_t * soa,
+                                          p8est_t * p8est);
+
+/** Find the lowest position tq in a local tree such that tq >= q.
+ * This binary search only touches the coordinate and level arrays.
+ * \param [in] soa          Structure-of-arrays storage.
+ * \param [in] which_tree   A local tree of the forest.
+ * \param [in] q            Quadrant to search for.
+ * \return                  Returns the local number of the matching
+ *                          quadrant, or -1 if all quadrants in the tree
+ *                          are smaller than \a q.
+ */
+p4est_locidx_t      p8est_soa_lower_bound (p8est_soa_t * soa,
+                                           p4est_topidx_t which_tree,
+                                           const p8est_quadrant_t * q);
+
+/** Compute the checksum of the forest from the dense form.
+ * The traversal reads only the coordinate and level arrays.  It works
+ * while the quadrant arrays of the forest are released.
+ * This function is collective.
+ * \param [in] soa          Structure-of-arrays storage.
+ * \param [in] p8est       The forest this has been created from.
+ * \return                  The same value as \ref p8est_checksum on rank 0,
+ *                          zero on all other ranks.
+ */
+unsigned            p8est_soa_checksum (p8est_soa_t * soa, p8est_t * p8est);
+
+/** Calculate the memory usage of the dense storage.
+ * \param [in] soa          Structure-of-arrays storage.
+ * \return                  Memory used in bytes.
+ */
+size_t              p8est_soa_memory_used (p8est_soa_t * soa);
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_SOA_H */
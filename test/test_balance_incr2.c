@@ -0,0 +1,221 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    base_level = 4;
+static const int    refine_level = 8;
+#else
+static const int    base_level = 3;
+static const int    refine_level = 6;
+#endif
+
+static const int    num_rounds = 6;
+static const int    num_targets = 3;
+
+typedef struct
+{
+  int                 round;
+  p4est_topidx_t      num_trees;
+  p4est_topidx_t      single_tree;
+  p4est_quadrant_t    single;
+}
+test_incr_t;
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(int *) quadrant->p.user_data = (int) which_tree;
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  int                 k;
+  test_incr_t        *ti = (test_incr_t *) p4est->user_pointer;
+  p4est_quadrant_t    target;
+
+  if ((int) quadrant->level >= refine_level) {
+    return 0;
+  }
+  for (k = 0; k < num_targets; ++k) {
+    /* a few small targets that move through the trees with the rounds */
+    if (which_tree != (3 * ti->round + 5 * k) % ti->num_trees) {
+      continue;
+    }
+    /* the corner of a coarse quadrant forces splits in its neighbors */
+    p4est_quadrant_set_morton (&target, base_level - 1,
+                               (uint64_t) (k * 7 + ti->round * 3) %
+                               ((uint64_t) 1 << (P4EST_DIM *
+                                                 (base_level - 1))));
+    p4est_quadrant_first_descendant (&target, &target, refine_level);
+    if (p4est_quadrant_is_ancestor (quadrant, &target)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * quadrants[])
+{
+  test_incr_t        *ti = (test_incr_t *) p4est->user_pointer;
+
+  /* remove some of the refinement added in earlier rounds */
+  return quadrants[0]->level > base_level + 1 &&
+    (which_tree + ti->round) % 2 == 0 && quadrants[0]->x == 0;
+}
+
+static int
+refine_single_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                  p4est_quadrant_t * quadrant)
+{
+  test_incr_t        *ti = (test_incr_t *) p4est->user_pointer;
+
+  return which_tree == ti->single_tree &&
+    p4est_quadrant_is_equal (quadrant, &ti->single);
+}
+
+static void
+check_incremental (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  p4est_t            *copy;
+
+  /* the copy does not track changes and is balanced fully */
+  copy = p4est_copy (p4est, 1);
+  SC_CHECK_ABORT (copy->balance_log == NULL, "Balance copy log");
+  p4est_balance_ext (copy, btype, init_fn, NULL);
+  p4est_balance_ext (p4est, btype, init_fn, NULL);
+
+  SC_CHECK_ABORT (p4est_is_valid (p4est), "Balance incremental valid");
+  SC_CHECK_ABORT (p4est_is_balanced (p4est, btype),
+                  "Balance incremental 2:1");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1),
+                  "Balance incremental equal");
+  p4est_destroy (copy);
+}
+
+static void
+test_connectivity (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn,
+                   p4est_connect_type_t btype)
+{
+  long                count;
+  test_incr_t         ti;
+  p4est_t            *p4est;
+  p4est_tree_t       *tree;
+
+  ti.round = 0;
+  ti.num_trees = conn->num_trees;
+  p4est = p4est_new_ext (mpicomm, conn, 0, base_level, 1, sizeof (int),
+                         init_fn, &ti);
+
+  /* the first balance after enabling the log is a full one */
+  p4est_balance_track (p4est, 1);
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  check_incremental (p4est, btype);
+  SC_CHECK_ABORT (p4est_balance_incremental_count (p4est) == 0,
+                  "Balance first full");
+
+  for (ti.round = 1; ti.round <= num_rounds; ++ti.round) {
+    /* a partition of a freshly balanced forest keeps the log */
+    p4est_partition (p4est, 0, NULL);
+    p4est_refine (p4est, 1, refine_fn, init_fn);
+    p4est_coarsen (p4est, 0, coarsen_fn, init_fn);
+    check_incremental (p4est, btype);
+  }
+
+  /* a weaker balance may reuse the log of a stronger one */
+  p4est_refine (p4est, 1, refine_fn, init_fn);
+  check_incremental (p4est, P4EST_CONNECT_FACE);
+
+  /* a single refined quadrant is always balanced incrementally */
+  ti.single_tree = -1;
+  if (p4est->mpirank == 0 && p4est->local_num_quadrants > 0) {
+    tree = p4est_tree_array_index (p4est->trees, p4est->first_local_tree);
+    ti.single_tree = p4est->first_local_tree;
+    ti.single = *p4est_quadrant_array_index (&tree->quadrants, 0);
+  }
+  count = p4est_balance_incremental_count (p4est);
+  p4est_refine (p4est, 0, refine_single_fn, init_fn);
+  check_incremental (p4est, P4EST_CONNECT_FACE);
+  SC_CHECK_ABORT (p4est_balance_incremental_count (p4est) == count + 1,
+                  "Balance single incremental");
+
+  p4est_balance_track (p4est, 0);
+  SC_CHECK_ABORT (p4est->balance_log == NULL, "Balance track off");
+  SC_CHECK_ABORT (p4est_balance_incremental_count (p4est) == 0,
+                  "Balance count off");
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+}
+
+int
+main (int argc, char **argv)
+{
+  sc_MPI_Comm         mpicomm;
+  int                 mpiret;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  test_connectivity (mpicomm, p4est_connectivity_new_brick (5, 4, 1, 0),
+                     P4EST_CONNECT_FULL);
+  test_connectivity (mpicomm, p4est_connectivity_new_star (),
+                     P4EST_CONNECT_FACE);
+  test_connectivity (mpicomm, p4est_connectivity_new_moebius (),
+                     P4EST_CONNECT_FULL);
+#else
+  test_connectivity (mpicomm,
+                     p8est_connectivity_new_brick (3, 3, 2, 1, 0, 1),
+                     P8EST_CONNECT_FULL);
+  test_connectivity (mpicomm, p8est_connectivity_new_rotcubes (),
+                     P8EST_CONNECT_EDGE);
+  test_connectivity (mpicomm, p8est_connectivity_new_twocubes (),
+                     P8EST_CONNECT_FACE);
+#endif
+
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
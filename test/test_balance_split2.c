@@ -0,0 +1,154 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    refine_level = 7;
+#else
+static const int    refine_level = 5;
+#endif
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(int *) quadrant->p.user_data = (int) which_tree;
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  if ((int) quadrant->level >= refine_level) {
+    return 0;
+  }
+  if (quadrant->level < 2) {
+    return which_tree % 3 != 1;
+  }
+  return p4est_quadrant_child_id (quadrant) == (int) (which_tree %
+                                                      P4EST_CHILDREN);
+}
+
+static void
+check_split (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  int                 i;
+  double              work;
+  p4est_t            *copy;
+  p4est_balance_context_t *ctx;
+
+  copy = p4est_copy (p4est, 1);
+  p4est_balance_ext (p4est, btype, init_fn, NULL);
+
+  ctx = p4est_balance_begin (copy, btype, init_fn, NULL);
+  SC_CHECK_ABORT (ctx != NULL, "Balance begin");
+
+  /* unrelated work to be overlapped with communication */
+  work = 0.;
+  for (i = 1; i <= 1000; ++i) {
+    work += 1. / i;
+  }
+  SC_CHECK_ABORT (work > 1., "Balance work");
+
+  p4est_balance_end (ctx);
+
+  SC_CHECK_ABORT (p4est_is_valid (copy), "Balance split valid");
+  SC_CHECK_ABORT (p4est_is_balanced (copy, btype), "Balance split 2:1");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1), "Balance split equal");
+  SC_CHECK_ABORT (p4est_checksum (p4est) == p4est_checksum (copy),
+                  "Balance split checksum");
+  p4est_destroy (copy);
+}
+
+static void
+test_connectivity (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn)
+{
+  int                 k;
+  p4est_t            *p4est;
+#ifndef P4_TO_P8
+  const p4est_connect_type_t btypes[P4EST_DIM] =
+    { P4EST_CONNECT_FACE, P4EST_CONNECT_CORNER };
+#else
+  const p4est_connect_type_t btypes[P4EST_DIM] =
+    { P8EST_CONNECT_FACE, P8EST_CONNECT_EDGE, P8EST_CONNECT_CORNER };
+#endif
+
+  p4est = p4est_new_ext (mpicomm, conn, 0, 1, 1, sizeof (int),
+                         init_fn, NULL);
+  p4est_refine (p4est, 1, refine_fn, init_fn);
+  p4est_partition (p4est, 0, NULL);
+
+  for (k = 0; k < P4EST_DIM; ++k) {
+    check_split (p4est, btypes[k]);
+  }
+
+  /* an already balanced forest remains unchanged */
+  check_split (p4est, P4EST_CONNECT_FULL);
+
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+}
+
+int
+main (int argc, char **argv)
+{
+  sc_MPI_Comm         mpicomm;
+  int                 mpiret;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* many trees per process provide trees that are balanced late */
+#ifndef P4_TO_P8
+  test_connectivity (mpicomm, p4est_connectivity_new_brick (7, 6, 0, 0));
+  test_connectivity (mpicomm, p4est_connectivity_new_brick (5, 4, 1, 1));
+  test_connectivity (mpicomm, p4est_connectivity_new_star ());
+#else
+  test_connectivity (mpicomm,
+                     p8est_connectivity_new_brick (4, 3, 3, 0, 0, 0));
+  test_connectivity (mpicomm,
+                     p8est_connectivity_new_brick (3, 3, 2, 1, 0, 1));
+  test_connectivity (mpicomm, p8est_connectivity_new_rotcubes ());
+#endif
+
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
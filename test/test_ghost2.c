@@ -24,10 +24,12 @@
 
 #ifndef P4_TO_P8
 #include <p4est_bits.h>
+#include <p4est_extended.h>
 #include <p4est_ghost.h>
 #include <p4est_lnodes.h>
 #else
 #include <p8est_bits.h>
+#include <p8est_extended.h>
 #include <p8est_ghost.h>
 #include <p8est_lnodes.h>
 #endif
@@ -374,6 +376,438 @@ test_exchange_D (p4est_t * p4est, p4est_ghost_t * ghost)
   P4EST_FREE (ghost_struct_data);
 }
 
+static void
+test_exchange_E (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p;
+  int                 persistent, round;
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      gexcl, gincl, gl;
+  p4est_gloidx_t      gnum;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_ghost_plan_t *plan, *splan;
+  void              **ghost_void_data;
+  void              **mirror_data;
+  test_exchange_t    *mirror_struct_data;
+  test_exchange_t    *ghost_struct_data, *e;
+
+  /* Test E: repeated exchanges through persistent plans */
+
+  p4est_reset_data (p4est, 0, NULL, NULL);
+  ghost_void_data = P4EST_ALLOC (void *, ghost->ghosts.elem_count);
+  ghost_struct_data = P4EST_ALLOC (test_exchange_t, ghost->ghosts.elem_count);
+  mirror_struct_data =
+    P4EST_ALLOC (test_exchange_t, ghost->mirrors.elem_count);
+  mirror_data = P4EST_ALLOC (void *, ghost->mirrors.elem_count);
+  for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+    mirror_data[zz] = mirror_struct_data + zz;
+  }
+
+  for (persistent = 0; persistent < 2; ++persistent) {
+    plan = p4est_ghost_plan_new (p4est, ghost, sizeof (void *),
+                                 ghost_void_data, persistent);
+    splan = p4est_ghost_plan_new (p4est, ghost, sizeof (test_exchange_t),
+                                  ghost_struct_data, persistent);
+    for (round = 0; round < 3; ++round) {
+      /* change the data between exchanges on the same plans */
+      gnum = p4est->global_first_quadrant[p4est->mpirank];
+      for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree;
+           ++nt) {
+        tree = p4est_tree_array_index (p4est->trees, nt);
+        for (zz = 0; zz < tree->quadrants.elem_count; ++gnum, ++zz) {
+          q = p4est_quadrant_array_index (&tree->quadrants, zz);
+          q->p.user_long = (long) ((round + 2) * gnum + persistent);
+        }
+      }
+      for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&ghost->mirrors, zz);
+        gnum = p4est->global_first_quadrant[p4est->mpirank] +
+          (p4est_gloidx_t) q->p.piggy3.local_num;
+        e = mirror_struct_data + zz;
+        e->gi = gnum + round;
+        e->ll = (long) gnum - round;
+        e->magic = TEST_EXCHANGE_MAGIC + round;
+      }
+
+      /* overlap both plans in flight */
+      p4est_ghost_plan_start (plan, NULL);
+      p4est_ghost_plan_start (splan, mirror_data);
+      p4est_ghost_plan_wait (splan);
+      p4est_ghost_plan_wait (plan);
+
+      gexcl = 0;
+      for (p = 0; p < p4est->mpisize; ++p) {
+        gincl = ghost->proc_offsets[p + 1];
+        gnum = p4est->global_first_quadrant[p];
+        for (gl = gexcl; gl < gincl; ++gl) {
+          q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+          e = ghost_struct_data + gl;
+          SC_CHECK_ABORT ((round + 2) *
+                          (gnum + (p4est_gloidx_t) q->p.piggy3.local_num) +
+                          persistent == (p4est_gloidx_t) ghost_void_data[gl],
+                          "Ghost exchange mismatch E1");
+          SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num +
+                          round == e->gi, "Ghost exchange mismatch E2");
+          SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num -
+                          round == (p4est_gloidx_t) e->ll,
+                          "Ghost exchange mismatch E3");
+          SC_CHECK_ABORT (e->magic == TEST_EXCHANGE_MAGIC + round,
+                          "Ghost exchange mismatch E4");
+        }
+        gexcl = gincl;
+      }
+      P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+    }
+    p4est_ghost_plan_destroy (splan);
+    p4est_ghost_plan_destroy (plan);
+  }
+
+  P4EST_FREE (mirror_data);
+  P4EST_FREE (mirror_struct_data);
+  P4EST_FREE (ghost_struct_data);
+  P4EST_FREE (ghost_void_data);
+}
+
+typedef struct test_field
+{
+  double              value;
+  p4est_gloidx_t      sentinel;
+}
+test_field_t;
+
+static void
+test_exchange_F (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p;
+  size_t              zz;
+  p4est_locidx_t      gexcl, gincl, gl, ll;
+  p4est_gloidx_t      gnum, gfirst;
+  p4est_quadrant_t   *q;
+  p4est_ghost_exchange_t *exc;
+  test_field_t       *local_fields, *ghost_fields;
+  double             *ghost_values;
+
+  /* Test F: exchange one member of a field array without pointers */
+
+  gfirst = p4est->global_first_quadrant[p4est->mpirank];
+  local_fields = P4EST_ALLOC (test_field_t, p4est->local_num_quadrants);
+  for (ll = 0; ll < p4est->local_num_quadrants; ++ll) {
+    local_fields[ll].value = .5 * (double) (gfirst + ll);
+    local_fields[ll].sentinel = -1;
+  }
+  ghost_fields = P4EST_ALLOC (test_field_t, ghost->ghosts.elem_count);
+  ghost_values = P4EST_ALLOC (double, ghost->ghosts.elem_count);
+  for (zz = 0; zz < ghost->ghosts.elem_count; ++zz) {
+    ghost_fields[zz].value = -1.;
+    ghost_fields[zz].sentinel = (p4est_gloidx_t) zz;
+  }
+
+  /* strided on both ends, asynchronously */
+  exc = p4est_ghost_exchange_strided_begin
+    (p4est, ghost, sizeof (double), &local_fields[0].value,
+     sizeof (test_field_t), &ghost_fields[0].value, sizeof (test_field_t));
+  p4est_ghost_exchange_strided_end (exc);
+
+  /* strided local data into a contiguous ghost array */
+  p4est_ghost_exchange_strided (p4est, ghost, sizeof (double),
+                                &local_fields[0].value,
+                                sizeof (test_field_t), ghost_values,
+                                sizeof (double));
+
+  gexcl = 0;
+  for (p = 0; p < p4est->mpisize; ++p) {
+    gincl = ghost->proc_offsets[p + 1];
+    gnum = p4est->global_first_quadrant[p];
+    for (gl = gexcl; gl < gincl; ++gl) {
+      q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+      SC_CHECK_ABORT (.5 * (double) (gnum + q->p.piggy3.local_num) ==
+                      ghost_fields[gl].value, "Ghost exchange mismatch F1");
+      SC_CHECK_ABORT ((p4est_gloidx_t) gl == ghost_fields[gl].sentinel,
+                      "Ghost exchange mismatch F2");
+      SC_CHECK_ABORT (.5 * (double) (gnum + q->p.piggy3.local_num) ==
+                      ghost_values[gl], "Ghost exchange mismatch F3");
+    }
+    gexcl = gincl;
+  }
+  P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  P4EST_FREE (local_fields);
+  P4EST_FREE (ghost_fields);
+  P4EST_FREE (ghost_values);
+}
+
+static void
+test_exchange_G (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p, j;
+  p4est_locidx_t      gexcl, gincl, gl, ll;
+  p4est_gloidx_t      gnum, gfirst, gg;
+  p4est_quadrant_t   *q;
+  p4est_ghost_field_t fields[3];
+  p4est_ghost_exchange_t *exc;
+  double             *local_rho, *ghost_rho;
+  double             *local_mom, *ghost_mom;
+  p4est_gloidx_t     *local_e, *ghost_e;
+  const size_t        num_ghosts = ghost->ghosts.elem_count;
+  const p4est_locidx_t num_local = p4est->local_num_quadrants;
+
+  /* Test G: several fields of different size fused into one exchange */
+
+  gfirst = p4est->global_first_quadrant[p4est->mpirank];
+  local_rho = P4EST_ALLOC (double, num_local);
+  local_mom = P4EST_ALLOC (double, P4EST_DIM * num_local);
+  local_e = P4EST_ALLOC (p4est_gloidx_t, num_local);
+  for (ll = 0; ll < num_local; ++ll) {
+    local_rho[ll] = 1. + (double) (gfirst + ll);
+    for (j = 0; j < P4EST_DIM; ++j) {
+      local_mom[P4EST_DIM * ll + j] = (double) (j * (gfirst + ll));
+    }
+    local_e[ll] = 7 * (gfirst + ll);
+  }
+  ghost_rho = P4EST_ALLOC (double, num_ghosts);
+  ghost_mom = P4EST_ALLOC (double, P4EST_DIM * num_ghosts);
+  ghost_e = P4EST_ALLOC (p4est_gloidx_t, num_ghosts);
+
+  fields[0].local_data = local_rho;
+  fields[0].ghost_data = ghost_rho;
+  fields[0].data_size = sizeof (double);
+  fields[1].local_data = local_mom;
+  fields[1].ghost_data = ghost_mom;
+  fields[1].data_size = P4EST_DIM * sizeof (double);
+  fields[2].local_data = local_e;
+  fields[2].ghost_data = ghost_e;
+  fields[2].data_size = sizeof (p4est_gloidx_t);
+
+  /* the descriptors may be changed as soon as the exchange has begun */
+  exc = p4est_ghost_exchange_fields_begin (p4est, ghost, 3, fields);
+  memset (fields, 0, 3 * sizeof (p4est_ghost_field_t));
+  p4est_ghost_exchange_fields_end (exc);
+
+  gexcl = 0;
+  for (p = 0; p < p4est->mpisize; ++p) {
+    gincl = ghost->proc_offsets[p + 1];
+    gnum = p4est->global_first_quadrant[p];
+    for (gl = gexcl; gl < gincl; ++gl) {
+      q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+      gg = gnum + q->p.piggy3.local_num;
+      SC_CHECK_ABORT (1. + (double) gg == ghost_rho[gl],
+                      "Ghost exchange mismatch G1");
+      for (j = 0; j < P4EST_DIM; ++j) {
+        SC_CHECK_ABORT ((double) (j * gg) == ghost_mom[P4EST_DIM * gl + j],
+                        "Ghost exchange mismatch G2");
+      }
+      SC_CHECK_ABORT (7 * gg == ghost_e[gl], "Ghost exchange mismatch G3");
+    }
+    gexcl = gincl;
+  }
+  P4EST_ASSERT (gexcl == (p4est_locidx_t) num_ghosts);
+
+  /* an exchange without fields does nothing */
+  p4est_ghost_exchange_fields (p4est, ghost, 0, NULL);
+
+  P4EST_FREE (local_rho);
+  P4EST_FREE (local_mom);
+  P4EST_FREE (local_e);
+  P4EST_FREE (ghost_rho);
+  P4EST_FREE (ghost_mom);
+  P4EST_FREE (ghost_e);
+}
+
+static int
+refine_update_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                  p4est_quadrant_t * quadrant)
+{
+  const int           round = *(int *) p4est->user_pointer;
+  const p4est_qcoord_t len = P4EST_QUADRANT_LEN (quadrant->level);
+
+  if ((int) quadrant->level >= refine_level) {
+    return 0;
+  }
+  return (quadrant->x / len + 3 * (quadrant->y / len) + which_tree + round)
+    % 17 == 0;
+}
+
+static int
+coarsen_update_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                   p4est_quadrant_t * quadrants[])
+{
+  const int           round = *(int *) p4est->user_pointer;
+  const p4est_qcoord_t len = P4EST_QUADRANT_LEN (quadrants[0]->level - 1);
+
+  return (quadrants[0]->x / len + quadrants[0]->y / len + round) % 4 == 0;
+}
+
+static void
+test_ghost_equal (p4est_t * p4est, p4est_ghost_t * g, p4est_ghost_t * h)
+{
+  const size_t        tsize = (g->num_trees + 1) * sizeof (p4est_locidx_t);
+  const size_t        psize = (g->mpisize + 1) * sizeof (p4est_locidx_t);
+  size_t              zz;
+  p4est_quadrant_t   *q, *r;
+
+  SC_CHECK_ABORT (g->btype == h->btype, "Ghost update type");
+  SC_CHECK_ABORT (g->ghosts.elem_count == h->ghosts.elem_count &&
+                  g->mirrors.elem_count == h->mirrors.elem_count,
+                  "Ghost update counts");
+  for (zz = 0; zz < g->ghosts.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&g->ghosts, zz);
+    r = p4est_quadrant_array_index (&h->ghosts, zz);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy (q, r) &&
+                    q->p.piggy3.local_num == r->p.piggy3.local_num,
+                    "Ghost update ghosts");
+  }
+  for (zz = 0; zz < g->mirrors.elem_count; ++zz) {
+    q = p4est_quadrant_array_index (&g->mirrors, zz);
+    r = p4est_quadrant_array_index (&h->mirrors, zz);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy (q, r) &&
+                    q->p.piggy3.local_num == r->p.piggy3.local_num,
+                    "Ghost update mirrors");
+  }
+  SC_CHECK_ABORT (!memcmp (g->tree_offsets, h->tree_offsets, tsize) &&
+                  !memcmp (g->proc_offsets, h->proc_offsets, psize) &&
+                  !memcmp (g->mirror_tree_offsets, h->mirror_tree_offsets,
+                           tsize) &&
+                  !memcmp (g->mirror_proc_offsets, h->mirror_proc_offsets,
+                           psize), "Ghost update offsets");
+  SC_CHECK_ABORT (!memcmp (g->mirror_proc_mirrors, h->mirror_proc_mirrors,
+                           g->mirror_proc_offsets[g->mpisize] *
+                           sizeof (p4est_locidx_t)), "Ghost update lists");
+  SC_CHECK_ABORT (p4est_ghost_is_valid (p4est, g), "Ghost update valid");
+}
+
+static void
+test_ghost_update (sc_MPI_Comm mpicomm, p4est_connectivity_t * conn)
+{
+  int                 round;
+  p4est_t            *p4est;
+  p4est_ghost_t      *ghost, *fresh;
+
+  /* adapt a small forest without changing its partition */
+  p4est = p4est_new_ext (mpicomm, conn, 0, 2, 1, 0, NULL, &round);
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  for (round = 0; round < 4; ++round) {
+    if (round % 2 == 0) {
+      p4est_refine (p4est, 0, refine_update_fn, NULL);
+    }
+    else {
+      p4est_coarsen (p4est, 0, coarsen_update_fn, NULL);
+    }
+    p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+
+    /* the updated ghost layer matches a newly created one */
+    p4est_ghost_update (p4est, ghost);
+    fresh = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+    test_ghost_equal (p4est, ghost, fresh);
+    p4est_ghost_destroy (fresh);
+
+    /* exchanging data works with the updated ghost layer */
+    test_exchange_C (p4est, ghost);
+  }
+
+  /* an update without changes leaves the ghost layer as it is */
+  p4est_ghost_update (p4est, ghost);
+  fresh = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  test_ghost_equal (p4est, ghost, fresh);
+  p4est_ghost_destroy (fresh);
+
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+}
+
+/* compare a multi-layer ghost layer with one grown by expansion */
+static void
+test_ghost_layers (p4est_t * p4est, p4est_ghost_t * ghost, int num_layers)
+{
+  p4est_ghost_t      *layered, *expanded;
+
+  /* a single layer is the usual ghost layer */
+  layered = p4est_ghost_new_ext (p4est, ghost->btype, 1);
+  expanded = p4est_ghost_new (p4est, ghost->btype);
+  test_ghost_equal (p4est, layered, expanded);
+  p4est_ghost_destroy (layered);
+  p4est_ghost_destroy (expanded);
+
+  layered = p4est_ghost_new_ext (p4est, ghost->btype, num_layers);
+  SC_CHECK_ABORT (p4est_ghost_is_valid (p4est, layered), "Ghost layers");
+  test_ghost_equal (p4est, layered, ghost);
+
+  /* expansion continues from the outermost layer */
+  expanded = p4est_ghost_new_ext (p4est, ghost->btype, num_layers - 1);
+  p4est_ghost_expand (p4est, expanded);
+  test_ghost_equal (p4est, layered, expanded);
+  p4est_ghost_destroy (expanded);
+
+  test_exchange_A (p4est, layered);
+  test_exchange_C (p4est, layered);
+  p4est_ghost_destroy (layered);
+}
+
+static void
+test_ghost_compact (p4est_ghost_t * ghost)
+{
+  int                 p, owner;
+  p4est_topidx_t      t;
+  p4est_locidx_t      gl, ml, k;
+  p4est_quadrant_t    q, *r;
+  p4est_ghost_compact_t *compact;
+
+  compact = p4est_ghost_compact_new (ghost);
+  SC_CHECK_ABORT (p4est_ghost_compact_num_ghosts (compact) ==
+                  (p4est_locidx_t) ghost->ghosts.elem_count &&
+                  p4est_ghost_compact_num_mirrors (compact) ==
+                  (p4est_locidx_t) ghost->mirrors.elem_count,
+                  "Ghost compact counts");
+
+  /* every quadrant and offset is recovered from the compact form */
+  for (p = 0, gl = 0; gl < (p4est_locidx_t) ghost->ghosts.elem_count; ++gl) {
+    while (ghost->proc_offsets[p + 1] <= gl) {
+      ++p;
+    }
+    owner = p4est_ghost_compact_ghost (compact, gl, &q);
+    r = p4est_quadrant_array_index (&ghost->ghosts, (size_t) gl);
+    SC_CHECK_ABORT (owner == p && p4est_quadrant_is_equal_piggy (&q, r) &&
+                    q.p.piggy3.local_num == r->p.piggy3.local_num,
+                    "Ghost compact ghosts");
+  }
+  for (ml = 0; ml < (p4est_locidx_t) ghost->mirrors.elem_count; ++ml) {
+    p4est_ghost_compact_mirror (compact, ml, &q);
+    r = p4est_quadrant_array_index (&ghost->mirrors, (size_t) ml);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal_piggy (&q, r) &&
+                    q.p.piggy3.local_num == r->p.piggy3.local_num,
+                    "Ghost compact mirrors");
+  }
+  for (p = 0; p <= ghost->mpisize; ++p) {
+    SC_CHECK_ABORT (p4est_ghost_compact_proc_offset (compact, p) ==
+                    ghost->proc_offsets[p] &&
+                    p4est_ghost_compact_mirror_proc_offset (compact, p) ==
+                    ghost->mirror_proc_offsets[p],
+                    "Ghost compact proc offsets");
+  }
+  for (t = 0; t <= ghost->num_trees; ++t) {
+    SC_CHECK_ABORT (p4est_ghost_compact_tree_offset (compact, t) ==
+                    ghost->tree_offsets[t] &&
+                    p4est_ghost_compact_mirror_tree_offset (compact, t) ==
+                    ghost->mirror_tree_offsets[t],
+                    "Ghost compact tree offsets");
+  }
+  for (k = 0; k < ghost->mirror_proc_offsets[ghost->mpisize]; ++k) {
+    SC_CHECK_ABORT (p4est_ghost_compact_mirror_proc_mirror (compact, k) ==
+                    ghost->mirror_proc_mirrors[k],
+                    "Ghost compact mirror lists");
+  }
+
+  /* the compact form pays off for any ghost layer of reasonable size */
+  if (ghost->ghosts.elem_count >= 64) {
+    SC_CHECK_ABORT (2 * p4est_ghost_compact_memory_used (compact) <
+                    p4est_ghost_memory_used (ghost) +
+                    p4est_ghost_mirror_memory_used (ghost),
+                    "Ghost compact memory");
+  }
+  p4est_ghost_compact_destroy (compact);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -413,25 +847,39 @@ main (int argc, char **argv)
   /* do a uniform partition */
   p4est_partition (p4est, 0, NULL);
 
+  /* test updating the ghost layer after local adaptation */
+  test_ghost_update (mpicomm, conn);
+
   /* create the ghost layer */
   ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
 
   /* test ghost data exchange */
+  test_ghost_compact (ghost);
   test_exchange_A (p4est, ghost);
   test_exchange_B (p4est, ghost);
   test_exchange_C (p4est, ghost);
   test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
+  test_exchange_F (p4est, ghost);
+  test_exchange_G (p4est, ghost);
 
   for (i = 0; i < num_cycles; i++) {
     /* expand and test that the ghost layer can still exchange data properly
      * */
     p4est_ghost_expand (p4est, ghost);
+    test_ghost_compact (ghost);
     test_exchange_A (p4est, ghost);
     test_exchange_B (p4est, ghost);
     test_exchange_C (p4est, ghost);
     test_exchange_D (p4est, ghost);
+    test_exchange_E (p4est, ghost);
+    test_exchange_F (p4est, ghost);
+    test_exchange_G (p4est, ghost);
   }
 
+  /* build the same number of layers at once */
+  test_ghost_layers (p4est, ghost, num_cycles + 1);
+
   p4est_ghost_destroy (ghost);
   /* repeat the cycle, but with lnodes */
   /* create the ghost layer */
@@ -440,10 +888,14 @@ main (int argc, char **argv)
   lnodes = p4est_lnodes_new (p4est, ghost, -type);
   p4est_ghost_support_lnodes (p4est, lnodes, ghost);
   /* test ghost data exchange */
+  test_ghost_compact (ghost);
   test_exchange_A (p4est, ghost);
   test_exchange_B (p4est, ghost);
   test_exchange_C (p4est, ghost);
   test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
+  test_exchange_F (p4est, ghost);
+  test_exchange_G (p4est, ghost);
 
   for (i = 0; i < num_cycles; i++) {
     /* expand and test that the ghost layer can still exchange data properly
@@ -454,6 +906,9 @@ main (int argc, char **argv)
     test_exchange_B (p4est, ghost);
     test_exchange_C (p4est, ghost);
     test_exchange_D (p4est, ghost);
+    test_exchange_E (p4est, ghost);
+    test_exchange_F (p4est, ghost);
+    test_exchange_G (p4est, ghost);
     test_exchange_end (exc);
   }
 
@@ -823,6 +823,81 @@ test_volume_adjacency (p4est_iter_volume_info_t * info, void *data)
   }
 }
 
+/* with shared_writes false the callbacks serialize their writes */
+
+static void
+test_volume_critical (p4est_iter_volume_info_t * info, void *data)
+{
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (test_iterate_checks)
+#endif
+  test_volume_adjacency (info, data);
+}
+
+static void
+test_face_critical (p4est_iter_face_info_t * info, void *data)
+{
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (test_iterate_checks)
+#endif
+  test_face_adjacency (info, data);
+}
+
+#ifdef P4_TO_P8
+static void
+test_edge_critical (p8est_iter_edge_info_t * info, void *data)
+{
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (test_iterate_checks)
+#endif
+  test_edge_adjacency (info, data);
+}
+#endif
+
+static void
+test_corner_critical (p4est_iter_corner_info_t * info, void *data)
+{
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (test_iterate_checks)
+#endif
+  test_corner_adjacency (info, data);
+}
+
+static void
+test_volume_span (p4est_iter_volume_span_info_t * info, void *data)
+{
+  iter_data_t        *iter_data = (iter_data_t *) data;
+  p4est_tree_t       *tree;
+  p4est_locidx_t      i;
+
+  tree = p4est_tree_array_index (info->p4est->trees, info->treeid);
+  SC_CHECK_ABORT (info->offset == tree->quadrants_offset &&
+                  info->count == (p4est_locidx_t) tree->quadrants.elem_count,
+                  "Iterate: volume span");
+  for (i = 0; i < info->count; i++) {
+    SC_CHECK_ABORT (info->quads + i ==
+                    p4est_quadrant_array_index (&tree->quadrants, i),
+                    "Iterate: volume span quadrant");
+    iter_data->checks[(info->offset + i) * checks_per_quad]++;
+  }
+}
+
+static void
+test_face_span (p4est_iter_face_span_info_t * info, void *data)
+{
+  iter_data_t        *iter_data = (iter_data_t *) data;
+  p4est_locidx_t      i;
+  int                 s;
+
+  SC_CHECK_ABORT (info->count > 0, "Iterate: empty face span");
+  for (i = 0; i < info->count; i++) {
+    for (s = 0; s < 2; s++) {
+      iter_data->checks[info->quadid[s][i] * checks_per_quad + face_offset +
+                        2 * info->direction + 1 - s]++;
+    }
+  }
+}
+
 int
 main (int argc, char **argv)
 {
@@ -835,8 +910,9 @@ main (int argc, char **argv)
   p4est_locidx_t      num_checks;
   int                *checks;
   p4est_ghost_t      *ghost_layer;
+  p4est_iter_schedule_t *schedule;
   int                 ntests;
-  int                 i, j, k;
+  int                 i, j, k, l;
   iter_data_t         iter_data;
   p4est_iter_volume_t iter_volume;
   p4est_iter_face_t   iter_face;
@@ -1000,34 +1076,93 @@ main (int argc, char **argv)
 
         P4EST_GLOBAL_PRODUCTIONF ("Begin adjacency test %d:%d:%d\n", i, j, k);
 
-        p4est_iterate (p4est, ghost_layer, &iter_data, iter_volume, iter_face,
+        schedule = p4est_iterate_record (p4est, ghost_layer,
+                                         P4EST_CONNECT_FULL);
+        for (l = 0; l < 5; l++) {
+          if (l == 0) {
+            p4est_iterate (p4est, ghost_layer, &iter_data, iter_volume,
+                           iter_face,
 #ifdef P4_TO_P8
-                       iter_edge,
+                           iter_edge,
 #endif
-                       iter_corner);
-
-        for (li = 0; li < num_checks; li++) {
-          switch (check_to_type[li % checks_per_quad]) {
-          case P4EST_DIM:
-            SC_CHECK_ABORT (checks[li] == volume_count,
-                            "Iterate: completion check");
-            break;
-          case (P4EST_DIM - 1):
-            SC_CHECK_ABORT (checks[li] == face_count,
-                            "Iterate: completion check");
-            break;
+                           iter_corner);
+          }
+          else {
+            volume_count += (iter_volume != NULL);
+            face_count += (iter_face != NULL);
+#ifdef P4_TO_P8
+            edge_count += (iter_edge != NULL);
+#endif
+            corner_count += (iter_corner != NULL);
+          }
+          if (l == 1) {
+            /* the callbacks only write to the checks of local quadrants */
+            p4est_iterate_threads (p4est, ghost_layer, &iter_data,
+                                   iter_volume, iter_face,
+#ifdef P4_TO_P8
+                                   iter_edge,
+#endif
+                                   iter_corner, 0, 0, 1);
+          }
+          else if (l == 2) {
+            p4est_iterate_replay (schedule, &iter_data, iter_volume,
+                                  iter_face,
+#ifdef P4_TO_P8
+                                  iter_edge,
+#endif
+                                  iter_corner);
+          }
+          else if (l == 3) {
+            p4est_iterate_spans (p4est, ghost_layer, &iter_data,
+                                 iter_volume != NULL ? test_volume_span :
+                                 NULL,
+                                 iter_face != NULL ? test_face_span : NULL,
+                                 iter_face);
+            p4est_iterate (p4est, ghost_layer, &iter_data, NULL, NULL,
+#ifdef P4_TO_P8
+                           iter_edge,
+#endif
+                           iter_corner);
+          }
+          else if (l == 4) {
+            /* thread-safe callbacks may run concurrently in any order */
+            p4est_iterate_threads (p4est, ghost_layer, &iter_data,
+                                   iter_volume != NULL ?
+                                   test_volume_critical : NULL,
+                                   iter_face != NULL ?
+                                   test_face_critical : NULL,
+#ifdef P4_TO_P8
+                                   iter_edge != NULL ?
+                                   test_edge_critical : NULL,
+#endif
+                                   iter_corner != NULL ?
+                                   test_corner_critical : NULL, 0, 0, 0);
+          }
+
+          for (li = 0; li < num_checks; li++) {
+            switch (check_to_type[li % checks_per_quad]) {
+            case P4EST_DIM:
+              SC_CHECK_ABORT (checks[li] == volume_count,
+                              "Iterate: completion check");
+              break;
+            case (P4EST_DIM - 1):
+              SC_CHECK_ABORT (checks[li] == face_count,
+                              "Iterate: completion check");
+              break;
 #ifdef P4_TO_P8
-          case 1:
-            SC_CHECK_ABORT (checks[li] == edge_count,
-                            "Iterate: completion check");
-            break;
+            case 1:
+              SC_CHECK_ABORT (checks[li] == edge_count,
+                              "Iterate: completion check");
+              break;
 #endif
-          default:
-            SC_CHECK_ABORT (checks[li] == corner_count,
-                            "Iterate: completion check");
+            default:
+              SC_CHECK_ABORT (checks[li] == corner_count,
+                              "Iterate: completion check");
+            }
           }
         }
         /* clean up */
+        p4est_iter_schedule_destroy (schedule);
         if (k > 0) {
           p4est_ghost_destroy (ghost_layer);
         }
@@ -0,0 +1,299 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_search.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_search.h>
+#endif
+
+#ifndef P4_TO_P8
+static int          refine_level = 6;
+#else
+static int          refine_level = 4;
+#endif
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  if ((int) quadrant->level >= refine_level - (int) (which_tree % 3)) {
+    return 0;
+  }
+  return p4est_quadrant_child_id (quadrant) != 2;
+}
+
+/* a random quadrant inside the root with a level suitable for keys */
+static void
+random_quadrant (p4est_quadrant_t * q)
+{
+  int                 level;
+
+  level = rand () % (P4EST_KEY_MAXLEVEL + 1);
+  P4EST_QUADRANT_INIT (q);
+  q->level = (int8_t) level;
+  q->x = (p4est_qcoord_t) (rand () & ((1 << level) - 1)) <<
+    (P4EST_MAXLEVEL - level);
+  q->y = (p4est_qcoord_t) (rand () & ((1 << level) - 1)) <<
+    (P4EST_MAXLEVEL - level);
+#ifdef P4_TO_P8
+  q->z = (p4est_qcoord_t) (rand () & ((1 << level) - 1)) <<
+    (P4EST_MAXLEVEL - level);
+#endif
+}
+
+static void
+check_pair (const p4est_quadrant_t * q1, const p4est_quadrant_t * q2)
+{
+  int                 cmp;
+  uint64_t            k1, k2;
+
+  k1 = p4est_quadrant_key (q1);
+  k2 = p4est_quadrant_key (q2);
+  cmp = p4est_quadrant_compare (q1, q2);
+  SC_CHECK_ABORT ((cmp < 0) == (k1 < k2) && (cmp == 0) == (k1 == k2),
+                  "Key order");
+  SC_CHECK_ABORT (p4est_key_compare (&k1, &k2) == (cmp > 0) - (cmp < 0),
+                  "Key compare");
+  SC_CHECK_ABORT (p4est_key_overlaps (k1, k2) ==
+                  p4est_quadrant_overlaps (q1, q2), "Key overlaps");
+}
+
+static void
+check_tree (p4est_tree_t * tree)
+{
+  size_t              zz, nq;
+  ssize_t             result;
+  uint64_t           *keys;
+  p4est_quadrant_t   *q, r, s;
+
+  nq = tree->quadrants.elem_count;
+  keys = P4EST_ALLOC (uint64_t, nq);
+  for (zz = 0; zz < nq; ++zz) {
+    q = p4est_quadrant_array_index (&tree->quadrants, zz);
+    keys[zz] = p4est_quadrant_key (q);
+    p4est_quadrant_set_key (&r, keys[zz]);
+    SC_CHECK_ABORT (p4est_quadrant_is_equal (&r, q), "Key round trip");
+    SC_CHECK_ABORT (zz == 0 || keys[zz - 1] < keys[zz], "Key ascending");
+  }
+
+  /* search for each quadrant and the last descendant of it */
+  for (zz = 0; zz < nq; ++zz) {
+    q = p4est_quadrant_array_index (&tree->quadrants, zz);
+    SC_CHECK_ABORT (p4est_key_lower_bound (keys, nq, keys[zz]) ==
+                    (ssize_t) zz, "Key lower bound");
+    p4est_quadrant_last_descendant (q, &s, P4EST_KEY_MAXLEVEL);
+    result = p4est_find_lower_bound (&tree->quadrants, &s, 0);
+    SC_CHECK_ABORT (p4est_key_lower_bound (keys, nq,
+                                           p4est_quadrant_key (&s)) ==
+                    result, "Key descendant lower bound");
+  }
+  P4EST_FREE (keys);
+}
+
+static void
+check_sort (size_t count, int piggy)
+{
+  size_t              zz;
+  p4est_quadrant_t   *q;
+  sc_array_t         *a, *b;
+
+  a = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  for (zz = 0; zz < count; ++zz) {
+    q = p4est_quadrant_array_index (a, zz);
+    random_quadrant (q);
+    if (zz > 0 && zz % 7 == 0) {
+      /* include duplicates */
+      *q = *p4est_quadrant_array_index (a, zz / 2);
+    }
+    q->p.which_tree = (p4est_topidx_t) (rand () % 5);
+  }
+  b = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  sc_array_copy (b, a);
+
+  p4est_quadrant_array_sort (a, piggy);
+  sc_array_sort (b, piggy ? p4est_quadrant_compare_piggy :
+                 p4est_quadrant_compare);
+  for (zz = 0; zz < count; ++zz) {
+    SC_CHECK_ABORT ((piggy ? p4est_quadrant_compare_piggy :
+                     p4est_quadrant_compare)
+                    (p4est_quadrant_array_index (a, zz),
+                     p4est_quadrant_array_index (b, zz)) == 0, "Key sort");
+  }
+
+  /* a quadrant outside the root triggers the comparison sort */
+  q = p4est_quadrant_array_index (a, count / 2);
+  q->x = -P4EST_QUADRANT_LEN (q->level);
+  SC_CHECK_ABORT (!p4est_quadrant_is_keyable (q), "Key outside");
+  p4est_quadrant_array_sort (a, piggy);
+  for (zz = 1; zz < count; ++zz) {
+    SC_CHECK_ABORT ((piggy ? p4est_quadrant_compare_piggy :
+                     p4est_quadrant_compare)
+                    (p4est_quadrant_array_index (a, zz - 1),
+                     p4est_quadrant_array_index (a, zz)) <= 0,
+                    "Key fallback sort");
+  }
+
+  sc_array_destroy (a);
+  sc_array_destroy (b);
+}
+
+/* a random extended quadrant of the given level */
+static void
+random_extended (p4est_quadrant_t * q, int level)
+{
+  const p4est_qcoord_t len = P4EST_QUADRANT_LEN (level);
+
+  P4EST_QUADRANT_INIT (q);
+  q->level = (int8_t) level;
+  q->x = (p4est_qcoord_t) (rand () % (3 << level) - (1 << level)) * len;
+  q->y = (p4est_qcoord_t) (rand () % (3 << level) - (1 << level)) * len;
+#ifdef P4_TO_P8
+  q->z = (p4est_qcoord_t) (rand () % (3 << level) - (1 << level)) * len;
+#endif
+}
+
+static void
+check_morton_batch (void)
+{
+  const size_t        count = 500;
+  int                 level;
+  size_t              zz;
+  uint64_t           *ids;
+  p4est_lid_t        *lids, lid;
+  p4est_quadrant_t   *q, *r, s;
+  sc_array_t         *a, *b;
+
+  a = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  b = sc_array_new_count (sizeof (p4est_quadrant_t), count);
+  ids = P4EST_ALLOC (uint64_t, count);
+  lids = P4EST_ALLOC (p4est_lid_t, count);
+  for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+    for (zz = 0; zz < count; ++zz) {
+      random_extended (p4est_quadrant_array_index (a, zz), level);
+    }
+
+    /* 64 bit indices against the scalar versions */
+    if (level <= P4EST_OLD_QMAXLEVEL) {
+      p4est_quadrant_array_linear_id (a, level, ids);
+      p4est_quadrant_array_set_morton (b, level, ids);
+      for (zz = 0; zz < count; ++zz) {
+        q = p4est_quadrant_array_index (a, zz);
+        r = p4est_quadrant_array_index (b, zz);
+        SC_CHECK_ABORT (ids[zz] == p4est_quadrant_linear_id (q, level),
+                        "Batch linear id");
+        p4est_quadrant_set_morton (&s, level, ids[zz]);
+        SC_CHECK_ABORT (p4est_quadrant_is_equal (&s, q) &&
+                        p4est_quadrant_is_equal (r, q), "Batch set morton");
+      }
+    }
+
+    /* 128 bit indices against the scalar versions */
+    p4est_quadrant_array_linear_id_ext128 (a, level, lids);
+    p4est_quadrant_array_set_morton_ext128 (b, level, lids);
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (a, zz);
+      r = p4est_quadrant_array_index (b, zz);
+      p4est_quadrant_linear_id_ext128 (q, level, &lid);
+      SC_CHECK_ABORT (p4est_lid_is_equal (&lid, &lids[zz]),
+                      "Batch linear id ext128");
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (r, q),
+                      "Batch set morton ext128");
+    }
+  }
+
+  P4EST_FREE (ids);
+  P4EST_FREE (lids);
+  sc_array_destroy (a);
+  sc_array_destroy (b);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 i;
+  sc_MPI_Comm         mpicomm;
+  p4est_topidx_t      jt;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+  p4est_quadrant_t    q1, q2;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+  srand (4711);
+
+  /* keys of the quadrants of a refined forest */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_star ();
+#endif
+  p4est = p4est_new (mpicomm, connectivity, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_partition (p4est, 0, NULL);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    check_tree (p4est_tree_array_index (p4est->trees, jt));
+  }
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+
+  /* keys of random quadrants */
+  p4est_quadrant_set_morton (&q1, 0, 0);
+  p4est_quadrant_set_key (&q2, p4est_quadrant_key (&q1));
+  SC_CHECK_ABORT (p4est_quadrant_is_equal (&q1, &q2), "Key root");
+  for (i = 0; i < 10000; ++i) {
+    random_quadrant (&q1);
+    if (i % 3 == 0 && q1.level > 0) {
+      p4est_quadrant_ancestor (&q1, rand () % q1.level, &q2);
+    }
+    else {
+      random_quadrant (&q2);
+    }
+    p4est_quadrant_set_key (&q2, p4est_quadrant_key (&q2));
+    check_pair (&q1, &q2);
+    check_pair (&q2, &q1);
+  }
+  /* short arrays are sorted by comparison */
+  check_sort (100, 0);
+  check_sort (100, 1);
+  check_sort (3000, 0);
+  check_sort (3000, 1);
+  check_morton_batch ();
+
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
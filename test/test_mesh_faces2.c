@@ -0,0 +1,274 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_mesh.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_mesh.h>
+#endif
+
+#ifndef P4_TO_P8
+static int          refine_level = 5;
+#else
+static int          refine_level = 3;
+#endif
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  int                 cid;
+
+  if ((int) quadrant->level >= refine_level - (int) (which_tree % 3)) {
+    return 0;
+  }
+  cid = p4est_quadrant_child_id (quadrant);
+  return cid == 0 || cid == P4EST_CHILDREN - 1 || quadrant->level < 2;
+}
+
+/* check that every interior face of the mesh is listed exactly once */
+static void
+check_faces (p4est_mesh_t * mesh, p4est_locidx_t block_size)
+{
+  const int           same = P4EST_FACES * P4EST_HALF;
+  const p4est_locidx_t lq = mesh->local_num_quadrants;
+  int                 f, v, h, expected;
+  int                *count;
+  p4est_locidx_t      b, i, jl, owner, s, l, qtq, *halves;
+  p4est_mesh_faces_t *faces;
+
+  faces = p4est_mesh_faces_new (mesh, block_size);
+  SC_CHECK_ABORT (faces->num_blocks * block_size >= lq &&
+                  (faces->num_blocks - 1) * block_size < lq + (lq == 0),
+                  "Face list blocks");
+  SC_CHECK_ABORT (faces->conforming_offsets[0] == 0 &&
+                  faces->hanging_offsets[0] == faces->num_conforming &&
+                  faces->conforming_offsets[faces->num_blocks] ==
+                  faces->num_conforming &&
+                  faces->hanging_offsets[faces->num_blocks] ==
+                  faces->num_faces, "Face list offsets");
+
+  count = P4EST_ALLOC_ZERO (int, P4EST_FACES * lq);
+  for (b = 0; b < faces->num_blocks; ++b) {
+    /* same-size faces point back to each other */
+    for (i = faces->conforming_offsets[b];
+         i < faces->conforming_offsets[b + 1]; ++i) {
+      jl = faces->quads[2 * i];
+      qtq = faces->quads[2 * i + 1];
+      f = faces->faces[2 * i];
+      v = faces->faces[2 * i + 1];
+      SC_CHECK_ABORT (0 <= jl && jl < lq && jl / block_size == b &&
+                      0 <= v && v < same, "Face list conforming");
+      SC_CHECK_ABORT (mesh->quad_to_quad[P4EST_FACES * jl + f] == qtq &&
+                      mesh->quad_to_face[P4EST_FACES * jl + f] == v,
+                      "Face list conforming code");
+      ++count[P4EST_FACES * jl + f];
+      if (qtq < lq) {
+        SC_CHECK_ABORT (mesh->quad_to_quad[P4EST_FACES * qtq +
+                                           v % P4EST_FACES] == jl,
+                        "Face list conforming neighbor");
+        ++count[P4EST_FACES * qtq + v % P4EST_FACES];
+      }
+    }
+
+    /* hanging faces pair a small with a large quadrant */
+    for (i = faces->hanging_offsets[b];
+         i < faces->hanging_offsets[b + 1]; ++i) {
+      s = faces->quads[2 * i];
+      l = faces->quads[2 * i + 1];
+      f = faces->faces[2 * i];
+      v = faces->faces[2 * i + 1];
+      owner = s < lq ? s : l;
+      SC_CHECK_ABORT (owner < lq && owner / block_size == b &&
+                      same <= v && v < (P4EST_HALF + 1) * same,
+                      "Face list hanging");
+      if (s < lq) {
+        SC_CHECK_ABORT (mesh->quad_to_quad[P4EST_FACES * s + f] == l &&
+                        mesh->quad_to_face[P4EST_FACES * s + f] == v,
+                        "Face list hanging code");
+        ++count[P4EST_FACES * s + f];
+      }
+      if (l < lq) {
+        h = v / same - 1;
+        qtq = mesh->quad_to_quad[P4EST_FACES * l + v % P4EST_FACES];
+        SC_CHECK_ABORT (mesh->quad_to_face[P4EST_FACES * l +
+                                           v % P4EST_FACES] < 0,
+                        "Face list hanging large");
+        halves = (p4est_locidx_t *)
+          sc_array_index (mesh->quad_to_half, (size_t) qtq);
+        SC_CHECK_ABORT (halves[h] == s, "Face list hanging subface");
+        ++count[P4EST_FACES * l + v % P4EST_FACES];
+      }
+    }
+  }
+
+  /* boundary faces are omitted and large faces appear once per half */
+  for (jl = 0; jl < lq; ++jl) {
+    for (f = 0; f < P4EST_FACES; ++f) {
+      qtq = mesh->quad_to_quad[P4EST_FACES * jl + f];
+      v = mesh->quad_to_face[P4EST_FACES * jl + f];
+      expected = v < 0 ? P4EST_HALF : (qtq == jl && v == f) ? 0 : 1;
+      SC_CHECK_ABORT (count[P4EST_FACES * jl + f] == expected,
+                      "Face list count");
+    }
+  }
+  P4EST_FREE (count);
+
+  SC_CHECK_ABORT (p4est_mesh_faces_memory_used (faces) > 0,
+                  "Face list memory");
+  p4est_mesh_faces_destroy (faces);
+}
+
+/* check that the threaded mesh constructor reproduces the serial one */
+static void
+check_threads (p4est_t * p4est, p4est_ghost_t * ghost,
+               p4est_connect_type_t btype, int num_threads)
+{
+  int                 level;
+  size_t              lqz;
+  p4est_mesh_t       *serial, *threaded;
+
+  serial = p4est_mesh_new_ext (p4est, ghost, 1, 1, btype);
+  threaded = p4est_mesh_new_threads (p4est, ghost, 1, 1, btype,
+                                     num_threads);
+  lqz = (size_t) serial->local_num_quadrants;
+
+  SC_CHECK_ABORT (threaded->local_num_quadrants == serial->local_num_quadrants
+                  && threaded->ghost_num_quadrants ==
+                  serial->ghost_num_quadrants, "Threaded mesh counts");
+  SC_CHECK_ABORT (!memcmp (threaded->quad_to_tree, serial->quad_to_tree,
+                           lqz * sizeof (p4est_topidx_t)) &&
+                  !memcmp (threaded->ghost_to_proc, serial->ghost_to_proc,
+                           (size_t) serial->ghost_num_quadrants *
+                           sizeof (int)), "Threaded mesh trees");
+  SC_CHECK_ABORT (!memcmp (threaded->quad_to_quad, serial->quad_to_quad,
+                           P4EST_FACES * lqz * sizeof (p4est_locidx_t)) &&
+                  !memcmp (threaded->quad_to_face, serial->quad_to_face,
+                           P4EST_FACES * lqz * sizeof (int8_t)),
+                  "Threaded mesh faces");
+  SC_CHECK_ABORT (sc_array_is_equal (threaded->quad_to_half,
+                                     serial->quad_to_half),
+                  "Threaded mesh hanging faces");
+  for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+    SC_CHECK_ABORT (sc_array_is_equal (threaded->quad_level + level,
+                                       serial->quad_level + level),
+                    "Threaded mesh levels");
+  }
+#ifdef P4_TO_P8
+  SC_CHECK_ABORT ((threaded->quad_to_edge == NULL) ==
+                  (serial->quad_to_edge == NULL), "Threaded mesh edges");
+  if (serial->quad_to_edge != NULL) {
+    SC_CHECK_ABORT (threaded->local_num_edges == serial->local_num_edges &&
+                    !memcmp (threaded->quad_to_edge, serial->quad_to_edge,
+                             P8EST_EDGES * lqz * sizeof (p4est_locidx_t)),
+                    "Threaded mesh edges");
+    SC_CHECK_ABORT (sc_array_is_equal (threaded->edge_offset,
+                                       serial->edge_offset) &&
+                    sc_array_is_equal (threaded->edge_quad,
+                                       serial->edge_quad) &&
+                    sc_array_is_equal (threaded->edge_edge,
+                                       serial->edge_edge),
+                    "Threaded mesh edge lists");
+  }
+#endif
+  SC_CHECK_ABORT ((threaded->quad_to_corner == NULL) ==
+                  (serial->quad_to_corner == NULL), "Threaded mesh corners");
+  if (serial->quad_to_corner != NULL) {
+    SC_CHECK_ABORT (threaded->local_num_corners == serial->local_num_corners
+                    && !memcmp (threaded->quad_to_corner,
+                                serial->quad_to_corner, P4EST_CHILDREN * lqz
+                                * sizeof (p4est_locidx_t)),
+                    "Threaded mesh corners");
+    SC_CHECK_ABORT (sc_array_is_equal (threaded->corner_offset,
+                                       serial->corner_offset) &&
+                    sc_array_is_equal (threaded->corner_quad,
+                                       serial->corner_quad) &&
+                    sc_array_is_equal (threaded->corner_corner,
+                                       serial->corner_corner),
+                    "Threaded mesh corner lists");
+  }
+
+  p4est_mesh_destroy (threaded);
+  p4est_mesh_destroy (serial);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_t       *mesh;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* create a nonuniform forest with rotated tree connections */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_moebius ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 1, 1, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  mesh = p4est_mesh_new (p4est, ghost, P4EST_CONNECT_FULL);
+
+  /* list the faces with blocks of various sizes */
+  check_faces (mesh, 1);
+  check_faces (mesh, 64);
+  check_faces (mesh, mesh->local_num_quadrants + 1);
+
+  /* build the mesh with several threads */
+  check_threads (p4est, ghost, P4EST_CONNECT_FACE, 3);
+#ifdef P4_TO_P8
+  check_threads (p4est, ghost, P8EST_CONNECT_EDGE, 2);
+#endif
+  check_threads (p4est, ghost, P4EST_CONNECT_FULL, 1);
+  check_threads (p4est, ghost, P4EST_CONNECT_FULL, 0);
+
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_mesh.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_mesh.h>
+#endif
+
+#ifndef P4_TO_P8
+static int          refine_level = 5;
+#else
+static int          refine_level = 3;
+#endif
+
+/* the adaptation pattern changes with every cycle */
+static int          cycle;
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  int                 cid;
+
+  if ((int) quadrant->level >= refine_level + (cycle > 0)) {
+    return 0;
+  }
+  cid = p4est_quadrant_child_id (quadrant);
+  return (cid + (int) which_tree + cycle) % 5 == 0 || quadrant->level < 2;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * q[])
+{
+  if (q[0]->level <= 2) {
+    return 0;
+  }
+  return ((q[0]->x / P4EST_QUADRANT_LEN (q[0]->level - 1)) +
+          (int) which_tree + cycle) % 3 == 0;
+}
+
+static void
+replace_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            int num_outgoing, p4est_quadrant_t * outgoing[],
+            int num_incoming, p4est_quadrant_t * incoming[])
+{
+  p4est_mesh_record_replace ((sc_array_t *) p4est->user_pointer,
+                             which_tree, num_outgoing, outgoing,
+                             num_incoming, incoming);
+}
+
+/* check that an updated mesh agrees with a new one from the range builder */
+static void
+check_mesh (p4est_t * p4est, p4est_ghost_t * ghost, p4est_mesh_t * mesh,
+            p4est_connect_type_t btype)
+{
+  int                 level;
+  size_t              lqz;
+  p4est_mesh_t       *fresh;
+
+  fresh = p4est_mesh_new_ext (p4est, ghost, 1, 1, btype);
+  lqz = (size_t) fresh->local_num_quadrants;
+
+  SC_CHECK_ABORT (mesh->local_num_quadrants == fresh->local_num_quadrants
+                  && mesh->ghost_num_quadrants ==
+                  fresh->ghost_num_quadrants, "Updated mesh counts");
+  SC_CHECK_ABORT (!memcmp (mesh->quad_to_tree, fresh->quad_to_tree,
+                           lqz * sizeof (p4est_topidx_t)) &&
+                  !memcmp (mesh->ghost_to_proc, fresh->ghost_to_proc,
+                           (size_t) fresh->ghost_num_quadrants *
+                           sizeof (int)), "Updated mesh trees");
+  SC_CHECK_ABORT (!memcmp (mesh->quad_to_quad, fresh->quad_to_quad,
+                           P4EST_FACES * lqz * sizeof (p4est_locidx_t)) &&
+                  !memcmp (mesh->quad_to_face, fresh->quad_to_face,
+                           P4EST_FACES * lqz * sizeof (int8_t)),
+                  "Updated mesh faces");
+  SC_CHECK_ABORT (sc_array_is_equal (mesh->quad_to_half,
+                                     fresh->quad_to_half),
+                  "Updated mesh hanging faces");
+  for (level = 0; level <= P4EST_QMAXLEVEL; ++level) {
+    SC_CHECK_ABORT (sc_array_is_equal (mesh->quad_level + level,
+                                       fresh->quad_level + level),
+                    "Updated mesh levels");
+  }
+#ifdef P4_TO_P8
+  if (fresh->quad_to_edge != NULL) {
+    SC_CHECK_ABORT (mesh->local_num_edges == fresh->local_num_edges &&
+                    !memcmp (mesh->quad_to_edge, fresh->quad_to_edge,
+                             P8EST_EDGES * lqz * sizeof (p4est_locidx_t)),
+                    "Updated mesh edges");
+    SC_CHECK_ABORT (sc_array_is_equal (mesh->edge_offset,
+                                       fresh->edge_offset) &&
+                    sc_array_is_equal (mesh->edge_quad, fresh->edge_quad) &&
+                    sc_array_is_equal (mesh->edge_edge, fresh->edge_edge),
+                    "Updated mesh edge lists");
+  }
+#endif
+  if (fresh->quad_to_corner != NULL) {
+    SC_CHECK_ABORT (mesh->local_num_corners == fresh->local_num_corners &&
+                    !memcmp (mesh->quad_to_corner, fresh->quad_to_corner,
+                             P4EST_CHILDREN * lqz *
+                             sizeof (p4est_locidx_t)),
+                    "Updated mesh corners");
+    SC_CHECK_ABORT (sc_array_is_equal (mesh->corner_offset,
+                                       fresh->corner_offset) &&
+                    sc_array_is_equal (mesh->corner_quad,
+                                       fresh->corner_quad) &&
+                    sc_array_is_equal (mesh->corner_corner,
+                                       fresh->corner_corner),
+                    "Updated mesh corner lists");
+  }
+
+  p4est_mesh_destroy (fresh);
+}
+
+/* adapt the forest several times and update its mesh in between */
+static void
+test_update (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  sc_array_t         *replaced;
+  p4est_ghost_t      *ghost;
+  p4est_mesh_t       *mesh;
+
+  replaced = (sc_array_t *) p4est->user_pointer;
+  ghost = p4est_ghost_new (p4est, btype);
+  mesh = p4est_mesh_new_ext (p4est, ghost, 1, 1, btype);
+
+  for (cycle = 0; cycle < 3; ++cycle) {
+    sc_array_truncate (replaced);
+    p4est_refine_ext (p4est, cycle == 1, -1, refine_fn, NULL, replace_fn);
+    p4est_coarsen_ext (p4est, cycle == 2, 0, coarsen_fn, NULL, replace_fn);
+    p4est_balance_ext (p4est, btype, NULL, replace_fn);
+    p4est_ghost_update (p4est, ghost);
+
+    p4est_mesh_update (p4est, ghost, mesh, replaced);
+    check_mesh (p4est, ghost, mesh, btype);
+  }
+
+  /* an update without changes leaves the mesh as it is */
+  sc_array_truncate (replaced);
+  p4est_mesh_update (p4est, ghost, mesh, replaced);
+  check_mesh (p4est, ghost, mesh, btype);
+
+  p4est_mesh_destroy (mesh);
+  p4est_ghost_destroy (ghost);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  sc_MPI_Comm         mpicomm;
+  sc_array_t         *replaced;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* create a nonuniform forest with rotated tree connections */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_moebius ();
+#endif
+  replaced = sc_array_new (sizeof (p4est_quadrant_t));
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 1, 1, 0, NULL, replaced);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  /* update meshes with and without edge and corner information,
+   * such that the forest stays balanced for the next connection type */
+  test_update (p4est, P4EST_CONNECT_FULL);
+#ifdef P4_TO_P8
+  test_update (p4est, P8EST_CONNECT_EDGE);
+#endif
+  test_update (p4est, P4EST_CONNECT_FACE);
+
+  p4est_destroy (p4est);
+  sc_array_destroy (replaced);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -99,6 +99,96 @@ weight_once (p4est_t * p4est, p4est_topidx_t which_tree,
   return 0;
 }
 
+static int
+weight_heavy (p4est_t * p4est, p4est_topidx_t which_tree,
+              p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 ? 3 : 1;
+}
+
+/** Return the largest load relative to the average minus one. */
+static double
+weight_imbalance (p4est_t * p4est, p4est_weight_t weight_fn)
+{
+  int                 mpiret;
+  size_t              zz;
+  p4est_topidx_t      tt;
+  p4est_tree_t       *tree;
+  int64_t             load, loads[2];
+
+  load = 0;
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; ++tt) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      load += weight_fn (p4est, tt, p4est_quadrant_array_index
+                         (&tree->quadrants, zz));
+    }
+  }
+  mpiret = sc_MPI_Allreduce (&load, &loads[0], 1, sc_MPI_LONG_LONG_INT,
+                             sc_MPI_MAX, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Allreduce (&load, &loads[1], 1, sc_MPI_LONG_LONG_INT,
+                             sc_MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  return loads[0] * (double) p4est->mpisize / (double) loads[1] - 1.;
+}
+
+static void
+weights_two (p4est_t * p4est, p4est_topidx_t which_tree,
+             p4est_quadrant_t * quadrant, int *weights)
+{
+  /* the second weight is concentrated in part of the domain */
+  weights[0] = 1;
+  weights[1] = quadrant->x < P4EST_QUADRANT_LEN (1) ? 8 :
+    quadrant->y < P4EST_QUADRANT_LEN (2);
+}
+
+/** Return the largest relative deviation of any cut from its ideal. */
+static double
+weights_deviation (p4est_t * p4est)
+{
+  int                 mpiret;
+  int                 c;
+  int                 weights[2];
+  size_t              zz;
+  p4est_topidx_t      tt;
+  p4est_tree_t       *tree;
+  int64_t             local[2], offsets[2], totals[2], diff;
+  double              dev, global_dev;
+
+  local[0] = local[1] = 0;
+  for (tt = p4est->first_local_tree; tt <= p4est->last_local_tree; ++tt) {
+    tree = p4est_tree_array_index (p4est->trees, tt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      weights_two (p4est, tt, p4est_quadrant_array_index
+                   (&tree->quadrants, zz), weights);
+      local[0] += weights[0];
+      local[1] += weights[1];
+    }
+  }
+  offsets[0] = offsets[1] = 0;
+  mpiret = sc_MPI_Exscan (local, offsets, 2, sc_MPI_LONG_LONG_INT,
+                          sc_MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Allreduce (local, totals, 2, sc_MPI_LONG_LONG_INT,
+                             sc_MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  dev = 0.;
+  for (c = 0; c < 2 && p4est->mpirank > 0; ++c) {
+    diff = offsets[c] - (int64_t) p4est_partition_cut_uint64
+      ((uint64_t) totals[c], p4est->mpirank, p4est->mpisize);
+    dev = SC_MAX (dev, (diff < 0 ? -diff : diff) *
+                  (double) p4est->mpisize / (double) totals[c]);
+  }
+  mpiret = sc_MPI_Allreduce (&dev, &global_dev, 1, sc_MPI_DOUBLE,
+                             sc_MPI_MAX, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  return global_dev;
+}
+
 static int
 traverse_fn (p4est_t * p4est, p4est_topidx_t which_tree,
              p4est_quadrant_t * quadrant, int pfirst, int plast, void *point)
@@ -280,6 +370,57 @@ test_transfer_post (test_transfer_t * tt, p4est_t * p4est)
   P4EST_FREE (tt);
 }
 
+static p4est_partition_sparse_t *
+test_sparse_pre (p4est_t * p4est, p4est_weight_t weight_fn)
+{
+  p4est_partition_sparse_t *sparse;
+
+  /* the weight functions count their calls */
+  weight_counter = 0;
+  sparse = p4est_partition_sparse_new (p4est, weight_fn);
+  weight_counter = 0;
+
+  return sparse;
+}
+
+static void
+test_sparse_post (p4est_partition_sparse_t * sparse, p4est_t * p4est)
+{
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  p4est_locidx_t      li, src_count, dest_count;
+  p4est_gloidx_t     *src_data, *dest_data;
+  const p4est_gloidx_t *gfq;
+
+  /* the sparse partition agrees with the one of the forest */
+  SC_CHECK_ABORT (sparse->dest_begin == p4est->global_first_quadrant[rank]
+                  && sparse->dest_end ==
+                  p4est->global_first_quadrant[rank + 1],
+                  "Sparse local range mismatch");
+  gfq = p4est_partition_sparse_gfq (sparse);
+  SC_CHECK_ABORT (!memcmp (gfq, p4est->global_first_quadrant,
+                           sizeof (p4est_gloidx_t) * (num_procs + 1)),
+                  "Sparse partition mismatch");
+
+  /* transfer the global indices of the quadrants */
+  src_count = (p4est_locidx_t) (sparse->src_end - sparse->src_begin);
+  dest_count = (p4est_locidx_t) (sparse->dest_end - sparse->dest_begin);
+  src_data = P4EST_ALLOC (p4est_gloidx_t, src_count);
+  dest_data = P4EST_ALLOC (p4est_gloidx_t, dest_count);
+  for (li = 0; li < src_count; ++li) {
+    src_data[li] = sparse->src_begin + li;
+  }
+  p4est_transfer_sparse (sparse, 2, dest_data, src_data,
+                         sizeof (p4est_gloidx_t));
+  for (li = 0; li < dest_count; ++li) {
+    SC_CHECK_ABORT (dest_data[li] == sparse->dest_begin + li,
+                    "Sparse transfer mismatch");
+  }
+  P4EST_FREE (src_data);
+  P4EST_FREE (dest_data);
+  p4est_partition_sparse_destroy (sparse);
+}
+
 static void
 test_pertree (p4est_t * p4est, const p4est_gloidx_t * prev_pertree,
               p4est_gloidx_t * new_pertree)
@@ -429,6 +570,10 @@ main (int argc, char **argv)
   int64_t             sum;
   unsigned            crc;
   test_transfer_t    *tt;
+  p4est_partition_sparse_t *sparse;
+  double              dev_single, dev_multi;
+  p4est_gloidx_t      shipped, full, bytes;
+  p4est_t            *copy2;
 
   mpiret = sc_MPI_Init (&argc, &argv);
   SC_CHECK_MPI (mpiret);
@@ -504,7 +649,9 @@ main (int argc, char **argv)
 
   /* do a weighted partition with uniform weights */
   tt = test_transfer_pre (p4est);
+  sparse = test_sparse_pre (p4est, weight_one);
   p4est_partition (p4est, 0, weight_one);
+  test_sparse_post (sparse, p4est);
   test_transfer_post (tt, p4est);
   test_pertree (p4est, pertree1, pertree2);
   SC_CHECK_ABORT (crc == p4est_checksum (p4est),
@@ -518,7 +665,9 @@ main (int argc, char **argv)
   weight_counter = 0;
   weight_index = (rank == 1) ? 1342 : 0;
   tt = test_transfer_pre (copy);
+  sparse = test_sparse_pre (copy, weight_once);
   p4est_partition (copy, 0, weight_once);
+  test_sparse_post (sparse, copy);
   test_transfer_post (tt, copy);
   test_pertree (copy, pertree1, pertree2);
   SC_CHECK_ABORT (crc == p4est_checksum (copy),
@@ -528,7 +677,9 @@ main (int argc, char **argv)
   weight_counter = 0;
   weight_index = 0;
   tt = test_transfer_pre (copy);
+  sparse = test_sparse_pre (copy, weight_once);
   p4est_partition (copy, 0, weight_once);
+  test_sparse_post (sparse, copy);
   test_transfer_post (tt, copy);
   test_pertree (copy, pertree1, pertree2);
   SC_CHECK_ABORT (crc == p4est_checksum (copy),
@@ -543,7 +694,9 @@ main (int argc, char **argv)
   weight_index =
     (rank == num_procs - 1) ? ((int) copy->local_num_quadrants - 1) : 0;
   tt = test_transfer_pre (copy);
+  sparse = test_sparse_pre (copy, weight_once);
   p4est_partition (copy, 0, weight_once);
+  test_sparse_post (sparse, copy);
   test_transfer_post (tt, copy);
   test_pertree (copy, pertree1, pertree2);
   SC_CHECK_ABORT (crc == p4est_checksum (copy),
@@ -562,6 +715,55 @@ main (int argc, char **argv)
     }
   }
 
+  /* partition for two weights at once and compare with one weight */
+  p4est_partition (copy, 0, NULL);
+  dev_single = weights_deviation (copy);
+  tt = test_transfer_pre (copy);
+  p4est_partition_multi (copy, 2, weights_two, 0.);
+  test_transfer_post (tt, copy);
+  test_pertree (copy, pertree1, pertree2);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy),
+                  "bad checksum after multi weight partition");
+  dev_multi = weights_deviation (copy);
+  P4EST_GLOBAL_INFOF ("Cut deviation single %g multi %g\n",
+                      dev_single, dev_multi);
+  SC_CHECK_ABORT (dev_multi <= dev_single, "multi weight deviation");
+
+  /* within a generous tolerance the cuts move to equal counts */
+  tt = test_transfer_pre (copy);
+  p4est_partition_multi (copy, 2, weights_two, 10.);
+  test_transfer_post (tt, copy);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy),
+                  "bad checksum after tolerant multi weight partition");
+  SC_CHECK_ABORT (weights_deviation (copy) == dev_single,
+                  "tolerant multi weight partition");
+
+  /* a balanced partition needs no repair */
+  p4est_partition (copy, 0, NULL);
+  shipped = p4est_partition_repair (copy, NULL, .05, &bytes);
+  SC_CHECK_ABORT (shipped == 0 && bytes == 0, "unnecessary repair");
+
+  /* repair moves no more quadrants than a new partition */
+  copy2 = p4est_copy (copy, 1);
+  full = p4est_partition_ext (copy2, 0, weight_heavy);
+  p4est_destroy (copy2);
+  tt = test_transfer_pre (copy);
+  shipped = p4est_partition_repair (copy, weight_heavy, .1, &bytes);
+  test_transfer_post (tt, copy);
+  test_pertree (copy, pertree1, pertree2);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy),
+                  "bad checksum after partition repair");
+  P4EST_GLOBAL_INFOF ("Partition repair shipped %lld full %lld\n",
+                      (long long) shipped, (long long) full);
+  SC_CHECK_ABORT (shipped <= full, "partition repair shipped");
+  SC_CHECK_ABORT (bytes == shipped * (p4est_gloidx_t)
+                  (sizeof (p4est_quadrant_t) + copy->data_size),
+                  "partition repair bytes");
+  /* the tolerance holds up to the largest weight of one quadrant */
+  SC_CHECK_ABORT (weight_imbalance (copy, weight_heavy) <= .1 + 3. *
+                  copy->mpisize / (double) copy->global_num_quadrants,
+                  "partition repair imbalance");
+
   /* Add another test.  Overwrites pertree1, pertree2 */
   test_partition_circle (mpicomm, connectivity, pertree1, pertree2);
 
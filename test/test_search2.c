@@ -26,6 +26,7 @@
 #include <p4est_algorithms.h>
 #include <p4est_bits.h>
 #include <p4est_build.h>
+#include <p4est_communication.h>
 #include <p4est_extended.h>
 #include <p4est_geometry.h>
 #include <p4est_search.h>
@@ -34,6 +35,7 @@
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
 #include <p8est_build.h>
+#include <p8est_communication.h>
 #include <p8est_extended.h>
 #include <p8est_geometry.h>
 #include <p8est_search.h>
@@ -542,6 +544,231 @@ test_build_local (sc_MPI_Comm mpicomm)
   p4est_connectivity_destroy (conn);
 }
 
+typedef struct
+{
+  p4est_topidx_t      which_tree;
+  p4est_qcoord_t      xyz[3];
+  p4est_locidx_t      expected;
+  int                 use_key;
+}
+test_loc_point_t;
+
+static int
+test_loc_point_in (p4est_topidx_t which_tree, p4est_quadrant_t * quadrant,
+                   const test_loc_point_t * lp)
+{
+  p4est_qcoord_t      qlen = P4EST_QUADRANT_LEN (quadrant->level);
+
+  return lp->which_tree == which_tree &&
+    quadrant->x <= lp->xyz[0] && lp->xyz[0] < quadrant->x + qlen &&
+#ifdef P4_TO_P8
+    quadrant->z <= lp->xyz[2] && lp->xyz[2] < quadrant->z + qlen &&
+#endif
+    quadrant->y <= lp->xyz[1] && lp->xyz[1] < quadrant->y + qlen;
+}
+
+static int
+test_loc_key (p4est_t * p4est, void *point, p4est_quadrant_t * key)
+{
+  test_loc_point_t   *lp = (test_loc_point_t *) point;
+
+  if (!lp->use_key) {
+    return 0;
+  }
+  key->p.which_tree = lp->which_tree;
+  key->x = lp->xyz[0];
+  key->y = lp->xyz[1];
+#ifdef P4_TO_P8
+  key->z = lp->xyz[2];
+#endif
+  return 1;
+}
+
+static int
+test_loc_point (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * quadrant, p4est_locidx_t local_num,
+                void *point)
+{
+  test_loc_point_t   *lp = (test_loc_point_t *) point;
+
+  SC_CHECK_ABORT (!lp->use_key, "Points fallback");
+  return test_loc_point_in (which_tree, quadrant, lp);
+}
+
+static void
+test_search_points (sc_MPI_Comm mpicomm)
+{
+  const int           grid = 5;
+  int                 i, j, k;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      il, lnum;
+  p4est_connectivity_t *conn;
+  p4est_t            *p4est;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quadrant;
+  p4est_qcoord_t      qh;
+  test_loc_point_t   *lp;
+  sc_array_t         *points, *owners;
+
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_moebius ();
+#else
+  conn = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, conn, 0, 1, 1, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_partition (p4est, 0, NULL);
+  points = sc_array_new (sizeof (test_loc_point_t));
+
+  /* the center of every local quadrant in reverse order */
+  for (jt = p4est->last_local_tree; jt >= p4est->first_local_tree; --jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (il = (p4est_locidx_t) tree->quadrants.elem_count - 1; il >= 0;
+         --il) {
+      quadrant = p4est_quadrant_array_index (&tree->quadrants, il);
+      qh = P4EST_QUADRANT_LEN (quadrant->level) / 2;
+      lp = (test_loc_point_t *) sc_array_push (points);
+      lp->which_tree = jt;
+      lp->xyz[0] = quadrant->x + qh;
+      lp->xyz[1] = quadrant->y + qh;
+#ifdef P4_TO_P8
+      lp->xyz[2] = quadrant->z + qh;
+#else
+      lp->xyz[2] = 0;
+#endif
+      lp->expected = tree->quadrants_offset + il;
+    }
+  }
+
+  /* a regular grid of points in every tree, local or not */
+  for (jt = 0; jt < conn->num_trees; ++jt) {
+    for (k = 0; k < (P4EST_DIM == 3 ? grid : 1); ++k) {
+      for (j = 0; j < grid; ++j) {
+        for (i = 0; i < grid; ++i) {
+          lp = (test_loc_point_t *) sc_array_push (points);
+          lp->which_tree = jt;
+          lp->xyz[0] = i * (P4EST_ROOT_LEN / grid) + 1;
+          lp->xyz[1] = j * (P4EST_ROOT_LEN / grid) + 1;
+          lp->xyz[2] = P4EST_DIM == 3 ? k * (P4EST_ROOT_LEN / grid) + 1 : 0;
+          lp->expected = -1;
+          if (jt < p4est->first_local_tree || jt > p4est->last_local_tree) {
+            continue;
+          }
+          tree = p4est_tree_array_index (p4est->trees, jt);
+          for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+            quadrant = p4est_quadrant_array_index (&tree->quadrants, zz);
+            if (test_loc_point_in (jt, quadrant, lp)) {
+              lp->expected = tree->quadrants_offset + (p4est_locidx_t) zz;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /* every third point is located by the recursion */
+  for (zz = 0; zz < points->elem_count; ++zz) {
+    lp = (test_loc_point_t *) sc_array_index (points, zz);
+    lp->use_key = zz % 3 != 0;
+  }
+
+  owners = sc_array_new (sizeof (p4est_locidx_t));
+  p4est_search_local_points (p4est, test_loc_key, test_loc_point,
+                             points, owners, 0);
+  SC_CHECK_ABORT (owners->elem_count == points->elem_count, "Points count");
+  for (zz = 0; zz < points->elem_count; ++zz) {
+    lp = (test_loc_point_t *) sc_array_index (points, zz);
+    lnum = *(p4est_locidx_t *) sc_array_index (owners, zz);
+    SC_CHECK_ABORT (lnum == lp->expected, "Points owner");
+  }
+
+  /* without a point callback the points without a key stay unowned */
+  p4est_search_local_points (p4est, test_loc_key, NULL, points, owners, 0);
+  for (zz = 0; zz < points->elem_count; ++zz) {
+    lp = (test_loc_point_t *) sc_array_index (points, zz);
+    lnum = *(p4est_locidx_t *) sc_array_index (owners, zz);
+    SC_CHECK_ABORT (lnum == (lp->use_key ? lp->expected : -1),
+                    "Points without callback");
+  }
+
+  sc_array_destroy (owners);
+  sc_array_destroy (points);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+}
+
+static int
+test_index_weight (p4est_t * p4est, p4est_topidx_t which_tree,
+                   p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 ? 1 + quadrant->level : 1;
+}
+
+/** Compare the partition index with the owner search of the forest. */
+static void
+test_partition_index_check (p4est_t * p4est, p4est_partition_index_t * index)
+{
+  int                 level, pfirst, plast;
+  p4est_topidx_t      jt;
+  uint64_t            id;
+  p4est_quadrant_t    q, last;
+
+  for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
+    for (level = 0; level <= refine_level + 1; ++level) {
+      for (id = 0; id < (uint64_t) 1 << (P4EST_DIM * level); ++id) {
+        p4est_quadrant_set_morton (&q, level, id);
+        p4est_quadrant_last_descendant (&q, &last, P4EST_QMAXLEVEL);
+        p4est_partition_index_range (index, jt, &q, &pfirst, &plast);
+        SC_CHECK_ABORT (pfirst == p4est_comm_find_owner
+                        (p4est, jt, &q, p4est->mpirank), "Index first");
+        SC_CHECK_ABORT (plast == p4est_comm_find_owner
+                        (p4est, jt, &last, p4est->mpirank), "Index last");
+        SC_CHECK_ABORT (pfirst == p4est_partition_index_owner
+                        (index, jt, &q), "Index owner");
+      }
+    }
+  }
+}
+
+static void
+test_partition_index (sc_MPI_Comm mpicomm)
+{
+  p4est_connectivity_t *conn;
+  p4est_t            *p4est;
+  p4est_partition_index_t *index;
+
+  /* a refined forest, then repartitioned unevenly */
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_moebius ();
+#else
+  conn = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, conn, 0, 1, 1, 0, NULL, NULL);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_partition (p4est, 0, NULL);
+  index = p4est_partition_index_new (p4est);
+  test_partition_index_check (p4est, index);
+  p4est_partition_ext (p4est, 0, test_index_weight);
+  test_partition_index_check (p4est, index);
+  p4est_partition_index_destroy (index);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+
+  /* a single quadrant leaves all but one process empty */
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_unitsquare ();
+#else
+  conn = p8est_connectivity_new_unitcube ();
+#endif
+  p4est = p4est_new_ext (mpicomm, conn, 0, 0, 0, 0, NULL, NULL);
+  index = p4est_partition_index_new (p4est);
+  test_partition_index_check (p4est, index);
+  p4est_partition_index_destroy (index);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -653,6 +880,12 @@ main (int argc, char **argv)
   /* Test the build_local function and friends */
   test_build_local (mpicomm);
 
+  /* Test the batch point location */
+  test_search_points (mpicomm);
+
+  /* Test the partition lookup index */
+  test_partition_index (mpicomm);
+
   /* Finalize */
   sc_finalize ();
   mpiret = sc_MPI_Finalize ();
@@ -0,0 +1,169 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_search.h>
+#include <p4est_soa.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_search.h>
+#include <p8est_soa.h>
+#endif
+
+#ifndef P4_TO_P8
+static int          refine_level = 6;
+#else
+static int          refine_level = 4;
+#endif
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  if ((int) quadrant->level >= refine_level - (int) (which_tree % 3)) {
+    return 0;
+  }
+  return p4est_quadrant_child_id (quadrant) != 1;
+}
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(int *) quadrant->p.user_data = (int) quadrant->level + 100 * which_tree;
+}
+
+static void
+check_soa (p4est_t * p4est, p4est_soa_t * soa)
+{
+  int                 same;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lnum;
+  size_t              zz;
+  ssize_t             result;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, r, s;
+
+  SC_CHECK_ABORT (p4est_soa_is_current (soa, p4est), "SoA revision");
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lnum = p4est_soa_index (soa, jt, (p4est_locidx_t) zz);
+      SC_CHECK_ABORT (lnum == tree->quadrants_offset +
+                      (p4est_locidx_t) zz, "SoA index");
+      same = P4EST_SOA_X (soa, lnum) == q->x &&
+        P4EST_SOA_Y (soa, lnum) == q->y &&
+        P4EST_SOA_LEVEL (soa, lnum) == q->level;
+#ifdef P4_TO_P8
+      same = same && P4EST_SOA_Z (soa, lnum) == q->z;
+#endif
+      SC_CHECK_ABORT (same, "SoA coordinates");
+      SC_CHECK_ABORT (P4EST_SOA_DATA (soa, lnum) == q->p.user_data,
+                      "SoA data");
+      p4est_soa_quadrant (soa, lnum, &r);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&r, q), "SoA quadrant");
+
+      /* search for the quadrant itself and for its first descendant */
+      SC_CHECK_ABORT (p4est_soa_lower_bound (soa, jt, q) == lnum,
+                      "SoA lower bound");
+      p4est_quadrant_first_descendant (q, &s, P4EST_QMAXLEVEL);
+      result = p4est_find_lower_bound (&tree->quadrants, &s, 0);
+      SC_CHECK_ABORT ((result < 0 && p4est_soa_lower_bound (soa, jt, &s) < 0)
+                      || p4est_soa_lower_bound (soa, jt, &s) ==
+                      tree->quadrants_offset + (p4est_locidx_t) result,
+                      "SoA descendant lower bound");
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  unsigned            crc;
+  long                revision;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est, *copy;
+  p4est_connectivity_t *connectivity;
+  p4est_soa_t        *soa;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* create connectivity and forest structures */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_star ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 1, 1,
+                         sizeof (int), init_fn, NULL);
+  p4est_refine (p4est, 1, refine_fn, init_fn);
+  p4est_partition (p4est, 0, NULL);
+  crc = p4est_checksum (p4est);
+
+  /* the dense form alongside the regular storage */
+  soa = p4est_soa_new (p4est, 1, 0);
+  check_soa (p4est, soa);
+  SC_CHECK_ABORT (p4est_soa_checksum (soa, p4est) == crc, "SoA checksum");
+  SC_CHECK_ABORT (p4est_soa_memory_used (soa) > 0, "SoA memory");
+  p4est_soa_destroy (soa);
+
+  /* the dense form instead of the regular storage */
+  copy = p4est_copy (p4est, 1);
+  soa = p4est_soa_new (p4est, 1, 1);
+  SC_CHECK_ABORT (p4est_soa_checksum (soa, p4est) == crc,
+                  "SoA released checksum");
+  p4est_soa_restore (soa, p4est);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 1), "SoA restore");
+  SC_CHECK_ABORT (p4est_checksum (p4est) == crc, "SoA checksum");
+  check_soa (p4est, soa);
+
+  /* a changed forest invalidates the dense form */
+  revision = p4est->revision;
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  SC_CHECK_ABORT (p4est->revision == revision ||
+                  !p4est_soa_is_current (soa, p4est), "SoA outdated");
+  p4est_soa_destroy (soa);
+
+  p4est_destroy (copy);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,293 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+
+#ifndef P4_TO_P8
+static int          refine_level = 6;
+#else
+static int          refine_level = 4;
+#endif
+
+typedef struct
+{
+  p4est_topidx_t      which_tree;
+  int                 level;
+  int                 generation;
+}
+user_data_t;
+
+typedef struct
+{
+  long                num_replaced;
+  long                num_called;
+  unsigned long       sequence;
+}
+user_counter_t;
+
+/* fold a callback into an order dependent checksum */
+static void
+record_call (p4est_t * p4est, p4est_topidx_t which_tree,
+             p4est_quadrant_t * quadrant, int kind)
+{
+  user_counter_t     *counter = (user_counter_t *) p4est->user_pointer;
+
+  if (counter != NULL) {
+    ++counter->num_called;
+    counter->sequence = counter->sequence * 1000003UL +
+      (unsigned long) which_tree * 31UL + (unsigned long) kind;
+    counter->sequence = counter->sequence * 1000003UL +
+      (unsigned long) quadrant->x + (unsigned long) quadrant->level;
+    counter->sequence = counter->sequence * 1000003UL +
+      (unsigned long) quadrant->y;
+#ifdef P4_TO_P8
+    counter->sequence = counter->sequence * 1000003UL +
+      (unsigned long) quadrant->z;
+#endif
+  }
+}
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  user_data_t        *data = (user_data_t *) quadrant->p.user_data;
+
+  data->which_tree = which_tree;
+  data->level = (int) quadrant->level;
+  data->generation = 0;
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  int                 cid;
+
+  if ((int) quadrant->level >= refine_level - (int) (which_tree % 3)) {
+    return 0;
+  }
+  cid = p4est_quadrant_child_id (quadrant);
+  if (cid == 0 || cid == P4EST_CHILDREN - 1) {
+    return 1;
+  }
+  return quadrant->x < P4EST_ROOT_LEN / 2 && quadrant->y >= P4EST_ROOT_LEN / 4;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * q[])
+{
+  record_call (p4est, which_tree, q[0], q[1] == NULL);
+  if (q[1] == NULL) {
+    return 0;
+  }
+  SC_CHECK_ABORT (p4est_quadrant_is_familypv (q), "Coarsen family");
+
+  return q[0]->y < P4EST_ROOT_LEN / 2 || (int) q[0]->level > 3;
+}
+
+static void
+replace_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            int num_outgoing, p4est_quadrant_t * outgoing[],
+            int num_incoming, p4est_quadrant_t * incoming[])
+{
+  int                 i;
+  user_data_t        *parent, *child;
+  user_counter_t     *counter = (user_counter_t *) p4est->user_pointer;
+
+  if (num_outgoing == 1) {
+    /* refinement */
+    SC_CHECK_ABORT (num_incoming == P4EST_CHILDREN, "Refine replace count");
+    SC_CHECK_ABORT (p4est_quadrant_is_familypv (incoming), "Refine family");
+    SC_CHECK_ABORT (p4est_quadrant_is_parent (outgoing[0], incoming[0]),
+                    "Refine parent");
+
+    parent = (user_data_t *) outgoing[0]->p.user_data;
+    SC_CHECK_ABORT (parent->which_tree == which_tree, "Refine parent data");
+    for (i = 0; i < P4EST_CHILDREN; ++i) {
+      child = (user_data_t *) incoming[i]->p.user_data;
+      child->generation = parent->generation + 1;
+    }
+  }
+  else {
+    /* coarsening */
+    SC_CHECK_ABORT (num_outgoing == P4EST_CHILDREN && num_incoming == 1,
+                    "Coarsen replace count");
+    SC_CHECK_ABORT (p4est_quadrant_is_familypv (outgoing),
+                    "Coarsen family");
+    SC_CHECK_ABORT (p4est_quadrant_is_parent (incoming[0], outgoing[0]),
+                    "Coarsen parent");
+
+    parent = (user_data_t *) incoming[0]->p.user_data;
+    child = (user_data_t *) outgoing[P4EST_CHILDREN - 1]->p.user_data;
+    SC_CHECK_ABORT (child->which_tree == which_tree, "Coarsen child data");
+    parent->generation = child->generation - 1;
+    record_call (p4est, which_tree, incoming[0], 2);
+  }
+  if (counter != NULL) {
+    ++counter->num_replaced;
+  }
+}
+
+static void
+check_refine (p4est_t * p4est, int refine_recursive, int maxlevel,
+              int num_threads, int concurrent_callbacks)
+{
+  p4est_t            *serial, *threaded;
+  user_counter_t      serial_counter, threaded_counter;
+
+  serial = p4est_copy (p4est, 1);
+  memset (&serial_counter, 0, sizeof (user_counter_t));
+  serial->user_pointer = &serial_counter;
+  p4est_refine_ext (serial, refine_recursive, maxlevel,
+                    refine_fn, init_fn, replace_fn);
+
+  threaded = p4est_copy (p4est, 1);
+  memset (&threaded_counter, 0, sizeof (user_counter_t));
+  threaded->user_pointer = concurrent_callbacks ? NULL : &threaded_counter;
+  p4est_refine_threads (threaded, refine_recursive, maxlevel,
+                        refine_fn, init_fn, replace_fn,
+                        num_threads, concurrent_callbacks);
+
+  SC_CHECK_ABORT (p4est_is_equal (serial, threaded, 1),
+                  "Threaded refine differs from serial");
+  SC_CHECK_ABORT (p4est_checksum (serial) == p4est_checksum (threaded),
+                  "Threaded refine checksum");
+  SC_CHECK_ABORT (serial->revision == threaded->revision,
+                  "Threaded refine revision");
+  if (!concurrent_callbacks) {
+    SC_CHECK_ABORT (serial_counter.num_replaced ==
+                    threaded_counter.num_replaced,
+                    "Threaded refine replace count");
+  }
+
+  p4est_destroy (serial);
+  p4est_destroy (threaded);
+}
+
+static void
+check_coarsen (p4est_t * p4est, int coarsen_recursive, int callback_orphans,
+               int num_threads, int concurrent_callbacks)
+{
+  p4est_t            *serial, *threaded;
+  user_counter_t      serial_counter, threaded_counter;
+
+  serial = p4est_copy (p4est, 1);
+  memset (&serial_counter, 0, sizeof (user_counter_t));
+  serial->user_pointer = &serial_counter;
+  p4est_coarsen_ext (serial, coarsen_recursive, callback_orphans,
+                     coarsen_fn, init_fn, replace_fn);
+
+  threaded = p4est_copy (p4est, 1);
+  memset (&threaded_counter, 0, sizeof (user_counter_t));
+  threaded->user_pointer = concurrent_callbacks ? NULL : &threaded_counter;
+  p4est_coarsen_threads (threaded, coarsen_recursive, callback_orphans,
+                         coarsen_fn, init_fn, replace_fn,
+                         num_threads, concurrent_callbacks);
+
+  SC_CHECK_ABORT (p4est_is_equal (serial, threaded, 1),
+                  "Threaded coarsen differs from serial");
+  SC_CHECK_ABORT (p4est_checksum (serial) == p4est_checksum (threaded),
+                  "Threaded coarsen checksum");
+  SC_CHECK_ABORT (serial->revision == threaded->revision,
+                  "Threaded coarsen revision");
+  if (!concurrent_callbacks) {
+    /* the callbacks are made in the same order */
+    SC_CHECK_ABORT (serial_counter.num_replaced ==
+                    threaded_counter.num_replaced &&
+                    serial_counter.num_called ==
+                    threaded_counter.num_called &&
+                    serial_counter.sequence == threaded_counter.sequence,
+                    "Threaded coarsen callback sequence");
+  }
+
+  p4est_destroy (serial);
+  p4est_destroy (threaded);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 recursive, concurrent, orphans;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* create connectivity and forest structures */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_star ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 1, 1,
+                         sizeof (user_data_t), init_fn, NULL);
+
+  /* compare threaded and serial refinement */
+  for (recursive = 0; recursive <= 1; ++recursive) {
+    for (concurrent = 0; concurrent <= 1; ++concurrent) {
+      check_refine (p4est, recursive, -1, 4, concurrent);
+      check_refine (p4est, recursive, refine_level - 1, 3, concurrent);
+    }
+  }
+  check_refine (p4est, 1, -1, 1, 0);
+  check_refine (p4est, 1, -1, 0, 0);
+
+  /* compare threaded and serial coarsening of a refined forest */
+  p4est_refine_ext (p4est, 1, -1, refine_fn, init_fn, NULL);
+  for (recursive = 0; recursive <= 1; ++recursive) {
+    for (orphans = 0; orphans <= 1; ++orphans) {
+      for (concurrent = 0; concurrent <= 1; ++concurrent) {
+        check_coarsen (p4est, recursive, orphans, 4, concurrent);
+        check_coarsen (p4est, recursive, orphans, 3, concurrent);
+      }
+    }
+  }
+  check_coarsen (p4est, 1, 1, 0, 1);
+
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}